@@ -0,0 +1,100 @@
+/**
+ * Fast multipole method benchmark
+ *
+ * This example compares the speed and accuracy of the 
+ * Barnes-Hut tree (REB_GRAVITY_TREE) and the fast multipole
+ * method (REB_GRAVITY_FMM) for a Plummer sphere. The 
+ * accelerations are compared to direct summation. For each
+ * opening angle and expansion order, the time for one force
+ * calculation and the rms relative error are printed. 
+ * The tree is also run with the relative opening criterion
+ * (REB_TREE_OPENING_RELATIVE) for several tolerances. With
+ * N=50000, opening_tolerance=0.005 took about half the time
+ * of theta=0.5 (0.66s instead of 1.24s) for a similar rms
+ * error (3.1e-3 instead of 2.2e-3).
+ * The number of particles can be set on the command line,
+ * e.g. ./rebound --N=100000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+#include "gravity.h"
+#include "tree.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+// Returns the time for one force calculation and the rms relative error.
+double benchmark(struct reb_simulation* r, const double* const a, double* error){
+	if (r->gravity==REB_GRAVITY_TREE){
+		reb_tree_update_gravity_data(r);
+	}
+	double start = walltime();
+	reb_calculate_acceleration(r);
+	double end = walltime();
+	double e2 = 0;
+	for (int i=0;i<r->N;i++){
+		const struct reb_particle p = r->particles[i];
+		const double dax = p.ax-a[3*i+0];
+		const double day = p.ay-a[3*i+1];
+		const double daz = p.az-a[3*i+2];
+		e2 += (dax*dax+day*day+daz*daz)/(a[3*i+0]*a[3*i+0]+a[3*i+1]*a[3*i+1]+a[3*i+2]*a[3*i+2]);
+	}
+	*error = sqrt(e2/r->N);
+	return end-start;
+}
+
+int main(int argc, char* argv[]){
+	struct reb_simulation* r = reb_create_simulation();
+	r->gravity	= REB_GRAVITY_FMM;	// Particles need to be added to the tree.
+	r->softening 	= 0.001;
+	reb_configure_box(r, 200., 1, 1, 1);
+	int N = reb_read_int(argc, argv, "N", 20000);
+	reb_tools_init_plummer(r, N, 1., 1.);
+	
+	// Reference accelerations
+	r->gravity	= REB_GRAVITY_BASIC;
+	reb_calculate_acceleration(r);
+	double* a = malloc(sizeof(double)*3*r->N);
+	for (int i=0;i<r->N;i++){
+		a[3*i+0] = r->particles[i].ax;
+		a[3*i+1] = r->particles[i].ay;
+		a[3*i+2] = r->particles[i].az;
+	}
+
+	double error;
+	double thetas[] = {0.3, 0.5, 0.7};
+	r->gravity	= REB_GRAVITY_TREE;
+	for (int i=0;i<3;i++){
+		r->opening_angle2 = thetas[i]*thetas[i];
+		double time = benchmark(r, a, &error);
+		printf("Tree theta=%.1f:       %8.4fs   rms error %.2e\n", thetas[i], time, error);
+	}
+	// The relative criterion uses the accelerations of the previous force calculation.
+	r->tree_opening = REB_TREE_OPENING_RELATIVE;
+	double tolerances[] = {0.001, 0.005, 0.02};
+	for (int i=0;i<3;i++){
+		r->opening_tolerance = tolerances[i];
+		double time = benchmark(r, a, &error);
+		printf("Tree tolerance=%.3f: %8.4fs   rms error %.2e\n", tolerances[i], time, error);
+	}
+	r->tree_opening = REB_TREE_OPENING_GEOMETRIC;
+	r->gravity	= REB_GRAVITY_FMM;
+	int orders[] = {2, 4, 6};
+	for (int i=0;i<3;i++){
+		for (int j=0;j<3;j++){
+			r->opening_angle2 = thetas[i]*thetas[i];
+			r->fmm_order = orders[j];
+			double time = benchmark(r, a, &error);
+			printf("FMM  theta=%.1f order=%d: %8.4fs   rms error %.2e\n", thetas[i], orders[j], time, error);
+		}
+	}
+	free(a);
+	reb_free_simulation(r);
+}
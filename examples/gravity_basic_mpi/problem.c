@@ -0,0 +1,102 @@
+/**
+ * Direct summation with MPI
+ *
+ * This example checks the exact direct summation of
+ * REB_GRAVITY_BASIC with MPI. The massive particles of each
+ * node are passed around a ring of nodes, so that every node
+ * calculates the forces of all particles on its own particles.
+ * Every node creates the same set of particles. The root node
+ * adds them to the simulation and distributes them to the
+ * nodes owning their root boxes. The accelerations are then
+ * compared to a direct sum over all particles. The largest
+ * relative difference should be at the level of round-off
+ * errors, independent of the number of nodes. Otherwise the
+ * program exits with an error, so it can be used as a
+ * regression test, e.g.
+ * for n in 1 2 3 4; do mpirun -np $n ./rebound || break; done
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <mpi.h>
+#include "rebound.h"
+#include "gravity.h"
+#include "communication_mpi.h"
+
+int main(int argc, char* argv[]){
+	struct reb_simulation* const r = reb_create_simulation();
+	r->gravity	= REB_GRAVITY_BASIC;
+	r->softening 	= 0.01;
+	// 4x4 root boxes allow up to 16 MPI nodes.
+	reb_configure_box(r, 2.5, 4, 4, 1);
+	reb_mpi_init(r);
+
+	// The same particles on every node.
+	const int N = reb_read_int(argc, argv, "N", 2000);
+	struct reb_particle* const particles = malloc(sizeof(struct reb_particle)*N);
+	srand(1);
+	for (int i=0;i<N;i++){
+		struct reb_particle p = {0};
+		p.x 	= reb_random_uniform(-r->boxsize.x/2.,r->boxsize.x/2.);
+		p.y 	= reb_random_uniform(-r->boxsize.y/2.,r->boxsize.y/2.);
+		p.z 	= reb_random_uniform(-r->boxsize.z/2.,r->boxsize.z/2.);
+		p.m 	= reb_random_uniform(0.5,1.5)/N;
+		p.id 	= i;
+		particles[i] = p;
+	}
+	if (r->mpi_id==0){
+		for (int i=0;i<N;i++){
+			reb_add(r, particles[i]);
+		}
+	}
+	reb_communication_mpi_distribute_particles(r);
+	reb_calculate_acceleration(r);
+
+	// Direct sum over all particles for the particles of this node.
+	const double softening2 = r->softening*r->softening;
+	double error_max = 0.;
+	for (int k=0;k<r->N;k++){
+		const struct reb_particle pk = r->particles[k];
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int j=0;j<N;j++){
+			if (j==pk.id) continue;
+			const double dx = pk.x - particles[j].x;
+			const double dy = pk.y - particles[j].y;
+			const double dz = pk.z - particles[j].z;
+			const double _r2 = dx*dx + dy*dy + dz*dz + softening2;
+			const double prefact = -r->G*particles[j].m/(_r2*sqrt(_r2));
+			ax += prefact*dx;
+			ay += prefact*dy;
+			az += prefact*dz;
+		}
+		const double dax = pk.ax - ax;
+		const double day = pk.ay - ay;
+		const double daz = pk.az - az;
+		const double error = sqrt((dax*dax + day*day + daz*daz)/(ax*ax + ay*ay + az*az));
+		if (error>error_max){
+			error_max = error;
+		}
+	}
+
+	double error_all;
+	int N_all;
+	MPI_Reduce(&error_max, &error_all, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&(r->N), &N_all, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+	int failed = 0;
+	if (r->mpi_id==0){
+		printf("%d node(s): %d particles, largest relative difference %.2e\n", r->mpi_num, N_all, error_all);
+		if (N_all!=N || !(error_all<1e-12)){
+			printf("Error: the forces do not agree with the direct sum.\n");
+			failed = 1;
+		}
+	}
+	MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+	reb_mpi_finalize(r);
+	reb_free_simulation(r);
+	free(particles);
+	return failed?EXIT_FAILURE:EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/**
+ * Gravity benchmark
+ *
+ * This example measures the throughput (particle-particle
+ * interactions per second) of the direct summation in 
+ * REB_GRAVITY_BASIC. It compares the scalar loop, the 
+ * vectorized loop and the cache blocked (tiled) loop for 
+ * different tile sizes. Use this to find the best values 
+ * of gravity_tile_i and gravity_tile_j for your machine.
+ * Finally, it measures the throughput of the test particle
+ * loop with a few massive particles and N test particles.
+ * The number of particles can be set on the command line,
+ * e.g. ./rebound --N=50000
+ * Last, REB_GRAVITY_EWALD is compared with one ghost box
+ * in each direction in a periodic box. With 2000 particles,
+ * calculating the Ewald table took 0.7s and each force 
+ * calculation was slightly faster than with ghost boxes 
+ * (12 instead of 10 per second).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+#include "gravity.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+// Returns the number of force evaluations per second.
+double benchmark(struct reb_simulation* r){
+	int n = 0;
+	double start = walltime();
+	double end = start;
+	while (end-start<1. || n<2){ // Run for at least 1 second
+		reb_calculate_acceleration(r);
+		n++;
+		end = walltime();
+	}
+	return (double)n/(end-start);
+}
+
+int main(int argc, char* argv[]){
+	struct reb_simulation* r = reb_create_simulation();
+	r->gravity	= REB_GRAVITY_BASIC;
+	r->softening 	= 0.01;
+	int N = reb_read_int(argc, argv, "N", 20000);
+	const double interactions = (double)N*(N-1.);
+	reb_tools_init_plummer(r, N, 1., 1.);
+
+	r->gravity_simd = REB_SIMD_NONE;
+	r->gravity_tile_j = 0;
+	printf("Scalar loop:             %.3e interactions/s\n", interactions*benchmark(r));
+	
+	r->gravity_simd = REB_SIMD_AUTO;
+	printf("Vectorized loop:         %.3e interactions/s\n", interactions*benchmark(r));
+	
+	int tiles_i[] = {32, 128, 512};
+	int tiles_j[] = {512, 2048, 8192};
+	for (int i=0;i<3;i++){
+		for (int j=0;j<3;j++){
+			r->gravity_tile_i = tiles_i[i];
+			r->gravity_tile_j = tiles_j[j];
+			if (N<=tiles_j[j]) continue; // Tiling not used.
+			printf("Tiles %4d x %4d:       %.3e interactions/s\n", tiles_i[i], tiles_j[j], interactions*benchmark(r));
+		}
+	}
+	reb_free_simulation(r);
+
+	// Test particles
+	r = reb_create_simulation();
+	r->gravity	= REB_GRAVITY_BASIC;
+	int N_active = reb_read_int(argc, argv, "N_active", 10);
+	reb_tools_init_plummer(r, N_active, 1., 1.);
+	r->N_active = N_active;
+	reb_tools_init_plummer(r, N, 1., 1.); // Masses are ignored.
+	const double interactions_test = (double)N_active*(N_active-1.) + (double)N*N_active;
+	r->gravity_simd = REB_SIMD_NONE;
+	printf("Test particles, scalar:  %.3e interactions/s\n", interactions_test*benchmark(r));
+	r->gravity_simd = REB_SIMD_AUTO;
+	printf("Test particles, vector:  %.3e interactions/s\n", interactions_test*benchmark(r));
+	reb_free_simulation(r);
+
+	// Periodic box
+	r = reb_create_simulation();
+	reb_configure_box(r, 1., 1, 1, 1);
+	r->boundary	= REB_BOUNDARY_PERIODIC;
+	int N_periodic = reb_read_int(argc, argv, "N_periodic", 2000);
+	for (int i=0;i<N_periodic;i++){
+		struct reb_particle p = {0};
+		p.m = 1./N_periodic;
+		p.x = reb_random_uniform(-0.5,0.5);
+		p.y = reb_random_uniform(-0.5,0.5);
+		p.z = reb_random_uniform(-0.5,0.5);
+		reb_add(r, p);
+	}
+	r->gravity	= REB_GRAVITY_BASIC;
+	r->nghostx = 1; r->nghosty = 1; r->nghostz = 1;
+	printf("Periodic, 1 ghost box:   %.3e force calculations/s\n", benchmark(r));
+	r->gravity	= REB_GRAVITY_EWALD;
+	r->nghostx = 0; r->nghosty = 0; r->nghostz = 0;
+	double start = walltime();
+	reb_calculate_acceleration(r); // Calculates the table of the Ewald correction.
+	printf("Periodic, Ewald table:   %.3fs\n", walltime()-start);
+	printf("Periodic, Ewald:         %.3e force calculations/s\n", benchmark(r));
+	reb_free_simulation(r);
+}
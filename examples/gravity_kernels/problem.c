@@ -0,0 +1,107 @@
+/**
+ * Specialized gravity kernels
+ *
+ * This example is a micro-benchmark for the scalar direct 
+ * summation in REB_GRAVITY_BASIC. REBOUND chooses a kernel 
+ * without per-pair branches depending on whether softening
+ * and ghost boxes are used, and handles test particles and 
+ * gravity_ignore_10 outside of the inner loop. For every 
+ * combination of these options, the example compares the 
+ * time of one force evaluation with a generic loop that 
+ * checks every condition for every pair.
+ * The number of particles can be set on the command line,
+ * e.g. ./rebound --N=2000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+#include "gravity.h"
+#include "boundary.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+// Generic loop with runtime branches for every pair.
+void generic_loop(struct reb_simulation* r){
+	struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+	const int _N_active = (r->N_active==-1)?N:r->N_active;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	for (int i=0; i<N; i++){
+		particles[i].ax = 0; 
+		particles[i].ay = 0; 
+		particles[i].az = 0; 
+	}
+	for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
+	for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
+	for (int gbz=-r->nghostz; gbz<=r->nghostz; gbz++){
+		struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+		for (int i=0; i<N; i++){
+		for (int j=0; j<_N_active; j++){
+			if (_gravity_ignore_10 && ((j==1 && i==0) || (i==1 && j==0))) continue;
+			if (i==j) continue;
+			const double dx = (gb.shiftx+particles[i].x) - particles[j].x;
+			const double dy = (gb.shifty+particles[i].y) - particles[j].y;
+			const double dz = (gb.shiftz+particles[i].z) - particles[j].z;
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = -G/(_r*_r*_r)*particles[j].m;
+			particles[i].ax    += prefact*dx;
+			particles[i].ay    += prefact*dy;
+			particles[i].az    += prefact*dz;
+		}
+		}
+	}
+	}
+	}
+}
+
+// Returns the time of one force evaluation in seconds.
+double benchmark(struct reb_simulation* r, void (*f)(struct reb_simulation*)){
+	int n = 0;
+	double start = walltime();
+	double end = start;
+	while (end-start<0.5 || n<2){ 
+		f(r);
+		n++;
+		end = walltime();
+	}
+	return (end-start)/(double)n;
+}
+
+int main(int argc, char* argv[]){
+	int N = reb_read_int(argc, argv, "N", 2000);
+	printf("softening  ignore_10  ghostboxes  testparticles    generic [s]  specialized [s]  speedup\n");
+	for (int v=0; v<16; v++){
+		const int softening = v&1;
+		const int ignore_10 = (v>>1)&1;
+		const int ghostboxes = (v>>2)&1;
+		const int testparticles = (v>>3)&1;
+		struct reb_simulation* r = reb_create_simulation();
+		r->gravity	= REB_GRAVITY_BASIC;
+		r->gravity_simd	= REB_SIMD_NONE;	// Scalar kernels only
+		r->gravity_tile_j = 0;			// No tiling
+		r->softening 	= softening?0.01:0.;
+		r->gravity_ignore_10 = ignore_10;
+		reb_configure_box(r, 10., 1, 1, 1);
+		if (ghostboxes){
+			r->nghostx = 1;
+			r->nghosty = 1;
+		}
+		reb_tools_init_plummer(r, N, 1., 1.);
+		if (testparticles){
+			r->N_active = N/10;
+		}
+		const double t_generic = benchmark(r, generic_loop);
+		const double t_specialized = benchmark(r, reb_calculate_acceleration);
+		printf("%9d  %9d  %10d  %13d    %11.3e  %15.3e  %7.2f\n", softening, ignore_10, ghostboxes, testparticles, t_generic, t_specialized, t_generic/t_specialized);
+		reb_free_simulation(r);
+	}
+}
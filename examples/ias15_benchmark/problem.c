@@ -0,0 +1,64 @@
+/**
+ * IAS15 benchmark
+ *
+ * This example measures the number of IAS15 timesteps per 
+ * second as a function of the number of particles. The
+ * particles are test particles orbiting a single star, so 
+ * the force calculation scales as O(N) and the time is 
+ * dominated by the predictor-corrector loops of the 
+ * integrator itself. The timestep is kept fixed. Compile
+ * with OPENMP=1 and vary OMP_NUM_THREADS to see the effect
+ * of the parallel loops for large N. The largest number 
+ * of particles can be set on the command line, 
+ * e.g. ./rebound --N_max=100000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+// Returns the number of timesteps per second.
+double benchmark(struct reb_simulation* r){
+	int n = 0;
+	double start = walltime();
+	double end = start;
+	while (end-start<1. || n<2){ // Run for at least 1 second
+		reb_step(r);
+		n++;
+		end = walltime();
+	}
+	return (double)n/(end-start);
+}
+
+int main(int argc, char* argv[]){
+	int N_max = reb_read_int(argc, argv, "N_max", 20000);
+	printf("       N        steps/s   particle steps/s\n");
+	for (int N=16; N<=N_max; N*=2){
+		struct reb_simulation* r = reb_create_simulation();
+		r->integrator	= REB_INTEGRATOR_IAS15;
+		r->gravity	= REB_GRAVITY_BASIC;
+		r->ri_ias15.epsilon = 0; 	// Fixed timestep
+		r->dt 		= 1e-2;
+		r->N_active 	= 1;
+		struct reb_particle star = {0};
+		star.m = 1.;
+		reb_add(r, star);
+		for (int i=1;i<N;i++){
+			double a = 1.+reb_random_uniform(0.,1.);
+			double f = reb_random_uniform(0.,2.*M_PI);
+			struct reb_particle p = reb_tools_orbit_to_particle(r->G, star, 0., a, 0.1, 0.1, 0., 0., f);
+			reb_add(r, p);
+		}
+		const double steps = benchmark(r);
+		printf("%8d  %12.3e  %17.3e\n", N, steps, steps*N);
+		reb_free_simulation(r);
+	}
+}
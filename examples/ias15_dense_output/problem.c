@@ -0,0 +1,97 @@
+/**
+ * IAS15 dense output
+ *
+ * This example shows how to generate many outputs per orbit
+ * with IAS15 without shortening the timestep. A planet on an
+ * eccentric orbit is integrated with exact_finish_time=0 and
+ * the positions at the output times are evaluated with 
+ * reb_integrator_ias15_interpolate() from the polynomials 
+ * of the last step. The same outputs are then generated
+ * with exact_finish_time=1 for comparison. The number of
+ * outputs per orbit can be set on the command line, 
+ * e.g. ./rebound --N_out=10000
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+int steps;
+double t_last;
+void heartbeat(struct reb_simulation* r){
+	// reb_integrate() also calls the heartbeat once before the first step.
+	if (r->t!=t_last){
+		steps++;
+		t_last = r->t;
+	}
+}
+
+struct reb_simulation* setup(const int exact_finish_time){
+	struct reb_simulation* r = reb_create_simulation();
+	r->integrator		= REB_INTEGRATOR_IAS15;
+	r->exact_finish_time	= exact_finish_time;
+	r->heartbeat		= heartbeat;
+	r->dt 			= 1e-3;
+
+	struct reb_particle star = {0};
+	star.m  = 1.;
+	reb_add(r, star); 
+	
+	double e = 0.9;
+	struct reb_particle planet = {0}; 
+	planet.m  = 1e-3;
+	planet.x  = 1.-e; 
+	planet.vy = sqrt((1.+e)/(1.-e)*(1.+planet.m));
+	reb_add(r, planet); 
+	reb_move_to_com(r);
+	return r;
+}
+
+int main(int argc, char* argv[]){
+	const int N_out = reb_read_int(argc, argv, "N_out", 1000);
+	const int N_orbits = 10;
+	const double tmax = N_orbits*2.*M_PI;
+	struct reb_particle* particles = malloc(sizeof(struct reb_particle)*2);
+	double* x_dense = malloc(sizeof(double)*N_out*N_orbits);
+
+	// Dense output
+	struct reb_simulation* r = setup(0);
+	steps = 0;
+	t_last = 0.;
+	double start = walltime();
+	for (int i=0;i<N_out*N_orbits;i++){
+		const double t = tmax*(i+1)/(N_out*N_orbits);
+		if (t>r->t){
+			reb_integrate(r, t);	// Overshoots t.
+		}
+		reb_integrator_ias15_interpolate(r, t, particles);
+		x_dense[i] = particles[1].x;
+	}
+	printf("Dense output:       %8d steps, %.4f s\n", steps, walltime()-start);
+	reb_free_simulation(r);
+
+	// Exact finish time
+	r = setup(1);
+	steps = 0;
+	t_last = 0.;
+	double max_diff = 0.;
+	start = walltime();
+	for (int i=0;i<N_out*N_orbits;i++){
+		const double t = tmax*(i+1)/(N_out*N_orbits);
+		reb_integrate(r, t);
+		max_diff = fmax(max_diff, fabs(x_dense[i]-r->particles[1].x));
+	}
+	printf("Exact finish time:  %8d steps, %.4f s\n", steps, walltime()-start);
+	printf("Maximum difference in x: %e\n", max_diff);
+	reb_free_simulation(r);
+	free(x_dense);
+	free(particles);
+}
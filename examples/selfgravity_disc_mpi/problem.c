@@ -5,8 +5,10 @@
  * the leap frog integrator. Collisions are not resolved.
  * This program makes use of MPI. Note that you need 
  * to have MPI compilers (mpicc) installed. The code is using 
- * four root boxes to distribute to particles to one, two 
- * or four MPI nodes. How to efficiently run this code on
+ * 16 root boxes to distribute the particles to up to 16 
+ * MPI nodes. The root boxes are redistributed between the 
+ * nodes during the simulation, so that each node has 
+ * roughly the same amount of work. How to efficiently run this code on
  * large clusters goes beyond this simple example and
  * almost certainly requires experimentation.
  */
@@ -35,9 +37,12 @@ int main(int argc, char* argv[]){
 	r->dt 		= 3e-2;		// Timestep
 	const double boxsize = 10.2;
     // Setup root boxes for gravity tree.
-    // Here, we use 2x2=4 root boxes (each with length 'boxsize')
-    // This allows you to use up to 4 MPI nodes.
-	reb_configure_box(r,boxsize,2,2,1);
+    // Here, we use 4x4=16 root boxes (each with length 'boxsize/4')
+    // This allows you to use up to 16 MPI nodes.
+	reb_configure_box(r,boxsize/4.,4,4,1);
+    // Move root boxes between nodes if the busiest node has 
+    // more than 10% more work than the average node.
+    r->mpi_imbalance_max = 1.1;
 
     // Initialize MPI
     // This can only be done after reb_configure_box.
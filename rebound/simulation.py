@@ -1,4 +1,4 @@
-from ctypes import Structure, c_double, POINTER, c_int, c_uint, c_long, c_ulong, c_void_p, c_char_p, CFUNCTYPE, byref
+from ctypes import Structure, c_double, POINTER, c_int, c_uint, c_long, c_ulong, c_longlong, c_void_p, c_char_p, CFUNCTYPE, byref
 from . import clibrebound, Escape, NoParticles, Encounter, SimulationError
 from .particle import Particle
 from .units import units_convert_particle, check_units, convert_G
@@ -15,9 +15,9 @@ import types
 ### The following enum and class definitions need to
 ### consitent with those in rebound.h
         
-INTEGRATORS = {"ias15": 0, "whfast": 1, "sei": 2, "wh": 3, "leapfrog": 4, "hybrid": 5, "none": 6}
+INTEGRATORS = {"ias15": 0, "whfast": 1, "sei": 2, "wh": 3, "leapfrog": 4, "hybrid": 5, "none": 6, "hermite": 7}
 BOUNDARIES = {"none": 0, "open": 1, "periodic": 2, "shear": 3}
-GRAVITIES = {"none": 0, "basic": 1, "compensated": 2, "tree": 3}
+GRAVITIES = {"none": 0, "basic": 1, "compensated": 2, "tree": 3, "fmm": 4, "ewald": 5, "fft": 6}
 COLLISIONS = {"none": 0, "direct": 1, "tree": 2}
 
 class reb_vec3d(Structure):
@@ -65,7 +65,11 @@ class reb_simulation_integrator_ias15(Structure):
                 ("min_dt", c_double),
                 ("epsilon_global", c_uint),
                 ("iterations_max_exceeded", c_ulong),
+                ("last_t", c_double),
+                ("last_dt", c_double),
+                ("last_N", c_int),
                 ("allocatedN", c_int),
+                ("arena", POINTER(c_double)),
                 ("at", POINTER(c_double)),
                 ("x0", POINTER(c_double)),
                 ("v0", POINTER(c_double)),
@@ -73,6 +77,8 @@ class reb_simulation_integrator_ias15(Structure):
                 ("csx", POINTER(c_double)),
                 ("csv", POINTER(c_double)),
                 ("csa0", POINTER(c_double)),
+                ("xs", POINTER(c_double)),
+                ("vs", POINTER(c_double)),
                 ("g", reb_dp7),
                 ("b", reb_dp7),
                 ("csb", reb_dp7),
@@ -80,12 +86,33 @@ class reb_simulation_integrator_ias15(Structure):
                 ("br", reb_dp7),
                 ("er", reb_dp7)]
 
+class reb_simulation_integrator_hermite(Structure):
+    _fields_ = [("eta", c_double),
+                ("eta_start", c_double),
+                ("max_level", c_uint),
+                ("recalculate_this_timestep", c_uint),
+                ("steps_done", c_ulong),
+                ("allocatedN", c_int),
+                ("initializedN", c_int),
+                ("level_warning", c_uint),
+                ("a", POINTER(c_double)),
+                ("jerk", POINTER(c_double)),
+                ("xp", POINTER(c_double)),
+                ("vp", POINTER(c_double)),
+                ("ap", POINTER(c_double)),
+                ("jp", POINTER(c_double)),
+                ("tick", POINTER(c_longlong)),
+                ("level", POINTER(c_int)),
+                ("active", POINTER(c_int))]
+
 class reb_simulation_integrator_whfast(Structure):
     _fields_ = [("corrector", c_uint),
                 ("recalculate_jacobi_this_timestep", c_uint),
                 ("safe_mode", c_uint),
+                ("simd", c_int),
                 ("p_j", POINTER(Particle)),
                 ("eta", POINTER(c_double)),
+                ("p_tmp", POINTER(Particle)),
                 ("Mtotal", c_double),
                 ("is_synchronized", c_uint),
                 ("allocatedN", c_uint),
@@ -301,6 +328,7 @@ class Simulation(Structure):
         - ``'leapfrog'``
         - ``'hybrid'``
         - ``'none'``
+        - ``'hermite'``
         
         Check the online documentation for a full description of each of the integrators. 
         """
@@ -373,6 +401,9 @@ class Simulation(Structure):
         - ``'basic'``
         - ``'compensated'`` (default)
         - ``'tree'``
+        - ``'fmm'``
+        - ``'ewald'``
+        - ``'fft'`` (requires FFTW)
         
         Check the online documentation for a full description of each of the modules. 
         """
@@ -537,6 +568,32 @@ class Simulation(Structure):
         """
         clibrebound.reb_tools_calculate_lyapunov.restype = c_double
         return clibrebound.reb_tools_calculate_lyapunov(byref(self))
+
+    def init_variations(self, k, delta=1e-16):
+        """
+        Add k sets of variational particles, e.g. to calculate a Lyapunov spectrum.
+
+        Each set contains one variational particle per real particle. The sets are 
+        randomly oriented and orthonormalized, each has length delta in phase space.
+        If MEGNO is needed as well, call init_megno() first. Supported by IAS15 and
+        leapfrog. WHFast and hybrid only support a single set, Hermite does not 
+        support variational particles.
+        """
+        if self.integrator in ["whfast", "hybrid"] and self.N_var+k*self.N_real>self.N_real:
+            raise ValueError("WHFast only supports one set of variational particles.")
+        clibrebound.reb_tools_variations_init(byref(self), c_int(k), c_double(delta))
+
+    def orthonormalize_variations(self, delta=1e-16):
+        """
+        Orthonormalize all sets of variational particles with the Gram-Schmidt method
+        and rescale them to length delta. Returns a list with the logarithms of the 
+        stretching factors of each set since the last call. Summing these regularly 
+        and dividing by the time gives the Lyapunov spectrum.
+        """
+        k = self.N_var//self.N_real
+        lnstretch = (c_double*k)()
+        clibrebound.reb_tools_variations_orthonormalize(byref(self), c_double(delta), lnstretch)
+        return list(lnstretch)
     
 # Particle add function, used to be called particle_add() and add_particle() 
     def add(self, particle=None, **kwargs):   
@@ -857,6 +914,41 @@ class Simulation(Structure):
         else:
             debug.integrate_other_package(tmax,exact_finish_time)
 
+    def interpolate(self, t):
+        """
+        Returns a list of particles at time t without changing the simulation.
+
+        Supported by IAS15 and WHFast. IAS15 evaluates the polynomials of the last step, 
+        t has to lie between ``sim.t-sim.dt_last_done`` and ``sim.t``.
+        WHFast synchronizes a copy of the Jacobi coordinates, t has to be within one 
+        timestep of ``sim.t-sim.dt/2``. With ``integrator_whfast_safe_mode = 0``,
+        the simulation stays unsynchronized.
+        This allows many outputs per step without shortening the timestep. 
+
+        Examples
+        --------
+        >>> sim.integrator = "ias15"
+        >>> times = np.linspace(0.,100.,10000)
+        >>> for t in times:
+        >>>     if t>sim.t:
+        >>>         sim.integrate(t, exact_finish_time=0)
+        >>>     particles = sim.interpolate(t)
+
+        """
+        N = self.N
+        particles = (Particle*N)()
+        if self.integrator == "ias15":
+            clibrebound.reb_integrator_ias15_interpolate.restype = c_int
+            ret_value = clibrebound.reb_integrator_ias15_interpolate(byref(self), c_double(t), particles)
+        elif self.integrator == "whfast":
+            clibrebound.reb_integrator_whfast_interpolate.restype = c_int
+            ret_value = clibrebound.reb_integrator_whfast_interpolate(byref(self), c_double(t), particles)
+        else:
+            raise ValueError("Interpolation is only supported by the IAS15 and WHFast integrators.")
+        if ret_value == 0:
+            raise ValueError("Cannot interpolate to t=%g. Time needs to be within the last step and the number of particles cannot change." % t)
+        return list(particles)
+
     def integrator_synchronize(self):
         """
         Call this function if safe-mode is disabled and you need synchronize particle positions and velocities between timesteps.
@@ -877,13 +969,56 @@ Simulation._fields_ = [("t", c_double),
                 ("_particles", POINTER(Particle)),
                 ("gravity_cs", POINTER(reb_vec3d)),
                 ("gravity_cs_allocatedN", c_int),
+                ("gravity_simd_buffer", POINTER(c_double)),
+                ("gravity_simd_allocatedN", c_int),
+                ("gravity_thread_buffer", POINTER(c_double)),
+                ("gravity_thread_buffer_allocatedN", c_int),
+                ("gravity_var_buffer", POINTER(c_double)),
+                ("gravity_var_allocatedN", c_int),
+                ("gravity_fmm_cells", c_void_p),
+                ("gravity_fmm_expansions", POINTER(c_double)),
+                ("gravity_fmm_allocatedN", c_int),
+                ("gravity_fmm_order", c_int),
+                ("gravity_fmm_list", POINTER(c_int)),
+                ("gravity_fmm_particles", POINTER(c_double)),
+                ("gravity_fmm_list_allocatedN", c_int),
+                ("gravity_ewald_table", POINTER(c_double)),
+                ("gravity_ewald_boxsize", reb_vec3d),
+                ("gravity_fft_data", c_void_p),
                 ("tree_root", c_void_p),
+                ("tree_multipoles", POINTER(c_double)),
+                ("tree_multipoles_N", c_int),
+                ("tree_multipoles_allocatedN", c_int),
+                ("tree_cell_slabs", c_void_p),
+                ("tree_cell_slabs_N", c_int),
+                ("tree_cell_free", c_void_p),
+                ("tree_cells", c_void_p),
+                ("tree_cells_allocatedN", c_int),
+                ("tree_keys", c_void_p),
+                ("tree_keys_tmp", c_void_p),
+                ("tree_keys_N", c_int),
+                ("tree_keys_allocatedN", c_int),
+                ("tree_aold", POINTER(c_double)),
+                ("tree_aold_allocatedN", c_int),
                 ("tree_needs_update", c_int),
                 ("opening_angle2", c_double),
+                ("opening_tolerance", c_double),
+                ("tree_ncrit", c_int),
+                ("fmm_order", c_int),
+                ("fmm_ncrit", c_int),
+                ("fft_nx", c_int),
+                ("fft_ny", c_int),
+                ("fft_rcut", c_double),
+                ("reorder_interval", c_int),
+                ("reorder_steps", c_int),
+                ("reorder_jump", c_double),
                 ("_status", c_int),
                 ("exact_finish_time", c_int),
                 ("force_is_velocity_dependent", c_uint),
                 ("gravity_ignore_10", c_uint),
+                ("gravity_basic_symmetric", c_uint),
+                ("gravity_tile_i", c_int),
+                ("gravity_tile_j", c_int),
                 ("output_timing_last", c_double),
                 ("exit_max_distance", c_double),
                 ("exit_min_distance", c_double),
@@ -916,11 +1051,16 @@ Simulation._fields_ = [("t", c_double),
                 ("_integrator", c_int),
                 ("_boundary", c_int),
                 ("_gravity", c_int),
+                ("gravity_simd", c_int),
+                ("tree_multipole", c_int),
+                ("tree_type", c_int),
+                ("tree_opening", c_int),
                 ("ri_sei", reb_simulation_integrator_sei), 
                 ("ri_wh", reb_simulation_integrator_wh), 
                 ("ri_hybrid", reb_simulation_integrator_hybrid),
                 ("ri_whfast", reb_simulation_integrator_whfast),
                 ("ri_ias15", reb_simulation_integrator_ias15),
+                ("ri_hermite", reb_simulation_integrator_hermite),
                 ("_additional_forces", CFUNCTYPE(None,POINTER(Simulation))),
                 ("_post_timestep_modifications", CFUNCTYPE(None,POINTER(Simulation))),
                 ("_heartbeat", CFUNCTYPE(None,POINTER(Simulation))),
@@ -0,0 +1,346 @@
+import rebound
+import unittest
+import math
+import random
+from ctypes import c_int
+
+# Thread counts can only be changed if librebound was compiled with OPENMP=1.
+omp_set_num_threads = getattr(rebound.clibrebound, "omp_set_num_threads", None)
+omp_get_max_threads = getattr(rebound.clibrebound, "omp_get_max_threads", None)
+THREADS = [1, 2, 3, 4] if omp_set_num_threads else [1]
+DEFAULT_THREADS = omp_get_max_threads() if omp_get_max_threads else 1
+
+def set_num_threads(n):
+    if omp_set_num_threads:
+        omp_set_num_threads(c_int(n))
+
+class TestGravity(unittest.TestCase):
+    def setUp(self):
+        self.sim = rebound.Simulation()
+        self.sim.add(m=1.)
+        for i in range(50):
+            self.sim.add(m=1e-5, a=1.+0.1*i, e=0.05, inc=0.01*i, omega=0.3*i, M=0.7*i)
+        self.sim.move_to_com()
+        self.sim.integrator = "leapfrog"
+        self.sim.dt = 1e-3
+    
+    def tearDown(self):
+        self.sim = None
+        set_num_threads(DEFAULT_THREADS)
+
+    def integrate_copy(self, tmax=1., **kwargs):
+        sim = rebound.Simulation()
+        sim.integrator = self.sim.integrator
+        sim.dt = self.sim.dt
+        for p in self.sim.particles:
+            sim.add(p)
+        for k, v in kwargs.items():
+            setattr(sim, k, v)
+        sim.integrate(tmax)
+        return sim
+    
+    def assertSameParticles(self, sim1, sim2, delta):
+        for p1, p2 in zip(sim1.particles, sim2.particles):
+            self.assertAlmostEqual(p1.x, p2.x, delta=delta)
+            self.assertAlmostEqual(p1.y, p2.y, delta=delta)
+            self.assertAlmostEqual(p1.z, p2.z, delta=delta)
+            self.assertAlmostEqual(p1.vx, p2.vx, delta=delta)
+            self.assertAlmostEqual(p1.vy, p2.vy, delta=delta)
+            self.assertAlmostEqual(p1.vz, p2.vz, delta=delta)
+
+    def test_basic_simd(self):
+        scalar = self.integrate_copy(gravity="basic", gravity_simd=1)
+        for simd in [0, 2, 3]: # auto, avx2, avx512. Falls back to scalar if not supported.
+            vector = self.integrate_copy(gravity="basic", gravity_simd=simd)
+            self.assertSameParticles(scalar, vector, 1e-12)
+
+    def test_basic_symmetric(self):
+        full = self.integrate_copy(gravity="basic", gravity_simd=1)
+        for simd in [0, 1]:
+            symmetric = self.integrate_copy(gravity="basic", gravity_simd=simd, gravity_basic_symmetric=1)
+            self.assertSameParticles(full, symmetric, 1e-12)
+    
+    def test_basic_symmetric_reproducible(self):
+        # With OpenMP, each thread sums into its own buffer. The pairs a thread
+        # works on must not change between runs, otherwise neither do the bits.
+        for i in range(150):
+            self.sim.add(m=1e-7, a=1.05+0.01*i, e=0.02, inc=0.005*i, omega=0.1*i, M=0.3*i)
+        for simd in [0, 1]:
+            sim1 = self.integrate_copy(gravity="basic", gravity_simd=simd, gravity_basic_symmetric=1)
+            sim2 = self.integrate_copy(gravity="basic", gravity_simd=simd, gravity_basic_symmetric=1)
+            self.assertSameParticles(sim1, sim2, 0.)
+    
+    def test_basic_tiled(self):
+        untiled = self.integrate_copy(gravity="basic", gravity_simd=1, gravity_tile_j=0)
+        for simd in [0, 1]:
+            for tile_i, tile_j in [(1, 8), (7, 16), (64, 32)]:
+                tiled = self.integrate_copy(gravity="basic", gravity_simd=simd, gravity_tile_i=tile_i, gravity_tile_j=tile_j)
+                self.assertSameParticles(untiled, tiled, 1e-12)
+
+    def test_basic_testparticles(self):
+        self.sim.N_active = 5
+        for i in range(101): # Not a multiple of the vector width
+            self.sim.add(a=1.05+0.01*i, e=0.02, inc=0.005*i, omega=0.1*i, M=0.3*i)
+        compensated = self.integrate_copy(gravity="compensated", N_active=5)
+        for simd in [0, 1]:
+            basic = self.integrate_copy(gravity="basic", gravity_simd=simd, N_active=5)
+            self.assertSameParticles(compensated, basic, 1e-12)
+
+    def test_basic_symmetric_whfast(self):
+        self.sim.integrator = "whfast"
+        full = self.integrate_copy(gravity="compensated")
+        symmetric = self.integrate_copy(gravity="basic", gravity_basic_symmetric=1)
+        self.assertSameParticles(full, symmetric, 1e-12)
+
+    def test_basic_compensated(self):
+        basic = self.integrate_copy(gravity="basic")
+        compensated = self.integrate_copy(gravity="compensated")
+        self.assertSameParticles(basic, compensated, 1e-12)
+
+    def test_compensated_threads(self):
+        # The tiles of pairs add to each particle in the serial order, for any number of threads.
+        for i in range(300):
+            self.sim.add(m=1e-7, a=1.05+0.01*i, e=0.02, inc=0.005*i, omega=0.1*i, M=0.3*i)
+        set_num_threads(THREADS[0])
+        serial = self.integrate_copy(tmax=0.1, gravity="compensated")
+        for n in THREADS[1:]:
+            set_num_threads(n)
+            parallel = self.integrate_copy(tmax=0.1, gravity="compensated")
+            self.assertSameParticles(serial, parallel, 0.)
+
+    def accelerations_in_box(self, periodic, N=300, **kwargs):
+        sim = rebound.Simulation()
+        sim.configure_box(10.)
+        if periodic:
+            sim.boundary = "periodic"
+            sim.nghostx, sim.nghosty, sim.nghostz = 1, 1, 1
+        for k,v in kwargs.items():
+            setattr(sim, k, v)
+        sim.dt = 0.
+        random.seed(3)
+        for i in range(N):
+            sim.add(m=random.uniform(0.5,1.5), x=random.uniform(-5.,5.), y=random.uniform(-5.,5.), z=random.uniform(-5.,5.))
+        sim.step()
+        return [(p.ax, p.ay, p.az) for p in sim.particles]
+
+    def test_fmm(self):
+        for periodic in [False, True]:
+            basic = self.accelerations_in_box(periodic, gravity="basic")
+            fmm = self.accelerations_in_box(periodic, gravity="fmm", fmm_order=8, opening_angle2=0.25)
+            norm = max(math.sqrt(a[0]**2+a[1]**2+a[2]**2) for a in basic)
+            for a, b in zip(basic, fmm):
+                for k in range(3):
+                    self.assertAlmostEqual(a[k]/norm, b[k]/norm, delta=1e-4)
+
+    def test_tree_multipole(self):
+        basic = self.accelerations_in_box(False, gravity="basic")
+        errors = []
+        for order in [0, 2, 3, 4]: # monopole, quadrupole, octupole, hexadecapole
+            tree = self.accelerations_in_box(False, gravity="tree", tree_multipole=order)
+            errors.append(max(abs(a[k]-b[k]) for a, b in zip(basic, tree) for k in range(3)))
+        for k in range(3):
+            self.assertLess(errors[k+1], 0.6*errors[k])
+
+    def test_tree_groups(self):
+        for order in [0, 2]:
+            single = self.accelerations_in_box(False, gravity="tree", tree_ncrit=0, tree_multipole=order)
+            norm = max(math.sqrt(a[0]**2+a[1]**2+a[2]**2) for a in single)
+            # Groups of one particle open the same cells
+            for simd in [0, 1]:
+                groups = self.accelerations_in_box(False, gravity="tree", tree_ncrit=1, tree_multipole=order, gravity_simd=simd)
+                for a, b in zip(single, groups):
+                    for k in range(3):
+                        self.assertAlmostEqual(a[k]/norm, b[k]/norm, delta=1e-12)
+        # Larger groups open more cells and are more accurate
+        for periodic in [False, True]:
+            basic = self.accelerations_in_box(periodic, gravity="basic")
+            errors = []
+            for ncrit in [0, 64]:
+                tree = self.accelerations_in_box(periodic, gravity="tree", tree_ncrit=ncrit)
+                errors.append(max(abs(a[k]-b[k]) for a, b in zip(basic, tree) for k in range(3)))
+            self.assertLess(errors[1], errors[0])
+
+    def test_tree_linear(self):
+        for periodic in [False, True]:
+            for order in [0, 2]:
+                dynamic = self.accelerations_in_box(periodic, gravity="tree", tree_multipole=order)
+                linear = self.accelerations_in_box(periodic, gravity="tree", tree_multipole=order, tree_type=1)
+                # Both trees consist of the same cells
+                for a, b in zip(dynamic, linear):
+                    for k in range(3):
+                        self.assertAlmostEqual(a[k], b[k], delta=1e-12)
+        # Particles leaving the box are removed from both trees
+        N = []
+        for tree_type in [0, 1]:
+            sim = rebound.Simulation()
+            sim.configure_box(10.)
+            sim.boundary = "open"
+            sim.gravity = "tree"
+            sim.tree_type = tree_type
+            sim.integrator = "leapfrog"
+            sim.dt = 0.01
+            random.seed(4)
+            for i in range(300):
+                sim.add(m=1e-3, x=random.uniform(-5,5), y=random.uniform(-5,5), z=random.uniform(-5,5), vx=random.uniform(-5,5))
+            sim.integrate(0.5)
+            N.append(sim.N)
+        self.assertLess(N[1], 300)
+        self.assertEqual(N[0], N[1])
+
+    def test_tree_threads(self):
+        # With enough particles, the dynamic tree is updated with tasks and the sorted keys
+        # of the linear tree are split into one chunk per 1024 particles, up to four per thread.
+        for tree_type in [0, 1]:
+            set_num_threads(THREADS[0])
+            serial = self.accelerations_in_box(False, N=12000, gravity="tree", tree_type=tree_type, tree_multipole=2)
+            for n in THREADS[1:]:
+                set_num_threads(n)
+                parallel = self.accelerations_in_box(False, N=12000, gravity="tree", tree_type=tree_type, tree_multipole=2)
+                self.assertEqual(serial, parallel)
+
+    def test_tree_pool(self):
+        # Particles leave their cells and wrap around the periodic box. Freed cells 
+        # are reused from the slab pool and the tree must equal a freshly built one.
+        def setup():
+            sim = rebound.Simulation()
+            sim.configure_box(10.)
+            sim.boundary = "periodic"
+            sim.gravity = "tree"
+            sim.collision = "tree"
+            sim.integrator = "leapfrog"
+            return sim
+        sim = setup()
+        sim.dt = 1e-2
+        random.seed(5)
+        for i in range(300):
+            sim.add(m=1e-3, r=0.05, x=random.uniform(-5,5), y=random.uniform(-5,5), z=random.uniform(-5,5), vx=random.uniform(-5,5), vy=random.uniform(-5,5), vz=random.uniform(-5,5))
+        sim.integrate(5.)
+        self.assertEqual(sim.N, 300)
+        self.assertEqual(sim.tree_cell_slabs_N, 1) # Freed cells are reused, the pool does not grow.
+        fresh = setup()
+        for p in sim.particles:
+            fresh.add(p)
+        for s in [sim, fresh]:
+            s.dt = 0.
+            s.step()
+        for p1, p2 in zip(sim.particles, fresh.particles):
+            self.assertEqual([p1.ax, p1.ay, p1.az], [p2.ax, p2.ay, p2.az])
+
+    def test_tree_opening_relative(self):
+        basic = self.accelerations_in_box(False, gravity="basic")
+        def max_error(tree):
+            return max(math.sqrt(sum((a[k]-b[k])**2 for k in range(3))/sum(a[k]**2 for k in range(3))) for a, b in zip(basic, tree))
+        geometric = self.accelerations_in_box(False, gravity="tree", integrator="leapfrog", opening_angle2=0.5)
+        # Without a previous acceleration, the geometric criterion is used
+        first = self.accelerations_in_box(False, gravity="tree", integrator="leapfrog", opening_angle2=0.5, tree_opening=1)
+        self.assertEqual(geometric, first)
+        for ncrit in [0, 64]:
+            errors = []
+            for tolerance in [0.01, 0.001]:
+                sim = rebound.Simulation()
+                sim.configure_box(10.)
+                sim.gravity = "tree"
+                sim.integrator = "leapfrog"
+                sim.tree_ncrit = ncrit
+                sim.opening_angle2 = 0.5
+                sim.tree_opening = 1
+                sim.opening_tolerance = tolerance
+                sim.dt = 0.
+                random.seed(3)
+                for i in range(300):
+                    sim.add(m=random.uniform(0.5,1.5), x=random.uniform(-5.,5.), y=random.uniform(-5.,5.), z=random.uniform(-5.,5.))
+                sim.step()
+                sim.step()
+                errors.append(max_error([(p.ax, p.ay, p.az) for p in sim.particles]))
+            self.assertLess(errors[1], errors[0])
+            self.assertLess(errors[1], 0.01)
+
+    def test_reorder(self):
+        result = []
+        for tree_type in [0, 1]:
+            for reorder_interval in [0, 3]:
+                sim = rebound.Simulation()
+                sim.configure_box(10., 2, 2, 1)
+                sim.boundary = "periodic"
+                sim.nghostx, sim.nghosty = 1, 1
+                sim.gravity = "tree"
+                sim.collision = "tree"
+                sim.tree_type = tree_type
+                sim.reorder_interval = reorder_interval
+                sim.integrator = "leapfrog"
+                sim.dt = 0.01
+                random.seed(5)
+                for i in range(500):
+                    sim.add(m=1e-4, r=1e-3, x=random.uniform(-10,10), y=random.uniform(-10,10), z=random.uniform(-5,5), vx=random.uniform(-1,1), vy=random.uniform(-1,1))
+                    sim.particles[i].id = i
+                sim.integrate(0.1)
+                ps = sorted(sim.particles, key=lambda p: p.id)
+                result.append([(p.x, p.y, p.z, p.vx) for p in ps])
+                if reorder_interval:
+                    self.assertGreater(sim.reorder_jump, 1.)
+                    ids = [p.id for p in sim.particles]
+                    self.assertNotEqual(ids, sorted(ids))
+        # Reordering does not change the result
+        for a, b in zip(result[0], result[1]):
+            self.assertEqual(a, b)
+        for a, b in zip(result[2], result[3]):
+            self.assertEqual(a, b)
+
+    def ewald_reference(self, L, x, alpha=2.5, n=3, h=8):
+        # Independent Ewald sum for the acceleration due to a unit mass (G=1).
+        a = [0., 0., 0.]
+        for i in range(-n, n+1):
+            for j in range(-n, n+1):
+                for k in range(-n, n+1):
+                    d = [x[0]-i*L[0], x[1]-j*L[1], x[2]-k*L[2]]
+                    r = math.sqrt(d[0]**2+d[1]**2+d[2]**2)
+                    f = (math.erfc(alpha*r) + 2.*alpha*r/math.sqrt(math.pi)*math.exp(-alpha**2*r**2))/r**3
+                    for l in range(3):
+                        a[l] -= f*d[l]
+        for i in range(-h, h+1):
+            for j in range(-h, h+1):
+                for k in range(-h, h+1):
+                    if i==0 and j==0 and k==0:
+                        continue
+                    kv = [2.*math.pi*i/L[0], 2.*math.pi*j/L[1], 2.*math.pi*k/L[2]]
+                    k2 = kv[0]**2+kv[1]**2+kv[2]**2
+                    f = 4.*math.pi/(L[0]*L[1]*L[2])/k2*math.exp(-k2/(4.*alpha**2))*math.sin(kv[0]*x[0]+kv[1]*x[1]+kv[2]*x[2])
+                    for l in range(3):
+                        a[l] -= f*kv[l]
+        return a
+
+    def test_ewald(self):
+        sim = rebound.Simulation()
+        sim.configure_box(1., 2, 1, 1)
+        sim.boundary = "periodic"
+        sim.gravity = "ewald"
+        sim.integrator = "leapfrog"
+        sim.dt = 1e-8
+        random.seed(3)
+        for i in range(6):
+            sim.add(m=random.uniform(0.5,1.), x=random.uniform(-1.,1.), y=random.uniform(-0.5,0.5), z=random.uniform(-0.5,0.5))
+        sim.step()
+        ps = sim.particles
+        L = [2., 1., 1.]
+        px, py, pz = 0., 0., 0.
+        for i in range(sim.N):
+            a = [0., 0., 0.]
+            for j in range(sim.N):
+                if i!=j:
+                    aj = self.ewald_reference(L, [ps[i].x-ps[j].x, ps[i].y-ps[j].y, ps[i].z-ps[j].z])
+                    for l in range(3):
+                        a[l] += ps[j].m*aj[l]
+            scale = math.sqrt(a[0]**2+a[1]**2+a[2]**2)
+            self.assertAlmostEqual(ps[i].ax, a[0], delta=1e-3*scale)
+            self.assertAlmostEqual(ps[i].ay, a[1], delta=1e-3*scale)
+            self.assertAlmostEqual(ps[i].az, a[2], delta=1e-3*scale)
+            px += ps[i].m*ps[i].ax
+            py += ps[i].m*ps[i].ay
+            pz += ps[i].m*ps[i].az
+        # Pairs are antisymmetric, momentum is conserved.
+        self.assertAlmostEqual(px, 0., delta=1e-12)
+        self.assertAlmostEqual(py, 0., delta=1e-12)
+        self.assertAlmostEqual(pz, 0., delta=1e-12)
+    
+if __name__ == "__main__":
+    unittest.main()
@@ -1,6 +1,17 @@
 import rebound
 import unittest
 import math
+from ctypes import c_int
+
+# Thread counts can only be changed if librebound was compiled with OPENMP=1.
+omp_set_num_threads = getattr(rebound.clibrebound, "omp_set_num_threads", None)
+omp_get_max_threads = getattr(rebound.clibrebound, "omp_get_max_threads", None)
+THREADS = [1, 2, 3, 4] if omp_set_num_threads else [1]
+DEFAULT_THREADS = omp_get_max_threads() if omp_get_max_threads else 1
+
+def set_num_threads(n):
+    if omp_set_num_threads:
+        omp_set_num_threads(c_int(n))
 
 class TestIntegrator(unittest.TestCase):
     def setUp(self):
@@ -10,6 +21,7 @@ class TestIntegrator(unittest.TestCase):
     
     def tearDown(self):
         self.sim = None
+        set_num_threads(DEFAULT_THREADS)
     
     def test_ias15(self):
         self.sim.integrator = "ias15"
@@ -24,6 +36,142 @@ class TestIntegrator(unittest.TestCase):
         #e1 = self.sim.calculate_energy()
         #self.assertLess(math.fabs((e0-e1)/e1),10**13.5)
     
+    def test_ias15_threads(self):
+        # With more than 512 particles, the predictor-corrector loops run in parallel.
+        def run(n):
+            set_num_threads(n)
+            sim = rebound.Simulation()
+            rebound.data.add_outer_solar_system(sim)
+            for i in range(600):
+                sim.add(primary=sim.particles[0], a=4.+0.05*i, e=0.1, inc=0.001*i, omega=0.3*i, f=0.7*i)
+            sim.N_active = 6
+            sim.move_to_com()
+            sim.integrator = "ias15"
+            sim.integrate(100.)
+            return sim
+        serial = run(THREADS[0])
+        for n in THREADS[1:]:
+            parallel = run(n)
+            self.assertEqual(serial.t, parallel.t)
+            for p1, p2 in zip(serial.particles, parallel.particles):
+                self.assertEqual([p1.x, p1.y, p1.z, p1.vx, p1.vy, p1.vz], [p2.x, p2.y, p2.z, p2.vx, p2.vy, p2.vz])
+
+    def test_ias15_resize(self):
+        # Shrinks the arena, then removes and adds particles within its capacity.
+        sim = self.sim
+        sim.integrator = "ias15"
+        for i in range(400):
+            sim.add(m=1e-9, primary=sim.particles[0], a=4.+0.05*i, e=0.1, inc=0.001*i, f=0.7*i)
+        sim.integrate(1.)
+        self.assertEqual(sim.ri_ias15.allocatedN, 3*sim.N)
+        while sim.N>10:
+            sim.remove(index=sim.N-1)
+        sim.integrate(20.)
+        self.assertEqual(sim.ri_ias15.allocatedN, 60)
+        sim.remove(index=9)
+        sim.remove(index=8)
+        sim.integrate(30.)
+        for i in range(10):
+            sim.add(m=1e-9, primary=sim.particles[0], a=10.+0.5*i, e=0.2, inc=0.01*i, f=1.3*i)
+        sim.integrate(40.)
+        self.assertEqual(sim.ri_ias15.allocatedN, 60)
+        fresh = rebound.Simulation()
+        fresh.integrator = "ias15"
+        fresh.t = sim.t
+        fresh.dt = sim.dt
+        for p in sim.particles:
+            fresh.add(p)
+        sim.integrate(100.)
+        fresh.integrate(100.)
+        for p1, p2 in zip(sim.particles, fresh.particles):
+            d = math.sqrt((p1.x-p2.x)**2+(p1.y-p2.y)**2+(p1.z-p2.z)**2)
+            v = math.sqrt((p1.vx-p2.vx)**2+(p1.vy-p2.vy)**2+(p1.vz-p2.vz)**2)
+            self.assertLess(d,1e-12*math.sqrt(p2.x**2+p2.y**2+p2.z**2))
+            self.assertLess(v,1e-12*math.sqrt(p2.vx**2+p2.vy**2+p2.vz**2))
+
+    def test_ias15_interpolate(self):
+        self.sim.integrator = "ias15"
+        sim2 = rebound.Simulation()
+        rebound.data.add_outer_solar_system(sim2)
+        sim2.move_to_com()
+        sim2.integrator = "ias15"
+        with self.assertRaises(ValueError):
+            self.sim.interpolate(0.)
+        self.sim.integrate(1e3, exact_finish_time=0)
+        t0 = self.sim.t-self.sim.dt_last_done
+        for f in [0., 0.1, 0.5, 0.9, 1.]:
+            t = t0+f*self.sim.dt_last_done
+            ps = self.sim.interpolate(t)
+            sim2.integrate(t)
+            for p, p2 in zip(ps, sim2.particles):
+                d = math.sqrt((p.x-p2.x)**2+(p.y-p2.y)**2+(p.z-p2.z)**2)
+                v = math.sqrt((p.vx-p2.vx)**2+(p.vy-p2.vy)**2+(p.vz-p2.vz)**2)
+                self.assertLess(d,1e-12*math.sqrt(p2.x**2+p2.y**2+p2.z**2)+1e-13)
+                self.assertLess(v,1e-12*math.sqrt(p2.vx**2+p2.vy**2+p2.vz**2)+1e-13)
+        with self.assertRaises(ValueError):
+            self.sim.interpolate(self.sim.t+1.)
+    
+    def test_whfast_interpolate(self):
+        self.sim.integrator = "whfast"
+        self.sim.integrator_whfast_safe_mode = 0
+        self.sim.integrator_whfast_corrector = 11
+        self.sim.dt = 0.1
+        sim2 = rebound.Simulation()
+        rebound.data.add_outer_solar_system(sim2)
+        sim2.move_to_com()
+        sim2.integrator = "whfast"
+        sim2.integrator_whfast_safe_mode = 0
+        sim2.integrator_whfast_corrector = 11
+        sim2.dt = 0.1
+        with self.assertRaises(ValueError):
+            self.sim.interpolate(0.)
+        self.sim.integrate(1e2, exact_finish_time=0)
+        sim2.integrate(1e2, exact_finish_time=0)
+        sim2.integrator_synchronize()
+        x = [p.x for p in self.sim.particles]
+        ps = self.sim.interpolate(self.sim.t)
+        # Same as synchronizing, but the simulation is not changed.
+        self.assertEqual(x, [p.x for p in self.sim.particles])
+        for p, p2 in zip(ps, sim2.particles):
+            self.assertAlmostEqual(p.x,p2.x,delta=1e-13)
+            self.assertAlmostEqual(p.vy,p2.vy,delta=1e-13)
+        # Intermediate times agree with IAS15 started from the previous step.
+        sim3 = rebound.Simulation()
+        for p in self.sim.interpolate(self.sim.t-self.sim.dt):
+            sim3.add(p)
+        sim3.t = self.sim.t-self.sim.dt
+        for f in [0.3, 0.5, 0.8]:
+            t = self.sim.t-(1.-f)*self.sim.dt
+            sim3.integrate(t)
+            for p, p3 in zip(self.sim.interpolate(t), sim3.particles):
+                d = math.sqrt((p.x-p3.x)**2+(p.y-p3.y)**2+(p.z-p3.z)**2)
+                self.assertLess(d,1e-8*math.sqrt(p3.x**2+p3.y**2+p3.z**2)+1e-12)
+        with self.assertRaises(ValueError):
+            self.sim.interpolate(self.sim.t+self.sim.dt)
+    
+    def test_whfast_simd(self):
+        # The batched Kepler solver must give bitwise the same results as the scalar one.
+        def run(simd):
+            sim = rebound.Simulation()
+            sim.integrator = "whfast"
+            sim.gravity = "none"
+            sim.ri_whfast.simd = simd
+            sim.dt = 0.05
+            sim.add(m=1.)
+            for i in range(37): # Not a multiple of the vector width
+                if i%5==3:
+                    sim.add(primary=sim.particles[0], a=-1.-0.1*i, e=1.2+0.05*i, inc=0.02*i, f=0.)
+                else:
+                    sim.add(primary=sim.particles[0], a=0.5+0.1*i, e=0.02*i, inc=0.02*i, omega=0.3*i, f=0.7*i)
+            sim.N_active = 1
+            sim.integrate(10.)
+            return sim
+        scalar = run(1)
+        for simd in [0, 2, 3]: # auto, avx2, avx512. Falls back to scalar if not supported.
+            vector = run(simd)
+            for p1, p2 in zip(scalar.particles, vector.particles):
+                self.assertEqual([p1.x, p1.y, p1.z, p1.vx, p1.vy, p1.vz], [p2.x, p2.y, p2.z, p2.vx, p2.vy, p2.vz])
+
     def test_whfast_largedt(self):
         self.sim.integrator = "whfast"
         jupyr = 11.86*2.*math.pi
@@ -65,3 +213,33 @@ class TestIntegrator(unittest.TestCase):
         self.assertNotEqual(e0,0.)
         e1 = self.sim.calculate_energy()
         self.assertLess(math.fabs((e0-e1)/e1),1e-9)
+
+    def test_hermite(self):
+        self.sim.integrator = "hermite"
+        self.sim.ri_hermite.eta = 0.005
+        jupyr = 11.86*2.*math.pi
+        self.sim.dt = jupyr
+        e0 = self.sim.calculate_energy()
+        self.sim.integrate(1e2*jupyr)
+        e1 = self.sim.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-4)
+
+    def test_hermite_blocktimesteps(self):
+        sim = rebound.Simulation()
+        sim.integrator = "hermite"
+        sim.ri_hermite.eta = 0.005
+        sim.add(m=1.)
+        sim.add(m=1e-3,a=0.1)
+        for i in range(8):
+            sim.add(m=1e-5,a=5.+2.*i,e=0.05,f=i)
+        sim.move_to_com()
+        sim.dt = 10.
+        e0 = sim.calculate_energy()
+        sim.integrate(200.)
+        e1 = sim.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-4)
+        levels = [sim.ri_hermite.level[i] for i in range(sim.N)]
+        self.assertGreater(max(levels),min(levels)+4)
+        # Number of particle steps with a shared timestep equal to the smallest block.
+        shared = sim.N*(200./10.)*2**max(levels)
+        self.assertLess(sim.ri_hermite.steps_done,0.3*shared)
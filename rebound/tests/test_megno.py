@@ -28,3 +28,46 @@ class TestMegno(unittest.TestCase):
         self.assertAlmostEqual(self.sim.calculate_lyapunov(),0.,delta=1e-3)
 
 
+
+    def test_variations_whfast(self):
+        sim = rebound.Simulation()
+        sim.integrator = "whfast"
+        sim.add(m=1)
+        sim.add(m=1e-3,a=1.)
+        sim.init_megno(1e-16)
+        with self.assertRaises(ValueError):
+            sim.init_variations(1)
+        self.assertEqual(sim.N_var,sim.N_real)
+
+    def test_variations(self):
+        def setup():
+            sim = rebound.Simulation()
+            sim.integrator = "leapfrog"
+            sim.dt = 1e-3
+            sim.add(m=1)
+            sim.add(m=1e-3,a=1.,e=0.1)
+            sim.add(m=1e-3,a=1.6,e=0.1,inc=0.1)
+            return sim
+        sim = setup()
+        sim.init_variations(3)
+        N = sim.N_real
+        self.assertEqual(sim.N_var,3*N)
+        ps = sim.particles
+        for s in range(3):
+            for q in range(s):
+                dot = sum(ps[N+s*N+i].x*ps[N+q*N+i].x + ps[N+s*N+i].y*ps[N+q*N+i].y + ps[N+s*N+i].z*ps[N+q*N+i].z
+                        + ps[N+s*N+i].vx*ps[N+q*N+i].vx + ps[N+s*N+i].vy*ps[N+q*N+i].vy + ps[N+s*N+i].vz*ps[N+q*N+i].vz for i in range(N))
+                self.assertAlmostEqual(dot*1e32,0.,delta=1e-12)
+        # Each set evolves as if it were the only one.
+        initial = [(p.x, p.y, p.z, p.vx, p.vy, p.vz) for p in ps[N:sim.N]]
+        sim.integrate(1.)
+        for s in range(3):
+            single = setup()
+            single.init_variations(1)
+            for i in range(N):
+                q = single.particles[N+i]
+                q.x, q.y, q.z, q.vx, q.vy, q.vz = initial[s*N+i]
+            single.integrate(1.)
+            for i in range(N):
+                self.assertAlmostEqual(single.particles[N+i].x/ps[N+s*N+i].x,1.,delta=1e-12)
+                self.assertAlmostEqual(single.particles[N+i].vy/ps[N+s*N+i].vy,1.,delta=1e-12)
@@ -13,8 +13,13 @@ libreboundmodule = Extension('librebound',
                                 'src/integrator_leapfrog.c',
                                 'src/integrator_sei.c',
                                 'src/integrator_hybrid.c',
+                                'src/integrator_hermite.c',
                                 'src/integrator.c',
                                 'src/gravity.c',
+                                'src/gravity_simd.c',
+                                'src/gravity_fmm.c',
+                                'src/gravity_ewald.c',
+                                'src/gravity_fft.c',
                                 'src/boundary.c',
                                 'src/collision.c',
                                 'src/tools.c',
@@ -236,8 +236,7 @@ static void reb_tree_get_nearest_neighbour_in_cell(struct reb_simulation* const
 				p2 = particles[c->pt];
 #ifdef MPI
 			}else{
-				int root_n_per_node = r->root_n/r->mpi_num;
-				int proc_id = ri/root_n_per_node;
+				int proc_id = reb_communication_mpi_rootbox_owner(r, ri);
 				p2 = r->particles_recv[proc_id][c->pt];
 			}
 #endif // MPI
@@ -307,8 +306,7 @@ static void reb_collision_resolve_hardsphere(struct reb_simulation* const r, str
 		p2 = particles[c.p2];
 #ifdef MPI
 	}else{
-		int root_n_per_node = r->root_n/r->mpi_num;
-		int proc_id = c.ri/root_n_per_node;
+		int proc_id = reb_communication_mpi_rootbox_owner(r, c.ri);
 		p2 = r->particles_recv[proc_id][c.p2];
 	}
 #endif // MPI
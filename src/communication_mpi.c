@@ -13,6 +13,11 @@
  *   criteria is different for gravity and collision 
  *   tree walks.
  * 
+ * Root boxes are assigned to nodes in contiguous segments along 
+ * a Hilbert curve. If mpi_imbalance_max is set, the segments are 
+ * recalculated so that every node has the same number of 
+ * interactions and particles are migrated to their new node.
+ * 
  * 
  * @section LICENSE
  * Copyright (c) 2011 Hanno Rein, Shangfei Liu
@@ -36,15 +41,21 @@
 #ifdef MPI
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
 #include <sys/time.h>
+#include <stdint.h>
 #include "particle.h"
 #include "rebound.h"
 #include "tree.h"
 #include "boundary.h"
 #include "communication_mpi.h"
+#include "gravity_simd.h"
+
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
 
 void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char** argv){
 	MPI_Init(&argc,&argv);
@@ -54,9 +65,9 @@ void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char**
 	
 	// Setup MPI description of the particle structure 
 	int bnum = 0;
-	int blen[5];
-	MPI_Aint indices[5];
-	MPI_Datatype oldtypes[5];
+	int blen[4];
+	MPI_Aint indices[4];
+	MPI_Datatype oldtypes[4];
     {
         blen[bnum] 	= 12;
         indices[bnum] 	= 0; 
@@ -84,13 +95,12 @@ void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char**
         oldtypes[bnum] 	= MPI_CHAR;
     }
 	bnum++;
-    {
-        blen[bnum] 	= 1; 
-        indices[bnum] 	= sizeof(struct reb_particle); 
-        oldtypes[bnum] 	= MPI_UB;
-    }
-	bnum++;
-	MPI_Type_struct(bnum, blen, indices, oldtypes, &(r->mpi_particle) );
+	// The extent of the datatype is set to the size of the structure, so
+	// arrays of particles can be sent. MPI_UB was removed in MPI-3.
+	MPI_Datatype mpi_particle_tmp;
+	MPI_Type_create_struct(bnum, blen, indices, oldtypes, &mpi_particle_tmp);
+	MPI_Type_create_resized(mpi_particle_tmp, 0, sizeof(struct reb_particle), &(r->mpi_particle));
+	MPI_Type_free(&mpi_particle_tmp);
 	MPI_Type_commit(&(r->mpi_particle)); 
 
 	// Setup MPI description of the cell structure 
@@ -98,9 +108,6 @@ void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char**
 	bnum = 0;
     {
         blen[bnum] 	= 8; 
-#ifdef QUADRUPOLE
-        blen[bnum] 	+= 6;
-#endif // QUADRUPOLE
         indices[bnum] 	= 0; 
         oldtypes[bnum] 	= MPI_DOUBLE;
     }
@@ -117,13 +124,10 @@ void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char**
         oldtypes[bnum] 	= MPI_INT;
     }
 	bnum++;
-    {
-        blen[bnum] 	= 1; 
-        indices[bnum] 	= sizeof(struct reb_treecell); 
-        oldtypes[bnum] 	= MPI_UB;
-    }
-	bnum++;
-	MPI_Type_struct(bnum, blen, indices, oldtypes, &(r->mpi_cell) );
+	MPI_Datatype mpi_cell_tmp;
+	MPI_Type_create_struct(bnum, blen, indices, oldtypes, &mpi_cell_tmp);
+	MPI_Type_create_resized(mpi_cell_tmp, 0, sizeof(struct reb_treecell), &(r->mpi_cell));
+	MPI_Type_free(&mpi_cell_tmp);
 	MPI_Type_commit(&(r->mpi_cell)); 
 	
 	// Prepare send/recv buffers for particles
@@ -141,18 +145,195 @@ void reb_communication_mpi_init(struct reb_simulation* const r, int argc, char**
 	r->tree_essential_recv   	= calloc(r->mpi_num,sizeof(struct reb_treecell*));
 	r->tree_essential_recv_N 	= calloc(r->mpi_num,sizeof(int));
 	r->tree_essential_recv_Nmax = calloc(r->mpi_num,sizeof(int));
+	r->tree_essential_send_multipoles = calloc(r->mpi_num,sizeof(double*));
+	r->tree_essential_recv_multipoles = calloc(r->mpi_num,sizeof(double*));
+
+	// Initial domain decomposition: the same number of root boxes for every node.
+	r->mpi_rootbox_owner = malloc(sizeof(int)*r->root_n);
+	r->mpi_rootbox_cost = calloc(r->root_n,sizeof(double));
+	for (int i=0;i<r->root_n;i++){
+		r->mpi_rootbox_owner[i] = (int)((long)i*r->mpi_num/r->root_n);
+	}
+
+	// Buffers for the direct summation ring
+	r->mpi_ring_buffer	= NULL;
+	r->mpi_ring_allocatedN	= 0;
+	r->mpi_ring_stride	= 0;
+	r->mpi_ring_N		= calloc(r->mpi_num,sizeof(int));
+	r->mpi_ring_members	= NULL;
+	r->mpi_ring_members_allocatedN = 0;
+}
+
+int reb_communication_mpi_rootbox_owner(struct reb_simulation* const r, int i){
+	return r->mpi_rootbox_owner[i];
 }
 
 int reb_communication_mpi_rootbox_is_local(struct reb_simulation* const r, int i){
-	int root_n_per_node = r->root_n/r->mpi_num;
-	int proc_id = i/root_n_per_node;
-	if (proc_id != r->mpi_id){
+	if (r->mpi_rootbox_owner[i] != r->mpi_id){
 		return 0;
 	}else{
 		return 1;
 	}
 }
 
+/**
+ * Returns the position of a root box on a Hilbert curve through all root boxes.
+ * Uses the algorithm of Skilling (2004, AIP Conf. Proc. 707, 381).
+ * @param x Coordinates of the root box. Overwritten.
+ * @param bits Number of bits of each coordinate.
+ */
+static uint64_t reb_communication_mpi_hilbert_key(unsigned int x[3], const int bits){
+	const unsigned int M = 1u<<(bits-1);
+	unsigned int t;
+	// Inverse undo
+	for (unsigned int Q=M; Q>1; Q>>=1){
+		const unsigned int P = Q-1;
+		for (int i=0;i<3;i++){
+			if (x[i]&Q){
+				x[0] ^= P;
+			}else{
+				t = (x[0]^x[i])&P;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+	// Gray encode
+	for (int i=1;i<3;i++){
+		x[i] ^= x[i-1];
+	}
+	t = 0;
+	for (unsigned int Q=M; Q>1; Q>>=1){
+		if (x[2]&Q) t ^= Q-1;
+	}
+	for (int i=0;i<3;i++){
+		x[i] ^= t;
+	}
+	uint64_t key = 0;
+	for (int b=bits-1;b>=0;b--){
+		for (int i=0;i<3;i++){
+			key = (key<<1) | ((x[i]>>b)&1);
+		}
+	}
+	return key;
+}
+
+/**
+ * Root box index and its position on the Hilbert curve. Used for sorting.
+ */
+struct reb_communication_mpi_rootbox_key {
+	uint64_t key;
+	int index;
+};
+
+static int reb_communication_mpi_compare_rootbox_key(const void* a, const void* b){
+	const uint64_t ka = ((const struct reb_communication_mpi_rootbox_key*)a)->key;
+	const uint64_t kb = ((const struct reb_communication_mpi_rootbox_key*)b)->key;
+	return (ka>kb)-(ka<kb);
+}
+
+/**
+ * Returns the cost of the busiest node divided by the mean cost.
+ */
+static double reb_communication_mpi_imbalance(struct reb_simulation* const r, const double* const cost, const int* const owner, const double total){
+	double proc_cost[r->mpi_num];
+	for (int p=0;p<r->mpi_num;p++){
+		proc_cost[p] = 0;
+	}
+	for (int i=0;i<r->root_n;i++){
+		proc_cost[owner[i]] += cost[i];
+	}
+	double max = 0;
+	for (int p=0;p<r->mpi_num;p++){
+		if (proc_cost[p]>max) max = proc_cost[p];
+	}
+	return max/(total/r->mpi_num);
+}
+
+void reb_communication_mpi_balance(struct reb_simulation* const r){
+	if (r->mpi_imbalance_max<=0.) return;
+	const int root_n = r->root_n;
+	// Cost of every root box: number of interactions plus number of particles.
+	for (int i=0;i<r->N;i++){
+		r->mpi_rootbox_cost[reb_get_rootbox_for_particle(r, r->particles[i])] += 1.;
+	}
+	double cost[root_n];
+	MPI_Allreduce(r->mpi_rootbox_cost, cost, root_n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+	double total = 0;
+	for (int i=0;i<root_n;i++){
+		total += cost[i];
+		r->mpi_rootbox_cost[i] = 0;
+	}
+	if (total==0.) return;
+	r->mpi_imbalance = reb_communication_mpi_imbalance(r, cost, r->mpi_rootbox_owner, total);
+	if (r->mpi_imbalance<=r->mpi_imbalance_max) return;
+
+	// Sort root boxes along the Hilbert curve.
+	int bits = 1;
+	while ((1<<bits)<r->root_nx || (1<<bits)<r->root_ny || (1<<bits)<r->root_nz) bits++;
+	struct reb_communication_mpi_rootbox_key keys[root_n];
+	for (int i=0;i<root_n;i++){
+		unsigned int x[3] = {i%r->root_nx, (i/r->root_nx)%r->root_ny, i/(r->root_nx*r->root_ny)};
+		keys[i].key = reb_communication_mpi_hilbert_key(x, bits);
+		keys[i].index = i;
+	}
+	qsort(keys, root_n, sizeof(struct reb_communication_mpi_rootbox_key), reb_communication_mpi_compare_rootbox_key);
+
+	// Cut the curve into segments of equal cost, at least one root box per node.
+	int owner[root_n];
+	int p = 0;
+	int p_boxes = 0;
+	double cumulative = 0;
+	for (int n=0;n<root_n;n++){
+		const int i = keys[n].index;
+		if (p<r->mpi_num-1 && p_boxes>0){
+			if (cumulative+cost[i]/2.>(double)(p+1)*total/r->mpi_num || root_n-n<=r->mpi_num-1-p){
+				p++;
+				p_boxes = 0;
+			}
+		}
+		owner[i] = p;
+		p_boxes++;
+		cumulative += cost[i];
+	}
+	if (reb_communication_mpi_imbalance(r, cost, owner, total)>=r->mpi_imbalance) return;
+
+	// Migrate particles. Particles already in the send queue are sent to the new owner.
+	memcpy(r->mpi_rootbox_owner, owner, sizeof(int)*root_n);
+	int moved_N = 0;
+	for (int q=0;q<r->mpi_num;q++){
+		moved_N += r->particles_send_N[q];
+	}
+	for (int i=0;i<r->N;i++){
+		if (reb_communication_mpi_rootbox_is_local(r, reb_get_rootbox_for_particle(r, r->particles[i]))==0){
+			moved_N++;
+		}
+	}
+	struct reb_particle* moved = malloc(sizeof(struct reb_particle)*moved_N);
+	moved_N = 0;
+	for (int q=0;q<r->mpi_num;q++){
+		memcpy(moved+moved_N, r->particles_send[q], sizeof(struct reb_particle)*r->particles_send_N[q]);
+		moved_N += r->particles_send_N[q];
+		r->particles_send_N[q] = 0;
+	}
+	for (int i=0;i<r->N;i++){
+		if (reb_communication_mpi_rootbox_is_local(r, reb_get_rootbox_for_particle(r, r->particles[i]))==0){
+			moved[moved_N++] = r->particles[i];
+			r->N--;
+			r->particles[i] = r->particles[r->N];
+			i--;
+		}
+	}
+	if (r->tree_root!=NULL){
+		// Particle indices in the tree changed.
+		reb_tree_rebuild_local(r);
+	}
+	for (int i=0;i<moved_N;i++){
+		reb_add(r, moved[i]);
+	}
+	free(moved);
+}
+
 
 void reb_communication_mpi_distribute_particles(struct reb_simulation* const r){
 	// Distribute the number of particles to be transferred.
@@ -214,6 +395,18 @@ void reb_communication_mpi_add_particle_to_send_queue(struct reb_simulation* con
 }
 
 
+void reb_communication_mpi_queue_nonlocal_particles(struct reb_simulation* const r){
+	for (int i=0;i<r->N;i++){
+		const int owner = reb_communication_mpi_rootbox_owner(r, reb_get_rootbox_for_particle(r, r->particles[i]));
+		if (owner!=r->mpi_id){
+			reb_communication_mpi_add_particle_to_send_queue(r, r->particles[i], owner);
+			r->N--;
+			r->particles[i] = r->particles[r->N];
+			i--;
+		}
+	}
+}
+
 /** 
  * This is the data structure for an axis aligned bounding box.
  */
@@ -240,23 +433,6 @@ struct reb_aabb communication_boundingbox_for_root(struct reb_simulation* const
 	return boundingbox;
 }
 
-struct reb_aabb reb_communication_boundingbox_for_proc(struct reb_simulation* const r, int proc_id){
-	int root_n_per_node = r->root_n/r->mpi_num;
-	int root_start = proc_id*root_n_per_node;
-	int root_stop  = (proc_id+1)*root_n_per_node;
-	struct reb_aabb boundingbox = communication_boundingbox_for_root(r, root_start);
-	for (int i=root_start+1;i<root_stop;i++){
-		struct reb_aabb boundingbox2 = communication_boundingbox_for_root(r,i);
-		if (boundingbox.xmin > boundingbox2.xmin) boundingbox.xmin = boundingbox2.xmin;
-		if (boundingbox.ymin > boundingbox2.ymin) boundingbox.ymin = boundingbox2.ymin;
-		if (boundingbox.zmin > boundingbox2.zmin) boundingbox.zmin = boundingbox2.zmin;
-		if (boundingbox.xmax < boundingbox2.xmax) boundingbox.xmax = boundingbox2.xmax;
-		if (boundingbox.ymax < boundingbox2.ymax) boundingbox.ymax = boundingbox2.ymax;
-		if (boundingbox.zmax < boundingbox2.zmax) boundingbox.zmax = boundingbox2.zmax;
-	}
-	return boundingbox;
-}
-
 double reb_communication_distance2_of_aabb_to_cell(struct reb_aabb bb, struct reb_treecell* node){
 	double distancex = fabs(node->x - (bb.xmin+bb.xmax)/2.)  -  (node->w + bb.xmax-bb.xmin)/2.;
 	double distancey = fabs(node->y - (bb.ymin+bb.ymax)/2.)  -  (node->w + bb.ymax-bb.ymin)/2.;
@@ -273,22 +449,26 @@ double reb_communication_distance2_of_proc_to_node(struct reb_simulation* const
 	int nghostzcol = (r->nghostz>0?1:0);
 	double distance2 = r->root_size*(double)r->root_n; // A conservative estimate for the minimum distance.
 	distance2 *= distance2;
-	for (int gbx=-nghostxcol; gbx<=nghostxcol; gbx++){
-	for (int gby=-nghostycol; gby<=nghostycol; gby++){
-	for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
-		struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
-		struct reb_aabb boundingbox = reb_communication_boundingbox_for_proc(r, proc_id);
-		boundingbox.xmin+=gb.shiftx;
-		boundingbox.xmax+=gb.shiftx;
-		boundingbox.ymin+=gb.shifty;
-		boundingbox.ymax+=gb.shifty;
-		boundingbox.zmin+=gb.shiftz;
-		boundingbox.zmax+=gb.shiftz;
-		// calculate distance
-		double distance2new = reb_communication_distance2_of_aabb_to_cell(boundingbox,node);
-		if (distance2 > distance2new) distance2 = distance2new;
-	}
-	}
+	// Root boxes of a node are not necessarily adjacent, so each one is checked.
+	for (int i=0;i<r->root_n;i++){
+		if (r->mpi_rootbox_owner[i]!=proc_id) continue;
+		for (int gbx=-nghostxcol; gbx<=nghostxcol; gbx++){
+		for (int gby=-nghostycol; gby<=nghostycol; gby++){
+		for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
+			struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+			struct reb_aabb boundingbox = communication_boundingbox_for_root(r, i);
+			boundingbox.xmin+=gb.shiftx;
+			boundingbox.xmax+=gb.shiftx;
+			boundingbox.ymin+=gb.shifty;
+			boundingbox.ymax+=gb.shifty;
+			boundingbox.zmin+=gb.shiftz;
+			boundingbox.zmax+=gb.shiftz;
+			// calculate distance
+			double distance2new = reb_communication_distance2_of_aabb_to_cell(boundingbox,node);
+			if (distance2 > distance2new) distance2 = distance2new;
+		}
+		}
+		}
 	}
 	return distance2;
 }
@@ -298,6 +478,7 @@ void reb_communication_mpi_prepare_essential_cell_for_collisions_for_proc(struct
 	if (r->tree_essential_send_N[proc]>=r->tree_essential_send_Nmax[proc]){
 		r->tree_essential_send_Nmax[proc] += 32;
 		r->tree_essential_send[proc] = realloc(r->tree_essential_send[proc],sizeof(struct reb_treecell)*r->tree_essential_send_Nmax[proc]);
+		r->tree_essential_send_multipoles[proc] = realloc(r->tree_essential_send_multipoles[proc],sizeof(double)*reb_tree_multipoles_per_cell(r)*r->tree_essential_send_Nmax[proc]);
 	}
 	// Copy node to send buffer
 	r->tree_essential_send[proc][r->tree_essential_send_N[proc]] = (*node);
@@ -336,13 +517,23 @@ void reb_communication_mpi_prepare_essential_tree_for_collisions(struct reb_simu
 
 
 void reb_communication_mpi_prepare_essential_cell_for_gravity_for_proc(struct reb_simulation* const r, struct reb_treecell* node, int proc){
+	const int nmp = reb_tree_multipoles_per_cell(r);
 	// Add essential cell to tree_essential_send
 	if (r->tree_essential_send_N[proc]>=r->tree_essential_send_Nmax[proc]){
 		r->tree_essential_send_Nmax[proc] += 32;
 		r->tree_essential_send[proc] = realloc(r->tree_essential_send[proc],sizeof(struct reb_treecell)*r->tree_essential_send_Nmax[proc]);
+		r->tree_essential_send_multipoles[proc] = realloc(r->tree_essential_send_multipoles[proc],sizeof(double)*nmp*r->tree_essential_send_Nmax[proc]);
 	}
-	// Copy node to send buffer
+	// Copy node and its higher order moments to send buffer
 	r->tree_essential_send[proc][r->tree_essential_send_N[proc]] = (*node);
+	if (nmp>0){
+		double* const mp = r->tree_essential_send_multipoles[proc] + nmp*r->tree_essential_send_N[proc];
+		if (node->pt<0){
+			memcpy(mp, r->tree_multipoles + node->mp, sizeof(double)*nmp);
+		}else{
+			memset(mp, 0, sizeof(double)*nmp);
+		}
+	}
 	r->tree_essential_send_N[proc]++;
 	if (node->pt<0){		// Not a leaf. Check if we need to transfer daughters.
 		double width = node->w;
@@ -377,11 +568,13 @@ void reb_communication_mpi_distribute_essential_tree_for_gravity(struct reb_simu
 		MPI_Scatter(r->tree_essential_send_N, 1, MPI_INT, &(r->tree_essential_recv_N[i]), 1, MPI_INT, i, MPI_COMM_WORLD);
 	}
 	// Allocate memory for incoming tree_essential
+	const int nmp = reb_tree_multipoles_per_cell(r);
 	for (int i=0;i<r->mpi_num;i++){
 		if  (i==r->mpi_id) continue;
 		while (r->tree_essential_recv_Nmax[i]<r->tree_essential_recv_N[i]){
 			r->tree_essential_recv_Nmax[i] += 32;
 			r->tree_essential_recv[i] = realloc(r->tree_essential_recv[i],sizeof(struct reb_treecell)*r->tree_essential_recv_Nmax[i]);
+			r->tree_essential_recv_multipoles[i] = realloc(r->tree_essential_recv_multipoles[i],sizeof(double)*nmp*r->tree_essential_recv_Nmax[i]);
 		}
 	}
 	
@@ -406,11 +599,38 @@ void reb_communication_mpi_distribute_essential_tree_for_gravity(struct reb_simu
 		MPI_Status status;
 		MPI_Wait(&(request[i]), &status);
 	}
+	// Exchange higher order moments of tree_essential.
+	if (nmp>0){
+		const int tag_offset = r->mpi_num*r->mpi_num;
+		for (int i=0;i<r->mpi_num;i++){
+			if (i==r->mpi_id) continue;
+			if (r->tree_essential_recv_N[i]==0) continue;
+			MPI_Irecv(r->tree_essential_recv_multipoles[i], nmp*r->tree_essential_recv_N[i], MPI_DOUBLE, i, tag_offset+i*r->mpi_num+r->mpi_id, MPI_COMM_WORLD, &(request[i]));
+		}
+		for (int i=0;i<r->mpi_num;i++){
+			if (i==r->mpi_id) continue;
+			if (r->tree_essential_send_N[i]==0) continue;
+			MPI_Send(r->tree_essential_send_multipoles[i], nmp*r->tree_essential_send_N[i], MPI_DOUBLE, i, tag_offset+r->mpi_id*r->mpi_num+i, MPI_COMM_WORLD);
+		}
+		for (int i=0;i<r->mpi_num;i++){
+			if (i==r->mpi_id) continue;
+			if (r->tree_essential_recv_N[i]==0) continue;
+			MPI_Status status;
+			MPI_Wait(&(request[i]), &status);
+		}
+	}
 	// Add tree_essential to local tree
 	for (int i=0;i<r->mpi_num;i++){
 		if (i==r->mpi_id) continue;
 		for (int j=0;j<r->tree_essential_recv_N[i];j++){
-			reb_tree_add_essential_node(r, &(r->tree_essential_recv[i][j]));
+			struct reb_treecell* const node = &(r->tree_essential_recv[i][j]);
+			if (node->pt>=0){
+				// Leaves store the index of a particle on node i. Otherwise the 
+				// force calculation skips them as a self-interaction if a local 
+				// particle has the same index.
+				node->pt = INT_MAX;
+			}
+			reb_tree_add_essential_node(r, node, nmp>0?r->tree_essential_recv_multipoles[i]+nmp*j:NULL);
 		}
 	}
 	// Bring everybody into sync, clean up. 
@@ -436,6 +656,7 @@ void reb_communication_mpi_distribute_essential_tree_for_collisions(struct reb_s
 		while (r->tree_essential_recv_Nmax[i]<r->tree_essential_recv_N[i]){
 			r->tree_essential_recv_Nmax[i] += 32;
 			r->tree_essential_recv[i] = realloc(r->tree_essential_recv[i],sizeof(struct reb_treecell)*r->tree_essential_recv_Nmax[i]);
+			r->tree_essential_recv_multipoles[i] = realloc(r->tree_essential_recv_multipoles[i],sizeof(double)*reb_tree_multipoles_per_cell(r)*r->tree_essential_recv_Nmax[i]);
 		}
 	}
 
@@ -463,7 +684,7 @@ void reb_communication_mpi_distribute_essential_tree_for_collisions(struct reb_s
 	// Add tree_essential to local tree
 	for (int i=0;i<r->mpi_num;i++){
 		for (int j=0;j<r->tree_essential_recv_N[i];j++){
-			reb_tree_add_essential_node(r, &(r->tree_essential_recv[i][j]));
+			reb_tree_add_essential_node(r, &(r->tree_essential_recv[i][j]), NULL);
 		}
 	}
 	// Bring everybody into sync, clean up. 
@@ -520,4 +741,85 @@ void reb_communication_mpi_distribute_essential_tree_for_collisions(struct reb_s
 }
 
 
+/**
+ * @brief Number of local particles per call of the interaction list kernel in the ring.
+ */
+#define REB_MPI_RING_CHUNK 64
+
+void reb_communication_mpi_gravity_ring_start(struct reb_simulation* const r, const int N_massive){
+	const int num = r->mpi_num;
+	MPI_Allgather((void*)&N_massive, 1, MPI_INT, r->mpi_ring_N, 1, MPI_INT, MPI_COMM_WORLD);
+	int N_max = 0;
+	for (int i=0;i<num;i++){
+		if (r->mpi_ring_N[i]>N_max) N_max = r->mpi_ring_N[i];
+	}
+	// All blocks have the same size, padded to a multiple of 8 for the SIMD kernels.
+	const int stride = ((N_max+7)/8)*8;
+	if (r->mpi_ring_allocatedN<2*4*stride){
+		free(r->mpi_ring_buffer);
+		if (posix_memalign((void**)&(r->mpi_ring_buffer), 64, 2*4*stride*sizeof(double))){
+			reb_exit("Cannot allocate memory for MPI gravity ring.");
+		}
+		r->mpi_ring_allocatedN = 2*4*stride;
+	}
+	r->mpi_ring_stride = stride;
+	double* const block = r->mpi_ring_buffer;
+	const struct reb_particle* const particles = r->particles;
+	for (int i=0;i<N_massive;i++){
+		block[i]          = particles[i].x;
+		block[stride+i]   = particles[i].y;
+		block[2*stride+i] = particles[i].z;
+		block[3*stride+i] = particles[i].m;
+	}
+	if (num>1){
+		const int right = (r->mpi_id+1)%num;
+		const int left  = (r->mpi_id+num-1)%num;
+		MPI_Irecv(block+4*stride, 4*stride, MPI_DOUBLE, left, 0, MPI_COMM_WORLD, &(r->mpi_ring_requests[1]));
+		MPI_Isend(block, 4*stride, MPI_DOUBLE, right, 0, MPI_COMM_WORLD, &(r->mpi_ring_requests[0]));
+	}
+}
+
+void reb_communication_mpi_gravity_ring_finish(struct reb_simulation* const r, const int simd, const int N_real){
+	const int num = r->mpi_num;
+	const int stride = r->mpi_ring_stride;
+	const int right = (r->mpi_id+1)%num;
+	const int left  = (r->mpi_id+num-1)%num;
+	if (r->mpi_ring_members_allocatedN<N_real){
+		r->mpi_ring_members = realloc(r->mpi_ring_members, N_real*sizeof(int));
+		r->mpi_ring_members_allocatedN = N_real;
+	}
+	int* const members = r->mpi_ring_members;
+	for (int i=0;i<N_real;i++){
+		members[i] = i;
+	}
+	const int n_chunks = (N_real+REB_MPI_RING_CHUNK-1)/REB_MPI_RING_CHUNK;
+	const int nghostx = r->nghostx;
+	const int nghosty = r->nghosty;
+	const int nghostz = r->nghostz;
+	for (int s=1;s<num;s++){
+		MPI_Waitall(2, r->mpi_ring_requests, MPI_STATUSES_IGNORE);
+		// Block s%2 now holds the particles of node mpi_id-s. 
+		const double* const block = r->mpi_ring_buffer + (s%2)*4*stride;
+		if (s<num-1){
+			// Pass it on while it is being used. 
+			double* const next = r->mpi_ring_buffer + ((s+1)%2)*4*stride;
+			MPI_Irecv(next, 4*stride, MPI_DOUBLE, left, 0, MPI_COMM_WORLD, &(r->mpi_ring_requests[1]));
+			MPI_Isend((void*)block, 4*stride, MPI_DOUBLE, right, 0, MPI_COMM_WORLD, &(r->mpi_ring_requests[0]));
+		}
+		const int n = r->mpi_ring_N[(r->mpi_id+num-s)%num];
+		for (int gbx=-nghostx; gbx<=nghostx; gbx++){
+		for (int gby=-nghosty; gby<=nghosty; gby++){
+		for (int gbz=-nghostz; gbz<=nghostz; gbz++){
+			struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+#pragma omp parallel for schedule(dynamic,1)
+			for (int c=0;c<n_chunks;c++){
+				const int n_members = MIN(REB_MPI_RING_CHUNK, N_real-c*REB_MPI_RING_CHUNK);
+				reb_gravity_simd_list(r, simd, block, stride, n, 0, members+c*REB_MPI_RING_CHUNK, n_members, gb.shiftx, gb.shifty, gb.shiftz);
+			}
+		}
+		}
+		}
+	}
+}
+
 #endif // MPI
@@ -74,12 +74,35 @@ void reb_communication_mpi_distribute_particles(struct reb_simulation* const r);
  */
 void reb_communication_mpi_add_particle_to_send_queue(struct reb_simulation* const r, struct reb_particle pt, int proc_id);
 
+/**
+ * Moves particles that are not in a local root box to the send queue.
+ * The tree does this when it is updated. This function is only needed if no tree is used.
+ */
+void reb_communication_mpi_queue_nonlocal_particles(struct reb_simulation* const r);
+
 /**
  * Determine if the root box is local or if it is a copy of a remote node.
  * @param i Id of root box.
  */ 
 int  reb_communication_mpi_rootbox_is_local(struct reb_simulation* const r, int i);
 
+/**
+ * Returns the MPI node the root box belongs to.
+ * @param i Id of root box.
+ */ 
+int  reb_communication_mpi_rootbox_owner(struct reb_simulation* const r, int i);
+
+/**
+ * Checks the load balance and redistributes root boxes if needed.
+ * The cost of every root box is the number of interactions since the last 
+ * call plus the number of particles. If the cost of the busiest node is larger
+ * than mpi_imbalance_max times the mean cost, the root boxes are sorted along 
+ * a Hilbert curve and the curve is cut into segments of equal cost. Particles
+ * in root boxes that changed owner are put in the send queue and local trees
+ * are rebuilt. Does nothing if mpi_imbalance_max is 0. Must be called by all nodes.
+ */
+void reb_communication_mpi_balance(struct reb_simulation* const r);
+
 /**
  * Send cells in buffer tree_essential_send to corresponding node. 
  * Receives cells from all nodes in buffer tree_essential_recv and adds them
@@ -107,6 +130,26 @@ void reb_communication_mpi_distribute_essential_tree_for_collisions(struct reb_s
  */
 void reb_communication_mpi_prepare_essential_tree_for_collisions(struct reb_simulation* const r, struct reb_treecell* root);
 
+/**
+ * Starts the ring for the direct summation with REB_GRAVITY_BASIC.
+ * Copies the massive local particles [0,N_massive) into a block, then sends 
+ * it to node mpi_id+1 and receives the block of node mpi_id-1 without 
+ * blocking, so the local forces can be calculated in the meantime. 
+ * Must be called by all nodes.
+ * @param N_massive Number of local massive particles.
+ */
+void reb_communication_mpi_gravity_ring_start(struct reb_simulation* const r, const int N_massive);
+
+/**
+ * Adds the forces of the massive particles of all other nodes to the local particles [0,N_real).
+ * In each of the mpi_num-1 steps, the block received last is forwarded to the 
+ * next node while its forces are calculated. Every block visits every node once,
+ * so the result is the exact direct sum. Must be called by all nodes after 
+ * reb_communication_mpi_gravity_ring_start().
+ * @param simd Instruction set as returned by reb_gravity_simd_level().
+ * @param N_real Number of local particles receiving a force.
+ */
+void reb_communication_mpi_gravity_ring_finish(struct reb_simulation* const r, const int simd, const int N_real);
 
 #endif // MPI
 #endif // _COMMUNICATION_MPI_H
@@ -5,9 +5,11 @@
  *
  * @details 	This is the crudest implementation of an N-body code
  * which sums up every pair of particles. It is only useful very small 
- * particle numbers (N<~100) as it scales as O(N^2). Note that the MPI
- * implementation is not well tested and only works for very specific
- * problems. This should be resolved in the future. 
+ * particle numbers (N<~100) as it scales as O(N^2). With MPI, 
+ * REB_GRAVITY_BASIC passes blocks of massive particles around a ring 
+ * of nodes, so every particle feels the force of all particles on all 
+ * nodes. The MPI implementation of the other methods is not well tested 
+ * and only works for very specific problems. 
  *
  * 
  * @section LICENSE
@@ -31,6 +33,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
@@ -38,10 +41,19 @@
 #include "rebound.h"
 #include "tree.h"
 #include "boundary.h"
+#include "gravity_simd.h"
+#include "gravity_fmm.h"
+#include "gravity_ewald.h"
+#include "gravity_fft.h"
 
 #ifdef MPI
 #include "communication_mpi.h"
 #endif
+#ifdef OPENMP
+#include <omp.h>
+#endif
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
+#define MAX(a, b) ((a) < (b) ? (b) : (a))    ///< Returns the maximum of a and b
 
 /**
   * @brief The function loops over all trees to call calculate_forces_for_particle_from_cell() tree to calculate forces for each particle.
@@ -49,7 +61,207 @@
   * @param pt Index of the particle the force is calculated for.
   * @param gb Ghostbox plus position of the particle (precalculated). 
   */
-static void reb_calculate_acceleration_for_particle(const struct reb_simulation* const r, const int pt, const struct reb_ghostbox gb);
+static int reb_calculate_acceleration_for_particle(const struct reb_simulation* const r, const int pt, const struct reb_ghostbox gb);
+
+/**
+  * @brief Calculates the forces for groups of particles with one tree walk per group.
+  * @details Used by REB_GRAVITY_TREE if tree_ncrit>0. 
+  * @param r REBOUND simulation to consider
+  */
+static void reb_calculate_acceleration_tree_groups(struct reb_simulation* const r);
+
+/**
+  * @brief Adds the force of particle j to the accumulators ax, ay, az of particle i at (xi,yi,zi).
+  * @details SOFTENING is a compile time constant, so no add is generated if it is 0. 
+  */
+#define REB_GRAVITY_BASIC_PAIR(SOFTENING) \
+	{ \
+		const double dx = xi - particles[j].x; \
+		const double dy = yi - particles[j].y; \
+		const double dz = zi - particles[j].z; \
+		const double r2 = dx*dx + dy*dy + dz*dz; \
+		const double _r = sqrt((SOFTENING)?r2+softening2:r2); \
+		const double prefact = particles[j].m/(_r*_r*_r); \
+		ax -= prefact*dx; \
+		ay -= prefact*dy; \
+		az -= prefact*dz; \
+	}
+
+/**
+  * @brief Generates a scalar direct summation kernel without any per-pair branches.
+  * @details The j loop is split into the ranges before and after particle i. If 
+  * gravity_ignore_10 is set, the rows of particles 0 and 1 start after particle 1.
+  * SOFTENING and SHIFT are 0 or 1. They are known at compile time, so the kernels 
+  * without softening or without ghost box shifts do not contain the corresponding adds.
+  * @param NAME Name of the generated function.
+  * @param SOFTENING 1 if the kernel supports a non-zero softening length.
+  * @param SHIFT 1 if the kernel supports a non-zero ghost box shift.
+  */
+#define REB_GRAVITY_BASIC_KERNEL(NAME, SOFTENING, SHIFT) \
+static void NAME(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){ \
+	struct reb_particle* const particles = r->particles; \
+	const double G = r->G; \
+	const double softening2 = r->softening*r->softening; \
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10; \
+	_Pragma("omp parallel for schedule(guided)") \
+	for (int i=i_start; i<i_end; i++){ \
+		const double xi = (SHIFT)?gb.shiftx+particles[i].x:particles[i].x; \
+		const double yi = (SHIFT)?gb.shifty+particles[i].y:particles[i].y; \
+		const double zi = (SHIFT)?gb.shiftz+particles[i].z:particles[i].z; \
+		int j_end1 = MAX(MIN(i, j_end), j_start); \
+		int j_start2 = MAX(i+1, j_start); \
+		if (_gravity_ignore_10 && i<2){ \
+			j_end1 = j_start; \
+			j_start2 = MAX(2, j_start); \
+		} \
+		double ax = 0.; \
+		double ay = 0.; \
+		double az = 0.; \
+		for (int j=j_start; j<j_end1; j++) REB_GRAVITY_BASIC_PAIR(SOFTENING) \
+		for (int j=j_start2; j<j_end; j++) REB_GRAVITY_BASIC_PAIR(SOFTENING) \
+		particles[i].ax += G*ax; \
+		particles[i].ay += G*ay; \
+		particles[i].az += G*az; \
+	} \
+}
+
+REB_GRAVITY_BASIC_KERNEL(reb_calculate_acceleration_basic_scalar, 1, 1)
+REB_GRAVITY_BASIC_KERNEL(reb_calculate_acceleration_basic_scalar_nosoftening, 0, 1)
+REB_GRAVITY_BASIC_KERNEL(reb_calculate_acceleration_basic_scalar_noshift, 1, 0)
+REB_GRAVITY_BASIC_KERNEL(reb_calculate_acceleration_basic_scalar_nosoftening_noshift, 0, 0)
+
+/**
+  * @brief Direct summation of the forces from particles [j_start,j_end) on particles [i_start,i_end).
+  * @details Uses the cache blocked kernel if more than gravity_tile_j particles exert a force, otherwise
+  * one of the SIMD kernels if simd is not REB_SIMD_NONE. The scalar kernel is chosen once per call
+  * depending on whether softening and the ghost box shift are zero. If gravity_ignore_10 is set,
+  * the interaction between particles 0 and 1 is ignored in both directions.
+  * @param r REBOUND simulation to consider
+  * @param simd Instruction set as returned by reb_gravity_simd_level().
+  * @param gb Ghostbox of the particles receiving the force.
+  * @param i_start First particle receiving a force.
+  * @param i_end One past the last particle receiving a force.
+  * @param j_start First particle exerting a force.
+  * @param j_end One past the last particle exerting a force.
+  */
+static void reb_calculate_acceleration_basic(struct reb_simulation* const r, const int simd, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	if (r->gravity_tile_j>0 && j_end-j_start>r->gravity_tile_j){
+		// Large N: reuse cached tiles of particles exerting a force.
+		reb_gravity_simd_basic_tiled(r, simd, gb, i_start, i_end, j_start, j_end);
+		return;
+	}
+	if (simd!=REB_SIMD_NONE){
+		reb_gravity_simd_basic(r, simd, gb, i_start, i_end, j_start, j_end);
+		return;
+	}
+	const int softening = r->softening!=0.;
+	const int shift = gb.shiftx!=0. || gb.shifty!=0. || gb.shiftz!=0.;
+	if (softening){
+		if (shift){
+			reb_calculate_acceleration_basic_scalar(r, gb, i_start, i_end, j_start, j_end);
+		}else{
+			reb_calculate_acceleration_basic_scalar_noshift(r, gb, i_start, i_end, j_start, j_end);
+		}
+	}else{
+		if (shift){
+			reb_calculate_acceleration_basic_scalar_nosoftening(r, gb, i_start, i_end, j_start, j_end);
+		}else{
+			reb_calculate_acceleration_basic_scalar_nosoftening_noshift(r, gb, i_start, i_end, j_start, j_end);
+		}
+	}
+}
+
+/**
+  * @brief Sets the accelerations of the test particles [i_start,i_end) due to the massive particles [j_start,j_end).
+  * @details Uses the specialized test particle kernel which sums over all ghost boxes and does 
+  * not check for i==j or gravity_ignore_10. The only pair it could miss, (1,0), is handled separately.
+  * @param r REBOUND simulation to consider
+  * @param simd Instruction set as returned by reb_gravity_simd_level().
+  * @param i_start First test particle.
+  * @param i_end One past the last test particle.
+  * @param j_start First massive particle.
+  * @param j_end One past the last massive particle.
+  */
+static void reb_calculate_acceleration_testparticles(struct reb_simulation* const r, const int simd, int i_start, const int i_end, const int j_start, const int j_end){
+	if (r->gravity_ignore_10 && i_start==1 && i_end>1){
+		struct reb_particle* const particles = r->particles;
+		particles[1].ax = 0.;
+		particles[1].ay = 0.;
+		particles[1].az = 0.;
+		for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
+		for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
+		for (int gbz=-r->nghostz; gbz<=r->nghostz; gbz++){
+			struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+			reb_calculate_acceleration_basic(r, simd, gb, 1, 2, j_start, j_end);
+		}
+		}
+		}
+		i_start = 2;
+	}
+	reb_gravity_simd_testparticles(r, simd, i_start, i_end, j_start, j_end);
+}
+
+/**
+  * @brief Adds the force between particles i and j to both particles using compensated summation.
+  * @details Not thread-safe for pairs sharing a particle.
+  * @param r REBOUND simulation to consider
+  * @param i Index of the first particle.
+  * @param j Index of the second particle.
+  */
+static inline void reb_calculate_acceleration_compensated_pair(struct reb_simulation* const r, const int i, const int j){
+	struct reb_particle* const particles = r->particles;
+	struct reb_vec3d* restrict const cs = r->gravity_cs;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	const double dx = particles[i].x - particles[j].x;
+	const double dy = particles[i].y - particles[j].y;
+	const double dz = particles[i].z - particles[j].z;
+	const double r2 = dx*dx + dy*dy + dz*dz + softening2;
+	const double _r = sqrt(r2);
+	const double prefact  = G/(r2*_r);
+	const double prefacti = prefact*particles[i].m;
+	const double prefactj = -prefact*particles[j].m;
+	
+	{
+	double ix = prefactj*dx;
+	double yx = ix - cs[i].x;
+	double tx = particles[i].ax + yx;
+	cs[i].x = (tx - particles[i].ax) - yx;
+	particles[i].ax = tx;
+
+	double iy = prefactj*dy;
+	double yy = iy- cs[i].y;
+	double ty = particles[i].ay + yy;
+	cs[i].y = (ty - particles[i].ay) - yy;
+	particles[i].ay = ty;
+	
+	double iz = prefactj*dz;
+	double yz = iz - cs[i].z;
+	double tz = particles[i].az + yz;
+	cs[i].z = (tz - particles[i].az) - yz;
+	particles[i].az = tz;
+	}
+	
+	{
+	double ix = prefacti*dx;
+	double yx = ix - cs[j].x;
+	double tx = particles[j].ax + yx;
+	cs[j].x = (tx - particles[j].ax) - yx;
+	particles[j].ax = tx;
+
+	double iy = prefacti*dy;
+	double yy = iy - cs[j].y;
+	double ty = particles[j].ay + yy;
+	cs[j].y = (ty - particles[j].ay) - yy;
+	particles[j].ay = ty;
+	
+	double iz = prefacti*dz;
+	double yz = iz - cs[j].z;
+	double tz = particles[j].az + yz;
+	cs[j].z = (tz - particles[j].az) - yz;
+	particles[j].az = tz;
+	}
+}
 
 /**
  * Main Gravity Routine
@@ -72,37 +284,48 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 			const int nghostx = r->nghostx;
 			const int nghosty = r->nghosty;
 			const int nghostz = r->nghostz;
+			const int simd = reb_gravity_simd_level(r);
+			// Newton's third law can only be used if there are no ghost boxes.
+			const int symmetric = r->gravity_basic_symmetric && nghostx==0 && nghosty==0 && nghostz==0;
+			// Accelerations of test particles are set by the test particle kernel.
 #pragma omp parallel for schedule(guided)
-			for (int i=0; i<N; i++){
+			for (int i=0; i<_N_active; i++){
 				particles[i].ax = 0; 
 				particles[i].ay = 0; 
 				particles[i].az = 0; 
 			}
-			// Summing over all Ghost Boxes
-			for (int gbx=-nghostx; gbx<=nghostx; gbx++){
-			for (int gby=-nghosty; gby<=nghosty; gby++){
-			for (int gbz=-nghostz; gbz<=nghostz; gbz++){
-				struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
-				// Summing over all particle pairs
-#pragma omp parallel for schedule(guided)
-				for (int i=_N_start; i<_N_real; i++){
-				for (int j=_N_start; j<_N_active; j++){
-					if (_gravity_ignore_10 && j==1 && i==0 ) continue;
-					if (i==j) continue;
-					const double dx = (gb.shiftx+particles[i].x) - particles[j].x;
-					const double dy = (gb.shifty+particles[i].y) - particles[j].y;
-					const double dz = (gb.shiftz+particles[i].z) - particles[j].z;
-					const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
-					const double prefact = -G/(_r*_r*_r)*particles[j].m;
-					
-					particles[i].ax    += prefact*dx;
-					particles[i].ay    += prefact*dy;
-					particles[i].az    += prefact*dz;
+			for (int i=_N_real; i<N; i++){
+				particles[i].ax = 0; 
+				particles[i].ay = 0; 
+				particles[i].az = 0; 
+			}
+			// Copy positions and masses of all massive particles into SoA buffer.
+			reb_gravity_simd_pack(r, _N_active);
+#ifdef MPI
+			// Send the local massive particles around the ring while the local forces are calculated.
+			reb_communication_mpi_gravity_ring_start(r, _N_active);
+#endif // MPI
+			if (symmetric){
+				// Summing over all massive particle pairs, each pair once
+				reb_gravity_simd_basic_symmetric(r, simd, _N_start, _N_active);
+			}else{
+				// Summing over all Ghost Boxes
+				for (int gbx=-nghostx; gbx<=nghostx; gbx++){
+				for (int gby=-nghosty; gby<=nghosty; gby++){
+				for (int gbz=-nghostz; gbz<=nghostz; gbz++){
+					struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+					// Summing over all massive particle pairs
+					reb_calculate_acceleration_basic(r, simd, gb, _N_start, _N_active, _N_start, _N_active);
+				}
 				}
 				}
 			}
-			}
-			}
+			// Testparticles, summing over all Ghost Boxes
+			reb_calculate_acceleration_testparticles(r, simd, _N_active, _N_real, _N_start, _N_active);
+#ifdef MPI
+			// Forces from the massive particles on all other nodes.
+			reb_communication_mpi_gravity_ring_finish(r, simd, _N_real);
+#endif // MPI
 		}
 		break;
 		case REB_GRAVITY_COMPENSATED:
@@ -122,60 +345,42 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 				cs[i].z = 0.;
 			}
 			// Summing over all massive particle pairs
-#pragma omp parallel for schedule(guided)
+#ifdef OPENMP
+			// Pairs are grouped in tiles of blocks I<=J. Tiles on the same anti-diagonal I+J 
+			// do not share any particles and can run in parallel. Sweeping the anti-diagonals 
+			// in order adds the contributions to each particle in the same order as the
+			// serial loop, so the result is bit-wise identical and independent of the 
+			// number of threads.
+			const int n_massive = _N_active-_N_start;
+			int n_blocks = 4*omp_get_max_threads();
+			if (n_blocks>n_massive/16) n_blocks = n_massive/16;
+			if (n_blocks<1) n_blocks = 1;
+			const int blocksize = (n_massive+n_blocks-1)/n_blocks;
+#pragma omp parallel
+			for (int d=0; d<2*n_blocks-1; d++){
+#pragma omp for schedule(dynamic,1)
+				for (int I=(d<n_blocks?0:d-n_blocks+1); I<=d/2; I++){
+					const int J = d-I;
+					const int i_start = _N_start+I*blocksize;
+					const int i_end   = MIN(i_start+blocksize, _N_active);
+					const int j_start = _N_start+J*blocksize;
+					const int j_end   = MIN(j_start+blocksize, _N_active);
+					for (int i=i_start; i<i_end; i++){
+					for (int j=(I==J?i+1:j_start); j<j_end; j++){
+						if (_gravity_ignore_10 && j==1 && i==0 ) continue;
+						reb_calculate_acceleration_compensated_pair(r, i, j);
+					}
+					}
+				}
+			}
+#else // OPENMP
 			for (int i=_N_start; i<_N_active; i++){
 			for (int j=i+1; j<_N_active; j++){
 				if (_gravity_ignore_10 && j==1 && i==0 ) continue;
-				const double dx = particles[i].x - particles[j].x;
-				const double dy = particles[i].y - particles[j].y;
-				const double dz = particles[i].z - particles[j].z;
-				const double r2 = dx*dx + dy*dy + dz*dz + softening2;
-				const double r = sqrt(r2);
-				const double prefact  = G/(r2*r);
-				const double prefacti = prefact*particles[i].m;
-				const double prefactj = -prefact*particles[j].m;
-				
-				{
-				double ix = prefactj*dx;
-				double yx = ix - cs[i].x;
-				double tx = particles[i].ax + yx;
-				cs[i].x = (tx - particles[i].ax) - yx;
-				particles[i].ax = tx;
-
-				double iy = prefactj*dy;
-				double yy = iy- cs[i].y;
-				double ty = particles[i].ay + yy;
-				cs[i].y = (ty - particles[i].ay) - yy;
-				particles[i].ay = ty;
-				
-				double iz = prefactj*dz;
-				double yz = iz - cs[i].z;
-				double tz = particles[i].az + yz;
-				cs[i].z = (tz - particles[i].az) - yz;
-				particles[i].az = tz;
-				}
-				
-				{
-				double ix = prefacti*dx;
-				double yx = ix - cs[j].x;
-				double tx = particles[j].ax + yx;
-				cs[j].x = (tx - particles[j].ax) - yx;
-				particles[j].ax = tx;
-
-				double iy = prefacti*dy;
-				double yy = iy - cs[j].y;
-				double ty = particles[j].ay + yy;
-				cs[j].y = (ty - particles[j].ay) - yy;
-				particles[j].ay = ty;
-				
-				double iz = prefacti*dz;
-				double yz = iz - cs[j].z;
-				double tz = particles[j].az + yz;
-				cs[j].z = (tz - particles[j].az) - yz;
-				particles[j].az = tz;
-				}
+				reb_calculate_acceleration_compensated_pair(r, i, j);
 			}
 			}
+#endif // OPENMP
 			// Testparticles
 #pragma omp parallel for schedule(guided)
 			for (int i=_N_active; i<_N_real; i++){
@@ -214,12 +419,31 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 		break;
 		case REB_GRAVITY_TREE:
 		{
+			if (r->tree_opening==REB_TREE_OPENING_RELATIVE){
+#ifdef MPI
+				reb_exit("REB_TREE_OPENING_RELATIVE does not support MPI.");
+#endif // MPI
+				// Keep the accelerations of the previous force calculation for the opening criterion.
+				if (r->tree_aold_allocatedN<N){
+					r->tree_aold_allocatedN = N;
+					r->tree_aold = realloc(r->tree_aold, sizeof(double)*N);
+				}
+#pragma omp parallel for schedule(guided)
+				for (int i=0; i<N; i++){
+					const struct reb_particle p = particles[i];
+					r->tree_aold[i] = sqrt(p.ax*p.ax + p.ay*p.ay + p.az*p.az);
+				}
+			}
 #pragma omp parallel for schedule(guided)
 			for (int i=0; i<N; i++){
 				particles[i].ax = 0; 
 				particles[i].ay = 0; 
 				particles[i].az = 0; 
 			}
+			if (r->tree_ncrit>0){
+				reb_calculate_acceleration_tree_groups(r);
+				break;
+			}
 			// Summing over all Ghost Boxes
 			for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
 			for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
@@ -232,12 +456,41 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 					gb.shiftx += particles[i].x;
 					gb.shifty += particles[i].y;
 					gb.shiftz += particles[i].z;
+#ifdef MPI
+					const int n = reb_calculate_acceleration_for_particle(r, i, gb);
+					// Interactions are the cost used for load balancing.
+#pragma omp atomic
+					r->mpi_rootbox_cost[reb_get_rootbox_for_particle(r, particles[i])] += n;
+#else // MPI
 					reb_calculate_acceleration_for_particle(r, i, gb);
+#endif // MPI
 				}
 			}
 			}
 			}
 		}
+		break;
+		case REB_GRAVITY_FMM:
+#ifdef MPI
+			reb_exit("REB_GRAVITY_FMM does not support MPI.");
+#endif // MPI
+			reb_gravity_fmm(r);
+		break;
+		case REB_GRAVITY_EWALD:
+#ifdef MPI
+			reb_exit("REB_GRAVITY_EWALD does not support MPI.");
+#endif // MPI
+			reb_gravity_ewald(r);
+		break;
+		case REB_GRAVITY_FFT:
+#ifdef MPI
+			reb_exit("REB_GRAVITY_FFT does not support MPI.");
+#endif // MPI
+#ifdef FFTW
+			reb_gravity_fft(r);
+#else // FFTW
+			reb_exit("REB_GRAVITY_FFT requires FFTW. Compile REBOUND with FFTW=1.");
+#endif // FFTW
 		break;
 		default:
 			reb_exit("Gravity calculation not yet implemented.");
@@ -266,48 +519,113 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
 		}
 		// No break!
 		case REB_GRAVITY_BASIC:
-#pragma omp parallel for schedule(guided)
-			for (int i=_N_real; i<N; i++){
-				particles[i].ax = 0.; 
-				particles[i].ay = 0.; 
-				particles[i].az = 0.; 
+		{
+			if (_N_real<=0 || r->N_var%_N_real){
+				reb_exit("Number of variational particles must be a multiple of the number of real particles.");
+			}
+			// Set s of variational particles starts at _N_real+s*_N_real.
+			const int k = r->N_var/_N_real;
+			// Each real particle owns 3*k consecutive doubles: x of all sets, y of all sets, z of all sets.
+			const int stride = 3*k;
+#ifdef OPENMP
+			const int nthreads = omp_get_max_threads();
+#else // OPENMP
+			const int nthreads = 1;
+#endif // OPENMP
+			// Positions followed by one accumulation buffer per thread.
+			const int size = (1+nthreads)*_N_real*stride;
+			if (r->gravity_var_allocatedN<size){
+				free(r->gravity_var_buffer);
+				if (posix_memalign((void**)&(r->gravity_var_buffer), 64, size*sizeof(double))){
+					reb_exit("Cannot allocate memory for variational gravity buffers.");
+				}
+				r->gravity_var_allocatedN = size;
 			}
+			double* restrict const buffer = r->gravity_var_buffer;
 #pragma omp parallel for schedule(guided)
-			for (int i=_N_real; i<N; i++){
-			for (int j=i+1; j<N; j++){
-				if (_gravity_ignore_10 && ((i==_N_real+1 && j==_N_real) || (j==_N_real+1 && i==_N_real)) ) continue;
-				const double dx = particles[i-N/2].x - particles[j-N/2].x;
-				const double dy = particles[i-N/2].y - particles[j-N/2].y;
-				const double dz = particles[i-N/2].z - particles[j-N/2].z;
-				const double r2 = dx*dx + dy*dy + dz*dz;
-				const double _r  = sqrt(r2);
-				const double r3inv = 1./(r2*_r);
-				const double r5inv = 3.*r3inv/r2;
-				const double ddx = particles[i].x - particles[j].x;
-				const double ddy = particles[i].y - particles[j].y;
-				const double ddz = particles[i].z - particles[j].z;
-				const double Gmi = G * particles[i].m;
-				const double Gmj = G * particles[j].m;
-				
-				const double dax =   ddx * ( dx*dx*r5inv - r3inv )
-						   + ddy * ( dx*dy*r5inv )
-						   + ddz * ( dx*dz*r5inv );
-				const double day =   ddx * ( dy*dx*r5inv )
-						   + ddy * ( dy*dy*r5inv - r3inv )
-						   + ddz * ( dy*dz*r5inv );
-				const double daz =   ddx * ( dz*dx*r5inv )
-						   + ddy * ( dz*dy*r5inv )
-						   + ddz * ( dz*dz*r5inv - r3inv );
-				
-				particles[i].ax += Gmj * dax;
-				particles[i].ay += Gmj * day;
-				particles[i].az += Gmj * daz;
-				
-				particles[j].ax -= Gmi * dax;
-				particles[j].ay -= Gmi * day;
-				particles[j].az -= Gmi * daz;
+			for (int i=0; i<_N_real; i++){
+				double* const dr = buffer + i*stride;
+				for (int s=0; s<k; s++){
+					const struct reb_particle dp = particles[_N_real+s*_N_real+i];
+					dr[s]     = dp.x;
+					dr[k+s]   = dp.y;
+					dr[2*k+s] = dp.z;
+				}
 			}
+			int nthreads_used = 1;
+#pragma omp parallel
+			{
+				int tid = 0;
+#ifdef OPENMP
+				tid = omp_get_thread_num();
+#pragma omp single
+				nthreads_used = omp_get_num_threads();
+#endif // OPENMP
+				double* const acc = buffer + (1+tid)*_N_real*stride;
+				memset(acc, 0, _N_real*stride*sizeof(double));
+				// A static schedule assigns the same pairs to the same thread in every call, so results are reproducible.
+#pragma omp for schedule(static,4)
+				for (int i=0; i<_N_real; i++){
+				for (int j=i+1; j<_N_real; j++){
+					if (_gravity_ignore_10 && i==0 && j==1) continue;
+					// The tidal tensor of the pair only depends on the real particles,
+					// it is calculated once and applied to all k sets.
+					const double dx = particles[i].x - particles[j].x;
+					const double dy = particles[i].y - particles[j].y;
+					const double dz = particles[i].z - particles[j].z;
+					const double r2 = dx*dx + dy*dy + dz*dz;
+					const double _r  = sqrt(r2);
+					const double r3inv = 1./(r2*_r);
+					const double r5inv = 3.*r3inv/r2;
+					const double Txx = dx*dx*r5inv - r3inv;
+					const double Tyy = dy*dy*r5inv - r3inv;
+					const double Tzz = dz*dz*r5inv - r3inv;
+					const double Txy = dx*dy*r5inv;
+					const double Txz = dx*dz*r5inv;
+					const double Tyz = dy*dz*r5inv;
+					const double Gmi = G * particles[i].m;
+					const double Gmj = G * particles[j].m;
+					const double* restrict const dri = buffer + i*stride;
+					const double* restrict const drj = buffer + j*stride;
+					double* restrict const dai = acc + i*stride;
+					double* restrict const daj = acc + j*stride;
+					for (int s=0; s<k; s++){
+						const double ddx = dri[s]     - drj[s];
+						const double ddy = dri[k+s]   - drj[k+s];
+						const double ddz = dri[2*k+s] - drj[2*k+s];
+						const double dax = Txx*ddx + Txy*ddy + Txz*ddz;
+						const double day = Txy*ddx + Tyy*ddy + Tyz*ddz;
+						const double daz = Txz*ddx + Tyz*ddy + Tzz*ddz;
+						dai[s]     += Gmj * dax;
+						dai[k+s]   += Gmj * day;
+						dai[2*k+s] += Gmj * daz;
+						daj[s]     -= Gmi * dax;
+						daj[k+s]   -= Gmi * day;
+						daj[2*k+s] -= Gmi * daz;
+					}
+				}
+				}
 			}
+			// Reduce thread buffers in a fixed order.
+#pragma omp parallel for schedule(guided)
+			for (int i=0; i<_N_real; i++){
+				for (int s=0; s<k; s++){
+					double ax = 0.;
+					double ay = 0.;
+					double az = 0.;
+					for (int t=0; t<nthreads_used; t++){
+						const double* const da = buffer + (1+t)*_N_real*stride + i*stride;
+						ax += da[s];
+						ay += da[k+s];
+						az += da[2*k+s];
+					}
+					struct reb_particle* const dp = &(particles[_N_real+s*_N_real+i]);
+					dp->ax = ax;
+					dp->ay = ay;
+					dp->az = az;
+				}
+			}
+		}
 			break;
 		default:
 			reb_exit("Variational gravity calculation not yet implemented.");
@@ -320,26 +638,117 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
 
 
 /**
-  * @brief The function calls itself recursively using cell breaking criterion to check whether it can use center of mass (and mass quadrupole tensor) to calculate forces.
+  * @brief The function calls itself recursively using cell breaking criterion to check whether it can use center of mass (and higher order moments) to calculate forces.
   * Calculate the acceleration for a particle from a given cell and all its daughter cells.
   *
   * @param r REBOUND simulation to consider
   * @param pt Index of the particle the force is calculated for.
   * @param node Pointer to the cell the force is calculated from.
   * @param gb Ghostbox plus position of the particle (precalculated). 
+  * @return Number of cells and particles the particle interacted with.
   */
-static void reb_calculate_acceleration_for_particle_from_cell(const struct reb_simulation* const r, const int pt, const struct reb_treecell *node, const struct reb_ghostbox gb);
+static int reb_calculate_acceleration_for_particle_from_cell(const struct reb_simulation* const r, const int pt, const struct reb_treecell *node, const struct reb_ghostbox gb);
 
-static void reb_calculate_acceleration_for_particle(const struct reb_simulation* const r, const int pt, const struct reb_ghostbox gb) {
+/**
+  * @brief Calculates the gradient V of the polynomial P_l with coefficients c.
+  * @details Loops over all monomials of degree l-1. Called with constant l, 
+  * so that the loops are unrolled and the indices are known at compile time.
+  */
+static inline void reb_calculate_acceleration_multipole_gradient(const int l, const double* const c, const double* const X, const double* const Y, const double* const Z, double* const V){
+	for (int mx=l-1; mx>=0; mx--){
+		for (int my=l-1-mx; my>=0; my--){
+			const int mz = l-1-mx-my;
+			const double mono = X[mx]*Y[my]*Z[mz];
+			// Index of the coefficient of x^(mx+1) y^my z^mz, etc.
+			V[0] += (mx+1)*c[(l-mx-1)*(l-mx)/2 + (l-mx-1-my)]*mono;
+			V[1] += (my+1)*c[(l-mx)*(l-mx+1)/2 + (l-mx-my-1)]*mono;
+			V[2] += (mz+1)*c[(l-mx)*(l-mx+1)/2 + (l-mx-my)]*mono;
+		}
+	}
+}
+
+/**
+  * @brief Adds the acceleration due to the higher order moments of a cell.
+  * @details The moments are stored as coefficients of the polynomials P_l, see tree.c.
+  * The acceleration is G sum_l (grad P_l/|x|^(2l+1) - (2l+1) P_l x/|x|^(2l+3)),
+  * where P_l = x.grad P_l / l.
+  *
+  * @param r REBOUND simulation to consider
+  * @param pt Index of the particle the force is calculated for.
+  * @param c Coefficients of the polynomials P_l for l=2..tree_multipole. 
+  * @param dx x position of the particle relative to the center of mass of the cell.
+  * @param dy y position of the particle relative to the center of mass of the cell.
+  * @param dz z position of the particle relative to the center of mass of the cell.
+  * @param _r Softened distance. 
+  */
+static void reb_calculate_acceleration_for_particle_from_multipoles(const struct reb_simulation* const r, const int pt, const double* c, const double dx, const double dy, const double dz, const double _r){
+	const double X[4] = {1., dx, dx*dx, dx*dx*dx};
+	const double Y[4] = {1., dy, dy*dy, dy*dy*dy};
+	const double Z[4] = {1., dz, dz*dz, dz*dz*dz};
+	const double _r2inv = 1./(_r*_r);
+	double _rl = _r2inv*_r2inv/_r; // 1/|x|^(2l+1)
+	double ax = 0.;
+	double ay = 0.;
+	double az = 0.;
+	const int order = r->tree_multipole;
+	for (int l=2; l<=order; l++){
+		double V[3] = {0., 0., 0.};
+		switch (l){
+			case 2:
+				reb_calculate_acceleration_multipole_gradient(2, c, X, Y, Z, V);
+				break;
+			case 3:
+				reb_calculate_acceleration_multipole_gradient(3, c, X, Y, Z, V);
+				break;
+			default:
+				reb_calculate_acceleration_multipole_gradient(4, c, X, Y, Z, V);
+				break;
+		}
+		c += (l+1)*(l+2)/2;
+		const double Pr = (2*l+1)/(double)l*(V[0]*dx + V[1]*dy + V[2]*dz)*_r2inv;
+		ax += (V[0] - Pr*dx)*_rl;
+		ay += (V[1] - Pr*dy)*_rl;
+		az += (V[2] - Pr*dz)*_rl;
+		_rl *= _r2inv;
+	}
+	const double G = r->G;
+	struct reb_particle* const particles = r->particles;
+	particles[pt].ax += G*ax; 
+	particles[pt].ay += G*ay; 
+	particles[pt].az += G*az; 
+}
+
+/**
+  * @brief Returns 1 if a cell has to be opened, 0 if its moments can be used.
+  * @details With REB_TREE_OPENING_RELATIVE the cell is opened if the estimated 
+  * force error G m w^2/d^4 is larger than opening_tolerance times the acceleration
+  * in the previous force calculation, or if the particle is within the cell 
+  * enlarged by 20%. Without a previous acceleration, the geometric criterion is used.
+  * @param r REBOUND simulation to consider
+  * @param node Cell to test.
+  * @param r2 Squared distance to the center of mass of the cell.
+  * @param aold Previous acceleration of the particle, 0 if not known.
+  * @param near 1 if the particle is within the enlarged cell.
+  */
+static inline int reb_calculate_acceleration_open_cell(const struct reb_simulation* const r, const struct reb_treecell* const node, const double r2, const double aold, const int near){
+	if (r->tree_opening==REB_TREE_OPENING_RELATIVE && aold>0.){
+		return near || r->G*node->m*node->w*node->w > r->opening_tolerance*aold*r2*r2;
+	}
+	return node->w*node->w > r->opening_angle2*r2;
+}
+
+static int reb_calculate_acceleration_for_particle(const struct reb_simulation* const r, const int pt, const struct reb_ghostbox gb) {
+	int n = 0;
 	for(int i=0;i<r->root_n;i++){
 		struct reb_treecell* node = r->tree_root[i];
 		if (node!=NULL){
-			reb_calculate_acceleration_for_particle_from_cell(r, pt, node, gb);
+			n += reb_calculate_acceleration_for_particle_from_cell(r, pt, node, gb);
 		}
 	}
+	return n;
 }
 
-static void reb_calculate_acceleration_for_particle_from_cell(const struct reb_simulation* r, const int pt, const struct reb_treecell *node, const struct reb_ghostbox gb) {
+static int reb_calculate_acceleration_for_particle_from_cell(const struct reb_simulation* r, const int pt, const struct reb_treecell *node, const struct reb_ghostbox gb) {
 	const double G = r->G;
 	const double softening2 = r->softening*r->softening;
 	struct reb_particle* const particles = r->particles;
@@ -348,39 +757,248 @@ static void reb_calculate_acceleration_for_particle_from_cell(const struct reb_s
 	const double dz = gb.shiftz - node->mz;
 	const double r2 = dx*dx + dy*dy + dz*dz;
 	if ( node->pt < 0 ) { // Not a leaf
-		if ( node->w*node->w > r->opening_angle2*r2 ){
+		double aold = 0.;
+		int near = 0;
+		if (r->tree_opening==REB_TREE_OPENING_RELATIVE){
+			aold = r->tree_aold[pt];
+			near = fabs(gb.shiftx-node->x)<0.6*node->w && fabs(gb.shifty-node->y)<0.6*node->w && fabs(gb.shiftz-node->z)<0.6*node->w;
+		}
+		if (reb_calculate_acceleration_open_cell(r, node, r2, aold, near)){
+			int n = 0;
 			for (int o=0; o<8; o++) {
 				if (node->oct[o] != NULL) {
-					reb_calculate_acceleration_for_particle_from_cell(r, pt, node->oct[o], gb);
+					n += reb_calculate_acceleration_for_particle_from_cell(r, pt, node->oct[o], gb);
 				}
 			}
+			return n;
 		} else {
 			double _r = sqrt(r2 + softening2);
 			double prefact = -G/(_r*_r*_r)*node->m;
-#ifdef QUADRUPOLE
-			double qprefact = G/(_r*_r*_r*_r*_r);
-			particles[pt].ax += qprefact*(dx*node->mxx + dy*node->mxy + dz*node->mxz); 
-			particles[pt].ay += qprefact*(dx*node->mxy + dy*node->myy + dz*node->myz); 
-			particles[pt].az += qprefact*(dx*node->mxz + dy*node->myz + dz*node->mzz); 
-			double mrr 	= dx*dx*node->mxx 	+ dy*dy*node->myy 	+ dz*dz*node->mzz
-					+ 2.*dx*dy*node->mxy 	+ 2.*dx*dz*node->mxz 	+ 2.*dy*dz*node->myz; 
-			qprefact *= -5.0/(2.0*_r*_r)*mrr;
-			particles[pt].ax += (qprefact + prefact) * dx; 
-			particles[pt].ay += (qprefact + prefact) * dy; 
-			particles[pt].az += (qprefact + prefact) * dz; 
-#else
 			particles[pt].ax += prefact*dx; 
 			particles[pt].ay += prefact*dy; 
 			particles[pt].az += prefact*dz; 
-#endif
+			if (r->tree_multipole>=REB_TREE_QUADRUPOLE){
+				reb_calculate_acceleration_for_particle_from_multipoles(r, pt, r->tree_multipoles + node->mp, dx, dy, dz, _r);
+			}
+			return 1;
 		}
 	} else { // It's a leaf node
-		if (node->pt == pt) return;
+		if (node->pt == pt) return 0;
 		double _r = sqrt(r2 + softening2);
 		double prefact = -G/(_r*_r*_r)*node->m;
 		particles[pt].ax += prefact*dx; 
 		particles[pt].ay += prefact*dy; 
 		particles[pt].az += prefact*dz; 
+		return 1;
+	}
+}
+
+
+/**
+  * @brief Interaction list and members of one group, used by the group walk.
+  */
+struct reb_tree_group {
+	const struct reb_treecell* cell;	///< Cell containing all members
+	double* list;				///< Positions and masses of particles and cells, SoA with stride
+	int stride;				///< Number of entries allocated in each array of list
+	int n;					///< Number of entries in list
+	const struct reb_treecell** mcells;	///< Cells in list with higher order moments, allocated with the same size as list
+	int n_mcells;				///< Number of cells in mcells
+	int* members;				///< Indices of the particles in the group
+	int n_members;				///< Number of particles in the group
+	int allocated_members;			///< Number of entries allocated in members
+	double bmin[3];				///< Lower corner of the bounding box of the (shifted) members
+	double bmax[3];				///< Upper corner of the bounding box of the (shifted) members
+	double aold;				///< Smallest previous acceleration of the members (REB_TREE_OPENING_RELATIVE)
+};
+
+static void reb_tree_group_list_add(struct reb_tree_group* const g, const double x, const double y, const double z, const double m){
+	if (g->n>=g->stride){
+		const int stride = g->stride?2*g->stride:256; // Multiple of the widest vector.
+		double* list;
+		if (posix_memalign((void**)&list, 64, 4*stride*sizeof(double))){
+			reb_exit("Cannot allocate memory for interaction list.");
+		}
+		// Entries past n are read (but masked) by the vector kernels and must be finite.
+		memset(list, 0, 4*stride*sizeof(double));
+		if (g->list){
+			for (int k=0; k<4; k++){
+				memcpy(list+k*stride, g->list+k*g->stride, g->n*sizeof(double));
+			}
+		}
+		free(g->list);
+		g->list = list;
+		g->stride = stride;
+		g->mcells = realloc(g->mcells, stride*sizeof(struct reb_treecell*));
+	}
+	g->list[g->n] = x;
+	g->list[g->stride+g->n] = y;
+	g->list[2*g->stride+g->n] = z;
+	g->list[3*g->stride+g->n] = m;
+	g->n++;
+}
+
+static void reb_tree_group_collect_members(struct reb_tree_group* const g, const struct reb_treecell* const node){
+	if (node->pt>=0){
+		if (g->n_members>=g->allocated_members){
+			g->allocated_members = g->allocated_members?2*g->allocated_members:64;
+			g->members = realloc(g->members, g->allocated_members*sizeof(int));
+		}
+		g->members[g->n_members++] = node->pt;
+		return;
+	}
+	for (int o=0; o<8; o++){
+		if (node->oct[o]!=NULL){
+			reb_tree_group_collect_members(g, node->oct[o]);
+		}
 	}
 }
 
+/**
+  * @brief Builds the interaction list of a group.
+  * @details A cell is used if the opening criterion is fulfilled for the point 
+  * of the bounding box of the group that is closest to the center of mass of 
+  * the cell. The criterion is then fulfilled for all members of the group.
+  * The relative criterion uses the smallest previous acceleration of the members.
+  * @param skip Cell not to add (the group itself if its members are already in the list).
+  */
+static void reb_tree_group_walk(const struct reb_simulation* const r, struct reb_tree_group* const g, const struct reb_treecell* const node, const struct reb_treecell* const skip){
+	if (node==skip) return;
+	if (node->pt>=0){ // It's a leaf node
+		reb_tree_group_list_add(g, node->mx, node->my, node->mz, node->m);
+		return;
+	}
+	const double dx = MAX(MAX(g->bmin[0]-node->mx, node->mx-g->bmax[0]), 0.);
+	const double dy = MAX(MAX(g->bmin[1]-node->my, node->my-g->bmax[1]), 0.);
+	const double dz = MAX(MAX(g->bmin[2]-node->mz, node->mz-g->bmax[2]), 0.);
+	const double r2 = dx*dx + dy*dy + dz*dz;
+	int near = 0;
+	if (r->tree_opening==REB_TREE_OPENING_RELATIVE){
+		// The bounding box of the group overlaps the enlarged cell
+		const double h = 0.6*node->w;
+		near = g->bmin[0]<node->x+h && g->bmax[0]>node->x-h && g->bmin[1]<node->y+h && g->bmax[1]>node->y-h && g->bmin[2]<node->z+h && g->bmax[2]>node->z-h;
+	}
+	if (reb_calculate_acceleration_open_cell(r, node, r2, g->aold, near)){
+		for (int o=0; o<8; o++) {
+			if (node->oct[o] != NULL) {
+				reb_tree_group_walk(r, g, node->oct[o], skip);
+			}
+		}
+	} else {
+		reb_tree_group_list_add(g, node->mx, node->my, node->mz, node->m);
+		if (r->tree_multipole>=REB_TREE_QUADRUPOLE){
+			g->mcells[g->n_mcells++] = node; // mcells has the same size as list
+		}
+	}
+}
+
+static void reb_tree_groups_collect(const struct reb_treecell* const node, const int ncrit, const struct reb_treecell*** groups, int* n_groups, int* allocated_groups){
+	if (node->pt>=0 || -node->pt<=ncrit){
+		if (*n_groups>=*allocated_groups){
+			*allocated_groups = *allocated_groups?2*(*allocated_groups):64;
+			*groups = realloc(*groups, (*allocated_groups)*sizeof(struct reb_treecell*));
+		}
+		(*groups)[(*n_groups)++] = node;
+		return;
+	}
+	for (int o=0; o<8; o++){
+		if (node->oct[o]!=NULL){
+			reb_tree_groups_collect(node->oct[o], ncrit, groups, n_groups, allocated_groups);
+		}
+	}
+}
+
+static void reb_calculate_acceleration_tree_groups(struct reb_simulation* const r){
+	struct reb_particle* const particles = r->particles;
+	const double softening2 = r->softening*r->softening;
+	const int level = reb_gravity_simd_level(r);
+	// Groups are cells with at most tree_ncrit particles.
+	const struct reb_treecell** groups = NULL;
+	int n_groups = 0;
+	int allocated_groups = 0;
+	for(int i=0;i<r->root_n;i++){
+#ifdef MPI
+		if (reb_communication_mpi_rootbox_is_local(r, i)==0) continue;
+#endif // MPI
+		if (r->tree_root[i]!=NULL){
+			reb_tree_groups_collect(r->tree_root[i], r->tree_ncrit, &groups, &n_groups, &allocated_groups);
+		}
+	}
+#pragma omp parallel
+	{
+		struct reb_tree_group g = {0};
+#pragma omp for schedule(dynamic,1)
+		for (int k=0; k<n_groups; k++){
+			g.cell = groups[k];
+			g.n_members = 0;
+			reb_tree_group_collect_members(&g, g.cell);
+			double bmin[3] = {INFINITY, INFINITY, INFINITY};
+			double bmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+			g.aold = 0.;
+			if (r->tree_opening==REB_TREE_OPENING_RELATIVE){
+				g.aold = INFINITY;
+				for (int m=0; m<g.n_members; m++){
+					g.aold = MIN(g.aold, r->tree_aold[g.members[m]]);
+				}
+			}
+			for (int m=0; m<g.n_members; m++){
+				const struct reb_particle p = particles[g.members[m]];
+				bmin[0] = MIN(bmin[0], p.x);
+				bmin[1] = MIN(bmin[1], p.y);
+				bmin[2] = MIN(bmin[2], p.z);
+				bmax[0] = MAX(bmax[0], p.x);
+				bmax[1] = MAX(bmax[1], p.y);
+				bmax[2] = MAX(bmax[2], p.z);
+			}
+			// Summing over all Ghost Boxes
+			for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
+			for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
+			for (int gbz=-r->nghostz; gbz<=r->nghostz; gbz++){
+				const struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+				const double shift[3] = {gb.shiftx, gb.shifty, gb.shiftz};
+				for (int d=0; d<3; d++){
+					g.bmin[d] = bmin[d] + shift[d];
+					g.bmax[d] = bmax[d] + shift[d];
+				}
+				g.n = 0;
+				g.n_mcells = 0;
+				// In the central box, the members come first in the list so they can skip themselves.
+				const int central = (gbx==0 && gby==0 && gbz==0);
+				if (central){
+					for (int m=0; m<g.n_members; m++){
+						const struct reb_particle p = particles[g.members[m]];
+						reb_tree_group_list_add(&g, p.x, p.y, p.z, p.m);
+					}
+				}
+				for(int i=0;i<r->root_n;i++){
+					if (r->tree_root[i]!=NULL){
+						reb_tree_group_walk(r, &g, r->tree_root[i], central?g.cell:NULL);
+					}
+				}
+				reb_gravity_simd_list(r, level, g.list, g.stride, g.n, central?g.n_members:0, g.members, g.n_members, gb.shiftx, gb.shifty, gb.shiftz);
+#ifdef MPI
+				// Interactions are the cost used for load balancing. All members are in the same root box.
+#pragma omp atomic
+				r->mpi_rootbox_cost[reb_get_rootbox_for_particle(r, particles[g.members[0]])] += (double)g.n*g.n_members;
+#endif // MPI
+				for (int c=0; c<g.n_mcells; c++){
+					const struct reb_treecell* const node = g.mcells[c];
+					for (int m=0; m<g.n_members; m++){
+						const int i = g.members[m];
+						const double dx = gb.shiftx + particles[i].x - node->mx;
+						const double dy = gb.shifty + particles[i].y - node->my;
+						const double dz = gb.shiftz + particles[i].z - node->mz;
+						const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+						reb_calculate_acceleration_for_particle_from_multipoles(r, i, r->tree_multipoles + node->mp, dx, dy, dz, _r);
+					}
+				}
+			}
+			}
+			}
+		}
+		free(g.list);
+		free(g.mcells);
+		free(g.members);
+	}
+	free(groups);
+}
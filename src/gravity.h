@@ -35,6 +35,9 @@ void reb_calculate_acceleration(struct reb_simulation* r);
 
 /**
   * The function calculates the acceleration for the variational equations.
+  * The N_var variational particles are stored as k=N_var/(N-N_var) consecutive 
+  * sets, each with one variational particle per real particle. The tidal tensor
+  * of each pair of real particles is calculated once and applied to all k sets.
   */
 void reb_calculate_acceleration_var(struct reb_simulation* r);
 
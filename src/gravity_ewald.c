@@ -0,0 +1,327 @@
+/**
+ * @file 	gravity_ewald.c
+ * @brief 	Periodic direct summation gravity with a tabulated Ewald correction.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ * @details	The acceleration due to a unit mass and all its periodic images 
+ * is split into a short range part, summed in real space, and a long range 
+ * part, summed in Fourier space (Hernquist, Bouchet & Suto 1991):
+ *
+ *   a(x) = - sum_n (x-n)/|x-n|^3 [erfc(alpha|x-n|) + 2 alpha|x-n|/sqrt(pi) exp(-alpha^2|x-n|^2)]
+ *          - 4 pi/V sum_{k!=0} k/k^2 exp(-k^2/(4 alpha^2)) sin(k.x)
+ *
+ * The correction a(x) + x/|x|^3 is smooth, odd in x and tabulated on a 
+ * regular grid in one octant of the box.
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rebound.h"
+#include "gravity_ewald.h"
+#include "gravity_simd.h"
+#ifdef OPENMP
+#include <omp.h>
+#endif // OPENMP
+
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
+#define REB_EWALD_N1 (REB_EWALD_N+1)    ///< Number of table entries per direction
+
+/**
+ * @brief Ewald sum of the correction at one separation.
+ * @param L Size of the box in each direction.
+ * @param alpha Splitting parameter, 1/length.
+ * @param nmax Number of images in real space in each direction.
+ * @param hmax Number of wave vectors in Fourier space in each direction.
+ * @param x Separation.
+ * @param c Correction (output).
+ */
+static void reb_gravity_ewald_sum(const double L[3], const double alpha, const int nmax[3], const int hmax[3], const double x[3], double c[3]){
+	const double rcut = 5./alpha;
+	const double V = L[0]*L[1]*L[2];
+	c[0] = 0.; c[1] = 0.; c[2] = 0.;
+	// Real space
+	for (int nx=-nmax[0]; nx<=nmax[0]; nx++){
+	for (int ny=-nmax[1]; ny<=nmax[1]; ny++){
+	for (int nz=-nmax[2]; nz<=nmax[2]; nz++){
+		const double dx = x[0]-nx*L[0];
+		const double dy = x[1]-ny*L[1];
+		const double dz = x[2]-nz*L[2];
+		const double r2 = dx*dx + dy*dy + dz*dz;
+		if (r2==0. || r2>rcut*rcut) continue;
+		const double _r = sqrt(r2);
+		double f = (erfc(alpha*_r) + 2.*alpha*_r/sqrt(M_PI)*exp(-alpha*alpha*r2))/(r2*_r);
+		if (nx==0 && ny==0 && nz==0){
+			f -= 1./(r2*_r); // Remove the nearest image.
+		}
+		c[0] -= f*dx;
+		c[1] -= f*dy;
+		c[2] -= f*dz;
+	}
+	}
+	}
+	// Fourier space, k and -k contribute equally.
+	for (int hx=0; hx<=hmax[0]; hx++){
+	for (int hy=-hmax[1]; hy<=hmax[1]; hy++){
+	for (int hz=-hmax[2]; hz<=hmax[2]; hz++){
+		if (hx==0 && (hy<0 || (hy==0 && hz<=0))) continue;
+		const double kx = 2.*M_PI*hx/L[0];
+		const double ky = 2.*M_PI*hy/L[1];
+		const double kz = 2.*M_PI*hz/L[2];
+		const double k2 = kx*kx + ky*ky + kz*kz;
+		const double f = 8.*M_PI/V/k2*exp(-k2/(4.*alpha*alpha))*sin(kx*x[0] + ky*x[1] + kz*x[2]);
+		c[0] -= f*kx;
+		c[1] -= f*ky;
+		c[2] -= f*kz;
+	}
+	}
+	}
+}
+
+/**
+ * @brief Calculates the correction table if the box size has changed.
+ * @param r REBOUND simulation to consider
+ */
+static void reb_gravity_ewald_table(struct reb_simulation* const r){
+	const double L[3] = {r->boxsize.x, r->boxsize.y, r->boxsize.z};
+	if (r->gravity_ewald_table!=NULL && r->gravity_ewald_boxsize.x==L[0] && r->gravity_ewald_boxsize.y==L[1] && r->gravity_ewald_boxsize.z==L[2]){
+		return;
+	}
+	if (L[0]<=0. || L[1]<=0. || L[2]<=0.){
+		reb_exit("REB_GRAVITY_EWALD requires a box. Call reb_configure_box() first.");
+	}
+	if (r->gravity_ewald_table==NULL){
+		r->gravity_ewald_table = malloc(sizeof(double)*3*REB_EWALD_N1*REB_EWALD_N1*REB_EWALD_N1);
+	}
+	r->gravity_ewald_boxsize.x = L[0];
+	r->gravity_ewald_boxsize.y = L[1];
+	r->gravity_ewald_boxsize.z = L[2];
+	// Choose the number of terms for a relative accuracy of about 1e-12.
+	const double alpha = 2./cbrt(L[0]*L[1]*L[2]);
+	int nmax[3];
+	int hmax[3];
+	for (int d=0; d<3; d++){
+		nmax[d] = (int)ceil(5./(alpha*L[d])+0.5);
+		hmax[d] = (int)ceil(10.5*alpha*L[d]/(2.*M_PI));
+	}
+	double* const table = r->gravity_ewald_table;
+#pragma omp parallel for schedule(dynamic)
+	for (int i=0; i<REB_EWALD_N1; i++){
+		for (int j=0; j<REB_EWALD_N1; j++){
+		for (int k=0; k<REB_EWALD_N1; k++){
+			const double x[3] = {0.5*L[0]*i/REB_EWALD_N, 0.5*L[1]*j/REB_EWALD_N, 0.5*L[2]*k/REB_EWALD_N};
+			double* const c = table + 3*((i*REB_EWALD_N1+j)*REB_EWALD_N1+k);
+			reb_gravity_ewald_sum(L, alpha, nmax, hmax, x, c);
+			// The correction is odd in each direction.
+			if (i==0) c[0] = 0.;
+			if (j==0) c[1] = 0.;
+			if (k==0) c[2] = 0.;
+		}
+		}
+	}
+}
+
+/**
+ * @brief Interpolates the correction table. The table needs to be up to date.
+ * @param table Correction table.
+ * @param ihL Number of table cells per unit length in each direction (REB_EWALD_N divided by half the box size).
+ * @param dx x component of the nearest image separation.
+ * @param dy y component of the nearest image separation.
+ * @param dz z component of the nearest image separation.
+ * @param c Correction (output).
+ */
+static inline void reb_gravity_ewald_interpolate(const double* const table, const double ihL[3], const double dx, const double dy, const double dz, double c[3]){
+	const double ux = fabs(dx)*ihL[0];
+	const double uy = fabs(dy)*ihL[1];
+	const double uz = fabs(dz)*ihL[2];
+	const int ix = MIN((int)ux, REB_EWALD_N-1);
+	const int iy = MIN((int)uy, REB_EWALD_N-1);
+	const int iz = MIN((int)uz, REB_EWALD_N-1);
+	const double fx = ux-ix;
+	const double fy = uy-iy;
+	const double fz = uz-iz;
+	const double* const t000 = table + 3*((ix*REB_EWALD_N1+iy)*REB_EWALD_N1+iz);
+	const double* const t100 = t000 + 3*REB_EWALD_N1*REB_EWALD_N1;
+	const double* const t010 = t000 + 3*REB_EWALD_N1;
+	const double* const t110 = t100 + 3*REB_EWALD_N1;
+	// Interpolate in z, then y, then x.
+	double cx[4];
+	double cy[4];
+	double cz[4];
+	const double* const t[4] = {t000, t010, t100, t110};
+	for (int l=0; l<4; l++){
+		cx[l] = t[l][0] + fz*(t[l][3]-t[l][0]);
+		cy[l] = t[l][1] + fz*(t[l][4]-t[l][1]);
+		cz[l] = t[l][2] + fz*(t[l][5]-t[l][2]);
+	}
+	const double x0 = cx[0] + fy*(cx[1]-cx[0]);
+	const double x1 = cx[2] + fy*(cx[3]-cx[2]);
+	const double y0 = cy[0] + fy*(cy[1]-cy[0]);
+	const double y1 = cy[2] + fy*(cy[3]-cy[2]);
+	const double z0 = cz[0] + fy*(cz[1]-cz[0]);
+	const double z1 = cz[2] + fy*(cz[3]-cz[2]);
+	// The correction is odd in each direction.
+	c[0] = copysign(1.,dx)*(x0 + fx*(x1-x0));
+	c[1] = copysign(1.,dy)*(y0 + fx*(y1-y0));
+	c[2] = copysign(1.,dz)*(z0 + fx*(z1-z0));
+}
+
+struct reb_vec3d reb_gravity_ewald_correction(struct reb_simulation* const r, const double dx, const double dy, const double dz){
+	reb_gravity_ewald_table(r);
+	const double ihL[3] = {2.*REB_EWALD_N/r->boxsize.x, 2.*REB_EWALD_N/r->boxsize.y, 2.*REB_EWALD_N/r->boxsize.z};
+	double c[3];
+	reb_gravity_ewald_interpolate(r->gravity_ewald_table, ihL, dx, dy, dz, c);
+	struct reb_vec3d v = {.x = c[0], .y = c[1], .z = c[2]};
+	return v;
+}
+
+/**
+ * @brief Nearest image separation and pair acceleration per unit mass (without G).
+ * @param r REBOUND simulation to consider
+ * @param dx x component of the separation (input), of the pair acceleration (output).
+ * @param dy y component of the separation (input), of the pair acceleration (output).
+ * @param dz z component of the separation (input), of the pair acceleration (output).
+ */
+static inline void reb_gravity_ewald_pair(const struct reb_simulation* const r, double* const dx, double* const dy, double* const dz){
+	const double Lx = r->boxsize.x;
+	const double Ly = r->boxsize.y;
+	const double Lz = r->boxsize.z;
+	const double ihL[3] = {2.*REB_EWALD_N/Lx, 2.*REB_EWALD_N/Ly, 2.*REB_EWALD_N/Lz};
+	// Nearest image. Particles are inside the box, so one shift is enough.
+	// Written without branches, because the shifts are unpredictable.
+	double x = *dx;
+	double y = *dy;
+	double z = *dz;
+	x += Lx*((x<-0.5*Lx) - (x>0.5*Lx));
+	y += Ly*((y<-0.5*Ly) - (y>0.5*Ly));
+	z += Lz*((z<-0.5*Lz) - (z>0.5*Lz));
+	const double r2 = x*x + y*y + z*z + r->softening*r->softening;
+	const double _r = sqrt(r2);
+	const double prefact = -1./(r2*_r);
+	double c[3];
+	reb_gravity_ewald_interpolate(r->gravity_ewald_table, ihL, x, y, z, c);
+	*dx = prefact*x + c[0];
+	*dy = prefact*y + c[1];
+	*dz = prefact*z + c[2];
+}
+
+void reb_gravity_ewald(struct reb_simulation* const r){
+	reb_gravity_ewald_table(r);
+	struct reb_particle* const particles = r->particles;
+	const int N = r->N - r->N_var;
+	const int N_active = (r->N_active==-1)?N:r->N_active;
+	const double G = r->G;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	// Copy positions and masses of all massive particles into SoA buffer.
+	reb_gravity_simd_pack(r, N_active);
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+#ifdef OPENMP
+	const int nthreads = omp_get_max_threads();
+#else // OPENMP
+	const int nthreads = 1;
+#endif // OPENMP
+	// Massive particles: the correction is odd, so each pair is evaluated only once.
+	// One accumulation buffer (ax, ay, az) per thread.
+	if (r->gravity_thread_buffer_allocatedN<nthreads*3*stride){
+		free(r->gravity_thread_buffer);
+		if (posix_memalign((void**)&(r->gravity_thread_buffer), 64, nthreads*3*stride*sizeof(double))){
+			reb_exit("Cannot allocate memory for gravity accumulation buffers.");
+		}
+		r->gravity_thread_buffer_allocatedN = nthreads*3*stride;
+	}
+	double* restrict const buffer = r->gravity_thread_buffer;
+	int nthreads_used = 1;
+#pragma omp parallel
+	{
+		int tid = 0;
+#ifdef OPENMP
+		tid = omp_get_thread_num();
+#pragma omp single
+		nthreads_used = omp_get_num_threads();
+#endif // OPENMP
+		double* restrict const accx = buffer + tid*3*stride;
+		double* restrict const accy = accx + stride;
+		double* restrict const accz = accx + 2*stride;
+		memset(accx, 0, 3*stride*sizeof(double));
+		// Static schedule: the partial sums of each buffer do not depend on timing.
+#pragma omp for schedule(static,16)
+		for (int i=0; i<N_active; i++){
+			double ax = 0.;
+			double ay = 0.;
+			double az = 0.;
+			for (int j=i+1; j<N_active; j++){
+				if (_gravity_ignore_10 && j==1 && i==0 ) continue;
+				double dx = bx[i] - bx[j];
+				double dy = by[i] - by[j];
+				double dz = bz[i] - bz[j];
+				reb_gravity_ewald_pair(r, &dx, &dy, &dz);
+				ax += bm[j]*dx;
+				ay += bm[j]*dy;
+				az += bm[j]*dz;
+				accx[j] -= bm[i]*dx;
+				accy[j] -= bm[i]*dy;
+				accz[j] -= bm[i]*dz;
+			}
+			accx[i] += ax;
+			accy[i] += ay;
+			accz[i] += az;
+		}
+	}
+	// Reduce thread buffers in a fixed order.
+#pragma omp parallel for schedule(static)
+	for (int j=0; j<N_active; j++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int t=0; t<nthreads_used; t++){
+			const double* const acc = buffer + t*3*stride;
+			ax += acc[j];
+			ay += acc[stride+j];
+			az += acc[2*stride+j];
+		}
+		particles[j].ax = G*ax;
+		particles[j].ay = G*ay;
+		particles[j].az = G*az;
+	}
+	// Test particles
+#pragma omp parallel for schedule(guided)
+	for (int i=N_active; i<N; i++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int j=(_gravity_ignore_10 && i==1)?1:0; j<N_active; j++){
+			double dx = particles[i].x - bx[j];
+			double dy = particles[i].y - by[j];
+			double dz = particles[i].z - bz[j];
+			reb_gravity_ewald_pair(r, &dx, &dy, &dz);
+			ax += bm[j]*dx;
+			ay += bm[j]*dy;
+			az += bm[j]*dz;
+		}
+		particles[i].ax = G*ax;
+		particles[i].ay = G*ay;
+		particles[i].az = G*az;
+	}
+}
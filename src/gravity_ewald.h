@@ -0,0 +1,60 @@
+/**
+ * @file 	gravity_ewald.h
+ * @brief 	Periodic direct summation gravity with a tabulated Ewald correction.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _GRAVITY_EWALD_H
+#define _GRAVITY_EWALD_H
+struct reb_simulation;
+
+/**
+ * @brief Number of cells of the Ewald correction table per half box in every direction.
+ */
+#define REB_EWALD_N 32
+
+/**
+ * @brief Calculates the gravitational accelerations in a periodic box with Ewald summation.
+ * @details Every pair of particles interacts once, via the nearest periodic image. 
+ * The force of all other images (and of a uniform background which makes the 
+ * total density zero) is added from a table of the Ewald correction, which is 
+ * interpolated trilinearly. The table covers one octant of the box and is 
+ * recalculated only if the size of the box changes. Softening is only applied 
+ * to the nearest image. Ghost boxes are not used.
+ * @param r REBOUND simulation to consider
+ */
+void reb_gravity_ewald(struct reb_simulation* const r);
+
+/**
+ * @brief Returns the Ewald correction to the acceleration caused by a unit mass (G=1).
+ * @details The correction is the acceleration at the separation (dx,dy,dz) due to all 
+ * periodic images of the unit mass and the background, minus the acceleration 
+ * due to the nearest image. The separation needs to be the nearest image separation. 
+ * Calculates the table if needed.
+ * @param r REBOUND simulation to consider
+ * @param dx x component of the separation.
+ * @param dy y component of the separation.
+ * @param dz z component of the separation.
+ * @return Correction to the acceleration.
+ */
+struct reb_vec3d reb_gravity_ewald_correction(struct reb_simulation* const r, const double dx, const double dy, const double dz);
+
+#endif // _GRAVITY_EWALD_H
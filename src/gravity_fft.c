@@ -0,0 +1,448 @@
+/**
+ * @file 	gravity_fft.c
+ * @brief 	Particle mesh (PM) and TreePM gravity using FFTW.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>, Geoffroy Lesur <geoffroy.lesur@obs.ujf-grenoble.fr>
+ *
+ * @details 	This is a 2D FFT Poisson solver for periodic and shearing sheet boxes.
+ * 		The number of grid points is set by fft_nx and fft_ny. 
+ *
+ * 		If fft_rcut>0, the force of a particle is split into a long range 
+ * 		part, calculated on the grid, and a short range part, calculated 
+ * 		with the tree. The long range potential is 
+ *
+ * 		  phi_L(R) = -G m/rcut (15/8 - 5/4 u^2 + 3/8 u^4),  u = R/rcut < 1
+ * 		  phi_L(R) = -G m/R,                                u >= 1
+ *
+ * 		which is twice continuously differentiable. The short range force 
+ * 		vanishes beyond rcut. The Fourier transform of the long range potential 
+ * 		in the plane of the disc is -2 pi G m/k h(k) with 
+ *
+ * 		  h(k) = 1 - k int_0^rcut (1 - R phi_L(R)/(-G m)) J0(kR) dR.
+ *
+ * 		h(k) is tabulated when the grid is set up.
+ * 
+ * @section LICENSE
+ * Copyright (c) 2011 Hanno Rein, Shangfei Liu, Geoffroy Lesur
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifdef FFTW
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fftw3.h>
+#include "rebound.h"
+#include "tree.h"
+#include "boundary.h"
+#include "gravity_fft.h"
+
+#define REB_FFT_HN 4096	///< Number of entries in the table of the long range filter h(k)
+
+/**
+ * @brief Grid, wave vectors and FFTW plans used by REB_GRAVITY_FFT.
+ */
+struct reb_fft_data {
+	int nx;			///< Number of grid points in x direction
+	int ny;			///< Number of grid points in y direction
+	double Lx;		///< Size of the box in x direction
+	double Ly;		///< Size of the box in y direction
+	double rcut;		///< Split radius of TreePM (0 for PM only)
+	int shear;		///< 1 if the box is a shearing sheet
+	double dx;		///< Grid spacing in x direction
+	double dy;		///< Grid spacing in y direction
+	int ncomplex;		///< Number of complex grid points, nx*(ny/2+1)
+	double* kx;		///< Wave vector in x direction
+	double* ky;		///< Wave vector in y direction
+	double* h;		///< Long range filter h(k), tabulated in k (TreePM only)
+	double hdk;		///< Spacing of the table h
+	double* density;	///< Surface density, real or complex (in place transform)
+	double* fx;		///< Force in x direction, real or complex
+	double* fy;		///< Force in y direction, real or complex
+	double* w1d;		///< Temporary 1D array for remapping (shearing sheet only)
+	fftw_plan r2cfft;	///< FFT plan real to complex
+	fftw_plan c2rfft;	///< FFT plan complex to real
+	fftw_plan for1dfft;	///< FFT plan for remapping (1D, shearing sheet only)
+	fftw_plan bac1dfft;	///< FFT plan for remapping (1D, shearing sheet only)
+};
+
+void reb_gravity_fft_free(struct reb_simulation* const r){
+	struct reb_fft_data* const d = r->gravity_fft_data;
+	if (d==NULL) return;
+	fftw_destroy_plan(d->r2cfft);
+	fftw_destroy_plan(d->c2rfft);
+	if (d->shear){
+		fftw_destroy_plan(d->for1dfft);
+		fftw_destroy_plan(d->bac1dfft);
+		fftw_free(d->w1d);
+	}
+	fftw_free(d->kx);
+	fftw_free(d->ky);
+	fftw_free(d->density);
+	fftw_free(d->fx);
+	fftw_free(d->fy);
+	free(d->h);
+	free(d);
+	r->gravity_fft_data = NULL;
+}
+
+/**
+ * @brief Long range part of the potential of a unit mass times -R, as a function of u=R/rcut<1.
+ */
+static double reb_gravity_fft_long_range(const double u){
+	return u*(15./8. - 5./4.*u*u + 3./8.*u*u*u*u);
+}
+
+/**
+ * @brief Tabulates the long range filter h(k) up to the largest wave vector used.
+ * @param d Grid to consider. 
+ * @param kmax Largest wave vector.
+ */
+static void reb_gravity_fft_init_filter(struct reb_fft_data* const d, const double kmax){
+	d->h = malloc(sizeof(double)*(REB_FFT_HN+1));
+	d->hdk = kmax/REB_FFT_HN;
+	const int nq = 512; // Simpson's rule, the integrand is a polynomial times J0.
+	const double du = 1./nq;
+	for (int i=0; i<=REB_FFT_HN; i++){
+		const double krc = i*d->hdk*d->rcut;
+		double sum = 0.;
+		for (int q=0; q<=nq; q++){
+			const double u = q*du;
+			const double f = (1.-reb_gravity_fft_long_range(u))*j0(krc*u);
+			sum += ((q==0 || q==nq)?1.:((q%2)?4.:2.))*f;
+		}
+		d->h[i] = 1.-krc*sum*du/3.;
+	}
+}
+
+/**
+ * @brief Allocates the grid and creates the FFTW plans if the grid or box has changed.
+ * @param r REBOUND simulation to consider
+ */
+static void reb_gravity_fft_init(struct reb_simulation* const r){
+	struct reb_fft_data* d = r->gravity_fft_data;
+	const int shear = r->boundary==REB_BOUNDARY_SHEAR;
+	if (d!=NULL && d->nx==r->fft_nx && d->ny==r->fft_ny && d->Lx==r->boxsize.x && d->Ly==r->boxsize.y && d->rcut==r->fft_rcut && d->shear==shear){
+		return;
+	}
+	if (r->fft_nx<=0 || r->fft_ny<=0 || r->fft_ny%2){
+		reb_exit("REB_GRAVITY_FFT needs a positive number of grid points, fft_ny needs to be even.");
+	}
+	if (r->boxsize.x<=0. || r->boxsize.y<=0.){
+		reb_exit("REB_GRAVITY_FFT requires a box. Call reb_configure_box() first.");
+	}
+	reb_gravity_fft_free(r);
+	d = calloc(1, sizeof(struct reb_fft_data));
+	r->gravity_fft_data = d;
+	const int nx = r->fft_nx;
+	const int ny = r->fft_ny;
+	d->nx 		= nx;
+	d->ny 		= ny;
+	d->Lx 		= r->boxsize.x;
+	d->Ly 		= r->boxsize.y;
+	d->rcut 	= r->fft_rcut;
+	d->shear 	= shear;
+	d->dx		= d->Lx/nx;
+	d->dy		= d->Ly/ny;
+	d->ncomplex	= nx*(ny/2+1);
+	
+	// Array allocation
+	d->kx  = (double *) fftw_malloc( sizeof(double) * d->ncomplex);
+	d->ky  = (double *) fftw_malloc( sizeof(double) * d->ncomplex);
+	if (shear){
+		d->w1d = (double *) fftw_malloc( sizeof(double) * ny * 2 );
+	}
+	d->density = (double *) fftw_malloc( sizeof(double) * d->ncomplex * 2);
+	d->fx  = (double *) fftw_malloc( sizeof(double) * d->ncomplex * 2);
+	d->fy  = (double *) fftw_malloc( sizeof(double) * d->ncomplex * 2);
+	
+	// Init wavevectors
+	for(int i = 0; i < nx; i++) {
+		for(int j =0; j < ny/2+1; j++) {
+			const int IDX2D = i * (ny/2+1) + j;
+			d->kx[IDX2D] = (2.0 * M_PI) / d->Lx * (double)((i + nx/2)%nx - nx/2);
+			d->ky[IDX2D] = (2.0 * M_PI) / d->Ly * ((double) j);
+		}
+	}
+	if (d->rcut>0.){
+		// The sheared wave vector kx+shift/Ly*ky is at most |kx|+|ky|.
+		reb_gravity_fft_init_filter(d, 2.*M_PI*(nx/d->Lx+ny/d->Ly));
+	}
+	
+	// Init ffts (use in place fourier transform for efficient memory usage)
+	d->r2cfft = fftw_plan_dft_r2c_2d( nx, ny, d->density, (fftw_complex*)d->density, FFTW_MEASURE);
+	d->c2rfft = fftw_plan_dft_c2r_2d( nx, ny, (fftw_complex*)d->density, d->density, FFTW_MEASURE);
+	if (shear){
+		d->for1dfft = fftw_plan_dft_1d(ny, (fftw_complex*)d->w1d, (fftw_complex*)d->w1d, FFTW_FORWARD, FFTW_MEASURE);
+		d->bac1dfft = fftw_plan_dft_1d(ny, (fftw_complex*)d->w1d, (fftw_complex*)d->w1d, FFTW_BACKWARD, FFTW_MEASURE);
+	}
+}
+
+/**
+ * @brief Assignment function (TSC Scheme)
+ * @details See Hockney and Eastwood (1981), Computer Simulations Using Particles
+ */
+static double reb_gravity_fft_W(double x){
+	if (fabs(x)<=0.5) return 0.75 - x*x;
+	if (fabs(x)>=0.5 && fabs(x)<=3./2.) return 0.5*(3./2.-fabs(x))*(3./2.-fabs(x));
+	return 0; 
+}
+
+/**
+ * @brief Calculates the 9 grid cells a particle is assigned to and their weights.
+ * @details Cells beyond the x boundary of a shearing sheet are shifted in y by the 
+ * nearest number of cells. This is only an approximate mapping.
+ * @param d Grid to consider.
+ * @param shift_shear Shift of the neighbouring box in y direction (shearing sheet only).
+ * @param p Particle to consider.
+ * @param index Index of each cell in the real grid arrays (output).
+ * @param weight Weight of each cell (output).
+ */
+static void reb_gravity_fft_stencil(const struct reb_fft_data* const d, const double shift_shear, const struct reb_particle p, int index[9], double weight[9]){
+	const int nx = d->nx;
+	const int ny = d->ny;
+	// Formally, p.x is in the interval [-Lx/2, Lx/2[. Therefore, x and y should be in [0, n-1].
+	int x = (int) floor((p.x / d->Lx + 0.5) * nx);
+	int y = (int) floor((p.y / d->Ly + 0.5) * ny);
+	x = x<0?0:(x>=nx?nx-1:x);
+	y = y<0?0:(y>=ny?ny-1:y);
+	const int shift_cells = (int)round((shift_shear/d->Ly) * ny);
+	int n = 0;
+	for (int i=-1; i<=1; i++){
+		// Target according to boundary conditions. y depends on x because of the shearing patch.
+		int xTarget = x+i;
+		int yShift = 0;
+		if (xTarget>=nx){
+			xTarget -= nx;
+			yShift = shift_cells;
+		}
+		if (xTarget<0){
+			xTarget += nx;
+			yShift = -shift_cells;
+		}
+		const double tx = ((double)(x+i) +0.5) * d->dx -0.5*d->Lx - p.x;
+		const double wx = reb_gravity_fft_W(tx/d->dx);
+		for (int j=-1; j<=1; j++){
+			const int yTarget = ((y+j+yShift)%ny + ny)%ny;
+			const double ty = ((double)(y+j) +0.5) * d->dy -0.5*d->Ly - p.y;
+			index[n] = (ny+2) * xTarget + yTarget;
+			weight[n] = wx*reb_gravity_fft_W(ty/d->dy);
+			n++;
+		}
+	}
+}
+
+/**
+ * @brief Remaps a real grid in Fourier space to deal with shearing sheet boundary conditions.
+ * @param d Grid to consider.
+ * @param shift_shear Shift of the neighbouring box in y direction.
+ * @param wi Real grid.
+ * @param direction 1 before the forward transform, -1 after the backward transform.
+ */
+static void reb_gravity_fft_remap(struct reb_fft_data* const d, const double shift_shear, double* wi, const double direction) {
+	const int nx = d->nx;
+	const int ny = d->ny;
+	double* const w1d = d->w1d;
+	for(int i = 0 ; i < nx ; i++) {
+		for(int j = 0 ; j < ny ; j++) {
+			w1d[ 2 * j ] = wi[j + (ny + 2) * i];		// w1d is supposed to be a complex array. 
+			w1d[ 2 * j + 1 ] = 0.0;
+		}
+		
+		fftw_execute(d->for1dfft);
+					
+		for(int j = 0 ; j < ny ; j++) {
+			// phase = ky * (-shift_shear)
+			const double phase =  - direction * (2.0 * M_PI) / d->Ly * ((j + (ny / 2)) % ny - ny / 2) * shift_shear * ((double) i) / ((double) nx);
+			const double rew = w1d[2 * j];
+			const double imw = w1d[2 * j + 1];
+			w1d[2 * j    ] = rew * cos(phase) - imw * sin(phase);
+			w1d[2 * j + 1] = rew * sin(phase) + imw * cos(phase);
+			// Throw the Nyquist Frequency (should be useless anyway)
+			if(j==ny/2) {
+				w1d[2 * j    ] = 0.0;
+				w1d[2 * j + 1] = 0.0;
+			}
+		}
+		
+		fftw_execute(d->bac1dfft);
+		
+		for(int j = 0 ; j < ny ; j++) {
+			wi[j + (ny + 2) * i] = w1d[ 2 * j ] / ny;
+		}
+	}
+}
+
+/**
+ * @brief Adds the short range force of a cell and its daughters to a particle (TreePM only).
+ * @param r REBOUND simulation to consider
+ * @param pt Index of the particle receiving the force.
+ * @param node Cell exerting the force.
+ * @param gb Ghostbox plus position of the particle.
+ * @param a Acceleration, without G (input and output).
+ */
+static void reb_gravity_fft_short_range(const struct reb_simulation* const r, const int pt, const struct reb_treecell* const node, const struct reb_ghostbox gb, double a[3]){
+	const double rcut = r->fft_rcut;
+	if (node->pt < 0){
+		// Skip cells which are entirely beyond the split radius.
+		const double cx = gb.shiftx - node->x;
+		const double cy = gb.shifty - node->y;
+		const double cz = gb.shiftz - node->z;
+		const double rmax = rcut + 0.8660254037844386*node->w;
+		if (cx*cx + cy*cy + cz*cz > rmax*rmax) return;
+	}
+	const double dx = gb.shiftx - node->mx;
+	const double dy = gb.shifty - node->my;
+	const double dz = gb.shiftz - node->mz;
+	const double r2 = dx*dx + dy*dy + dz*dz;
+	if (node->pt < 0 && node->w*node->w > r->opening_angle2*r2){
+		for (int o=0; o<8; o++){
+			if (node->oct[o] != NULL){
+				reb_gravity_fft_short_range(r, pt, node->oct[o], gb, a);
+			}
+		}
+		return;
+	}
+	if (node->pt == pt || r2 >= rcut*rcut) return;
+	// Softened Newtonian force minus the long range force.
+	const double rs2 = r2 + r->softening*r->softening;
+	const double u2 = r2/(rcut*rcut);
+	const double prefact = -node->m*(1./(rs2*sqrt(rs2)) - (5./2.-3./2.*u2)/(rcut*rcut*rcut));
+	a[0] += prefact*dx;
+	a[1] += prefact*dy;
+	a[2] += prefact*dz;
+}
+
+void reb_gravity_fft(struct reb_simulation* const r){
+	reb_gravity_fft_init(r);
+	struct reb_fft_data* const d = r->gravity_fft_data;
+	struct reb_particle* const particles = r->particles;
+	const int N = r->N - r->N_var;
+	const int N_active = (r->N_active==-1)?N:r->N_active;
+	const int nx = d->nx;
+	const int ny = d->ny;
+	const double G = r->G;
+	double shift_shear = 0.;
+	if (d->shear){
+		struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, 1, 0, 0);
+		shift_shear = gb.shifty;
+	}
+
+	// Assign the surface density of all massive particles to the grid
+	double* const density = d->density;
+	for(int i = 0 ; i < nx * (ny + 2) ; i++) {
+		density[i] = 0.0;
+	}
+	for (int i=0; i<N_active; i++){
+		int index[9];
+		double weight[9];
+		reb_gravity_fft_stencil(d, shift_shear, particles[i], index, weight);
+		const double q0 = G*particles[i].m/(d->dx*d->dy);
+		for (int n=0; n<9; n++){
+			density[index[n]] += q0*weight[n];
+		}
+	}
+	
+	if (d->shear){
+		// Remap in fourier space to deal with shearing sheet boundary conditions.
+		reb_gravity_fft_remap(d, shift_shear, density, 1);
+	}
+	
+	fftw_execute_dft_r2c(d->r2cfft, density, (fftw_complex*)density);
+	
+	// Inverse Poisson equation
+	double* const fx = d->fx;
+	double* const fy = d->fy;
+	for(int i = 0 ; i < d->ncomplex ; i++) {
+		// Compute time-dependent wave-vectors (shearing sheet only)
+		const double kxt = d->kx[i] + shift_shear/d->Ly * d->ky[i];
+		const double k = sqrt(kxt*kxt + d->ky[i]*d->ky[i]);
+		if (k==0.){
+			// The mean density does not exert a force.
+			fx[2*i] = 0.; fx[2*i+1] = 0.;
+			fy[2*i] = 0.; fy[2*i+1] = 0.;
+			continue;
+		}
+		double filter = 1.;
+		if (d->h){
+			const double u = k/d->hdk;
+			const int iu = (int)u;
+			filter = iu>=REB_FFT_HN?d->h[REB_FFT_HN]:d->h[iu]+(u-iu)*(d->h[iu+1]-d->h[iu]);
+		}
+		const double q0 = - 2.0 * M_PI * filter * density[2*i] / (k * nx * ny);
+		const double q1 = - 2.0 * M_PI * filter * density[2*i+1] / (k * nx * ny);
+		const double sinkxt = sin(kxt * d->dx);
+		const double sinky  = sin(d->ky[i] * d->dy);
+		fx[2*i]		=   q1 * sinkxt / d->dx;	// Real part of Fx
+		fx[2*i+1] 	= - q0 * sinkxt / d->dx;	// Imaginary part of Fx
+		fy[2*i]		=   q1 * sinky  / d->dy;	
+		fy[2*i+1] 	= - q0 * sinky  / d->dy;
+	}
+	
+	// Transform back the force field
+	fftw_execute_dft_c2r(d->c2rfft, (fftw_complex*)fx, fx);
+	fftw_execute_dft_c2r(d->c2rfft, (fftw_complex*)fy, fy);
+	
+	if (d->shear){
+		reb_gravity_fft_remap(d, shift_shear, fx, -1);
+		reb_gravity_fft_remap(d, shift_shear, fy, -1);
+	}
+
+	// Interpolate the force back to the particles
+#pragma omp parallel for schedule(guided)
+	for(int i=0; i<N; i++){
+		int index[9];
+		double weight[9];
+		reb_gravity_fft_stencil(d, shift_shear, particles[i], index, weight);
+		double ax = 0.;
+		double ay = 0.;
+		for (int n=0; n<9; n++){
+			ax += fx[index[n]]*weight[n];
+			ay += fy[index[n]]*weight[n];
+		}
+		particles[i].ax = ax;
+		particles[i].ay = ay;
+		particles[i].az = 0.;
+	}
+	
+	if (d->rcut<=0. || r->tree_root==NULL) return;
+	// Short range force from the tree (TreePM)
+	for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
+	for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
+	for (int gbz=-r->nghostz; gbz<=r->nghostz; gbz++){
+		const struct reb_ghostbox gb0 = reb_boundary_get_ghostbox(r, gbx, gby, gbz);
+#pragma omp parallel for schedule(guided)
+		for (int i=0; i<N; i++){
+			struct reb_ghostbox gb = gb0;
+			gb.shiftx += particles[i].x;
+			gb.shifty += particles[i].y;
+			gb.shiftz += particles[i].z;
+			double a[3] = {0., 0., 0.};
+			for (int ri=0; ri<r->root_n; ri++){
+				struct reb_treecell* node = r->tree_root[ri];
+				if (node!=NULL){
+					reb_gravity_fft_short_range(r, i, node, gb, a);
+				}
+			}
+			particles[i].ax += G*a[0];
+			particles[i].ay += G*a[1];
+			particles[i].az += G*a[2];
+		}
+	}
+	}
+	}
+}
+#endif // FFTW
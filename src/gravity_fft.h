@@ -0,0 +1,48 @@
+/**
+ * @file 	gravity_fft.h
+ * @brief 	Particle mesh (PM) and TreePM gravity using FFTW.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _GRAVITY_FFT_H
+#define _GRAVITY_FFT_H
+struct reb_simulation;
+
+/**
+ * @brief Calculates the gravitational accelerations on a two dimensional grid using an FFT.
+ * @details The surface density is assigned to a grid of fft_nx x fft_ny cells covering 
+ * the box (TSC scheme), the Poisson equation of a razor thin disc is solved in 
+ * Fourier space and the forces are interpolated back to the particles. Works for 
+ * periodic boxes and the shearing sheet (the density is remapped in Fourier space). 
+ * If fft_rcut is larger than 0, only the long range part of the force is calculated 
+ * on the grid and the short range part (within fft_rcut) is added with the tree (TreePM).
+ * Only available if REBOUND is compiled with FFTW=1.
+ * @param r REBOUND simulation to consider
+ */
+void reb_gravity_fft(struct reb_simulation* const r);
+
+/**
+ * @brief Frees the grid, wave vectors and FFTW plans used by REB_GRAVITY_FFT.
+ * @param r REBOUND simulation to consider
+ */
+void reb_gravity_fft_free(struct reb_simulation* const r);
+
+#endif // _GRAVITY_FFT_H
@@ -0,0 +1,610 @@
+/**
+ * @file 	gravity_fmm.c
+ * @brief 	Fast multipole method (FMM) gravity solver.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @details 	The fast multipole method reuses the oct tree of REB_GRAVITY_TREE.
+ * Each cell gets a multipole expansion of its particles (P2M, M2M) in an upward
+ * pass. Well separated pairs of cells then interact via local expansions (M2L),
+ * while nearby leaf cells interact directly (P2P). In a downward pass, the local
+ * expansions are shifted to the daughter cells (L2L) and evaluated at the
+ * particle positions (L2P). The cost scales as O(N) for a fixed expansion order.
+ *
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rebound.h"
+#include "tree.h"
+#include "boundary.h"
+#include "gravity_fmm.h"
+#ifdef OPENMP
+#include <omp.h>
+#endif // OPENMP
+
+/*
+ * All expansions are Cartesian Taylor series in multi-indices n=(nx,ny,nz), 
+ * with d^n = dx^nx*dy^ny*dz^nz and C(n,k) = C(nx,kx)*C(ny,ky)*C(nz,kz).
+ * - Multipole of a cell with center z:	Q_n = sum_i m_i (x_i-z)^n
+ * - Local expansion about center z:	phi(z+e) = -G sum_k L_k e^k
+ * - Taylor coefficients of 1/|R|:	T_n = (d/dR)^n (1/|R|) / n!
+ * - M2L:	L_k += sum_n (-1)^|n| C(n+k,k) Q_n T_{n+k}(R), for |n|+|k| <= order
+ * - M2M:	Q'_n += sum_{j<=n} C(n,j) s^{n-j} Q_j
+ * - L2L:	L'_j += sum_{k>=j} C(k,j) t^{k-j} L_k
+ */
+
+/**
+ * @brief Precomputed multi-index tables for one expansion order.
+ */
+struct reb_fmm_tables {
+	int order;	///< Expansion order
+	int nc;		///< Number of coefficients (multi-indices with |n|<=order)
+	int* n;		///< Multi-indices, 3 per coefficient, sorted by |n|
+	int* m1;	///< Index of n-e_i for i=0,1,2 (3 per coefficient, -1 if n_i==0)
+	int* m2;	///< Index of n-2e_i for i=0,1,2 (3 per coefficient, -1 if n_i<2)
+	int n_m2l;	///< Number of terms in M2L
+	int* m2l;	///< Indices k, n, n+k of each M2L term
+	double* m2l_c;	///< Coefficient (-1)^|n| C(n+k,k) of each M2L term
+	int n_shift;	///< Number of terms in M2M and L2L
+	int* shift;	///< Indices n, j, n-j of each shift term
+	double* shift_c;///< Coefficient C(n,j) of each shift term
+};
+
+static double reb_fmm_binomial(const int n, const int k){
+	double c = 1.;
+	for (int i=1; i<=k; i++){
+		c = c*(double)(n-k+i)/(double)i;
+	}
+	return c;
+}
+
+static void reb_fmm_tables_init(struct reb_fmm_tables* const t, const int order){
+	t->order = order;
+	t->nc = (order+1)*(order+2)*(order+3)/6;
+	const int nc = t->nc;
+	const int o1 = order+1;
+	int* const lookup = malloc(o1*o1*o1*sizeof(int));
+	for (int i=0; i<o1*o1*o1; i++) lookup[i] = -1;
+	t->n = malloc(3*nc*sizeof(int));
+	int c = 0;
+	for (int o=0; o<=order; o++){
+		for (int nx=o; nx>=0; nx--){
+			for (int ny=o-nx; ny>=0; ny--){
+				const int nz = o-nx-ny;
+				t->n[3*c+0] = nx;
+				t->n[3*c+1] = ny;
+				t->n[3*c+2] = nz;
+				lookup[(nx*o1+ny)*o1+nz] = c;
+				c++;
+			}
+		}
+	}
+	t->m1 = malloc(3*nc*sizeof(int));
+	t->m2 = malloc(3*nc*sizeof(int));
+	for (int c=0; c<nc; c++){
+		const int* const n = t->n+3*c;
+		for (int i=0; i<3; i++){
+			int d[3] = {n[0], n[1], n[2]};
+			d[i] -= 1;
+			t->m1[3*c+i] = d[i]>=0?lookup[(d[0]*o1+d[1])*o1+d[2]]:-1;
+			d[i] -= 1;
+			t->m2[3*c+i] = d[i]>=0?lookup[(d[0]*o1+d[1])*o1+d[2]]:-1;
+		}
+	}
+	// M2L terms: all pairs with |n|+|k|<=order.
+	t->n_m2l = 0;
+	t->m2l = malloc(3*nc*nc*sizeof(int));
+	t->m2l_c = malloc(nc*nc*sizeof(double));
+	// Shift terms: all pairs with j<=n component-wise.
+	t->n_shift = 0;
+	t->shift = malloc(3*nc*nc*sizeof(int));
+	t->shift_c = malloc(nc*nc*sizeof(double));
+	for (int k=0; k<nc; k++){
+		const int* const kk = t->n+3*k;
+		for (int n=0; n<nc; n++){
+			const int* const nn = t->n+3*n;
+			const int onk = kk[0]+kk[1]+kk[2]+nn[0]+nn[1]+nn[2];
+			if (onk<=order){
+				const int nk = lookup[((kk[0]+nn[0])*o1+kk[1]+nn[1])*o1+kk[2]+nn[2]];
+				t->m2l[3*t->n_m2l+0] = k;
+				t->m2l[3*t->n_m2l+1] = n;
+				t->m2l[3*t->n_m2l+2] = nk;
+				t->m2l_c[t->n_m2l] = ((nn[0]+nn[1]+nn[2])%2?-1.:1.)
+					*reb_fmm_binomial(nn[0]+kk[0],kk[0])
+					*reb_fmm_binomial(nn[1]+kk[1],kk[1])
+					*reb_fmm_binomial(nn[2]+kk[2],kk[2]);
+				t->n_m2l++;
+			}
+			// Here k plays the role of n, and n the role of j.
+			if (nn[0]<=kk[0] && nn[1]<=kk[1] && nn[2]<=kk[2]){
+				t->shift[3*t->n_shift+0] = k;
+				t->shift[3*t->n_shift+1] = n;
+				t->shift[3*t->n_shift+2] = lookup[((kk[0]-nn[0])*o1+kk[1]-nn[1])*o1+kk[2]-nn[2]];
+				t->shift_c[t->n_shift] = reb_fmm_binomial(kk[0],nn[0])
+					*reb_fmm_binomial(kk[1],nn[1])
+					*reb_fmm_binomial(kk[2],nn[2]);
+				t->n_shift++;
+			}
+		}
+	}
+	free(lookup);
+}
+
+static void reb_fmm_tables_free(struct reb_fmm_tables* const t){
+	free(t->n);
+	free(t->m1);
+	free(t->m2);
+	free(t->m2l);
+	free(t->m2l_c);
+	free(t->shift);
+	free(t->shift_c);
+}
+
+/**
+ * @brief Calculates the monomials d^n for all multi-indices n.
+ */
+static inline void reb_fmm_powers(const struct reb_fmm_tables* const t, double* const pw, const double dx, const double dy, const double dz){
+	const double d[3] = {dx, dy, dz};
+	pw[0] = 1.;
+	for (int c=1; c<t->nc; c++){
+		// Use the first non-zero component.
+		const int i = t->m1[3*c+0]>=0?0:(t->m1[3*c+1]>=0?1:2);
+		pw[c] = pw[t->m1[3*c+i]]*d[i];
+	}
+}
+
+/**
+ * @brief Calculates the Taylor coefficients T_n of 1/|R| with a recurrence relation.
+ * @details |n| R^2 T_n + (2|n|-1) sum_i R_i T_{n-e_i} + (|n|-1) sum_i T_{n-2e_i} = 0
+ */
+static inline void reb_fmm_derivatives(const struct reb_fmm_tables* const t, double* const T, const double Rx, const double Ry, const double Rz){
+	const double R[3] = {Rx, Ry, Rz};
+	const double r2 = Rx*Rx + Ry*Ry + Rz*Rz;
+	const double r2inv = 1./r2;
+	T[0] = sqrt(r2inv);
+	for (int c=1; c<t->nc; c++){
+		const int* const n = t->n+3*c;
+		const int o = n[0]+n[1]+n[2];
+		double s1 = 0.;
+		double s2 = 0.;
+		for (int i=0; i<3; i++){
+			if (t->m1[3*c+i]>=0) s1 += R[i]*T[t->m1[3*c+i]];
+			if (t->m2[3*c+i]>=0) s2 += T[t->m2[3*c+i]];
+		}
+		T[c] = -((2*o-1)*s1 + (o-1)*s2)*r2inv/(double)o;
+	}
+}
+
+/**
+ * @brief Shared state of one FMM force calculation.
+ */
+struct reb_fmm {
+	struct reb_simulation* r;		///< Simulation
+	struct reb_fmm_tables t;		///< Multi-index tables
+	struct reb_fmm_cell* cells;		///< Cell bookkeeping, indexed by reb_treecell.fmm
+	double* M;				///< Multipole expansions, nc per cell
+	double* L;				///< Local expansions, nc per cell
+	int* list;				///< Particle indices, sorted by cell
+	double* px;				///< x positions in the order of list
+	double* py;				///< y positions in the order of list
+	double* pz;				///< z positions in the order of list
+	double* pm;				///< Masses in the order of list
+	double* pax;				///< Accelerations from P2P (without G) in the order of list
+	double* pay;				///< Accelerations from P2P (without G) in the order of list
+	double* paz;				///< Accelerations from P2P (without G) in the order of list
+	int ncrit;				///< Maximum number of particles in a leaf
+	int p2p_max;				///< Use P2P instead of M2L if na*nb is smaller than this
+	double theta2;				///< Square of the opening angle
+};
+
+static int reb_fmm_count_cells(const struct reb_treecell* const node){
+	if (node==NULL) return 0;
+	int n = 1;
+	if (node->pt<0){
+		for (int o=0; o<8; o++){
+			n += reb_fmm_count_cells(node->oct[o]);
+		}
+	}
+	return n;
+}
+
+static void reb_fmm_collect_particles(struct reb_fmm* const f, const struct reb_treecell* const node, int* const np){
+	if (node==NULL) return;
+	if (node->pt>=0){
+		f->list[(*np)++] = node->pt;
+	}else{
+		for (int o=0; o<8; o++){
+			reb_fmm_collect_particles(f, node->oct[o], np);
+		}
+	}
+}
+
+/**
+ * @brief Upward pass: P2M in leaves, M2M in all other cells.
+ * @details Expansions are centered on the center of mass of each cell, so that the dipole
+ * moment vanishes. Also copies the particles into the SoA buffer in the order of the 
+ * particle index list.
+ */
+static void reb_fmm_upward(struct reb_fmm* const f, struct reb_treecell* const node, int* const ncells, int* const np, double* const pw){
+	const struct reb_fmm_tables* const t = &f->t;
+	const int nc = t->nc;
+	const int id = (*ncells)++;
+	node->fmm = id;
+	struct reb_fmm_cell* const c = &f->cells[id];
+	double* const M = f->M + id*nc;
+	memset(M, 0, nc*sizeof(double));
+	c->start = *np;
+	c->leaf = node->pt>=0 || -node->pt<=f->ncrit;
+	c->rmax = 0.;
+	double m = 0.;
+	double mx = 0.;
+	double my = 0.;
+	double mz = 0.;
+	if (c->leaf){
+		reb_fmm_collect_particles(f, node, np);
+		c->n = *np - c->start;
+		const struct reb_particle* const particles = f->r->particles;
+		for (int l=c->start; l<*np; l++){
+			const struct reb_particle p = particles[f->list[l]];
+			f->px[l] = p.x;
+			f->py[l] = p.y;
+			f->pz[l] = p.z;
+			f->pm[l] = p.m;
+			m  += p.m;
+			mx += p.m*p.x;
+			my += p.m*p.y;
+			mz += p.m*p.z;
+		}
+	}else{
+		for (int o=0; o<8; o++){
+			struct reb_treecell* const d = node->oct[o];
+			if (d==NULL) continue;
+			reb_fmm_upward(f, d, ncells, np, pw);
+			const struct reb_fmm_cell* const cd = &f->cells[d->fmm];
+			const double md = f->M[d->fmm*nc];
+			m  += md;
+			mx += md*cd->x;
+			my += md*cd->y;
+			mz += md*cd->z;
+		}
+		c->n = *np - c->start;
+	}
+	if (m>0.){
+		c->x = mx/m;
+		c->y = my/m;
+		c->z = mz/m;
+	}else{
+		c->x = node->x;
+		c->y = node->y;
+		c->z = node->z;
+	}
+	if (c->leaf){
+		// P2M
+		for (int l=c->start; l<c->start+c->n; l++){
+			const double dx = f->px[l] - c->x;
+			const double dy = f->py[l] - c->y;
+			const double dz = f->pz[l] - c->z;
+			const double d = sqrt(dx*dx + dy*dy + dz*dz);
+			if (d>c->rmax) c->rmax = d;
+			reb_fmm_powers(t, pw, dx, dy, dz);
+			for (int n=0; n<nc; n++){
+				M[n] += f->pm[l]*pw[n];
+			}
+		}
+	}else{
+		// M2M
+		for (int o=0; o<8; o++){
+			const struct reb_treecell* const d = node->oct[o];
+			if (d==NULL) continue;
+			const struct reb_fmm_cell* const cd = &f->cells[d->fmm];
+			const double* const Md = f->M + d->fmm*nc;
+			const double sx = cd->x - c->x;
+			const double sy = cd->y - c->y;
+			const double sz = cd->z - c->z;
+			const double rd = cd->rmax + sqrt(sx*sx + sy*sy + sz*sz);
+			if (rd>c->rmax) c->rmax = rd;
+			reb_fmm_powers(t, pw, sx, sy, sz);
+			for (int s=0; s<t->n_shift; s++){
+				const int* const sh = t->shift+3*s;
+				M[sh[0]] += t->shift_c[s]*Md[sh[1]]*pw[sh[2]];
+			}
+		}
+	}
+	// Particles cannot be further away than the farthest corner of the cell.
+	const double ox = fabs(c->x - node->x);
+	const double oy = fabs(c->y - node->y);
+	const double oz = fabs(c->z - node->z);
+	const double h = node->w/2.;
+	const double rcube = sqrt((ox+h)*(ox+h) + (oy+h)*(oy+h) + (oz+h)*(oz+h));
+	if (rcube<c->rmax) c->rmax = rcube;
+}
+
+/**
+ * @brief Direct summation of the forces of the particles in cell b on the particles in cell a.
+ */
+static void reb_fmm_p2p(struct reb_fmm* const f, const struct reb_fmm_cell* const ca, const struct reb_fmm_cell* const cb, const double shiftx, const double shifty, const double shiftz){
+	const double softening2 = f->r->softening*f->r->softening;
+	const double* restrict const px = f->px;
+	const double* restrict const py = f->py;
+	const double* restrict const pz = f->pz;
+	const double* restrict const pm = f->pm;
+	double* restrict const pax = f->pax;
+	double* restrict const pay = f->pay;
+	double* restrict const paz = f->paz;
+	const int self = ca==cb && shiftx==0. && shifty==0. && shiftz==0.;
+	const int b_start = cb->start;
+	const int b_end = cb->start+cb->n;
+	for (int i=ca->start; i<ca->start+ca->n; i++){
+		const double xi = px[i] + shiftx;
+		const double yi = py[i] + shifty;
+		const double zi = pz[i] + shiftz;
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		// In the same cell, skip the particle itself.
+		const int j_skip = self?i:b_end;
+		for (int j=b_start; j<j_skip; j++){
+			const double dx = xi - px[j];
+			const double dy = yi - py[j];
+			const double dz = zi - pz[j];
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = pm[j]/(_r*_r*_r);
+			ax -= prefact*dx;
+			ay -= prefact*dy;
+			az -= prefact*dz;
+		}
+		for (int j=j_skip+1; j<b_end; j++){
+			const double dx = xi - px[j];
+			const double dy = yi - py[j];
+			const double dz = zi - pz[j];
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = pm[j]/(_r*_r*_r);
+			ax -= prefact*dx;
+			ay -= prefact*dy;
+			az -= prefact*dz;
+		}
+		pax[i] += ax;
+		pay[i] += ay;
+		paz[i] += az;
+	}
+}
+
+/**
+ * @brief Dual tree walk. Adds the field of cell b to cell a.
+ * @details The particles in cell a are shifted by (shiftx, shifty, shiftz). Only 
+ * cell a and its descendants are written to, so walks with different cells a can 
+ * run in parallel.
+ */
+static void reb_fmm_interact(struct reb_fmm* const f, const struct reb_treecell* const a, const struct reb_treecell* const b, const double shiftx, const double shifty, const double shiftz, double* const T){
+	const struct reb_fmm_cell* const ca = &f->cells[a->fmm];
+	const struct reb_fmm_cell* const cb = &f->cells[b->fmm];
+	if (cb->n==0) return;
+	const double Rx = ca->x + shiftx - cb->x;
+	const double Ry = ca->y + shifty - cb->y;
+	const double Rz = ca->z + shiftz - cb->z;
+	const double R2 = Rx*Rx + Ry*Ry + Rz*Rz;
+	const double rab = ca->rmax + cb->rmax;
+	const int separated = rab*rab<f->theta2*R2;
+	if (ca->leaf && cb->leaf && (!separated || ca->n*cb->n<f->p2p_max)){
+		reb_fmm_p2p(f, ca, cb, shiftx, shifty, shiftz);
+		return;
+	}
+	if (separated){
+		// M2L
+		const struct reb_fmm_tables* const t = &f->t;
+		const double* const M = f->M + b->fmm*t->nc;
+		double* const L = f->L + a->fmm*t->nc;
+		reb_fmm_derivatives(t, T, Rx, Ry, Rz);
+		for (int s=0; s<t->n_m2l; s++){
+			const int* const m = t->m2l+3*s;
+			L[m[0]] += t->m2l_c[s]*M[m[1]]*T[m[2]];
+		}
+		return;
+	}
+	// Split the larger cell.
+	if (ca->leaf || (!cb->leaf && cb->rmax>=ca->rmax)){
+		for (int o=0; o<8; o++){
+			if (b->oct[o]!=NULL){
+				reb_fmm_interact(f, a, b->oct[o], shiftx, shifty, shiftz, T);
+			}
+		}
+	}else{
+		for (int o=0; o<8; o++){
+			if (a->oct[o]!=NULL){
+				reb_fmm_interact(f, a->oct[o], b, shiftx, shifty, shiftz, T);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Downward pass: L2L to the children, L2P in leaves.
+ */
+static void reb_fmm_downward(struct reb_fmm* const f, const struct reb_treecell* const node, double* const pw){
+	const struct reb_fmm_tables* const t = &f->t;
+	const int nc = t->nc;
+	const struct reb_fmm_cell* const c = &f->cells[node->fmm];
+	const double* const L = f->L + node->fmm*nc;
+	if (c->leaf){
+		struct reb_particle* const particles = f->r->particles;
+		const double G = f->r->G;
+		for (int l=c->start; l<c->start+c->n; l++){
+			reb_fmm_powers(t, pw, f->px[l] - c->x, f->py[l] - c->y, f->pz[l] - c->z);
+			double ax = f->pax[l];
+			double ay = f->pay[l];
+			double az = f->paz[l];
+			for (int k=1; k<nc; k++){
+				const int* const n = t->n+3*k;
+				const int* const m1 = t->m1+3*k;
+				if (n[0]) ax += n[0]*L[k]*pw[m1[0]];
+				if (n[1]) ay += n[1]*L[k]*pw[m1[1]];
+				if (n[2]) az += n[2]*L[k]*pw[m1[2]];
+			}
+			struct reb_particle* const p = &particles[f->list[l]];
+			p->ax = G*ax;
+			p->ay = G*ay;
+			p->az = G*az;
+		}
+		return;
+	}
+	for (int o=0; o<8; o++){
+		const struct reb_treecell* const d = node->oct[o];
+		if (d==NULL) continue;
+		const struct reb_fmm_cell* const cd = &f->cells[d->fmm];
+		double* const Ld = f->L + d->fmm*nc;
+		reb_fmm_powers(t, pw, cd->x - c->x, cd->y - c->y, cd->z - c->z);
+		for (int s=0; s<t->n_shift; s++){
+			const int* const sh = t->shift+3*s;
+			Ld[sh[1]] += t->shift_c[s]*L[sh[0]]*pw[sh[2]];
+		}
+		reb_fmm_downward(f, d, pw);
+	}
+}
+
+void reb_gravity_fmm(struct reb_simulation* const r){
+	struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+#pragma omp parallel for schedule(guided)
+	for (int i=0; i<N; i++){
+		particles[i].ax = 0.;
+		particles[i].ay = 0.;
+		particles[i].az = 0.;
+	}
+	if (r->tree_root==NULL) return;
+
+	struct reb_fmm f;
+	f.r = r;
+	f.ncrit = r->fmm_ncrit>1?r->fmm_ncrit:1;
+	f.theta2 = r->opening_angle2;
+	reb_fmm_tables_init(&f.t, r->fmm_order>1?r->fmm_order:1);
+	const int nc = f.t.nc;
+	// Rough cost ratio between one M2L and one particle-particle interaction.
+	f.p2p_max = f.t.n_m2l/4+1;
+
+	// Allocate buffers
+	int ncells = 0;
+	for (int i=0; i<r->root_n; i++){
+		ncells += reb_fmm_count_cells(r->tree_root[i]);
+	}
+	if (r->gravity_fmm_allocatedN<ncells || r->gravity_fmm_order!=f.t.order){
+		const int n = ncells>r->gravity_fmm_allocatedN?ncells:r->gravity_fmm_allocatedN;
+		r->gravity_fmm_cells = realloc(r->gravity_fmm_cells, n*sizeof(struct reb_fmm_cell));
+		r->gravity_fmm_expansions = realloc(r->gravity_fmm_expansions, 2*n*nc*sizeof(double));
+		r->gravity_fmm_allocatedN = n;
+		r->gravity_fmm_order = f.t.order;
+	}
+	if (r->gravity_fmm_list_allocatedN<N){
+		r->gravity_fmm_list = realloc(r->gravity_fmm_list, N*sizeof(int));
+		r->gravity_fmm_particles = realloc(r->gravity_fmm_particles, 7*N*sizeof(double));
+		r->gravity_fmm_list_allocatedN = N;
+	}
+	f.cells = r->gravity_fmm_cells;
+	f.M = r->gravity_fmm_expansions;
+	f.L = r->gravity_fmm_expansions + r->gravity_fmm_allocatedN*nc;
+	f.list = r->gravity_fmm_list;
+	f.px  = r->gravity_fmm_particles;
+	f.py  = f.px + N;
+	f.pz  = f.px + 2*N;
+	f.pm  = f.px + 3*N;
+	f.pax = f.px + 4*N;
+	f.pay = f.px + 5*N;
+	f.paz = f.px + 6*N;
+	memset(f.pax, 0, 3*N*sizeof(double));
+	memset(f.L, 0, ncells*nc*sizeof(double));
+
+	// Upward pass
+	{
+		double* const pw = malloc(nc*sizeof(double));
+		int ic = 0;
+		int np = 0;
+		for (int i=0; i<r->root_n; i++){
+			if (r->tree_root[i]!=NULL){
+				reb_fmm_upward(&f, r->tree_root[i], &ic, &np, pw);
+			}
+		}
+		free(pw);
+	}
+
+	// Split the target trees into enough independent subtrees to keep all threads busy.
+	int ntargets = 0;
+	struct reb_treecell** targets = malloc(ncells*sizeof(struct reb_treecell*));
+	for (int i=0; i<r->root_n; i++){
+		if (r->tree_root[i]!=NULL){
+			targets[ntargets++] = r->tree_root[i];
+		}
+	}
+#ifdef OPENMP
+	const int ntargets_min = 16*omp_get_max_threads();
+#else // OPENMP
+	const int ntargets_min = 1;
+#endif // OPENMP
+	int split = 1;
+	while (ntargets<ntargets_min && split){
+		split = 0;
+		struct reb_treecell** next = malloc(ncells*sizeof(struct reb_treecell*));
+		int nnext = 0;
+		for (int i=0; i<ntargets; i++){
+			if (f.cells[targets[i]->fmm].leaf){
+				next[nnext++] = targets[i];
+			}else{
+				split = 1;
+				for (int o=0; o<8; o++){
+					if (targets[i]->oct[o]!=NULL){
+						next[nnext++] = targets[i]->oct[o];
+					}
+				}
+			}
+		}
+		free(targets);
+		targets = next;
+		ntargets = nnext;
+	}
+
+	// Dual tree walk and downward pass
+	const int nghostx = r->nghostx;
+	const int nghosty = r->nghosty;
+	const int nghostz = r->nghostz;
+#pragma omp parallel
+	{
+		double* const scratch = malloc(nc*sizeof(double));
+#pragma omp for schedule(dynamic,1)
+		for (int i=0; i<ntargets; i++){
+			for (int gbx=-nghostx; gbx<=nghostx; gbx++){
+			for (int gby=-nghosty; gby<=nghosty; gby++){
+			for (int gbz=-nghostz; gbz<=nghostz; gbz++){
+				const struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+				for (int j=0; j<r->root_n; j++){
+					if (r->tree_root[j]!=NULL){
+						reb_fmm_interact(&f, targets[i], r->tree_root[j], gb.shiftx, gb.shifty, gb.shiftz, scratch);
+					}
+				}
+			}
+			}
+			}
+			reb_fmm_downward(&f, targets[i], scratch);
+		}
+		free(scratch);
+	}
+	free(targets);
+	reb_fmm_tables_free(&f.t);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file 	gravity_fmm.h
+ * @brief 	Fast multipole method (FMM) gravity solver.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _GRAVITY_FMM_H
+#define _GRAVITY_FMM_H
+struct reb_simulation;
+
+/**
+ * @brief Bookkeeping of one tree cell used by REB_GRAVITY_FMM.
+ */
+struct reb_fmm_cell {
+	double x;	///< x position of the expansion center (center of mass).
+	double y;	///< y position of the expansion center (center of mass).
+	double z;	///< z position of the expansion center (center of mass).
+	double rmax;	///< Maximum distance of a particle in the cell from the expansion center.
+	int start;	///< First entry of the cell in the particle index list.
+	int n;		///< Number of particles in the cell.
+	int leaf;	///< 1 if the cell is not split any further by the FMM (at most fmm_ncrit particles).
+};
+
+/**
+ * @brief Calculates the gravitational accelerations with the fast multipole method.
+ * @details Uses the octree in tree_root. Multipole expansions of order fmm_order are 
+ * calculated about the center of mass of each cell (P2M, M2M). A dual tree walk converts
+ * multipoles of well separated cells into local expansions (M2L). Close cells 
+ * interact directly (P2P). The local expansions are then shifted to the leaves and
+ * evaluated at the particle positions (L2L, L2P). Two cells are well separated if 
+ * (r_A+r_B)^2 < opening_angle2*R^2 where r_A and r_B are the radii of the cells 
+ * around their centers of mass and R is the distance between the centers of mass. Ghost boxes are supported.
+ * @param r REBOUND simulation to consider
+ */
+void reb_gravity_fmm(struct reb_simulation* const r);
+
+#endif // _GRAVITY_FMM_H
@@ -0,0 +1,982 @@
+/**
+ * @file 	gravity_simd.c
+ * @brief 	Vectorized direct summation kernels with runtime instruction set dispatch.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @details 	The particle structure is large (more than 100 bytes) and the
+ * compiler cannot vectorize the direct summation loop in gravity.c as it
+ * reads strided fields. The kernels in this file first copy the positions
+ * and masses of all particles into an aligned structure-of-arrays buffer
+ * and then evaluate 4 (AVX2) or 8 (AVX-512) particle pairs per instruction.
+ * The instruction set is determined at runtime, so the same shared library
+ * can be used on different machines. The kernels are compiled with function
+ * specific target attributes, they do not depend on -march=native.
+ * If the CPU supports neither AVX2 nor AVX-512, or the compiler does not
+ * support target attributes, the scalar loop in gravity.c is used.
+ *
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rebound.h"
+#include "gravity_simd.h"
+#include "boundary.h"
+#ifdef OPENMP
+#include <omp.h>
+#endif // OPENMP
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REB_SIMD_X86	///< Compiler supports target attributes and x86 intrinsics
+#include <immintrin.h>
+#endif // __GNUC__
+
+#define REB_SIMD_WIDTH_MAX 8	///< Widest vector (in doubles) of all kernels. SoA buffer is padded to a multiple of this.
+#define REB_SIMD_IBLOCK 4	///< Number of particles receiving a force that the tiled kernels keep in registers.
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
+#define MAX(a, b) ((a) < (b) ? (b) : (a))    ///< Returns the maximum of a and b
+
+int reb_simd_level(const int simd){
+#ifdef REB_SIMD_X86
+	__builtin_cpu_init();
+	const int has_avx512 = __builtin_cpu_supports("avx512f");
+	const int has_avx2   = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	switch (simd){
+		case REB_SIMD_AUTO:
+			if (has_avx512) return REB_SIMD_AVX512;
+			if (has_avx2) return REB_SIMD_AVX2;
+			return REB_SIMD_NONE;
+		case REB_SIMD_AVX512:
+			return has_avx512?REB_SIMD_AVX512:REB_SIMD_NONE;
+		case REB_SIMD_AVX2:
+			return has_avx2?REB_SIMD_AVX2:REB_SIMD_NONE;
+		default:
+			return REB_SIMD_NONE;
+	}
+#else // REB_SIMD_X86
+	return REB_SIMD_NONE;
+#endif // REB_SIMD_X86
+}
+
+int reb_gravity_simd_level(const struct reb_simulation* const r){
+	return reb_simd_level(r->gravity_simd);
+}
+
+void reb_gravity_simd_pack(struct reb_simulation* const r, const int N){
+	if (r->gravity_simd_allocatedN<N){
+		// Stride of each of the four arrays is a multiple of the widest vector.
+		const int stride = ((N+REB_SIMD_WIDTH_MAX-1)/REB_SIMD_WIDTH_MAX)*REB_SIMD_WIDTH_MAX;
+		free(r->gravity_simd_buffer);
+		if (posix_memalign((void**)&(r->gravity_simd_buffer), 64, 4*stride*sizeof(double))){
+			reb_exit("Cannot allocate memory for SIMD gravity buffer.");
+		}
+		memset(r->gravity_simd_buffer, 0, 4*stride*sizeof(double));
+		r->gravity_simd_allocatedN = stride;
+	}
+	const int stride = r->gravity_simd_allocatedN;
+	const struct reb_particle* const particles = r->particles;
+	double* restrict const x = r->gravity_simd_buffer;
+	double* restrict const y = x + stride;
+	double* restrict const z = x + 2*stride;
+	double* restrict const m = x + 3*stride;
+#pragma omp parallel for schedule(static)
+	for (int i=0; i<N; i++){
+		x[i] = particles[i].x;
+		y[i] = particles[i].y;
+		z[i] = particles[i].z;
+		m[i] = particles[i].m;
+	}
+	// Padding: massless particles at the origin.
+	for (int i=N; i<stride; i++){
+		x[i] = 0.;
+		y[i] = 0.;
+		z[i] = 0.;
+		m[i] = 0.;
+	}
+}
+
+/**
+ * @brief Forces of the massive particles on test particles without any per-pair branches.
+ * @details Also used by the SIMD kernels for the particles that do not fill a full vector.
+ */
+static void reb_gravity_simd_testparticles_scalar(struct reb_simulation* const r, const struct reb_ghostbox* const gbs, const int n_gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+#pragma omp parallel for schedule(static)
+	for (int i=i_start; i<i_end; i++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int g=0; g<n_gb; g++){
+			const double xi = gbs[g].shiftx + particles[i].x;
+			const double yi = gbs[g].shifty + particles[i].y;
+			const double zi = gbs[g].shiftz + particles[i].z;
+			for (int j=j_start; j<j_end; j++){
+				const double dx = xi - bx[j];
+				const double dy = yi - by[j];
+				const double dz = zi - bz[j];
+				const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+				const double prefact = bm[j]/(_r*_r*_r);
+				ax -= prefact*dx;
+				ay -= prefact*dy;
+				az -= prefact*dz;
+			}
+		}
+		particles[i].ax = G*ax;
+		particles[i].ay = G*ay;
+		particles[i].az = G*az;
+	}
+}
+
+/**
+ * @brief Forces of an interaction list on a group of particles.
+ * @details Also used by the SIMD kernels if the list is short.
+ */
+static void reb_gravity_simd_list_scalar(struct reb_simulation* const r, const double* const list, const int stride, const int n, const int n_self, const int* const members, const int n_members, const double shiftx, const double shifty, const double shiftz){
+	struct reb_particle* const particles = r->particles;
+	const double* restrict const bx = list;
+	const double* restrict const by = list + stride;
+	const double* restrict const bz = list + 2*stride;
+	const double* restrict const bm = list + 3*stride;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	for (int k=0; k<n_members; k++){
+		const int i = members[k];
+		const double xi = shiftx + particles[i].x;
+		const double yi = shifty + particles[i].y;
+		const double zi = shiftz + particles[i].z;
+		const int kself = k<n_self?k:n;
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int j=0; j<kself; j++){
+			const double dx = xi - bx[j];
+			const double dy = yi - by[j];
+			const double dz = zi - bz[j];
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = bm[j]/(_r*_r*_r);
+			ax -= prefact*dx;
+			ay -= prefact*dy;
+			az -= prefact*dz;
+		}
+		for (int j=kself+1; j<n; j++){
+			const double dx = xi - bx[j];
+			const double dy = yi - by[j];
+			const double dz = zi - bz[j];
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = bm[j]/(_r*_r*_r);
+			ax -= prefact*dx;
+			ay -= prefact*dy;
+			az -= prefact*dz;
+		}
+		particles[i].ax += G*ax;
+		particles[i].ay += G*ay;
+		particles[i].az += G*az;
+	}
+}
+
+#ifdef REB_SIMD_X86
+/**
+ * @brief Returns a bit mask of the lanes [cs,cs+W) that contribute to particle i.
+ * @param cs Index of the first lane.
+ * @param W Vector width.
+ * @param j_start First particle exerting a force.
+ * @param j_end One past the last particle exerting a force.
+ * @param i Particle receiving the force (excluded).
+ * @param jskip Additional particle to exclude (-1 if none).
+ */
+static inline unsigned int reb_gravity_simd_lane_mask(const int cs, const int W, const int j_start, const int j_end, const int i, const int jskip){
+	const unsigned int full = (1u<<W)-1u;
+	unsigned int mask = full;
+	if (cs<j_start) mask &= full << (j_start-cs);
+	if (cs+W>j_end) mask &= full >> (cs+W-j_end);
+	if (i>=cs && i<cs+W) mask &= ~(1u<<(i-cs));
+	if (jskip>=cs && jskip<cs+W) mask &= ~(1u<<(jskip-cs));
+	return mask & full;
+}
+
+__attribute__((target("avx2,fma")))
+static void reb_gravity_simd_basic_avx2(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m256d eps2 = _mm256_set1_pd(r->softening*r->softening);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const __m256i lanebits = _mm256_set_epi64x(8,4,2,1);
+	const int cs_start = (j_start/4)*4;
+#pragma omp parallel for schedule(guided)
+	for (int i=i_start; i<i_end; i++){
+		const __m256d xi = _mm256_set1_pd(gb.shiftx + particles[i].x);
+		const __m256d yi = _mm256_set1_pd(gb.shifty + particles[i].y);
+		const __m256d zi = _mm256_set1_pd(gb.shiftz + particles[i].z);
+		const int jskip = _gravity_ignore_10?(i==0?1:(i==1?0:-1)):-1;
+		__m256d ax = _mm256_setzero_pd();
+		__m256d ay = _mm256_setzero_pd();
+		__m256d az = _mm256_setzero_pd();
+		for (int cs=cs_start; cs<j_end; cs+=4){
+			const unsigned int lanes = reb_gravity_simd_lane_mask(cs, 4, j_start, j_end, i, jskip);
+			const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_and_si256(_mm256_set1_epi64x(lanes), lanebits), _mm256_setzero_si256()));
+			const __m256d dx = _mm256_sub_pd(xi, _mm256_load_pd(bx+cs));
+			const __m256d dy = _mm256_sub_pd(yi, _mm256_load_pd(by+cs));
+			const __m256d dz = _mm256_sub_pd(zi, _mm256_load_pd(bz+cs));
+			const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2)));
+			// AVX2 has no double precision rsqrt. A single precision estimate would limit the dynamic range of r2.
+			const __m256d rinv3 = _mm256_div_pd(one, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+			const __m256d prefact = _mm256_and_pd(mask, _mm256_mul_pd(_mm256_load_pd(bm+cs), rinv3));
+			ax = _mm256_fnmadd_pd(prefact, dx, ax);
+			ay = _mm256_fnmadd_pd(prefact, dy, ay);
+			az = _mm256_fnmadd_pd(prefact, dz, az);
+		}
+		double sx[4], sy[4], sz[4];
+		_mm256_storeu_pd(sx, ax);
+		_mm256_storeu_pd(sy, ay);
+		_mm256_storeu_pd(sz, az);
+		particles[i].ax += G*((sx[0]+sx[1])+(sx[2]+sx[3]));
+		particles[i].ay += G*((sy[0]+sy[1])+(sy[2]+sy[3]));
+		particles[i].az += G*((sz[0]+sz[1])+(sz[2]+sz[3]));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void reb_gravity_simd_basic_avx512(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m512d eps2 = _mm512_set1_pd(r->softening*r->softening);
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d threehalf = _mm512_set1_pd(1.5);
+	const int cs_start = (j_start/8)*8;
+#pragma omp parallel for schedule(guided)
+	for (int i=i_start; i<i_end; i++){
+		const __m512d xi = _mm512_set1_pd(gb.shiftx + particles[i].x);
+		const __m512d yi = _mm512_set1_pd(gb.shifty + particles[i].y);
+		const __m512d zi = _mm512_set1_pd(gb.shiftz + particles[i].z);
+		const int jskip = _gravity_ignore_10?(i==0?1:(i==1?0:-1)):-1;
+		__m512d ax = _mm512_setzero_pd();
+		__m512d ay = _mm512_setzero_pd();
+		__m512d az = _mm512_setzero_pd();
+		for (int cs=cs_start; cs<j_end; cs+=8){
+			const __mmask8 mask = (__mmask8)reb_gravity_simd_lane_mask(cs, 8, j_start, j_end, i, jskip);
+			const __m512d dx = _mm512_sub_pd(xi, _mm512_load_pd(bx+cs));
+			const __m512d dy = _mm512_sub_pd(yi, _mm512_load_pd(by+cs));
+			const __m512d dz = _mm512_sub_pd(zi, _mm512_load_pd(bz+cs));
+			const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2)));
+			// 14 bit estimate, two Newton-Raphson iterations give full double precision.
+			const __m512d hr2 = _mm512_mul_pd(half, r2);
+			__m512d rinv = _mm512_rsqrt14_pd(r2);
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			const __m512d rinv3 = _mm512_mul_pd(rinv, _mm512_mul_pd(rinv, rinv));
+			const __m512d prefact = _mm512_maskz_mul_pd(mask, _mm512_load_pd(bm+cs), rinv3);
+			ax = _mm512_fnmadd_pd(prefact, dx, ax);
+			ay = _mm512_fnmadd_pd(prefact, dy, ay);
+			az = _mm512_fnmadd_pd(prefact, dz, az);
+		}
+		particles[i].ax += G*_mm512_reduce_add_pd(ax);
+		particles[i].ay += G*_mm512_reduce_add_pd(ay);
+		particles[i].az += G*_mm512_reduce_add_pd(az);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void reb_gravity_simd_basic_symmetric_avx2(const struct reb_simulation* const r, double* restrict const acc, const int j_start, const int j_end){
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	double* restrict const accx = acc;
+	double* restrict const accy = acc + stride;
+	double* restrict const accz = acc + 2*stride;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m256d eps2 = _mm256_set1_pd(r->softening*r->softening);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const __m256i lanebits = _mm256_set_epi64x(8,4,2,1);
+	// The work per i decreases linearly. Small static chunks balance the load and,
+	// unlike a dynamic schedule, give every thread the same rows in every call.
+#pragma omp for schedule(static,16)
+	for (int i=j_start; i<j_end; i++){
+		const __m256d xi = _mm256_set1_pd(bx[i]);
+		const __m256d yi = _mm256_set1_pd(by[i]);
+		const __m256d zi = _mm256_set1_pd(bz[i]);
+		const __m256d mi = _mm256_set1_pd(bm[i]);
+		const int jskip = (_gravity_ignore_10 && i==0)?1:-1;
+		__m256d ax = _mm256_setzero_pd();
+		__m256d ay = _mm256_setzero_pd();
+		__m256d az = _mm256_setzero_pd();
+		for (int cs=((i+1)/4)*4; cs<j_end; cs+=4){
+			const unsigned int lanes = reb_gravity_simd_lane_mask(cs, 4, i+1, j_end, -1, jskip);
+			const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_and_si256(_mm256_set1_epi64x(lanes), lanebits), _mm256_setzero_si256()));
+			const __m256d dx = _mm256_sub_pd(xi, _mm256_load_pd(bx+cs));
+			const __m256d dy = _mm256_sub_pd(yi, _mm256_load_pd(by+cs));
+			const __m256d dz = _mm256_sub_pd(zi, _mm256_load_pd(bz+cs));
+			const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2)));
+			const __m256d rinv3 = _mm256_and_pd(mask, _mm256_div_pd(one, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2))));
+			const __m256d prefactj = _mm256_mul_pd(_mm256_load_pd(bm+cs), rinv3);
+			const __m256d prefacti = _mm256_mul_pd(mi, rinv3);
+			ax = _mm256_fnmadd_pd(prefactj, dx, ax);
+			ay = _mm256_fnmadd_pd(prefactj, dy, ay);
+			az = _mm256_fnmadd_pd(prefactj, dz, az);
+			_mm256_store_pd(accx+cs, _mm256_fmadd_pd(prefacti, dx, _mm256_load_pd(accx+cs)));
+			_mm256_store_pd(accy+cs, _mm256_fmadd_pd(prefacti, dy, _mm256_load_pd(accy+cs)));
+			_mm256_store_pd(accz+cs, _mm256_fmadd_pd(prefacti, dz, _mm256_load_pd(accz+cs)));
+		}
+		double sx[4], sy[4], sz[4];
+		_mm256_storeu_pd(sx, ax);
+		_mm256_storeu_pd(sy, ay);
+		_mm256_storeu_pd(sz, az);
+		accx[i] += (sx[0]+sx[1])+(sx[2]+sx[3]);
+		accy[i] += (sy[0]+sy[1])+(sy[2]+sy[3]);
+		accz[i] += (sz[0]+sz[1])+(sz[2]+sz[3]);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void reb_gravity_simd_basic_symmetric_avx512(const struct reb_simulation* const r, double* restrict const acc, const int j_start, const int j_end){
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	double* restrict const accx = acc;
+	double* restrict const accy = acc + stride;
+	double* restrict const accz = acc + 2*stride;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m512d eps2 = _mm512_set1_pd(r->softening*r->softening);
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d threehalf = _mm512_set1_pd(1.5);
+#pragma omp for schedule(static,16)
+	for (int i=j_start; i<j_end; i++){
+		const __m512d xi = _mm512_set1_pd(bx[i]);
+		const __m512d yi = _mm512_set1_pd(by[i]);
+		const __m512d zi = _mm512_set1_pd(bz[i]);
+		const __m512d mi = _mm512_set1_pd(bm[i]);
+		const int jskip = (_gravity_ignore_10 && i==0)?1:-1;
+		__m512d ax = _mm512_setzero_pd();
+		__m512d ay = _mm512_setzero_pd();
+		__m512d az = _mm512_setzero_pd();
+		for (int cs=((i+1)/8)*8; cs<j_end; cs+=8){
+			const __mmask8 mask = (__mmask8)reb_gravity_simd_lane_mask(cs, 8, i+1, j_end, -1, jskip);
+			const __m512d dx = _mm512_sub_pd(xi, _mm512_load_pd(bx+cs));
+			const __m512d dy = _mm512_sub_pd(yi, _mm512_load_pd(by+cs));
+			const __m512d dz = _mm512_sub_pd(zi, _mm512_load_pd(bz+cs));
+			const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2)));
+			const __m512d hr2 = _mm512_mul_pd(half, r2);
+			__m512d rinv = _mm512_rsqrt14_pd(r2);
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			const __m512d rinv3 = _mm512_maskz_mul_pd(mask, rinv, _mm512_mul_pd(rinv, rinv));
+			const __m512d prefactj = _mm512_mul_pd(_mm512_load_pd(bm+cs), rinv3);
+			const __m512d prefacti = _mm512_mul_pd(mi, rinv3);
+			ax = _mm512_fnmadd_pd(prefactj, dx, ax);
+			ay = _mm512_fnmadd_pd(prefactj, dy, ay);
+			az = _mm512_fnmadd_pd(prefactj, dz, az);
+			_mm512_store_pd(accx+cs, _mm512_fmadd_pd(prefacti, dx, _mm512_load_pd(accx+cs)));
+			_mm512_store_pd(accy+cs, _mm512_fmadd_pd(prefacti, dy, _mm512_load_pd(accy+cs)));
+			_mm512_store_pd(accz+cs, _mm512_fmadd_pd(prefacti, dz, _mm512_load_pd(accz+cs)));
+		}
+		accx[i] += _mm512_reduce_add_pd(ax);
+		accy[i] += _mm512_reduce_add_pd(ay);
+		accz[i] += _mm512_reduce_add_pd(az);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void reb_gravity_simd_basic_tiled_avx2(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end, const int tile_i, const int tile_j){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m256d eps2 = _mm256_set1_pd(r->softening*r->softening);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const __m256i lanebits = _mm256_set_epi64x(8,4,2,1);
+	const int n_tiles = (i_end-i_start+tile_i-1)/tile_i;
+#pragma omp parallel for schedule(dynamic,1)
+	for (int t=0; t<n_tiles; t++){
+		const int it_start = i_start+t*tile_i;
+		const int it_end = MIN(it_start+tile_i, i_end);
+		for (int jt_start=(j_start/4)*4; jt_start<j_end; jt_start+=tile_j){
+			const int jt_end = MIN(jt_start+tile_j, j_end);
+			for (int ib=it_start; ib<it_end; ib+=REB_SIMD_IBLOCK){
+				// Incomplete blocks repeat the last particle, the results are discarded.
+				int ii[REB_SIMD_IBLOCK];
+				int jskip[REB_SIMD_IBLOCK];
+				__m256d xi[REB_SIMD_IBLOCK], yi[REB_SIMD_IBLOCK], zi[REB_SIMD_IBLOCK];
+				__m256d ax[REB_SIMD_IBLOCK], ay[REB_SIMD_IBLOCK], az[REB_SIMD_IBLOCK];
+				for (int k=0; k<REB_SIMD_IBLOCK; k++){
+					ii[k] = MIN(ib+k, it_end-1);
+					jskip[k] = _gravity_ignore_10?(ii[k]==0?1:(ii[k]==1?0:-1)):-1;
+					xi[k] = _mm256_set1_pd(gb.shiftx + particles[ii[k]].x);
+					yi[k] = _mm256_set1_pd(gb.shifty + particles[ii[k]].y);
+					zi[k] = _mm256_set1_pd(gb.shiftz + particles[ii[k]].z);
+					ax[k] = _mm256_setzero_pd();
+					ay[k] = _mm256_setzero_pd();
+					az[k] = _mm256_setzero_pd();
+				}
+				for (int cs=jt_start; cs<jt_end; cs+=4){
+					const unsigned int range = reb_gravity_simd_lane_mask(cs, 4, j_start, jt_end, -1, -1);
+					const __m256d xj = _mm256_load_pd(bx+cs);
+					const __m256d yj = _mm256_load_pd(by+cs);
+					const __m256d zj = _mm256_load_pd(bz+cs);
+					const __m256d mj = _mm256_load_pd(bm+cs);
+					for (int k=0; k<REB_SIMD_IBLOCK; k++){
+						unsigned int lanes = range;
+						if ((unsigned int)(ii[k]-cs)<4u) lanes &= ~(1u<<(ii[k]-cs));
+						if ((unsigned int)(jskip[k]-cs)<4u) lanes &= ~(1u<<(jskip[k]-cs));
+						const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_and_si256(_mm256_set1_epi64x(lanes), lanebits), _mm256_setzero_si256()));
+						const __m256d dx = _mm256_sub_pd(xi[k], xj);
+						const __m256d dy = _mm256_sub_pd(yi[k], yj);
+						const __m256d dz = _mm256_sub_pd(zi[k], zj);
+						const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2)));
+						const __m256d rinv3 = _mm256_div_pd(one, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+						const __m256d prefact = _mm256_and_pd(mask, _mm256_mul_pd(mj, rinv3));
+						ax[k] = _mm256_fnmadd_pd(prefact, dx, ax[k]);
+						ay[k] = _mm256_fnmadd_pd(prefact, dy, ay[k]);
+						az[k] = _mm256_fnmadd_pd(prefact, dz, az[k]);
+					}
+				}
+				for (int k=0; k<REB_SIMD_IBLOCK && ib+k<it_end; k++){
+					double sx[4], sy[4], sz[4];
+					_mm256_storeu_pd(sx, ax[k]);
+					_mm256_storeu_pd(sy, ay[k]);
+					_mm256_storeu_pd(sz, az[k]);
+					particles[ib+k].ax += G*((sx[0]+sx[1])+(sx[2]+sx[3]));
+					particles[ib+k].ay += G*((sy[0]+sy[1])+(sy[2]+sy[3]));
+					particles[ib+k].az += G*((sz[0]+sz[1])+(sz[2]+sz[3]));
+				}
+			}
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+static void reb_gravity_simd_basic_tiled_avx512(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end, const int tile_i, const int tile_j){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const __m512d eps2 = _mm512_set1_pd(r->softening*r->softening);
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d threehalf = _mm512_set1_pd(1.5);
+	const int n_tiles = (i_end-i_start+tile_i-1)/tile_i;
+#pragma omp parallel for schedule(dynamic,1)
+	for (int t=0; t<n_tiles; t++){
+		const int it_start = i_start+t*tile_i;
+		const int it_end = MIN(it_start+tile_i, i_end);
+		for (int jt_start=(j_start/8)*8; jt_start<j_end; jt_start+=tile_j){
+			const int jt_end = MIN(jt_start+tile_j, j_end);
+			for (int ib=it_start; ib<it_end; ib+=REB_SIMD_IBLOCK){
+				// Incomplete blocks repeat the last particle, the results are discarded.
+				int ii[REB_SIMD_IBLOCK];
+				int jskip[REB_SIMD_IBLOCK];
+				__m512d xi[REB_SIMD_IBLOCK], yi[REB_SIMD_IBLOCK], zi[REB_SIMD_IBLOCK];
+				__m512d ax[REB_SIMD_IBLOCK], ay[REB_SIMD_IBLOCK], az[REB_SIMD_IBLOCK];
+				for (int k=0; k<REB_SIMD_IBLOCK; k++){
+					ii[k] = MIN(ib+k, it_end-1);
+					jskip[k] = _gravity_ignore_10?(ii[k]==0?1:(ii[k]==1?0:-1)):-1;
+					xi[k] = _mm512_set1_pd(gb.shiftx + particles[ii[k]].x);
+					yi[k] = _mm512_set1_pd(gb.shifty + particles[ii[k]].y);
+					zi[k] = _mm512_set1_pd(gb.shiftz + particles[ii[k]].z);
+					ax[k] = _mm512_setzero_pd();
+					ay[k] = _mm512_setzero_pd();
+					az[k] = _mm512_setzero_pd();
+				}
+				for (int cs=jt_start; cs<jt_end; cs+=8){
+					const unsigned int range = reb_gravity_simd_lane_mask(cs, 8, j_start, jt_end, -1, -1);
+					const __m512d xj = _mm512_load_pd(bx+cs);
+					const __m512d yj = _mm512_load_pd(by+cs);
+					const __m512d zj = _mm512_load_pd(bz+cs);
+					const __m512d mj = _mm512_load_pd(bm+cs);
+					for (int k=0; k<REB_SIMD_IBLOCK; k++){
+						unsigned int lanes = range;
+						if ((unsigned int)(ii[k]-cs)<8u) lanes &= ~(1u<<(ii[k]-cs));
+						if ((unsigned int)(jskip[k]-cs)<8u) lanes &= ~(1u<<(jskip[k]-cs));
+						const __m512d dx = _mm512_sub_pd(xi[k], xj);
+						const __m512d dy = _mm512_sub_pd(yi[k], yj);
+						const __m512d dz = _mm512_sub_pd(zi[k], zj);
+						const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2)));
+						const __m512d hr2 = _mm512_mul_pd(half, r2);
+						__m512d rinv = _mm512_rsqrt14_pd(r2);
+						rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+						rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+						const __m512d rinv3 = _mm512_mul_pd(rinv, _mm512_mul_pd(rinv, rinv));
+						const __m512d prefact = _mm512_maskz_mul_pd((__mmask8)lanes, mj, rinv3);
+						ax[k] = _mm512_fnmadd_pd(prefact, dx, ax[k]);
+						ay[k] = _mm512_fnmadd_pd(prefact, dy, ay[k]);
+						az[k] = _mm512_fnmadd_pd(prefact, dz, az[k]);
+					}
+				}
+				for (int k=0; k<REB_SIMD_IBLOCK && ib+k<it_end; k++){
+					particles[ib+k].ax += G*_mm512_reduce_add_pd(ax[k]);
+					particles[ib+k].ay += G*_mm512_reduce_add_pd(ay[k]);
+					particles[ib+k].az += G*_mm512_reduce_add_pd(az[k]);
+				}
+			}
+		}
+	}
+}
+__attribute__((target("avx2,fma")))
+static void reb_gravity_simd_testparticles_avx2(struct reb_simulation* const r, const struct reb_ghostbox* const gbs, const int n_gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const __m256d eps2 = _mm256_set1_pd(r->softening*r->softening);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const int n_vec = (i_end-i_start)/4;
+#pragma omp parallel for schedule(static)
+	for (int v=0; v<n_vec; v++){
+		const int i = i_start + 4*v;
+		// Transpose four consecutive test particles into vector lanes.
+		const __m256d x = _mm256_set_pd(particles[i+3].x, particles[i+2].x, particles[i+1].x, particles[i].x);
+		const __m256d y = _mm256_set_pd(particles[i+3].y, particles[i+2].y, particles[i+1].y, particles[i].y);
+		const __m256d z = _mm256_set_pd(particles[i+3].z, particles[i+2].z, particles[i+1].z, particles[i].z);
+		__m256d ax = _mm256_setzero_pd();
+		__m256d ay = _mm256_setzero_pd();
+		__m256d az = _mm256_setzero_pd();
+		for (int g=0; g<n_gb; g++){
+			const __m256d xi = _mm256_add_pd(_mm256_set1_pd(gbs[g].shiftx), x);
+			const __m256d yi = _mm256_add_pd(_mm256_set1_pd(gbs[g].shifty), y);
+			const __m256d zi = _mm256_add_pd(_mm256_set1_pd(gbs[g].shiftz), z);
+			for (int j=j_start; j<j_end; j++){
+				const __m256d dx = _mm256_sub_pd(xi, _mm256_broadcast_sd(bx+j));
+				const __m256d dy = _mm256_sub_pd(yi, _mm256_broadcast_sd(by+j));
+				const __m256d dz = _mm256_sub_pd(zi, _mm256_broadcast_sd(bz+j));
+				const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2)));
+				const __m256d rinv3 = _mm256_div_pd(one, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+				const __m256d prefact = _mm256_mul_pd(_mm256_broadcast_sd(bm+j), rinv3);
+				ax = _mm256_fnmadd_pd(prefact, dx, ax);
+				ay = _mm256_fnmadd_pd(prefact, dy, ay);
+				az = _mm256_fnmadd_pd(prefact, dz, az);
+			}
+		}
+		double sx[4], sy[4], sz[4];
+		_mm256_storeu_pd(sx, ax);
+		_mm256_storeu_pd(sy, ay);
+		_mm256_storeu_pd(sz, az);
+		for (int k=0; k<4; k++){
+			particles[i+k].ax = G*sx[k];
+			particles[i+k].ay = G*sy[k];
+			particles[i+k].az = G*sz[k];
+		}
+	}
+	// Remaining particles
+	reb_gravity_simd_testparticles_scalar(r, gbs, n_gb, i_start+4*n_vec, i_end, j_start, j_end);
+}
+
+__attribute__((target("avx512f")))
+static void reb_gravity_simd_testparticles_avx512(struct reb_simulation* const r, const struct reb_ghostbox* const gbs, const int n_gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const __m512d G = _mm512_set1_pd(r->G);
+	const __m512d eps2 = _mm512_set1_pd(r->softening*r->softening);
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d threehalf = _mm512_set1_pd(1.5);
+	// Offsets (in doubles) of eight consecutive particles in the particle array.
+	const long long pstride = sizeof(struct reb_particle)/sizeof(double);
+	const __m512i vindex = _mm512_set_epi64(7*pstride, 6*pstride, 5*pstride, 4*pstride, 3*pstride, 2*pstride, pstride, 0);
+	const int n_vec = (i_end-i_start)/8;
+#pragma omp parallel for schedule(static)
+	for (int v=0; v<n_vec; v++){
+		const int i = i_start + 8*v;
+		const __m512d x = _mm512_i64gather_pd(vindex, &(particles[i].x), 8);
+		const __m512d y = _mm512_i64gather_pd(vindex, &(particles[i].y), 8);
+		const __m512d z = _mm512_i64gather_pd(vindex, &(particles[i].z), 8);
+		__m512d ax = _mm512_setzero_pd();
+		__m512d ay = _mm512_setzero_pd();
+		__m512d az = _mm512_setzero_pd();
+		for (int g=0; g<n_gb; g++){
+			const __m512d xi = _mm512_add_pd(_mm512_set1_pd(gbs[g].shiftx), x);
+			const __m512d yi = _mm512_add_pd(_mm512_set1_pd(gbs[g].shifty), y);
+			const __m512d zi = _mm512_add_pd(_mm512_set1_pd(gbs[g].shiftz), z);
+			for (int j=j_start; j<j_end; j++){
+				const __m512d dx = _mm512_sub_pd(xi, _mm512_set1_pd(bx[j]));
+				const __m512d dy = _mm512_sub_pd(yi, _mm512_set1_pd(by[j]));
+				const __m512d dz = _mm512_sub_pd(zi, _mm512_set1_pd(bz[j]));
+				const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2)));
+				const __m512d hr2 = _mm512_mul_pd(half, r2);
+				__m512d rinv = _mm512_rsqrt14_pd(r2);
+				rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+				rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+				const __m512d prefact = _mm512_mul_pd(_mm512_set1_pd(bm[j]), _mm512_mul_pd(rinv, _mm512_mul_pd(rinv, rinv)));
+				ax = _mm512_fnmadd_pd(prefact, dx, ax);
+				ay = _mm512_fnmadd_pd(prefact, dy, ay);
+				az = _mm512_fnmadd_pd(prefact, dz, az);
+			}
+		}
+		_mm512_i64scatter_pd(&(particles[i].ax), vindex, _mm512_mul_pd(G, ax), 8);
+		_mm512_i64scatter_pd(&(particles[i].ay), vindex, _mm512_mul_pd(G, ay), 8);
+		_mm512_i64scatter_pd(&(particles[i].az), vindex, _mm512_mul_pd(G, az), 8);
+	}
+	// Remaining particles
+	reb_gravity_simd_testparticles_scalar(r, gbs, n_gb, i_start+8*n_vec, i_end, j_start, j_end);
+}
+__attribute__((target("avx2,fma")))
+static void reb_gravity_simd_list_avx2(struct reb_simulation* const r, const double* const list, const int stride, const int n, const int n_self, const int* const members, const int n_members, const double shiftx, const double shifty, const double shiftz){
+	struct reb_particle* const particles = r->particles;
+	const double* restrict const bx = list;
+	const double* restrict const by = list + stride;
+	const double* restrict const bz = list + 2*stride;
+	const double* restrict const bm = list + 3*stride;
+	const double G = r->G;
+	const __m256d eps2 = _mm256_set1_pd(r->softening*r->softening);
+	const __m256d one  = _mm256_set1_pd(1.);
+	const __m256i lanebits = _mm256_set_epi64x(8,4,2,1);
+	for (int k=0; k<n_members; k++){
+		const int i = members[k];
+		const __m256d xi = _mm256_set1_pd(shiftx + particles[i].x);
+		const __m256d yi = _mm256_set1_pd(shifty + particles[i].y);
+		const __m256d zi = _mm256_set1_pd(shiftz + particles[i].z);
+		const int kself = k<n_self?k:-1;
+		__m256d ax = _mm256_setzero_pd();
+		__m256d ay = _mm256_setzero_pd();
+		__m256d az = _mm256_setzero_pd();
+		for (int cs=0; cs<n; cs+=4){
+			const unsigned int lanes = reb_gravity_simd_lane_mask(cs, 4, 0, n, kself, -1);
+			const __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_and_si256(_mm256_set1_epi64x(lanes), lanebits), _mm256_setzero_si256()));
+			const __m256d dx = _mm256_sub_pd(xi, _mm256_load_pd(bx+cs));
+			const __m256d dy = _mm256_sub_pd(yi, _mm256_load_pd(by+cs));
+			const __m256d dz = _mm256_sub_pd(zi, _mm256_load_pd(bz+cs));
+			const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_fmadd_pd(dz, dz, eps2)));
+			const __m256d rinv3 = _mm256_div_pd(one, _mm256_mul_pd(r2, _mm256_sqrt_pd(r2)));
+			const __m256d prefact = _mm256_and_pd(mask, _mm256_mul_pd(_mm256_load_pd(bm+cs), rinv3));
+			ax = _mm256_fnmadd_pd(prefact, dx, ax);
+			ay = _mm256_fnmadd_pd(prefact, dy, ay);
+			az = _mm256_fnmadd_pd(prefact, dz, az);
+		}
+		double sx[4], sy[4], sz[4];
+		_mm256_storeu_pd(sx, ax);
+		_mm256_storeu_pd(sy, ay);
+		_mm256_storeu_pd(sz, az);
+		particles[i].ax += G*((sx[0]+sx[1])+(sx[2]+sx[3]));
+		particles[i].ay += G*((sy[0]+sy[1])+(sy[2]+sy[3]));
+		particles[i].az += G*((sz[0]+sz[1])+(sz[2]+sz[3]));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void reb_gravity_simd_list_avx512(struct reb_simulation* const r, const double* const list, const int stride, const int n, const int n_self, const int* const members, const int n_members, const double shiftx, const double shifty, const double shiftz){
+	struct reb_particle* const particles = r->particles;
+	const double* restrict const bx = list;
+	const double* restrict const by = list + stride;
+	const double* restrict const bz = list + 2*stride;
+	const double* restrict const bm = list + 3*stride;
+	const double G = r->G;
+	const __m512d eps2 = _mm512_set1_pd(r->softening*r->softening);
+	const __m512d half = _mm512_set1_pd(0.5);
+	const __m512d threehalf = _mm512_set1_pd(1.5);
+	for (int k=0; k<n_members; k++){
+		const int i = members[k];
+		const __m512d xi = _mm512_set1_pd(shiftx + particles[i].x);
+		const __m512d yi = _mm512_set1_pd(shifty + particles[i].y);
+		const __m512d zi = _mm512_set1_pd(shiftz + particles[i].z);
+		const int kself = k<n_self?k:-1;
+		__m512d ax = _mm512_setzero_pd();
+		__m512d ay = _mm512_setzero_pd();
+		__m512d az = _mm512_setzero_pd();
+		for (int cs=0; cs<n; cs+=8){
+			const __mmask8 mask = (__mmask8)reb_gravity_simd_lane_mask(cs, 8, 0, n, kself, -1);
+			const __m512d dx = _mm512_sub_pd(xi, _mm512_load_pd(bx+cs));
+			const __m512d dy = _mm512_sub_pd(yi, _mm512_load_pd(by+cs));
+			const __m512d dz = _mm512_sub_pd(zi, _mm512_load_pd(bz+cs));
+			const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_fmadd_pd(dz, dz, eps2)));
+			const __m512d hr2 = _mm512_mul_pd(half, r2);
+			__m512d rinv = _mm512_rsqrt14_pd(r2);
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			rinv = _mm512_mul_pd(rinv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(rinv, rinv), threehalf));
+			const __m512d rinv3 = _mm512_mul_pd(rinv, _mm512_mul_pd(rinv, rinv));
+			const __m512d prefact = _mm512_maskz_mul_pd(mask, _mm512_load_pd(bm+cs), rinv3);
+			ax = _mm512_fnmadd_pd(prefact, dx, ax);
+			ay = _mm512_fnmadd_pd(prefact, dy, ay);
+			az = _mm512_fnmadd_pd(prefact, dz, az);
+		}
+		particles[i].ax += G*_mm512_reduce_add_pd(ax);
+		particles[i].ay += G*_mm512_reduce_add_pd(ay);
+		particles[i].az += G*_mm512_reduce_add_pd(az);
+	}
+}
+#endif // REB_SIMD_X86
+
+static void reb_gravity_simd_basic_tiled_scalar(struct reb_simulation* const r, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end, const int tile_i, const int tile_j){
+	struct reb_particle* const particles = r->particles;
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const int n_tiles = (i_end-i_start+tile_i-1)/tile_i;
+#pragma omp parallel for schedule(dynamic,1)
+	for (int t=0; t<n_tiles; t++){
+		const int it_start = i_start+t*tile_i;
+		const int it_end = MIN(it_start+tile_i, i_end);
+		for (int jt_start=j_start; jt_start<j_end; jt_start+=tile_j){
+			const int jt_end = MIN(jt_start+tile_j, j_end);
+			for (int i=it_start; i<it_end; i++){
+				const double xi = gb.shiftx + particles[i].x;
+				const double yi = gb.shifty + particles[i].y;
+				const double zi = gb.shiftz + particles[i].z;
+				double ax = 0.;
+				double ay = 0.;
+				double az = 0.;
+				// The tile row is split into the ranges before and after particle i,
+				// as in the untiled kernels, so the inner loop has no branches.
+				int jt_end1 = MAX(MIN(i, jt_end), jt_start);
+				int jt_start2 = MAX(i+1, jt_start);
+				if (_gravity_ignore_10 && i<2){
+					jt_end1 = jt_start;
+					jt_start2 = MAX(2, jt_start);
+				}
+				const int ranges[2][2] = {{jt_start, jt_end1}, {jt_start2, jt_end}};
+				for (int k=0; k<2; k++){
+				for (int j=ranges[k][0]; j<ranges[k][1]; j++){
+					const double dx = xi - bx[j];
+					const double dy = yi - by[j];
+					const double dz = zi - bz[j];
+					const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+					const double prefact = bm[j]/(_r*_r*_r);
+					ax -= prefact*dx;
+					ay -= prefact*dy;
+					az -= prefact*dz;
+				}
+				}
+				particles[i].ax += G*ax;
+				particles[i].ay += G*ay;
+				particles[i].az += G*az;
+			}
+		}
+	}
+}
+
+static void reb_gravity_simd_basic_symmetric_scalar(const struct reb_simulation* const r, double* restrict const acc, const int j_start, const int j_end){
+	const int stride = r->gravity_simd_allocatedN;
+	const double* restrict const bx = r->gravity_simd_buffer;
+	const double* restrict const by = bx + stride;
+	const double* restrict const bz = bx + 2*stride;
+	const double* restrict const bm = bx + 3*stride;
+	double* restrict const accx = acc;
+	double* restrict const accy = acc + stride;
+	double* restrict const accz = acc + 2*stride;
+	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+	const double softening2 = r->softening*r->softening;
+#pragma omp for schedule(static,16)
+	for (int i=j_start; i<j_end; i++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int j=i+1; j<j_end; j++){
+			if (_gravity_ignore_10 && j==1 && i==0 ) continue;
+			const double dx = bx[i] - bx[j];
+			const double dy = by[i] - by[j];
+			const double dz = bz[i] - bz[j];
+			const double r2 = dx*dx + dy*dy + dz*dz + softening2;
+			const double _r = sqrt(r2);
+			const double prefact = 1./(r2*_r);
+			const double prefactj = prefact*bm[j];
+			const double prefacti = prefact*bm[i];
+			ax -= prefactj*dx;
+			ay -= prefactj*dy;
+			az -= prefactj*dz;
+			accx[j] += prefacti*dx;
+			accy[j] += prefacti*dy;
+			accz[j] += prefacti*dz;
+		}
+		accx[i] += ax;
+		accy[i] += ay;
+		accz[i] += az;
+	}
+}
+
+void reb_gravity_simd_basic_symmetric(struct reb_simulation* const r, const int level, const int j_start, const int j_end){
+#ifdef OPENMP
+	const int nthreads = omp_get_max_threads();
+#else // OPENMP
+	const int nthreads = 1;
+#endif // OPENMP
+	const int stride = r->gravity_simd_allocatedN;
+	// One accumulation buffer (ax, ay, az) per thread.
+	if (r->gravity_thread_buffer_allocatedN<nthreads*3*stride){
+		free(r->gravity_thread_buffer);
+		if (posix_memalign((void**)&(r->gravity_thread_buffer), 64, nthreads*3*stride*sizeof(double))){
+			reb_exit("Cannot allocate memory for gravity accumulation buffers.");
+		}
+		r->gravity_thread_buffer_allocatedN = nthreads*3*stride;
+	}
+	double* restrict const buffer = r->gravity_thread_buffer;
+	int nthreads_used = 1;
+#pragma omp parallel
+	{
+		int tid = 0;
+#ifdef OPENMP
+		tid = omp_get_thread_num();
+#pragma omp single
+		nthreads_used = omp_get_num_threads();
+#endif // OPENMP
+		double* restrict const acc = buffer + tid*3*stride;
+		memset(acc, 0, 3*stride*sizeof(double));
+		switch (level){
+#ifdef REB_SIMD_X86
+			case REB_SIMD_AVX512:
+				reb_gravity_simd_basic_symmetric_avx512(r, acc, j_start, j_end);
+				break;
+			case REB_SIMD_AVX2:
+				reb_gravity_simd_basic_symmetric_avx2(r, acc, j_start, j_end);
+				break;
+#endif // REB_SIMD_X86
+			default:
+				reb_gravity_simd_basic_symmetric_scalar(r, acc, j_start, j_end);
+				break;
+		}
+	}
+	// Reduce thread buffers in a fixed order.
+	struct reb_particle* const particles = r->particles;
+	const double G = r->G;
+#pragma omp parallel for schedule(static)
+	for (int j=j_start; j<j_end; j++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		for (int t=0; t<nthreads_used; t++){
+			const double* const acc = buffer + t*3*stride;
+			ax += acc[j];
+			ay += acc[stride+j];
+			az += acc[2*stride+j];
+		}
+		particles[j].ax += G*ax;
+		particles[j].ay += G*ay;
+		particles[j].az += G*az;
+	}
+}
+
+void reb_gravity_simd_basic(struct reb_simulation* const r, const int level, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	switch (level){
+#ifdef REB_SIMD_X86
+		case REB_SIMD_AVX512:
+			reb_gravity_simd_basic_avx512(r, gb, i_start, i_end, j_start, j_end);
+			break;
+		case REB_SIMD_AVX2:
+			reb_gravity_simd_basic_avx2(r, gb, i_start, i_end, j_start, j_end);
+			break;
+#endif // REB_SIMD_X86
+		default:
+			reb_exit("SIMD gravity kernel not available on this machine.");
+	}
+}
+
+void reb_gravity_simd_basic_tiled(struct reb_simulation* const r, const int level, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end){
+	// The j tiles need to start at a vector boundary.
+	const int tile_j = ((MAX(r->gravity_tile_j,1)+REB_SIMD_WIDTH_MAX-1)/REB_SIMD_WIDTH_MAX)*REB_SIMD_WIDTH_MAX;
+	const int tile_i = MAX(r->gravity_tile_i,1);
+	switch (level){
+#ifdef REB_SIMD_X86
+		case REB_SIMD_AVX512:
+			reb_gravity_simd_basic_tiled_avx512(r, gb, i_start, i_end, j_start, j_end, tile_i, tile_j);
+			break;
+		case REB_SIMD_AVX2:
+			reb_gravity_simd_basic_tiled_avx2(r, gb, i_start, i_end, j_start, j_end, tile_i, tile_j);
+			break;
+#endif // REB_SIMD_X86
+		default:
+			reb_gravity_simd_basic_tiled_scalar(r, gb, i_start, i_end, j_start, j_end, tile_i, tile_j);
+			break;
+	}
+}
+
+void reb_gravity_simd_testparticles(struct reb_simulation* const r, const int level, const int i_start, const int i_end, const int j_start, const int j_end){
+	if (i_start>=i_end) return;
+	const int nghostx = r->nghostx;
+	const int nghosty = r->nghosty;
+	const int nghostz = r->nghostz;
+	const int n_gb = (2*nghostx+1)*(2*nghosty+1)*(2*nghostz+1);
+	struct reb_ghostbox* const gbs = malloc(n_gb*sizeof(struct reb_ghostbox));
+	int g = 0;
+	for (int gbx=-nghostx; gbx<=nghostx; gbx++){
+	for (int gby=-nghosty; gby<=nghosty; gby++){
+	for (int gbz=-nghostz; gbz<=nghostz; gbz++){
+		gbs[g++] = reb_boundary_get_ghostbox(r, gbx, gby, gbz);
+	}
+	}
+	}
+	switch (level){
+#ifdef REB_SIMD_X86
+		case REB_SIMD_AVX512:
+			reb_gravity_simd_testparticles_avx512(r, gbs, n_gb, i_start, i_end, j_start, j_end);
+			break;
+		case REB_SIMD_AVX2:
+			reb_gravity_simd_testparticles_avx2(r, gbs, n_gb, i_start, i_end, j_start, j_end);
+			break;
+#endif // REB_SIMD_X86
+		default:
+			reb_gravity_simd_testparticles_scalar(r, gbs, n_gb, i_start, i_end, j_start, j_end);
+			break;
+	}
+	free(gbs);
+}
+
+void reb_gravity_simd_list(struct reb_simulation* const r, const int level, const double* const list, const int stride, const int n, const int n_self, const int* const members, const int n_members, const double shiftx, const double shifty, const double shiftz){
+	switch (level){
+#ifdef REB_SIMD_X86
+		case REB_SIMD_AVX512:
+			reb_gravity_simd_list_avx512(r, list, stride, n, n_self, members, n_members, shiftx, shifty, shiftz);
+			break;
+		case REB_SIMD_AVX2:
+			reb_gravity_simd_list_avx2(r, list, stride, n, n_self, members, n_members, shiftx, shifty, shiftz);
+			break;
+#endif // REB_SIMD_X86
+		default:
+			reb_gravity_simd_list_scalar(r, list, stride, n, n_self, members, n_members, shiftx, shifty, shiftz);
+			break;
+	}
+}
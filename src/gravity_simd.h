@@ -0,0 +1,141 @@
+/**
+ * @file 	gravity_simd.h
+ * @brief 	Vectorized direct summation kernels with runtime instruction set dispatch.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ *
+ * @section LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _GRAVITY_SIMD_H
+#define _GRAVITY_SIMD_H
+struct reb_simulation;
+struct reb_ghostbox;
+
+/**
+ * @brief Returns the instruction set that will be used for a requested one.
+ * @details Resolves REB_SIMD_AUTO to the widest instruction set supported by
+ * the CPU the library is currently running on. If the requested instruction 
+ * set is not available, REB_SIMD_NONE is returned.
+ * @param simd Requested instruction set, one of the REB_SIMD_* values.
+ * @return One of REB_SIMD_NONE, REB_SIMD_AVX2 or REB_SIMD_AVX512.
+ */
+int reb_simd_level(const int simd);
+
+/**
+ * @brief Returns the instruction set that the direct summation kernels will use.
+ * @details Same as reb_simd_level() for gravity_simd.
+ * @param r REBOUND simulation to consider
+ * @return One of REB_SIMD_NONE, REB_SIMD_AVX2 or REB_SIMD_AVX512.
+ */
+int reb_gravity_simd_level(const struct reb_simulation* const r);
+
+/**
+ * @brief Copies positions and masses of particles [0,N) into the aligned SoA buffer.
+ * @details The buffer is padded with massless particles up to a multiple of the
+ * vector width, so kernels can always load full vectors.
+ * @param r REBOUND simulation to consider
+ * @param N Number of particles to copy.
+ */
+void reb_gravity_simd_pack(struct reb_simulation* const r, const int N);
+
+/**
+ * @brief Direct summation using the SoA buffer filled by reb_gravity_simd_pack().
+ * @details Adds the acceleration from particles [j_start,j_end) to particles
+ * [i_start,i_end), where particle i is shifted by the ghostbox gb.
+ * Pairs with i==j are skipped, as is the pair (0,1) if gravity_ignore_10 is set.
+ * @param r REBOUND simulation to consider
+ * @param level Instruction set as returned by reb_gravity_simd_level().
+ * @param gb Ghostbox of the particles receiving the force.
+ * @param i_start First particle receiving a force.
+ * @param i_end One past the last particle receiving a force.
+ * @param j_start First particle exerting a force.
+ * @param j_end One past the last particle exerting a force.
+ */
+void reb_gravity_simd_basic(struct reb_simulation* const r, const int level, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end);
+
+/**
+ * @brief Cache blocked version of reb_gravity_simd_basic().
+ * @details The particles receiving a force are split into tiles of gravity_tile_i
+ * particles, the particles exerting a force into tiles of gravity_tile_j particles.
+ * One j tile stays in cache while it is used for all particles of an i tile, 
+ * and several particles of the i tile are kept in registers. Also used if the 
+ * CPU does not support any SIMD instructions.
+ * @param r REBOUND simulation to consider
+ * @param level Instruction set as returned by reb_gravity_simd_level(). Can be REB_SIMD_NONE.
+ * @param gb Ghostbox of the particles receiving the force.
+ * @param i_start First particle receiving a force.
+ * @param i_end One past the last particle receiving a force.
+ * @param j_start First particle exerting a force.
+ * @param j_end One past the last particle exerting a force.
+ */
+void reb_gravity_simd_basic_tiled(struct reb_simulation* const r, const int level, const struct reb_ghostbox gb, const int i_start, const int i_end, const int j_start, const int j_end);
+
+/**
+ * @brief Sets the accelerations of test particles [i_start,i_end) to the forces of massive particles [j_start,j_end).
+ * @details The ranges must not overlap and gravity_ignore_10 is not checked. 
+ * Each massive particle is broadcast into a vector register while consecutive 
+ * test particles are processed in the vector lanes. All ghost boxes are summed 
+ * while a test particle is in registers, so each test particle is read and 
+ * written only once. Test particles are split evenly between OpenMP threads. 
+ * Uses the SoA buffer filled by reb_gravity_simd_pack() for the massive particles.
+ * @param r REBOUND simulation to consider
+ * @param level Instruction set as returned by reb_gravity_simd_level(). Can be REB_SIMD_NONE.
+ * @param i_start First test particle.
+ * @param i_end One past the last test particle.
+ * @param j_start First massive particle.
+ * @param j_end One past the last massive particle.
+ */
+void reb_gravity_simd_testparticles(struct reb_simulation* const r, const int level, const int i_start, const int i_end, const int j_start, const int j_end);
+
+/**
+ * @brief Direct summation evaluating each pair of particles [j_start,j_end) only once.
+ * @details Uses Newton's third law. Each thread accumulates the forces in its own 
+ * buffer, the buffers are reduced at the end. The pair (0,1) is skipped if 
+ * gravity_ignore_10 is set. Uses the SoA buffer filled by reb_gravity_simd_pack()
+ * and does not support ghost boxes. 
+ * @param r REBOUND simulation to consider
+ * @param level Instruction set as returned by reb_gravity_simd_level(). Can be REB_SIMD_NONE.
+ * @param j_start First massive particle.
+ * @param j_end One past the last massive particle.
+ */
+void reb_gravity_simd_basic_symmetric(struct reb_simulation* const r, const int level, const int j_start, const int j_end);
+
+/**
+ * @brief Adds the forces of an interaction list to a group of particles.
+ * @details The list is an aligned structure-of-arrays buffer with the arrays x, y, z
+ * and m, each of length stride. The list must be aligned to 64 bytes and the stride
+ * must be a multiple of 8.
+ * The first n_self entries of the list are the members of the group themselves, 
+ * member k does not interact with entry k. Does not use OpenMP, so it can be 
+ * called by several threads at once for different groups.
+ * @param r REBOUND simulation to consider
+ * @param level Instruction set as returned by reb_gravity_simd_level(). Can be REB_SIMD_NONE.
+ * @param list Interaction list.
+ * @param stride Distance between the arrays of the list.
+ * @param n Number of entries in the list.
+ * @param n_self Number of entries at the beginning of the list that are members of the group.
+ * @param members Indices of the particles receiving the force.
+ * @param n_members Number of particles receiving the force.
+ * @param shiftx Shift added to the x positions of the particles receiving the force.
+ * @param shifty Shift added to the y positions of the particles receiving the force.
+ * @param shiftz Shift added to the z positions of the particles receiving the force.
+ */
+void reb_gravity_simd_list(struct reb_simulation* const r, const int level, const double* const list, const int stride, const int n, const int n_self, const int* const members, const int n_members, const double shiftx, const double shifty, const double shiftz);
+
+#endif
@@ -0,0 +1,373 @@
+/**
+ * @file 	integrator_hermite.c
+ * @brief 	Fourth order Hermite integrator with block timesteps.
+ * @author 	Hanno Rein <hanno@hanno-rein.de>
+ * @details	This file implements the fourth order Hermite predictor-corrector
+ * scheme (Makino & Aarseth 1992) with individual, hierarchical block timesteps.
+ * Each particle has its own timestep dt/2^level, where dt is the timestep of the
+ * simulation. One call to reb_step() advances all particles by dt. Within
+ * this step, only the particles whose timestep ends at the current block
+ * time (the active block) are corrected. Their accelerations and jerks are
+ * calculated from the predicted positions and velocities of all other particles.
+ * At the end of every reb_step() all particles are synchronized.
+ *
+ * @section 	LICENSE
+ * Copyright (c) 2015 Hanno Rein
+ *
+ * This file is part of rebound.
+ *
+ * rebound is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * rebound is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with rebound.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "rebound.h"
+#include "integrator_hermite.h"
+
+/**
+ * @brief Adds x to sum using Kahan summation, c holds the running compensation.
+ */
+static inline void reb_integrator_hermite_kahan_add(double* const sum, double* const c, const double x){
+	const double y = x - *c;
+	const double t = *sum + y;
+	*c = (t - *sum) - y;
+	*sum = t;
+}
+
+/**
+ * @brief Calculates the acceleration and jerk of particle i.
+ * @details compensated is a compile time constant at both call sites, so the
+ * branch in the inner loop is removed by the compiler.
+ */
+static inline void reb_integrator_hermite_forces_particle(const struct reb_particle* const particles, const double* restrict const xp, const double* restrict const vp, double* restrict const ap, double* restrict const jp, const int _N_active, const double G, const double softening2, const int i, const int compensated){
+	double sum[6] = {0.,0.,0.,0.,0.,0.};	// ax, ay, az, jx, jy, jz
+	double cs[6] = {0.,0.,0.,0.,0.,0.};
+	for (int j=0; j<_N_active; j++){
+		if (j==i) continue;
+		const double dx = xp[3*j+0] - xp[3*i+0];
+		const double dy = xp[3*j+1] - xp[3*i+1];
+		const double dz = xp[3*j+2] - xp[3*i+2];
+		const double dvx = vp[3*j+0] - vp[3*i+0];
+		const double dvy = vp[3*j+1] - vp[3*i+1];
+		const double dvz = vp[3*j+2] - vp[3*i+2];
+		const double r2 = dx*dx + dy*dy + dz*dz + softening2;
+		const double _r = sqrt(r2);
+		const double prefact = G*particles[j].m/(r2*_r);
+		const double rv = 3.*(dx*dvx + dy*dvy + dz*dvz)/r2;
+		const double f[6] = {prefact*dx, prefact*dy, prefact*dz, prefact*(dvx - rv*dx), prefact*(dvy - rv*dy), prefact*(dvz - rv*dz)};
+		for (int l=0; l<6; l++){
+			if (compensated){
+				reb_integrator_hermite_kahan_add(&sum[l], &cs[l], f[l]);
+			}else{
+				sum[l] += f[l];
+			}
+		}
+	}
+	for (int c=0; c<3; c++){
+		ap[3*i+c] = sum[c];
+		jp[3*i+c] = sum[3+c];
+	}
+}
+
+/**
+ * @brief Calculates the acceleration and jerk of the active particles.
+ * @details Uses the predicted positions and velocities of all massive particles.
+ * The results are stored in ap and jp. With REB_GRAVITY_COMPENSATED the 
+ * sums over particles use Kahan summation.
+ */
+static void reb_integrator_hermite_forces(struct reb_simulation* const r, const int n_active){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	const struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+	const int _N_active = (r->N_active==-1)?N:r->N_active;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	const int* const active = ri_hermite->active;
+	const double* restrict const xp = ri_hermite->xp;
+	const double* restrict const vp = ri_hermite->vp;
+	double* restrict const ap = ri_hermite->ap;
+	double* restrict const jp = ri_hermite->jp;
+	if (r->gravity==REB_GRAVITY_COMPENSATED){
+#pragma omp parallel for schedule(guided)
+		for (int k=0; k<n_active; k++){
+			reb_integrator_hermite_forces_particle(particles, xp, vp, ap, jp, _N_active, G, softening2, active[k], 1);
+		}
+	}else{
+#pragma omp parallel for schedule(guided)
+		for (int k=0; k<n_active; k++){
+			reb_integrator_hermite_forces_particle(particles, xp, vp, ap, jp, _N_active, G, softening2, active[k], 0);
+		}
+	}
+}
+
+/**
+ * @brief Predicts positions and velocities of all particles at time T (in ticks).
+ * @details Particles already at time T are copied.
+ */
+static void reb_integrator_hermite_predict(struct reb_simulation* const r, const long long T, const double dt_tick){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	const struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+	const long long* const tick = ri_hermite->tick;
+	const double* restrict const a = ri_hermite->a;
+	const double* restrict const jerk = ri_hermite->jerk;
+	double* restrict const xp = ri_hermite->xp;
+	double* restrict const vp = ri_hermite->vp;
+#pragma omp parallel for schedule(guided)
+	for (int i=0; i<N; i++){
+		const double tau = (double)(T-tick[i])*dt_tick;
+		const double x[3] = {particles[i].x, particles[i].y, particles[i].z};
+		const double v[3] = {particles[i].vx, particles[i].vy, particles[i].vz};
+		for (int c=0; c<3; c++){
+			const int k = 3*i+c;
+			xp[k] = x[c] + tau*(v[c] + tau/2.*(a[k] + tau/3.*jerk[k]));
+			vp[k] = v[c] + tau*(a[k] + tau/2.*jerk[k]);
+		}
+	}
+}
+
+/**
+ * @brief Returns the smallest level with a timestep not larger than dt_i.
+ */
+static int reb_integrator_hermite_level(const double dt, const double dt_i, const int max_level){
+	int level = 0;
+	while (level<max_level && ldexp(fabs(dt), -level)>dt_i){
+		level++;
+	}
+	return level;
+}
+
+/**
+ * @brief Allocates arrays and calculates accelerations, jerks and timesteps of all particles.
+ */
+static void reb_integrator_hermite_init(struct reb_simulation* const r){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+	if (ri_hermite->allocatedN<N){
+		ri_hermite->allocatedN = N;
+		ri_hermite->a 		= realloc(ri_hermite->a, sizeof(double)*3*N);
+		ri_hermite->jerk 	= realloc(ri_hermite->jerk, sizeof(double)*3*N);
+		ri_hermite->xp 		= realloc(ri_hermite->xp, sizeof(double)*3*N);
+		ri_hermite->vp 		= realloc(ri_hermite->vp, sizeof(double)*3*N);
+		ri_hermite->ap 		= realloc(ri_hermite->ap, sizeof(double)*3*N);
+		ri_hermite->jp 		= realloc(ri_hermite->jp, sizeof(double)*3*N);
+		ri_hermite->tick 	= realloc(ri_hermite->tick, sizeof(long long)*N);
+		ri_hermite->level 	= realloc(ri_hermite->level, sizeof(int)*N);
+		ri_hermite->active 	= realloc(ri_hermite->active, sizeof(int)*N);
+	}
+	ri_hermite->initializedN = N;
+	ri_hermite->recalculate_this_timestep = 0;
+	for (int i=0; i<N; i++){
+		ri_hermite->tick[i] = 0;
+		ri_hermite->active[i] = i;
+		// The predictor multiplies a and jerk by tau=0, which gives NaN for uninitialized memory.
+		for (int c=0; c<3; c++){
+			ri_hermite->a[3*i+c] = 0.;
+			ri_hermite->jerk[3*i+c] = 0.;
+		}
+	}
+	reb_integrator_hermite_predict(r, 0, 0.);
+	reb_integrator_hermite_forces(r, N);
+	for (int i=0; i<N; i++){
+		double a2 = 0.;
+		double j2 = 0.;
+		for (int c=0; c<3; c++){
+			const int k = 3*i+c;
+			ri_hermite->a[k] = ri_hermite->ap[k];
+			ri_hermite->jerk[k] = ri_hermite->jp[k];
+			a2 += ri_hermite->a[k]*ri_hermite->a[k];
+			j2 += ri_hermite->jerk[k]*ri_hermite->jerk[k];
+		}
+		particles[i].ax = ri_hermite->a[3*i+0];
+		particles[i].ay = ri_hermite->a[3*i+1];
+		particles[i].az = ri_hermite->a[3*i+2];
+		const double dt_i = ri_hermite->eta_start*sqrt(a2/j2);
+		ri_hermite->level[i] = reb_integrator_hermite_level(r->dt, dt_i, ri_hermite->max_level);
+	}
+}
+
+/**
+ * @brief Corrects the active particles at time T (in ticks) and selects their new timesteps.
+ */
+static void reb_integrator_hermite_correct(struct reb_simulation* const r, const int n_active, const long long T, const double dt_tick){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	struct reb_particle* const particles = r->particles;
+	const int max_level = ri_hermite->max_level;
+	const double eta = ri_hermite->eta;
+	const double dt = r->dt;
+	const int* const active = ri_hermite->active;
+	long long* const tick = ri_hermite->tick;
+	int* const level = ri_hermite->level;
+	double* restrict const a = ri_hermite->a;
+	double* restrict const jerk = ri_hermite->jerk;
+	const double* restrict const xp = ri_hermite->xp;
+	const double* restrict const vp = ri_hermite->vp;
+	const double* restrict const ap = ri_hermite->ap;
+	const double* restrict const jp = ri_hermite->jp;
+	int level_warning = 0;
+#pragma omp parallel for schedule(guided) reduction(+:level_warning)
+	for (int k=0; k<n_active; k++){
+		const int i = active[k];
+		const double h = (double)(T-tick[i])*dt_tick;
+		double x[3], v[3];
+		double a2 = 0., j2 = 0., s2 = 0., c2 = 0.;
+		for (int c=0; c<3; c++){
+			const int q = 3*i+c;
+			// Higher derivatives at the beginning of the step from the Hermite interpolation.
+			const double snap = (-6.*(a[q]-ap[q]) - h*(4.*jerk[q]+2.*jp[q]))/(h*h);
+			const double crackle = (12.*(a[q]-ap[q]) + 6.*h*(jerk[q]+jp[q]))/(h*h*h);
+			x[c] = xp[q] + h*h*h*h/24.*(snap + h/5.*crackle);
+			v[c] = vp[q] + h*h*h/6.*(snap + h/4.*crackle);
+			const double snap1 = snap + h*crackle;
+			a2 += ap[q]*ap[q];
+			j2 += jp[q]*jp[q];
+			s2 += snap1*snap1;
+			c2 += crackle*crackle;
+			a[q] = ap[q];
+			jerk[q] = jp[q];
+		}
+		particles[i].x  = x[0];
+		particles[i].y  = x[1];
+		particles[i].z  = x[2];
+		particles[i].vx = v[0];
+		particles[i].vy = v[1];
+		particles[i].vz = v[2];
+		particles[i].ax = a[3*i+0];
+		particles[i].ay = a[3*i+1];
+		particles[i].az = a[3*i+2];
+		tick[i] = T;
+
+		// Aarseth criterion. Halve the timestep as often as needed,
+		// double it only if the new block is aligned.
+		const double _a = sqrt(a2), _j = sqrt(j2), _s = sqrt(s2), _c = sqrt(c2);
+		const double dt_new = sqrt(eta*(_a*_s + j2)/(_j*_c + s2));
+		int l = level[i];
+		if (dt_new<ldexp(fabs(dt), -l)){
+			l = reb_integrator_hermite_level(dt, dt_new, max_level);
+			if (l==max_level && ldexp(fabs(dt), -l)>dt_new){
+				level_warning++;
+			}
+		}else if (l>0 && dt_new>=ldexp(fabs(dt), 1-l) && T%(2LL<<(max_level-l))==0){
+			l--;
+		}
+		level[i] = l;
+	}
+	if (level_warning && ri_hermite->level_warning==0){
+		ri_hermite->level_warning = 1;
+		reb_warning("Hermite integrator reached the smallest timestep dt/2^max_level. Results might be inaccurate.");
+	}
+}
+
+// Do nothing here. Hermite performs one complete step (all blocks) in part 2.
+void reb_integrator_hermite_part1(struct reb_simulation* r){
+}
+
+void reb_integrator_hermite_part2(struct reb_simulation* r){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	const int N = r->N;
+	if (r->gravity!=REB_GRAVITY_BASIC && r->gravity!=REB_GRAVITY_COMPENSATED){
+		reb_exit("The Hermite integrator only supports direct summation (REB_GRAVITY_BASIC or REB_GRAVITY_COMPENSATED).");
+	}
+	if (r->nghostx || r->nghosty || r->nghostz){
+		reb_exit("The Hermite integrator does not support ghost boxes.");
+	}
+	if (r->boundary==REB_BOUNDARY_PERIODIC || r->boundary==REB_BOUNDARY_SHEAR){
+		reb_exit("The Hermite integrator does not support periodic or shear periodic boundaries.");
+	}
+	if (r->N_var){
+		reb_exit("The Hermite integrator does not support variational particles.");
+	}
+	if (r->additional_forces){
+		reb_exit("The Hermite integrator does not support additional forces.");
+	}
+	if (ri_hermite->max_level>62){
+		reb_exit("The Hermite integrator supports at most 62 timestep levels.");
+	}
+	if (ri_hermite->initializedN!=N || ri_hermite->recalculate_this_timestep){
+		reb_integrator_hermite_init(r);
+	}else if (r->dt!=r->dt_last_done){
+		// Levels are relative to dt. Keep the timesteps of all particles
+		// the same or smaller if dt changed (e.g. for exact_finish_time).
+		for (int i=0; i<N; i++){
+			const double dt_i = ldexp(fabs(r->dt_last_done), -ri_hermite->level[i]);
+			ri_hermite->level[i] = reb_integrator_hermite_level(r->dt, dt_i, ri_hermite->max_level);
+		}
+	}
+	const int max_level = ri_hermite->max_level;
+	const double dt_tick = ldexp(r->dt, -max_level);
+	const long long T_end = 1LL<<max_level;
+	long long T = 0;
+	while (T<T_end){
+		// Find the next block time and the particles whose timestep ends there.
+		long long T_next = T_end;
+		for (int i=0; i<N; i++){
+			const long long t_i = ri_hermite->tick[i] + (1LL<<(max_level-ri_hermite->level[i]));
+			if (t_i<T_next){
+				T_next = t_i;
+			}
+		}
+		int n_active = 0;
+		for (int i=0; i<N; i++){
+			if (ri_hermite->tick[i] + (1LL<<(max_level-ri_hermite->level[i]))==T_next){
+				ri_hermite->active[n_active++] = i;
+			}
+		}
+		reb_integrator_hermite_predict(r, T_next, dt_tick);
+		reb_integrator_hermite_forces(r, n_active);
+		reb_integrator_hermite_correct(r, n_active, T_next, dt_tick);
+		ri_hermite->steps_done += n_active;
+		T = T_next;
+	}
+	// All particles are synchronized, the next step starts at tick 0.
+	for (int i=0; i<N; i++){
+		ri_hermite->tick[i] = 0;
+	}
+	r->t += r->dt;
+	r->dt_last_done = r->dt;
+}
+
+void reb_integrator_hermite_synchronize(struct reb_simulation* r){
+	// Do nothing. Particles are synchronized after every step.
+}
+
+void reb_integrator_hermite_reset(struct reb_simulation* r){
+	struct reb_simulation_integrator_hermite* const ri_hermite = &(r->ri_hermite);
+	ri_hermite->allocatedN = 0;
+	ri_hermite->initializedN = 0;
+	ri_hermite->steps_done = 0;
+	ri_hermite->level_warning = 0;
+	free(ri_hermite->a);
+	ri_hermite->a = NULL;
+	free(ri_hermite->jerk);
+	ri_hermite->jerk = NULL;
+	free(ri_hermite->xp);
+	ri_hermite->xp = NULL;
+	free(ri_hermite->vp);
+	ri_hermite->vp = NULL;
+	free(ri_hermite->ap);
+	ri_hermite->ap = NULL;
+	free(ri_hermite->jp);
+	ri_hermite->jp = NULL;
+	free(ri_hermite->tick);
+	ri_hermite->tick = NULL;
+	free(ri_hermite->level);
+	ri_hermite->level = NULL;
+	free(ri_hermite->active);
+	ri_hermite->active = NULL;
+}
@@ -40,6 +40,7 @@
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <float.h>
 // Uncomment the following line to generate numerical constants with extended precision.
 //#define GENERATE_CONSTANTS
 #ifdef GENERATE_CONSTANTS
@@ -67,8 +68,8 @@ struct reb_dpconst7 {
 };
 
 // Helper functions for resetting the b and e coefficients
-static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, int N3);
-static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b);
+static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, const struct reb_dpconst7 _c, const struct reb_dpconst7 _d, int N3);
+static void predict_next_step(double ratio, int N3, int parallel, const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b);
 
 
 /////////////////////////
@@ -76,6 +77,18 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
 
 static const double safety_factor 			= 0.25;	/**< Maximum increase/deacrease of consecutve timesteps. */
 
+/**
+ * Loops over the 3N coordinates only use OpenMP if 3N is larger than this.
+ * For smaller simulations the fork/join overhead exceeds the work per loop.
+ */
+#define REB_IAS15_OPENMP_THRESHOLD 1536
+
+/**
+ * Number of arrays in the arena: the six reb_dp7 sets g, b, csb, e, br and er,
+ * plus at, x0, v0, a0, csx, csv, csa0, xs and vs.
+ */
+#define REB_IAS15_ARRAYS (6*7+9)
+
 // Gauss Radau spacings
 static const double h[8]	= { 0.0, 0.0562625605369221464656521910, 0.1802406917368923649875799428, 0.3526247171131696373739077702, 0.5471536263305553830014485577, 0.7342101772154105410531523211, 0.8853209468390957680903597629, 0.9775206135612875018911745004}; 
 // Other constants
@@ -87,39 +100,92 @@ static const double d[21] = {0.0562625605369221464656522, 0.00316547571817082924
 static const double w[8] = {0.03125, 0.185358154802979278540728972807180754479812609, 0.304130620646785128975743291458180383736715043, 0.376517545389118556572129261157225608762708603, 0.391572167452493593082499533303669362149363727, 0.347014795634501068709955597003528601733139176, 0.249647901329864963257869294715235590174262844, 0.114508814744257199342353731044292225247093225};
 
 
-static void free_dp7(struct reb_dp7* dp7){
-	free(dp7->p0);
-	free(dp7->p1);
-	free(dp7->p2);
-	free(dp7->p3);
-	free(dp7->p4);
-	free(dp7->p5);
-	free(dp7->p6);
-	dp7->p0 = NULL;
-	dp7->p1 = NULL;
-	dp7->p2 = NULL;
-	dp7->p3 = NULL;
-	dp7->p4 = NULL;
-	dp7->p5 = NULL;
-	dp7->p6 = NULL;
+static void set_dp7(struct reb_dp7* const dp7, double* const base, const size_t stride){
+	dp7->p0 = base ? base+0*stride : NULL;
+	dp7->p1 = base ? base+1*stride : NULL;
+	dp7->p2 = base ? base+2*stride : NULL;
+	dp7->p3 = base ? base+3*stride : NULL;
+	dp7->p4 = base ? base+4*stride : NULL;
+	dp7->p5 = base ? base+5*stride : NULL;
+	dp7->p6 = base ? base+6*stride : NULL;
+}
+
+/**
+ * Distance between consecutive arrays in the arena. Arrays are padded to
+ * whole cache lines, plus one extra cache line so that the same element of
+ * different arrays does not map to the same cache set if N3 is a power of two.
+ */
+static size_t arena_stride(const int allocatedN){
+	return ((size_t)allocatedN+7)/8*8 + 8;
+}
+
+// Points all arrays into the arena, or sets them to NULL if there is no arena.
+static void set_arena_pointers(struct reb_simulation_integrator_ias15* const ri){
+	double* const arena = ri->arena;
+	const size_t stride = arena_stride(ri->allocatedN);
+	set_dp7(&(ri->g),   arena ?  arena+0*7*stride : NULL, stride);
+	set_dp7(&(ri->b),   arena ?  arena+1*7*stride : NULL, stride);
+	set_dp7(&(ri->csb), arena ?  arena+2*7*stride : NULL, stride);
+	set_dp7(&(ri->e),   arena ?  arena+3*7*stride : NULL, stride);
+	set_dp7(&(ri->br),  arena ?  arena+4*7*stride : NULL, stride);
+	set_dp7(&(ri->er),  arena ?  arena+5*7*stride : NULL, stride);
+	double* const scratch = arena ? arena+6*7*stride : NULL;
+	ri->at   = scratch ? scratch+0*stride : NULL;
+	ri->x0   = scratch ? scratch+1*stride : NULL;
+	ri->v0   = scratch ? scratch+2*stride : NULL;
+	ri->a0   = scratch ? scratch+3*stride : NULL;
+	ri->csx  = scratch ? scratch+4*stride : NULL;
+	ri->csv  = scratch ? scratch+5*stride : NULL;
+	ri->csa0 = scratch ? scratch+6*stride : NULL;
+	ri->xs   = scratch ? scratch+7*stride : NULL;
+	ri->vs   = scratch ? scratch+8*stride : NULL;
+}
+
+/**
+ * Zeroes the coordinates [k_start, k_end) of the b, e, g coefficients and of 
+ * all compensated summation coefficients. Used for particles that were added
+ * since the last step, so they do not inherit the state of removed particles.
+ */
+static void zero_arena_rows(struct reb_simulation_integrator_ias15* const ri, const int k_start, const int k_end){
+	const size_t stride = arena_stride(ri->allocatedN);
+	const size_t size = sizeof(double)*(k_end-k_start);
+	for (int a=0; a<6*7; a++){
+		memset(ri->arena+a*stride+k_start, 0, size);
+	}
+	memset(ri->csx+k_start, 0, size);
+	memset(ri->csv+k_start, 0, size);
+	memset(ri->csa0+k_start, 0, size);
 }
-static void realloc_dp7(struct reb_dp7* const dp7, const int N3){
-	dp7->p0 = realloc(dp7->p0,sizeof(double)*N3);
-	dp7->p1 = realloc(dp7->p1,sizeof(double)*N3);
-	dp7->p2 = realloc(dp7->p2,sizeof(double)*N3);
-	dp7->p3 = realloc(dp7->p3,sizeof(double)*N3);
-	dp7->p4 = realloc(dp7->p4,sizeof(double)*N3);
-	dp7->p5 = realloc(dp7->p5,sizeof(double)*N3);
-	dp7->p6 = realloc(dp7->p6,sizeof(double)*N3);
-	for (int k=0;k<N3;k++){
-		dp7->p0[k] = 0.;
-		dp7->p1[k] = 0.;
-		dp7->p2[k] = 0.;
-		dp7->p3[k] = 0.;
-		dp7->p4[k] = 0.;
-		dp7->p5[k] = 0.;
-		dp7->p6[k] = 0.;
+
+/**
+ * Makes sure the arena has space for N3 coordinates. It grows by at least a 
+ * factor of two and shrinks to twice the size needed once less than a quarter
+ * is used, so adding or removing particles one at a time does not reallocate
+ * every timestep. A new arena is zeroed, which resets the b and e coefficients 
+ * and all compensated summation coefficients. If the arena is kept and N 
+ * grew since the last step, only the new coordinates are zeroed.
+ */
+static void resize_arena(struct reb_simulation_integrator_ias15* const ri, const int N3){
+	int allocatedN = ri->allocatedN;
+	if (N3 > allocatedN){
+		allocatedN = 2*allocatedN > N3 ? 2*allocatedN : N3;
+	}else if (N3 < allocatedN/4){
+		allocatedN = 2*N3;
+	}else{
+		if (N3 > 3*ri->last_N){
+			zero_arena_rows(ri, 3*ri->last_N, N3);
+		}
+		return;
+	}
+	free(ri->arena);
+	const size_t size = sizeof(double)*REB_IAS15_ARRAYS*arena_stride(allocatedN);
+	if (posix_memalign((void**)&(ri->arena), 64, size)){
+		reb_exit("Cannot allocate memory for IAS15.");
 	}
+	memset(ri->arena, 0, size);
+	ri->allocatedN = allocatedN;
+	ri->last_N = 0;
+	set_arena_pointers(ri);
 }
 
 static struct reb_dpconst7 dpcast(struct reb_dp7 dp){
@@ -141,40 +207,211 @@ static inline void add_cs(double* p, double* csp, double inp){
 	*csp = (t - *p) - y;
 	*p = t;
 }
- 
+
+// Kills the compensated summation coefficients of b and calculates g from b in one pass.
+static void init_g(const int N3, const int parallel, const struct reb_dpconst7 g, const struct reb_dpconst7 b, const struct reb_dpconst7 csb){
+#pragma omp parallel for schedule(static) if(parallel)
+	for(int k=0;k<N3;k++) {
+		csb.p0[k] = 0.;
+		csb.p1[k] = 0.;
+		csb.p2[k] = 0.;
+		csb.p3[k] = 0.;
+		csb.p4[k] = 0.;
+		csb.p5[k] = 0.;
+		csb.p6[k] = 0.;
+		g.p0[k] = b.p6[k]*d[15] + b.p5[k]*d[10] + b.p4[k]*d[6] + b.p3[k]*d[3]  + b.p2[k]*d[1]  + b.p1[k]*d[0]  + b.p0[k];
+		g.p1[k] = b.p6[k]*d[16] + b.p5[k]*d[11] + b.p4[k]*d[7] + b.p3[k]*d[4]  + b.p2[k]*d[2]  + b.p1[k];
+		g.p2[k] = b.p6[k]*d[17] + b.p5[k]*d[12] + b.p4[k]*d[8] + b.p3[k]*d[5]  + b.p2[k];
+		g.p3[k] = b.p6[k]*d[18] + b.p5[k]*d[13] + b.p4[k]*d[9] + b.p3[k];
+		g.p4[k] = b.p6[k]*d[19] + b.p5[k]*d[14] + b.p4[k];
+		g.p5[k] = b.p6[k]*d[20] + b.p5[k];
+		g.p6[k] = b.p6[k];
+	}
+}
+
+// Improves the b and g values at interval n. Returns the predictor corrector error if n==7.
+static double update_gb(const int n, const int N3, const int parallel, const int epsilon_global, const struct reb_dpconst7 g, const struct reb_dpconst7 b, const struct reb_dpconst7 csb, const double* restrict const at, const double* restrict const a0, const double* restrict const csa0, const double* restrict const acs){
+	double predictor_corrector_error = 0.;
+	switch (n) {							// Improve b and g values
+		case 1: 
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p0[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p0[k]  = gk/rr[0];
+				add_cs(&(b.p0[k]), &(csb.p0[k]), g.p0[k]-tmp);
+			} break;
+		case 2: 
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p1[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p1[k] = (gk/rr[1] - g.p0[k])/rr[2];
+				tmp = g.p1[k] - tmp;
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[0]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp);
+			} break;
+		case 3: 
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p2[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p2[k] = ((gk/rr[3] - g.p0[k])/rr[4] - g.p1[k])/rr[5];
+				tmp = g.p2[k] - tmp;
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[1]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[2]);
+				add_cs(&(b.p2[k]), &(csb.p2[k]), tmp);
+			} break;
+		case 4:
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p3[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p3[k] = (((gk/rr[6] - g.p0[k])/rr[7] - g.p1[k])/rr[8] - g.p2[k])/rr[9];
+				tmp = g.p3[k] - tmp;
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[3]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[4]);
+				add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[5]);
+				add_cs(&(b.p3[k]), &(csb.p3[k]), tmp);
+			} break;
+		case 5:
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p4[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p4[k] = ((((gk/rr[10] - g.p0[k])/rr[11] - g.p1[k])/rr[12] - g.p2[k])/rr[13] - g.p3[k])/rr[14];
+				tmp = g.p4[k] - tmp;
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[6]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[7]);
+				add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[8]);
+				add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[9]);
+				add_cs(&(b.p4[k]), &(csb.p4[k]), tmp);
+			} break;
+		case 6:
+#pragma omp parallel for schedule(static) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p5[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p5[k] = (((((gk/rr[15] - g.p0[k])/rr[16] - g.p1[k])/rr[17] - g.p2[k])/rr[18] - g.p3[k])/rr[19] - g.p4[k])/rr[20];
+				tmp = g.p5[k] - tmp;
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[10]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[11]);
+				add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[12]);
+				add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[13]);
+				add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[14]);
+				add_cs(&(b.p5[k]), &(csb.p5[k]), tmp);
+			} break;
+		case 7:
+		{
+			double maxak = 0.0;
+			double maxb6ktmp = 0.0;
+#pragma omp parallel for schedule(static) reduction(max:maxak,maxb6ktmp,predictor_corrector_error) if(parallel)
+			for(int k=0;k<N3;++k) {
+				double tmp = g.p6[k];
+				double gk = at[k];
+				double gk_cs = acs[k];
+				add_cs(&gk, &gk_cs, -a0[k]);
+				add_cs(&gk, &gk_cs, csa0[k]);
+				g.p6[k] = ((((((gk/rr[21] - g.p0[k])/rr[22] - g.p1[k])/rr[23] - g.p2[k])/rr[24] - g.p3[k])/rr[25] - g.p4[k])/rr[26] - g.p5[k])/rr[27];
+				tmp = g.p6[k] - tmp;	
+				add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[15]);
+				add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[16]);
+				add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[17]);
+				add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[18]);
+				add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[19]);
+				add_cs(&(b.p5[k]), &(csb.p5[k]), tmp * c[20]);
+				add_cs(&(b.p6[k]), &(csb.p6[k]), tmp);
+				
+				// Monitor change in b.p6[k] relative to at[k]. The predictor corrector scheme is converged if it is close to 0.
+				if (epsilon_global){
+					const double ak  = fabs(at[k]);
+					if (isnormal(ak) && ak>maxak){
+						maxak = ak;
+					}
+					const double b6ktmp = fabs(tmp);  // change of b6ktmp coefficient
+					if (isnormal(b6ktmp) && b6ktmp>maxb6ktmp){
+						maxb6ktmp = b6ktmp;
+					}
+				}else{
+					const double ak  = at[k];
+					const double b6ktmp = tmp; 
+					const double errork = fabs(b6ktmp/ak);
+					if (isnormal(errork) && errork>predictor_corrector_error){
+						predictor_corrector_error = errork;
+					}
+				}
+			} 
+			if (epsilon_global){
+				predictor_corrector_error = maxb6ktmp/maxak;
+			}
+			break;
+		}
+	}
+	return predictor_corrector_error;
+}
+
+// Finds new position and velocity values at end of the sequence.
+// The values at the beginning are saved in xs and vs for dense output.
+static void update_xv(const int N3, const int parallel, const double dt_done, double* restrict const x0, double* restrict const csx, double* restrict const v0, double* restrict const csv, double* restrict const xs, double* restrict const vs, const double* restrict const a0, const struct reb_dpconst7 b){
+	const double dt_done2 = dt_done * dt_done;
+#pragma omp parallel for schedule(static) if(parallel)
+	for(int k=0;k<N3;++k) {
+		xs[k] = x0[k];
+		vs[k] = v0[k];
+		{
+			add_cs(&(x0[k]), &(csx[k]), b.p6[k]/72.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p5[k]/56.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p4[k]/42.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p3[k]/30.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p2[k]/20.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p1[k]/12.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), b.p0[k]/6.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), a0[k]/2.*dt_done2);
+			add_cs(&(x0[k]), &(csx[k]), v0[k]*dt_done);
+		}
+		{
+			add_cs(&(v0[k]), &(csv[k]), b.p6[k]/8.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p5[k]/7.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p4[k]/6.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p3[k]/5.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p2[k]/4.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p1[k]/3.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), b.p0[k]/2.*dt_done);
+			add_cs(&(v0[k]), &(csv[k]), a0[k]*dt_done);
+		}
+	}
+}
+
 // Does the actual timestep.
 static int reb_integrator_ias15_step(struct reb_simulation* r) {
 	struct reb_particle* const particles = r->particles;
 	const int N = r->N;
 	const int N_var  = r->N_var;
 	const int N3 = 3*N;
-	if (N3 > r->ri_ias15.allocatedN) {
-		realloc_dp7(&(r->ri_ias15.g),N3);
-		realloc_dp7(&(r->ri_ias15.b),N3);
-		realloc_dp7(&(r->ri_ias15.csb),N3);
-		realloc_dp7(&(r->ri_ias15.e),N3);
-		realloc_dp7(&(r->ri_ias15.br),N3);
-		realloc_dp7(&(r->ri_ias15.er),N3);
-		r->ri_ias15.at = realloc(r->ri_ias15.at,sizeof(double)*N3);
-		r->ri_ias15.x0 = realloc(r->ri_ias15.x0,sizeof(double)*N3);
-		r->ri_ias15.v0 = realloc(r->ri_ias15.v0,sizeof(double)*N3);
-		r->ri_ias15.a0 = realloc(r->ri_ias15.a0,sizeof(double)*N3);
-		r->ri_ias15.csx= realloc(r->ri_ias15.csx,sizeof(double)*N3);
-		r->ri_ias15.csv= realloc(r->ri_ias15.csv,sizeof(double)*N3);
-		r->ri_ias15.csa0 = realloc(r->ri_ias15.csa0,sizeof(double)*N3);
-		double* restrict const csx = r->ri_ias15.csx; 
-		double* restrict const csv = r->ri_ias15.csv; 
-		for (int i=0;i<N3;i++){
-			// Kill compensated summation coefficients
-			csx[i] = 0;
-			csv[i] = 0;
-		}
-		r->ri_ias15.allocatedN = N3;
-	}
+	resize_arena(&(r->ri_ias15), N3);
 	
 	// reb_update_acceleration(); // Not needed. Forces are already calculated in main routine.
 	
-	double s[9];				// Summation coefficients 
+	double s[9];				// Summation coefficients for positions
+	double sv[8];				// Summation coefficients for velocities
 	double* restrict const csx = r->ri_ias15.csx; 
 	double* restrict const csv = r->ri_ias15.csv; 
 	double* restrict const csa0 = r->ri_ias15.csa0; 
@@ -189,6 +426,14 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 	const struct reb_dpconst7 csb= dpcast(r->ri_ias15.csb);
 	const struct reb_dpconst7 er = dpcast(r->ri_ias15.er);
 	const struct reb_dpconst7 br = dpcast(r->ri_ias15.br);
+	const int compensated = (r->gravity==REB_GRAVITY_COMPENSATED);
+	if (!compensated){
+		gravity_cs = (struct reb_vec3d*)csa0; // Always 0.
+	}
+	const double* const acs = (double*)gravity_cs;
+	const int parallel = (N3 > REB_IAS15_OPENMP_THRESHOLD);
+	const int epsilon_global = r->ri_ias15.epsilon_global;
+#pragma omp parallel for schedule(static) if(parallel)
 	for(int k=0;k<N;k++) {
 		x0[3*k]   = particles[k].x;
 		x0[3*k+1] = particles[k].y;
@@ -199,39 +444,18 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 		a0[3*k]   = particles[k].ax;
 		a0[3*k+1] = particles[k].ay; 
 		a0[3*k+2] = particles[k].az;
-	}
-	if (r->gravity==REB_GRAVITY_COMPENSATED){
-		for(int k=0;k<N;k++) {
+		if (compensated){
 			csa0[3*k]   = gravity_cs[k].x;
 			csa0[3*k+1] = gravity_cs[k].y;  
 			csa0[3*k+2] = gravity_cs[k].z;
+		}else{
+			csa0[3*k]   = 0.;
+			csa0[3*k+1] = 0.;
+			csa0[3*k+2] = 0.;
 		}
-	}else{
-		gravity_cs = (struct reb_vec3d*)csa0; // Always 0.
-		for(int k=0;k<N3;k++) {
-			csa0[k]   = 0;
-		}
-	}
-	for (int k=0;k<N3;k++){
-		// Memset might be faster!
-		csb.p0[k] = 0.;
-		csb.p1[k] = 0.;
-		csb.p2[k] = 0.;
-		csb.p3[k] = 0.;
-		csb.p4[k] = 0.;
-		csb.p5[k] = 0.;
-		csb.p6[k] = 0.;
 	}
 
-	for(int k=0;k<N3;k++) {
-		g.p0[k] = b.p6[k]*d[15] + b.p5[k]*d[10] + b.p4[k]*d[6] + b.p3[k]*d[3]  + b.p2[k]*d[1]  + b.p1[k]*d[0]  + b.p0[k];
-		g.p1[k] = b.p6[k]*d[16] + b.p5[k]*d[11] + b.p4[k]*d[7] + b.p3[k]*d[4]  + b.p2[k]*d[2]  + b.p1[k];
-		g.p2[k] = b.p6[k]*d[17] + b.p5[k]*d[12] + b.p4[k]*d[8] + b.p3[k]*d[5]  + b.p2[k];
-		g.p3[k] = b.p6[k]*d[18] + b.p5[k]*d[13] + b.p4[k]*d[9] + b.p3[k];
-		g.p4[k] = b.p6[k]*d[19] + b.p5[k]*d[14] + b.p4[k];
-		g.p5[k] = b.p6[k]*d[20] + b.p5[k];
-		g.p6[k] = b.p6[k];
-	}
+	init_g(N3, parallel, g, b, csb);
 
 	double integrator_megno_thisdt = 0.;
 	double integrator_megno_thisdt_init = 0.;
@@ -283,7 +507,19 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 			
 			r->t = t_beginning + s[0];
 
-			// Prepare particles arrays for force calculation
+			sv[0] = r->dt * h[n];
+			sv[1] =       sv[0] * h[n] / 2.;
+			sv[2] = 2. * sv[1] * h[n] / 3.;
+			sv[3] = 3. * sv[2] * h[n] / 4.;
+			sv[4] = 4. * sv[3] * h[n] / 5.;
+			sv[5] = 5. * sv[4] * h[n] / 6.;
+			sv[6] = 6. * sv[5] * h[n] / 7.;
+			sv[7] = 7. * sv[6] * h[n] / 8.;
+
+			// Prepare particles arrays for force calculation. 
+			// Positions and, if needed, velocities are predicted in the same pass.
+			const int predict_velocities = (N_var || (r->additional_forces && r->force_is_velocity_dependent));
+#pragma omp parallel for schedule(static) if(parallel)
 			for(int i=0;i<N;i++) {						// Predict positions at interval n using b values
 				const int k0 = 3*i+0;
 				const int k1 = 3*i+1;
@@ -295,27 +531,12 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 				particles[i].y = xk1 + x0[k1];
 				double xk2  = -csx[k2] + (s[8]*b.p6[k2] + s[7]*b.p5[k2] + s[6]*b.p4[k2] + s[5]*b.p3[k2] + s[4]*b.p2[k2] + s[3]*b.p1[k2] + s[2]*b.p0[k2] + s[1]*a0[k2] + s[0]*v0[k2] );
 				particles[i].z = xk2 + x0[k2];
-			}
-			if (N_var || (r->additional_forces && r->force_is_velocity_dependent)){
-				s[0] = r->dt * h[n];
-				s[1] =      s[0] * h[n] / 2.;
-				s[2] = 2. * s[1] * h[n] / 3.;
-				s[3] = 3. * s[2] * h[n] / 4.;
-				s[4] = 4. * s[3] * h[n] / 5.;
-				s[5] = 5. * s[4] * h[n] / 6.;
-				s[6] = 6. * s[5] * h[n] / 7.;
-				s[7] = 7. * s[6] * h[n] / 8.;
-
-				for(int i=0;i<N;i++) {					// Predict velocities at interval n using b values
-					const int k0 = 3*i+0;
-					const int k1 = 3*i+1;
-					const int k2 = 3*i+2;
-
-					double vk0 =  -csv[k0] + s[7]*b.p6[k0] + s[6]*b.p5[k0] + s[5]*b.p4[k0] + s[4]*b.p3[k0] + s[3]*b.p2[k0] + s[2]*b.p1[k0] + s[1]*b.p0[k0] + s[0]*a0[k0];
+				if (predict_velocities){			// Predict velocities at interval n using b values
+					double vk0 =  -csv[k0] + sv[7]*b.p6[k0] + sv[6]*b.p5[k0] + sv[5]*b.p4[k0] + sv[4]*b.p3[k0] + sv[3]*b.p2[k0] + sv[2]*b.p1[k0] + sv[1]*b.p0[k0] + sv[0]*a0[k0];
 					particles[i].vx = vk0 + v0[k0];
-					double vk1 =  -csv[k1] + s[7]*b.p6[k1] + s[6]*b.p5[k1] + s[5]*b.p4[k1] + s[4]*b.p3[k1] + s[3]*b.p2[k1] + s[2]*b.p1[k1] + s[1]*b.p0[k1] + s[0]*a0[k1];
+					double vk1 =  -csv[k1] + sv[7]*b.p6[k1] + sv[6]*b.p5[k1] + sv[5]*b.p4[k1] + sv[4]*b.p3[k1] + sv[3]*b.p2[k1] + sv[2]*b.p1[k1] + sv[1]*b.p0[k1] + sv[0]*a0[k1];
 					particles[i].vy = vk1 + v0[k1];
-					double vk2 =  -csv[k2] + s[7]*b.p6[k2] + s[6]*b.p5[k2] + s[5]*b.p4[k2] + s[4]*b.p3[k2] + s[3]*b.p2[k2] + s[2]*b.p1[k2] + s[1]*b.p0[k2] + s[0]*a0[k2];
+					double vk2 =  -csv[k2] + sv[7]*b.p6[k2] + sv[6]*b.p5[k2] + sv[5]*b.p4[k2] + sv[4]*b.p3[k2] + sv[3]*b.p2[k2] + sv[2]*b.p1[k2] + sv[1]*b.p0[k2] + sv[0]*a0[k2];
 					particles[i].vz = vk2 + v0[k2];
 				}
 			}
@@ -326,137 +547,15 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 				integrator_megno_thisdt += w[n] * r->t * reb_tools_megno_deltad_delta(r);
 			}
 
+#pragma omp parallel for schedule(static) if(parallel)
 			for(int k=0;k<N;++k) {
 				at[3*k]   = particles[k].ax;
 				at[3*k+1] = particles[k].ay;  
 				at[3*k+2] = particles[k].az;
 			}
-			switch (n) {							// Improve b and g values
-				case 1: 
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p0[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p0[k]  = gk/rr[0];
-						add_cs(&(b.p0[k]), &(csb.p0[k]), g.p0[k]-tmp);
-					} break;
-				case 2: 
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p1[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p1[k] = (gk/rr[1] - g.p0[k])/rr[2];
-						tmp = g.p1[k] - tmp;
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[0]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp);
-					} break;
-				case 3: 
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p2[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p2[k] = ((gk/rr[3] - g.p0[k])/rr[4] - g.p1[k])/rr[5];
-						tmp = g.p2[k] - tmp;
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[1]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[2]);
-						add_cs(&(b.p2[k]), &(csb.p2[k]), tmp);
-					} break;
-				case 4:
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p3[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p3[k] = (((gk/rr[6] - g.p0[k])/rr[7] - g.p1[k])/rr[8] - g.p2[k])/rr[9];
-						tmp = g.p3[k] - tmp;
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[3]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[4]);
-						add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[5]);
-						add_cs(&(b.p3[k]), &(csb.p3[k]), tmp);
-					} break;
-				case 5:
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p4[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p4[k] = ((((gk/rr[10] - g.p0[k])/rr[11] - g.p1[k])/rr[12] - g.p2[k])/rr[13] - g.p3[k])/rr[14];
-						tmp = g.p4[k] - tmp;
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[6]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[7]);
-						add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[8]);
-						add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[9]);
-						add_cs(&(b.p4[k]), &(csb.p4[k]), tmp);
-					} break;
-				case 6:
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p5[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p5[k] = (((((gk/rr[15] - g.p0[k])/rr[16] - g.p1[k])/rr[17] - g.p2[k])/rr[18] - g.p3[k])/rr[19] - g.p4[k])/rr[20];
-						tmp = g.p5[k] - tmp;
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[10]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[11]);
-						add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[12]);
-						add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[13]);
-						add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[14]);
-						add_cs(&(b.p5[k]), &(csb.p5[k]), tmp);
-					} break;
-				case 7:
-				{
-					double maxak = 0.0;
-					double maxb6ktmp = 0.0;
-					for(int k=0;k<N3;++k) {
-						double tmp = g.p6[k];
-						double gk = at[k];
-						double gk_cs = ((double*)(gravity_cs))[k];
-						add_cs(&gk, &gk_cs, -a0[k]);
-						add_cs(&gk, &gk_cs, csa0[k]);
-						g.p6[k] = ((((((gk/rr[21] - g.p0[k])/rr[22] - g.p1[k])/rr[23] - g.p2[k])/rr[24] - g.p3[k])/rr[25] - g.p4[k])/rr[26] - g.p5[k])/rr[27];
-						tmp = g.p6[k] - tmp;	
-						add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[15]);
-						add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[16]);
-						add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[17]);
-						add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[18]);
-						add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[19]);
-						add_cs(&(b.p5[k]), &(csb.p5[k]), tmp * c[20]);
-						add_cs(&(b.p6[k]), &(csb.p6[k]), tmp);
-						
-						// Monitor change in b.p6[k] relative to at[k]. The predictor corrector scheme is converged if it is close to 0.
-						if (r->ri_ias15.epsilon_global){
-							const double ak  = fabs(at[k]);
-							if (isnormal(ak) && ak>maxak){
-								maxak = ak;
-							}
-							const double b6ktmp = fabs(tmp);  // change of b6ktmp coefficient
-							if (isnormal(b6ktmp) && b6ktmp>maxb6ktmp){
-								maxb6ktmp = b6ktmp;
-							}
-						}else{
-							const double ak  = at[k];
-							const double b6ktmp = tmp; 
-							const double errork = fabs(b6ktmp/ak);
-							if (isnormal(errork) && errork>predictor_corrector_error){
-								predictor_corrector_error = errork;
-							}
-						}
-					} 
-					if (r->ri_ias15.epsilon_global){
-						predictor_corrector_error = maxb6ktmp/maxak;
-					}
-					
-					break;
-				}
+			const double error = update_gb(n, N3, parallel, epsilon_global, g, b, csb, at, a0, csa0, acs);
+			if (n==7){
+				predictor_corrector_error = error;
 			}
 		}
 	}
@@ -475,9 +574,10 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 		//   Here, the fractional error is calculated for each particle individually and we use the maximum of the fractional error.
 		//   This might fail in cases where a particle does not experience any (physical) acceleration besides roundoff errors. 
 		double integrator_error = 0.0;
-		if (r->ri_ias15.epsilon_global){
+		if (epsilon_global){
 			double maxak = 0.0;
 			double maxb6k = 0.0;
+#pragma omp parallel for schedule(static) reduction(max:maxak,maxb6k) if(parallel)
 			for(int i=0;i<N;i++){ // Looping over all particles and all 3 components of the acceleration. 
 				const double v2 = particles[i].vx*particles[i].vx+particles[i].vy*particles[i].vy+particles[i].vz*particles[i].vz;
 				const double x2 = particles[i].x*particles[i].x+particles[i].y*particles[i].y+particles[i].z*particles[i].z;
@@ -496,6 +596,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 			}
 			integrator_error = maxb6k/maxak;
 		}else{
+#pragma omp parallel for schedule(static) reduction(max:integrator_error) if(parallel)
 			for(int k=0;k<N3;k++) {
 				const double ak  = at[k];
 				const double b6k = b.p6[k]; 
@@ -518,6 +619,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 		
 		if (fabs(dt_new/dt_done) < safety_factor) {	// New timestep is significantly smaller.
 			// Reset particles
+#pragma omp parallel for schedule(static) if(parallel)
 			for(int k=0;k<N;++k) {
 				particles[k].x = x0[3*k+0];	// Set inital position
 				particles[k].y = x0[3*k+1];
@@ -530,7 +632,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 			r->dt = dt_new;
 			if (r->dt_last_done!=0.){		// Do not predict next e/b values if this is the first time step.
 				double ratio = r->dt/r->dt_last_done;
-				predict_next_step(ratio, N3, er, br, e, b);
+				predict_next_step(ratio, N3, parallel, er, br, e, b);
 			}
 			
 			return 0; // Step rejected. Do again. 
@@ -542,40 +644,10 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 	}
 
 	// Find new position and velocity values at end of the sequence
-	const double dt_done2 = dt_done * dt_done;
-	for(int k=0;k<N3;++k) {
-		{
-			add_cs(&(x0[k]), &(csx[k]), b.p6[k]/72.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p5[k]/56.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p4[k]/42.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p3[k]/30.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p2[k]/20.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p1[k]/12.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), b.p0[k]/6.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), a0[k]/2.*dt_done2);
-			add_cs(&(x0[k]), &(csx[k]), v0[k]*dt_done);
-		}
-		{
-			add_cs(&(v0[k]), &(csv[k]), b.p6[k]/8.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p5[k]/7.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p4[k]/6.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p3[k]/5.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p2[k]/4.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p1[k]/3.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), b.p0[k]/2.*dt_done);
-			add_cs(&(v0[k]), &(csv[k]), a0[k]*dt_done);
-		}
-	}
-
-	r->t += dt_done;
-	r->dt_last_done = dt_done;
-
-	if (r->calculate_megno){
-		double dY = dt_done*integrator_megno_thisdt;
-		reb_tools_megno_update(r, dY);
-	}
+	update_xv(N3, parallel, dt_done, x0, csx, v0, csv, r->ri_ias15.xs, r->ri_ias15.vs, a0, b);
 
 	// Swap particle buffers
+#pragma omp parallel for schedule(static) if(parallel)
 	for(int k=0;k<N;++k) {
 		particles[k].x = x0[3*k+0];	// Set final position
 		particles[k].y = x0[3*k+1];
@@ -585,14 +657,25 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 		particles[k].vy = v0[3*k+1];
 		particles[k].vz = v0[3*k+2];
 	}
-	copybuffers(e,er,N3);		
-	copybuffers(b,br,N3);		
+
+	r->ri_ias15.last_t  = t_beginning;
+	r->ri_ias15.last_dt = dt_done;
+	r->ri_ias15.last_N  = N;
+	r->t += dt_done;
+	r->dt_last_done = dt_done;
+
+	if (r->calculate_megno){
+		double dY = dt_done*integrator_megno_thisdt;
+		reb_tools_megno_update(r, dY);
+	}
+
+	copybuffers(e,er,b,br,N3);		
 	double ratio = r->dt/dt_done;
-	predict_next_step(ratio, N3, e, b, e, b);
+	predict_next_step(ratio, N3, parallel, e, b, e, b);
 	return 1; // Success.
 }
 
-static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b){
+static void predict_next_step(double ratio, int N3, int parallel, const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b){
 	// Predict new B values to use at the start of the next sequence. The predicted
 	// values from the last call are saved as E. The correction, BD, between the
 	// actual and predicted values of B is applied in advance as a correction.
@@ -605,6 +688,7 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
 	const double q6 = q3 * q3;
 	const double q7 = q3 * q4;
 
+#pragma omp parallel for schedule(static) if(parallel)
 	for(int k=0;k<N3;++k) {
 		double be0 = _b.p0[k] - _e.p0[k];
 		double be1 = _b.p1[k] - _e.p1[k];
@@ -634,7 +718,9 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
 	}
 }
 
-static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, int N3){
+// Copies _a to _b and _c to _d in one pass.
+static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, const struct reb_dpconst7 _c, const struct reb_dpconst7 _d, int N3){
+#pragma omp parallel for schedule(static) if(N3 > REB_IAS15_OPENMP_THRESHOLD)
 	for (int i=0;i<N3;i++){	
 		_b.p0[i] = _a.p0[i];
 		_b.p1[i] = _a.p1[i];
@@ -643,6 +729,13 @@ static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7
 		_b.p4[i] = _a.p4[i];
 		_b.p5[i] = _a.p5[i];
 		_b.p6[i] = _a.p6[i];
+		_d.p0[i] = _c.p0[i];
+		_d.p1[i] = _c.p1[i];
+		_d.p2[i] = _c.p2[i];
+		_d.p3[i] = _c.p3[i];
+		_d.p4[i] = _c.p4[i];
+		_d.p5[i] = _c.p5[i];
+		_d.p6[i] = _c.p6[i];
 	}
 // The above code seems faster than the code below, probably due to some compiler optimizations. 
 //	for (int i=0;i<7;i++){	
@@ -665,28 +758,70 @@ void reb_integrator_ias15_part2(struct reb_simulation* r){
 void reb_integrator_ias15_synchronize(struct reb_simulation* r){
 }
 
+int reb_integrator_ias15_interpolate(struct reb_simulation* const r, const double t, struct reb_particle* const particles){
+	const struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+	const int N = r->N;
+	if (ri->last_N==0 || ri->last_N!=N || ri->last_dt==0.){
+		return 0;
+	}
+	const double dt = ri->last_dt;
+	const double hh = (t-ri->last_t)/dt;
+	// Allow for round-off in t at the boundaries of the step.
+	const double tolerance = 4.*DBL_EPSILON*(fabs(t)+fabs(ri->last_t))/fabs(dt);
+	if (hh<-tolerance || hh>1.+tolerance){
+		return 0;
+	}
+	// Same polynomials as the predictor in reb_integrator_ias15_step, but
+	// with the converged b values of the last step, which copybuffers() saved in br.
+	double s[9];
+	s[0] = dt * hh;
+	s[1] = s[0] * s[0] / 2.;
+	s[2] = s[1] * hh / 3.;
+	s[3] = s[2] * hh / 2.;
+	s[4] = 3. * s[3] * hh / 5.;
+	s[5] = 2. * s[4] * hh / 3.;
+	s[6] = 5. * s[5] * hh / 7.;
+	s[7] = 3. * s[6] * hh / 4.;
+	s[8] = 7. * s[7] * hh / 9.;
+	double sv[8];
+	sv[0] = dt * hh;
+	sv[1] = sv[0] * hh / 2.;
+	sv[2] = 2. * sv[1] * hh / 3.;
+	sv[3] = 3. * sv[2] * hh / 4.;
+	sv[4] = 4. * sv[3] * hh / 5.;
+	sv[5] = 5. * sv[4] * hh / 6.;
+	sv[6] = 6. * sv[5] * hh / 7.;
+	sv[7] = 7. * sv[6] * hh / 8.;
+	const double* restrict const xs = ri->xs;
+	const double* restrict const vs = ri->vs;
+	const double* restrict const a0 = ri->a0;
+	const struct reb_dpconst7 br = dpcast(ri->br);
+#pragma omp parallel for schedule(static) if(3*N > REB_IAS15_OPENMP_THRESHOLD)
+	for(int i=0;i<N;i++){
+		particles[i] = r->particles[i];
+		double x[3];
+		double v[3];
+		for (int j=0;j<3;j++){
+			const int k = 3*i+j;
+			x[j] = xs[k] + (s[8]*br.p6[k] + s[7]*br.p5[k] + s[6]*br.p4[k] + s[5]*br.p3[k] + s[4]*br.p2[k] + s[3]*br.p1[k] + s[2]*br.p0[k] + s[1]*a0[k] + s[0]*vs[k]);
+			v[j] = vs[k] + sv[7]*br.p6[k] + sv[6]*br.p5[k] + sv[5]*br.p4[k] + sv[4]*br.p3[k] + sv[3]*br.p2[k] + sv[2]*br.p1[k] + sv[1]*br.p0[k] + sv[0]*a0[k];
+		}
+		particles[i].x  = x[0];
+		particles[i].y  = x[1];
+		particles[i].z  = x[2];
+		particles[i].vx = v[0];
+		particles[i].vy = v[1];
+		particles[i].vz = v[2];
+	}
+	return 1;
+}
+
 void reb_integrator_ias15_reset(struct reb_simulation* r){
 	r->ri_ias15.allocatedN 	= 0;
-	free_dp7(&(r->ri_ias15.g));
-	free_dp7(&(r->ri_ias15.e));
-	free_dp7(&(r->ri_ias15.b));
-	free_dp7(&(r->ri_ias15.csb));
-	free_dp7(&(r->ri_ias15.er));
-	free_dp7(&(r->ri_ias15.br));
-	free(r->ri_ias15.at);
-	r->ri_ias15.at =  NULL;
-	free(r->ri_ias15.x0);
-	r->ri_ias15.x0 =  NULL;
-	free(r->ri_ias15.v0);
-	r->ri_ias15.v0 =  NULL;
-	free(r->ri_ias15.a0);
-	r->ri_ias15.a0 =  NULL;
-	free(r->ri_ias15.csx);
-	r->ri_ias15.csx=  NULL;
-	free(r->ri_ias15.csv);
-	r->ri_ias15.csv=  NULL;
-	free(r->ri_ias15.csa0);
-	r->ri_ias15.csa0 =  NULL;
+	r->ri_ias15.last_N 	= 0;
+	free(r->ri_ias15.arena);
+	r->ri_ias15.arena = NULL;
+	set_arena_pointers(&(r->ri_ias15));
 }
 
 #ifdef GENERATE_CONSTANTS
@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 #include <sys/time.h>
 #include "rebound.h"
 #include "particle.h"
@@ -38,6 +39,12 @@
 #include "boundary.h"
 #include "integrator.h"
 #include "integrator_whfast.h"
+#include "gravity_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define REB_SIMD_X86	///< Compiler supports target attributes and x86 intrinsics
+#include <immintrin.h>
+#endif // __GNUC__
 
 #define MAX(a, b) ((a) < (b) ? (b) : (a))	///< Returns the maximum of a and b
 #define MIN(a, b) ((a) > (b) ? (b) : (a))	///< Returns the minimum of a and b
@@ -305,6 +312,289 @@ double X;
 
 }
 
+#ifdef REB_SIMD_X86
+/****************************** 
+ * Batched Keplerian motion   */
+// The functions below advance 4 (AVX2) or 8 (AVX-512) consecutive Jacobi 
+// particles in lockstep. Every lane performs the same floating point operations 
+// in the same order as kepler_step(), lanes that have converged are masked. 
+// The results are therefore bitwise identical to the scalar solver. 
+// Lanes that need the quartic solver or bisection are passed on to kepler_step().
+
+__attribute__((target("avx512f")))
+static void stiefel_Gs3_avx512(__m512d* const restrict Gs, const __m512d beta, const __m512d X, const __mmask8 active){
+	const __m512d one = _mm512_set1_pd(1.);
+	const __m512d X2 = _mm512_mul_pd(X, X);
+	__m512d z = _mm512_mul_pd(beta, X2);
+	__m512d n = _mm512_setzero_pd();	// Number of reductions of each lane
+	__mmask8 m;
+	while((m = _mm512_mask_cmp_pd_mask(active, _mm512_abs_pd(z), _mm512_set1_pd(0.1), _CMP_GT_OQ))){
+		z = _mm512_mask_mul_pd(z, m, z, _mm512_set1_pd(0.25));
+		n = _mm512_mask_add_pd(n, m, n, one);
+	}
+	const __m512d zm = _mm512_mul_pd(z, _mm512_set1_pd(-1.));
+	__m512d cs2 = _mm512_sub_pd(_mm512_set1_pd(invfactorial[2]), _mm512_mul_pd(z, _mm512_set1_pd(invfactorial[4])));
+	__m512d cs3 = _mm512_sub_pd(_mm512_set1_pd(invfactorial[3]), _mm512_mul_pd(z, _mm512_set1_pd(invfactorial[5])));
+	__m512d _pow = zm;
+	unsigned int k=6;
+	m = active;
+	do{
+		const __m512d old_c_2 = cs2;
+		_pow = _mm512_mask_mul_pd(_pow, m, _pow, zm);
+		cs2 = _mm512_mask_add_pd(cs2, m, cs2, _mm512_mul_pd(_pow, _mm512_set1_pd(invfactorial[k])));
+		k+=1;
+		cs3 = _mm512_mask_add_pd(cs3, m, cs3, _mm512_mul_pd(_pow, _mm512_set1_pd(invfactorial[k])));
+		k+=1;
+		m = _mm512_mask_cmp_pd_mask(m, cs2, old_c_2, _CMP_NEQ_UQ);
+	}while(m && k<34);
+	__m512d cs1 = _mm512_sub_pd(one, _mm512_mul_pd(z, cs3));
+	__m512d cs0 = _mm512_sub_pd(one, _mm512_mul_pd(z, cs2));
+	while((m = _mm512_cmp_pd_mask(n, _mm512_setzero_pd(), _CMP_GT_OQ))){
+		const __m512d c3 = _mm512_mul_pd(_mm512_add_pd(cs2, _mm512_mul_pd(cs0, cs3)), _mm512_set1_pd(0.25));
+		const __m512d c2 = _mm512_mul_pd(_mm512_mul_pd(cs1, cs1), _mm512_set1_pd(0.5));
+		const __m512d c1 = _mm512_mul_pd(cs0, cs1);
+		const __m512d c0 = _mm512_sub_pd(_mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(2.), cs0), cs0), one);
+		cs3 = _mm512_mask_mov_pd(cs3, m, c3);
+		cs2 = _mm512_mask_mov_pd(cs2, m, c2);
+		cs1 = _mm512_mask_mov_pd(cs1, m, c1);
+		cs0 = _mm512_mask_mov_pd(cs0, m, c0);
+		n = _mm512_mask_sub_pd(n, m, n, one);
+	}
+	Gs[0] = cs0;
+	Gs[1] = _mm512_mul_pd(cs1, X);
+	Gs[2] = _mm512_mul_pd(cs2, X2);
+	Gs[3] = _mm512_mul_pd(cs3, _mm512_mul_pd(X2, X));
+}
+
+// Advances Jacobi particles i0 to i0+7. No variational particles.
+__attribute__((target("avx512f")))
+static void kepler_step_avx512(struct reb_particle* const restrict p_j, const double* const eta, const double G, const unsigned int i0, const double _dt, unsigned int* timestep_warning){
+	double buf[6][8] __attribute__((aligned(64)));
+	for (int l=0;l<8;l++){
+		buf[0][l] = p_j[i0+l].x;
+		buf[1][l] = p_j[i0+l].y;
+		buf[2][l] = p_j[i0+l].z;
+		buf[3][l] = p_j[i0+l].vx;
+		buf[4][l] = p_j[i0+l].vy;
+		buf[5][l] = p_j[i0+l].vz;
+	}
+	const __m512d x  = _mm512_load_pd(buf[0]);
+	const __m512d y  = _mm512_load_pd(buf[1]);
+	const __m512d z  = _mm512_load_pd(buf[2]);
+	const __m512d vx = _mm512_load_pd(buf[3]);
+	const __m512d vy = _mm512_load_pd(buf[4]);
+	const __m512d vz = _mm512_load_pd(buf[5]);
+	const __m512d one = _mm512_set1_pd(1.);
+	const __m512d dt = _mm512_set1_pd(_dt);
+	const __m512d M = _mm512_mul_pd(_mm512_set1_pd(G), _mm512_loadu_pd(eta+i0));
+
+	const __m512d r0 = _mm512_sqrt_pd(_mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(x, x), _mm512_mul_pd(y, y)), _mm512_mul_pd(z, z)));
+	const __m512d r0i = _mm512_div_pd(one, r0);
+	const __m512d v2 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(vx, vx), _mm512_mul_pd(vy, vy)), _mm512_mul_pd(vz, vz));
+	const __m512d beta = _mm512_sub_pd(_mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(2.), M), r0i), v2);
+	const __m512d eta0 = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(x, vx), _mm512_mul_pd(y, vy)), _mm512_mul_pd(z, vz));
+	const __m512d zeta0 = _mm512_sub_pd(M, _mm512_mul_pd(beta, r0));
+
+	// Second order guess for elliptic orbits, 0 for hyperbolic orbits.
+	const __m512d dtr0i = _mm512_mul_pd(dt, r0i);
+	__m512d X = _mm512_mul_pd(dtr0i, _mm512_sub_pd(one, _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(dtr0i, eta0), _mm512_set1_pd(0.5)), r0i)));
+	X = _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(beta, _mm512_setzero_pd(), _CMP_GT_OQ), X);
+
+	__m512d oldX = X;
+	__m512d Gs[4];
+	stiefel_Gs3_avx512(Gs, beta, X, 0xFF);
+	__m512d e = _mm512_add_pd(_mm512_mul_pd(eta0, Gs[1]), _mm512_mul_pd(zeta0, Gs[2]));
+	__m512d ri = _mm512_div_pd(one, _mm512_add_pd(r0, e));
+	X = _mm512_mul_pd(ri, _mm512_add_pd(_mm512_sub_pd(_mm512_sub_pd(_mm512_mul_pd(X, e), _mm512_mul_pd(eta0, Gs[2])), _mm512_mul_pd(zeta0, Gs[3])), dt));
+	const __m512d X_per_period = _mm512_div_pd(_mm512_set1_pd(2.*M_PI), _mm512_sqrt_pd(beta));
+	const __mmask8 quartic = _mm512_cmp_pd_mask(_mm512_abs_pd(_mm512_sub_pd(X, oldX)), _mm512_mul_pd(_mm512_set1_pd(0.01), X_per_period), _CMP_GT_OQ);
+
+	// Newton's method. Lanes that have converged are masked.
+	__mmask8 active = ~quartic;
+	__mmask8 converged = 0;
+	__m512d oldX2 = oldX;
+	for (int n_hg=1;n_hg<WHFAST_NMAX_NEWT && active;n_hg++){
+		oldX2 = _mm512_mask_mov_pd(oldX2, active, oldX);
+		oldX = _mm512_mask_mov_pd(oldX, active, X);
+		__m512d Gsn[4];
+		stiefel_Gs3_avx512(Gsn, beta, X, active);
+		e = _mm512_add_pd(_mm512_mul_pd(eta0, Gsn[1]), _mm512_mul_pd(zeta0, Gsn[2]));
+		const __m512d rin = _mm512_div_pd(one, _mm512_add_pd(r0, e));
+		const __m512d Xn = _mm512_mul_pd(rin, _mm512_add_pd(_mm512_sub_pd(_mm512_sub_pd(_mm512_mul_pd(X, e), _mm512_mul_pd(eta0, Gsn[2])), _mm512_mul_pd(zeta0, Gsn[3])), dt));
+		for (int c=0;c<4;c++){
+			Gs[c] = _mm512_mask_mov_pd(Gs[c], active, Gsn[c]);
+		}
+		ri = _mm512_mask_mov_pd(ri, active, rin);
+		X = _mm512_mask_mov_pd(X, active, Xn);
+		const __mmask8 c = _mm512_mask_cmp_pd_mask(active, X, oldX, _CMP_EQ_OQ) | _mm512_mask_cmp_pd_mask(active, X, oldX2, _CMP_EQ_OQ);
+		converged |= c;
+		active &= ~c;
+	}
+
+	// Note: These are not the traditional f and g functions.
+	const __m512d Mm = _mm512_mul_pd(M, _mm512_set1_pd(-1.));
+	const __m512d f = _mm512_mul_pd(_mm512_mul_pd(Mm, Gs[2]), r0i);
+	const __m512d g = _mm512_sub_pd(dt, _mm512_mul_pd(M, Gs[3]));
+	const __m512d fd = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(Mm, Gs[1]), r0i), ri);
+	const __m512d gd = _mm512_mul_pd(_mm512_mul_pd(Mm, Gs[2]), ri);
+	_mm512_store_pd(buf[0], _mm512_add_pd(x, _mm512_add_pd(_mm512_mul_pd(f, x), _mm512_mul_pd(g, vx))));
+	_mm512_store_pd(buf[1], _mm512_add_pd(y, _mm512_add_pd(_mm512_mul_pd(f, y), _mm512_mul_pd(g, vy))));
+	_mm512_store_pd(buf[2], _mm512_add_pd(z, _mm512_add_pd(_mm512_mul_pd(f, z), _mm512_mul_pd(g, vz))));
+	_mm512_store_pd(buf[3], _mm512_add_pd(vx, _mm512_add_pd(_mm512_mul_pd(fd, x), _mm512_mul_pd(gd, vx))));
+	_mm512_store_pd(buf[4], _mm512_add_pd(vy, _mm512_add_pd(_mm512_mul_pd(fd, y), _mm512_mul_pd(gd, vy))));
+	_mm512_store_pd(buf[5], _mm512_add_pd(vz, _mm512_add_pd(_mm512_mul_pd(fd, z), _mm512_mul_pd(gd, vz))));
+	for (int l=0;l<8;l++){
+		if (converged & (1<<l)){
+			p_j[i0+l].x  = buf[0][l];
+			p_j[i0+l].y  = buf[1][l];
+			p_j[i0+l].z  = buf[2][l];
+			p_j[i0+l].vx = buf[3][l];
+			p_j[i0+l].vy = buf[4][l];
+			p_j[i0+l].vz = buf[5][l];
+		}else{
+			kepler_step(p_j, eta, G, i0+l, _dt, timestep_warning, 0);
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static void stiefel_Gs3_avx2(__m256d* const restrict Gs, const __m256d beta, const __m256d X, const __m256d active){
+	const __m256d one = _mm256_set1_pd(1.);
+	const __m256d X2 = _mm256_mul_pd(X, X);
+	__m256d z = _mm256_mul_pd(beta, X2);
+	__m256d n = _mm256_setzero_pd();	// Number of reductions of each lane
+	__m256d m;
+	while(_mm256_movemask_pd(m = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.), z), _mm256_set1_pd(0.1), _CMP_GT_OQ)))){
+		z = _mm256_blendv_pd(z, _mm256_mul_pd(z, _mm256_set1_pd(0.25)), m);
+		n = _mm256_blendv_pd(n, _mm256_add_pd(n, one), m);
+	}
+	const __m256d zm = _mm256_mul_pd(z, _mm256_set1_pd(-1.));
+	__m256d cs2 = _mm256_sub_pd(_mm256_set1_pd(invfactorial[2]), _mm256_mul_pd(z, _mm256_set1_pd(invfactorial[4])));
+	__m256d cs3 = _mm256_sub_pd(_mm256_set1_pd(invfactorial[3]), _mm256_mul_pd(z, _mm256_set1_pd(invfactorial[5])));
+	__m256d _pow = zm;
+	unsigned int k=6;
+	m = active;
+	do{
+		const __m256d old_c_2 = cs2;
+		_pow = _mm256_blendv_pd(_pow, _mm256_mul_pd(_pow, zm), m);
+		cs2 = _mm256_blendv_pd(cs2, _mm256_add_pd(cs2, _mm256_mul_pd(_pow, _mm256_set1_pd(invfactorial[k]))), m);
+		k+=1;
+		cs3 = _mm256_blendv_pd(cs3, _mm256_add_pd(cs3, _mm256_mul_pd(_pow, _mm256_set1_pd(invfactorial[k]))), m);
+		k+=1;
+		m = _mm256_and_pd(m, _mm256_cmp_pd(cs2, old_c_2, _CMP_NEQ_UQ));
+	}while(_mm256_movemask_pd(m) && k<34);
+	__m256d cs1 = _mm256_sub_pd(one, _mm256_mul_pd(z, cs3));
+	__m256d cs0 = _mm256_sub_pd(one, _mm256_mul_pd(z, cs2));
+	while(_mm256_movemask_pd(m = _mm256_cmp_pd(n, _mm256_setzero_pd(), _CMP_GT_OQ))){
+		const __m256d c3 = _mm256_mul_pd(_mm256_add_pd(cs2, _mm256_mul_pd(cs0, cs3)), _mm256_set1_pd(0.25));
+		const __m256d c2 = _mm256_mul_pd(_mm256_mul_pd(cs1, cs1), _mm256_set1_pd(0.5));
+		const __m256d c1 = _mm256_mul_pd(cs0, cs1);
+		const __m256d c0 = _mm256_sub_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.), cs0), cs0), one);
+		cs3 = _mm256_blendv_pd(cs3, c3, m);
+		cs2 = _mm256_blendv_pd(cs2, c2, m);
+		cs1 = _mm256_blendv_pd(cs1, c1, m);
+		cs0 = _mm256_blendv_pd(cs0, c0, m);
+		n = _mm256_blendv_pd(n, _mm256_sub_pd(n, one), m);
+	}
+	Gs[0] = cs0;
+	Gs[1] = _mm256_mul_pd(cs1, X);
+	Gs[2] = _mm256_mul_pd(cs2, X2);
+	Gs[3] = _mm256_mul_pd(cs3, _mm256_mul_pd(X2, X));
+}
+
+// Advances Jacobi particles i0 to i0+3. No variational particles.
+__attribute__((target("avx2")))
+static void kepler_step_avx2(struct reb_particle* const restrict p_j, const double* const eta, const double G, const unsigned int i0, const double _dt, unsigned int* timestep_warning){
+	double buf[6][4] __attribute__((aligned(32)));
+	for (int l=0;l<4;l++){
+		buf[0][l] = p_j[i0+l].x;
+		buf[1][l] = p_j[i0+l].y;
+		buf[2][l] = p_j[i0+l].z;
+		buf[3][l] = p_j[i0+l].vx;
+		buf[4][l] = p_j[i0+l].vy;
+		buf[5][l] = p_j[i0+l].vz;
+	}
+	const __m256d x  = _mm256_load_pd(buf[0]);
+	const __m256d y  = _mm256_load_pd(buf[1]);
+	const __m256d z  = _mm256_load_pd(buf[2]);
+	const __m256d vx = _mm256_load_pd(buf[3]);
+	const __m256d vy = _mm256_load_pd(buf[4]);
+	const __m256d vz = _mm256_load_pd(buf[5]);
+	const __m256d one = _mm256_set1_pd(1.);
+	const __m256d dt = _mm256_set1_pd(_dt);
+	const __m256d M = _mm256_mul_pd(_mm256_set1_pd(G), _mm256_loadu_pd(eta+i0));
+
+	const __m256d r0 = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z)));
+	const __m256d r0i = _mm256_div_pd(one, r0);
+	const __m256d v2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(vx, vx), _mm256_mul_pd(vy, vy)), _mm256_mul_pd(vz, vz));
+	const __m256d beta = _mm256_sub_pd(_mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.), M), r0i), v2);
+	const __m256d eta0 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, vx), _mm256_mul_pd(y, vy)), _mm256_mul_pd(z, vz));
+	const __m256d zeta0 = _mm256_sub_pd(M, _mm256_mul_pd(beta, r0));
+
+	// Second order guess for elliptic orbits, 0 for hyperbolic orbits.
+	const __m256d dtr0i = _mm256_mul_pd(dt, r0i);
+	__m256d X = _mm256_mul_pd(dtr0i, _mm256_sub_pd(one, _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(dtr0i, eta0), _mm256_set1_pd(0.5)), r0i)));
+	X = _mm256_and_pd(_mm256_cmp_pd(beta, _mm256_setzero_pd(), _CMP_GT_OQ), X);
+
+	__m256d oldX = X;
+	__m256d Gs[4];
+	const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	stiefel_Gs3_avx2(Gs, beta, X, all);
+	__m256d e = _mm256_add_pd(_mm256_mul_pd(eta0, Gs[1]), _mm256_mul_pd(zeta0, Gs[2]));
+	__m256d ri = _mm256_div_pd(one, _mm256_add_pd(r0, e));
+	X = _mm256_mul_pd(ri, _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(X, e), _mm256_mul_pd(eta0, Gs[2])), _mm256_mul_pd(zeta0, Gs[3])), dt));
+	const __m256d X_per_period = _mm256_div_pd(_mm256_set1_pd(2.*M_PI), _mm256_sqrt_pd(beta));
+	const __m256d quartic = _mm256_cmp_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.), _mm256_sub_pd(X, oldX)), _mm256_mul_pd(_mm256_set1_pd(0.01), X_per_period), _CMP_GT_OQ);
+
+	// Newton's method. Lanes that have converged are masked.
+	__m256d active = _mm256_andnot_pd(quartic, all);
+	int converged = 0;
+	__m256d oldX2 = oldX;
+	for (int n_hg=1;n_hg<WHFAST_NMAX_NEWT && _mm256_movemask_pd(active);n_hg++){
+		oldX2 = _mm256_blendv_pd(oldX2, oldX, active);
+		oldX = _mm256_blendv_pd(oldX, X, active);
+		__m256d Gsn[4];
+		stiefel_Gs3_avx2(Gsn, beta, X, active);
+		e = _mm256_add_pd(_mm256_mul_pd(eta0, Gsn[1]), _mm256_mul_pd(zeta0, Gsn[2]));
+		const __m256d rin = _mm256_div_pd(one, _mm256_add_pd(r0, e));
+		const __m256d Xn = _mm256_mul_pd(rin, _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_mul_pd(X, e), _mm256_mul_pd(eta0, Gsn[2])), _mm256_mul_pd(zeta0, Gsn[3])), dt));
+		for (int c=0;c<4;c++){
+			Gs[c] = _mm256_blendv_pd(Gs[c], Gsn[c], active);
+		}
+		ri = _mm256_blendv_pd(ri, rin, active);
+		X = _mm256_blendv_pd(X, Xn, active);
+		const __m256d c = _mm256_and_pd(active, _mm256_or_pd(_mm256_cmp_pd(X, oldX, _CMP_EQ_OQ), _mm256_cmp_pd(X, oldX2, _CMP_EQ_OQ)));
+		converged |= _mm256_movemask_pd(c);
+		active = _mm256_andnot_pd(c, active);
+	}
+
+	// Note: These are not the traditional f and g functions.
+	const __m256d Mm = _mm256_mul_pd(M, _mm256_set1_pd(-1.));
+	const __m256d f = _mm256_mul_pd(_mm256_mul_pd(Mm, Gs[2]), r0i);
+	const __m256d g = _mm256_sub_pd(dt, _mm256_mul_pd(M, Gs[3]));
+	const __m256d fd = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(Mm, Gs[1]), r0i), ri);
+	const __m256d gd = _mm256_mul_pd(_mm256_mul_pd(Mm, Gs[2]), ri);
+	_mm256_store_pd(buf[0], _mm256_add_pd(x, _mm256_add_pd(_mm256_mul_pd(f, x), _mm256_mul_pd(g, vx))));
+	_mm256_store_pd(buf[1], _mm256_add_pd(y, _mm256_add_pd(_mm256_mul_pd(f, y), _mm256_mul_pd(g, vy))));
+	_mm256_store_pd(buf[2], _mm256_add_pd(z, _mm256_add_pd(_mm256_mul_pd(f, z), _mm256_mul_pd(g, vz))));
+	_mm256_store_pd(buf[3], _mm256_add_pd(vx, _mm256_add_pd(_mm256_mul_pd(fd, x), _mm256_mul_pd(gd, vx))));
+	_mm256_store_pd(buf[4], _mm256_add_pd(vy, _mm256_add_pd(_mm256_mul_pd(fd, y), _mm256_mul_pd(gd, vy))));
+	_mm256_store_pd(buf[5], _mm256_add_pd(vz, _mm256_add_pd(_mm256_mul_pd(fd, z), _mm256_mul_pd(gd, vz))));
+	for (int l=0;l<4;l++){
+		if (converged & (1<<l)){
+			p_j[i0+l].x  = buf[0][l];
+			p_j[i0+l].y  = buf[1][l];
+			p_j[i0+l].z  = buf[2][l];
+			p_j[i0+l].vx = buf[3][l];
+			p_j[i0+l].vy = buf[4][l];
+			p_j[i0+l].vz = buf[5][l];
+		}else{
+			kepler_step(p_j, eta, G, i0+l, _dt, timestep_warning, 0);
+		}
+	}
+}
+#endif // REB_SIMD_X86
+
 /****************************** 
  * Coordinate transformations */
 static void to_jacobi_posvel(const struct reb_particle* const particles, struct reb_particle* const p_j, const double* const eta, const int N){
@@ -464,8 +754,23 @@ static void interaction_step(struct reb_particle* const p_j, const double* const
 /***************************** 
  * DKD Scheme                */
 
-static void kepler_drift(struct reb_particle* const p_j, const double* const eta, const double G, const double _dt, unsigned int* timestep_warning, const int N, const int N_var){
-	for (unsigned int i=1;i<N-N_var;i++){
+// The simd argument is the instruction set as returned by reb_simd_level().
+static void kepler_drift(struct reb_particle* const p_j, const double* const eta, const double G, const double _dt, unsigned int* timestep_warning, const int N, const int N_var, const int simd){
+	int i=1;
+#ifdef REB_SIMD_X86
+	if (N_var==0){
+		if (simd==REB_SIMD_AVX512){
+			for (;i+8<=N;i+=8){
+				kepler_step_avx512(p_j, eta, G, i, _dt, timestep_warning);
+			}
+		}else if (simd==REB_SIMD_AVX2){
+			for (;i+4<=N;i+=4){
+				kepler_step_avx2(p_j, eta, G, i, _dt, timestep_warning);
+			}
+		}
+	}
+#endif // REB_SIMD_X86
+	for (;i<N-N_var;i++){
 		kepler_step(p_j, eta, G, i, _dt, timestep_warning, N_var);
 	}
 	p_j[0].x += _dt*p_j[0].vx;
@@ -497,7 +802,7 @@ static void corrector_Z(struct reb_simulation* r, const double a, const double b
 	const int N_var = r->N_var;
 	const int N = r->N;
 	const int N_real = N-N_var;
-	kepler_drift(ri_whfast->p_j, ri_whfast->eta,  r->G, a, &(ri_whfast->timestep_warning), N, N_var);
+	kepler_drift(ri_whfast->p_j, ri_whfast->eta,  r->G, a, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
 	to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, N_real);
 	if (N_var){
 		to_inertial_pos(particles+N_var, ri_whfast->p_j+N_var, ri_whfast->eta, N_real);
@@ -508,7 +813,7 @@ static void corrector_Z(struct reb_simulation* r, const double a, const double b
 		to_jacobi_acc(particles+N_var, ri_whfast->p_j+N_var, ri_whfast->eta, N_real);
 	}
 	interaction_step(ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, -b, N, N_var);
-	kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, -2.*a, &(ri_whfast->timestep_warning), N, N_var);
+	kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, -2.*a, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
 	to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, N_real);
 	if (N_var){
 		to_inertial_pos(particles+N_var, ri_whfast->p_j+N_var, ri_whfast->eta, N_real);
@@ -519,7 +824,7 @@ static void corrector_Z(struct reb_simulation* r, const double a, const double b
 		to_jacobi_acc(particles+N_var, ri_whfast->p_j+N_var, ri_whfast->eta, N_real);
 	}
 	interaction_step(ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, b, N, N_var);
-	kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, a, &(ri_whfast->timestep_warning), N, N_var);
+	kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, a, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
 }
 
 static void apply_corrector(struct reb_simulation* r, double inv){
@@ -566,11 +871,15 @@ void reb_integrator_whfast_part1(struct reb_simulation* const r){
 	const int N = r->N;
 	const int N_var = r->N_var;
 	const int N_real = N-N_var;
+	if (N_var && N_var!=N_real){
+		reb_exit("WHFast only supports one set of variational particles.");
+	}
 	r->gravity_ignore_10 = 1;
 	if (ri_whfast->allocated_N != N){
 		ri_whfast->allocated_N = N;
 		ri_whfast->p_j = realloc(ri_whfast->p_j,sizeof(struct reb_particle)*N);
 		ri_whfast->eta = realloc(ri_whfast->eta,sizeof(double)*N_real);
+		ri_whfast->p_tmp = realloc(ri_whfast->p_tmp,sizeof(struct reb_particle)*2*N);
 		ri_whfast->recalculate_jacobi_this_timestep = 1;
 	}
 	// Only recalculate Jacobi coordinates if needed
@@ -603,10 +912,10 @@ void reb_integrator_whfast_part1(struct reb_simulation* const r){
 		if (ri_whfast->corrector){
 			apply_corrector(r, 1.);
 		}
-		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, _dt2, &(ri_whfast->timestep_warning), N, N_var);	// half timestep
+		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, _dt2, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));	// half timestep
 	}else{
 		// Combined DRIFT step
-		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, r->dt, &(ri_whfast->timestep_warning), N, N_var);	// full timestep
+		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, r->dt, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));	// full timestep
 	}
 	// Prepare coordinates for KICK step
 	if (r->force_is_velocity_dependent){
@@ -635,7 +944,7 @@ void reb_integrator_whfast_synchronize(struct reb_simulation* const r){
 	const int N_var = r->N_var;
 	const int N_real = N-N_var;
 	if (ri_whfast->is_synchronized == 0){
-		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, r->dt/2., &(ri_whfast->timestep_warning), N, N_var);
+		kepler_drift(ri_whfast->p_j, ri_whfast->eta, r->G, r->dt/2., &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
 		if (ri_whfast->corrector){
 			apply_corrector(r, -1.);
 		}
@@ -647,6 +956,73 @@ void reb_integrator_whfast_synchronize(struct reb_simulation* const r){
 	}
 }
 
+int reb_integrator_whfast_interpolate(struct reb_simulation* const r, const double t, struct reb_particle* const particles){
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	const int N = r->N;
+	const int N_var = r->N_var;
+	const int N_real = N-N_var;
+	const double dt = r->dt;
+	if (ri_whfast->allocated_N!=N || ri_whfast->p_tmp==NULL || r->dt_last_done==0. || dt==0.){
+		return 0;
+	}
+	// The last kick happened half a timestep ago. Unsynchronized Jacobi coordinates
+	// are right after the kick, synchronized ones have already been drifted by dt/2.
+	const double tau = t-(r->t-dt/2.);
+	if (tau/dt<-1. || tau/dt>1.){
+		return 0;
+	}
+	struct reb_particle* const p_j = ri_whfast->p_j;
+	struct reb_particle* const p_tmp = ri_whfast->p_tmp;
+	struct reb_particle* const particles_backup = ri_whfast->p_tmp+N;
+	// The corrector and force calculations below work on ri_whfast->p_j and 
+	// r->particles. Point them to a copy and restore r->particles at the end.
+	memcpy(p_tmp, p_j, sizeof(struct reb_particle)*N);
+	memcpy(particles_backup, r->particles, sizeof(struct reb_particle)*N);
+	ri_whfast->p_j = p_tmp;
+	double drift = tau;
+	if (ri_whfast->is_synchronized){
+		to_jacobi_posvel(r->particles, p_tmp, ri_whfast->eta, N_real);
+		if (N_var){
+			to_jacobi_posvel(r->particles+N_var, p_tmp+N_var, ri_whfast->eta, N_real);
+		}
+		if (ri_whfast->corrector){
+			apply_corrector(r, 1.);
+		}
+		drift -= dt/2.;
+	}
+	if (tau/dt<0.){
+		// Before the last kick. Drift back to the kick and undo it.
+		if (ri_whfast->is_synchronized){
+			// Accelerations in p_j are only those of the kick if the
+			// corrector has not been applied since.
+			kepler_drift(p_tmp, ri_whfast->eta, r->G, -dt/2., &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
+			drift = tau;
+			to_inertial_pos(r->particles, p_tmp, ri_whfast->eta, N_real);
+			if (N_var){
+				to_inertial_pos(r->particles+N_var, p_tmp+N_var, ri_whfast->eta, N_real);
+			}
+			reb_update_acceleration(r);
+			to_jacobi_acc(r->particles, p_tmp, ri_whfast->eta, N_real);
+			if (N_var){
+				to_jacobi_acc(r->particles+N_var, p_tmp+N_var, ri_whfast->eta, N_real);
+			}
+		}
+		interaction_step(p_tmp, ri_whfast->eta, r->G, r->softening, -dt, N, N_var);
+	}
+	kepler_drift(p_tmp, ri_whfast->eta, r->G, drift, &(ri_whfast->timestep_warning), N, N_var, reb_simd_level(ri_whfast->simd));
+	if (ri_whfast->corrector){
+		apply_corrector(r, -1.);
+	}
+	memcpy(particles, particles_backup, sizeof(struct reb_particle)*N);
+	to_inertial_posvel(particles, p_tmp, ri_whfast->eta, N_real);
+	if (N_var){
+		to_inertial_posvel(particles+N_var, p_tmp+N_var, ri_whfast->eta, N_real);
+	}
+	memcpy(r->particles, particles_backup, sizeof(struct reb_particle)*N);
+	ri_whfast->p_j = p_j;
+	return 1;
+}
+
 void reb_integrator_whfast_part2(struct reb_simulation* const r){
 	struct reb_particle* restrict const particles = r->particles;
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
@@ -719,6 +1095,7 @@ void reb_integrator_whfast_reset(struct reb_simulation* const r){
 	ri_whfast->corrector = 0;
 	ri_whfast->is_synchronized = 1;
 	ri_whfast->safe_mode = 1;
+	ri_whfast->simd = REB_SIMD_AUTO;
 	ri_whfast->recalculate_jacobi_this_timestep = 0;
 	ri_whfast->allocated_N = 0;
 	ri_whfast->timestep_warning = 0;
@@ -727,4 +1104,6 @@ void reb_integrator_whfast_reset(struct reb_simulation* const r){
 	ri_whfast->p_j = NULL;
 	free(ri_whfast->eta);
 	ri_whfast->eta = NULL;
+	free(ri_whfast->p_tmp);
+	ri_whfast->p_tmp = NULL;
 }
@@ -149,6 +149,10 @@ void reb_output_timing(struct reb_simulation* r, const double tmax){
 		}
 		if (i==PROFILING_CAT_NUM){
 			printf("%5.2f%%",(1.-_sum/(profiling_time_final - profiling_timing_initial))*100.);
+			if (r->reorder_interval>0){
+				// Locality of the particle array before the last reordering, 1 is optimal.
+				printf("   Reordering: mean jump %.1f",r->reorder_jump);
+			}
 		}else{
 			printf("%5.2f%%\n",profiling_time_sum[i]/(profiling_time_final - profiling_timing_initial)*100.);
 			_sum += profiling_time_sum[i];
@@ -56,7 +56,7 @@ static void reb_add_local(struct reb_simulation* const r, struct reb_particle pt
 
 	r->particles[r->N] = pt;
 	r->particles[r->N].sim = r;
-	if (r->gravity==REB_GRAVITY_TREE || r->collision==REB_COLLISION_TREE){
+	if (r->gravity==REB_GRAVITY_TREE || r->gravity==REB_GRAVITY_FMM || (r->gravity==REB_GRAVITY_FFT && r->fft_rcut>0.) || r->collision==REB_COLLISION_TREE){
 		reb_tree_add_particle_to_tree(r, r->N);
 	}
 	(r->N)++;
@@ -83,8 +83,7 @@ void reb_add(struct reb_simulation* const r, struct reb_particle pt){
 #endif // GRAVITY_GRAPE
 #ifdef MPI
 	int rootbox = reb_get_rootbox_for_particle(r, pt);
-	int root_n_per_node = r->root_n/r->mpi_num;
-	int proc_id = rootbox/root_n_per_node;
+	int proc_id = reb_communication_mpi_rootbox_owner(r, rootbox);
 	if (proc_id != r->mpi_id && r->N >= r->N_active){
 		// Add particle to array and send them to proc_id later. 
 		reb_communication_mpi_add_particle_to_send_queue(r,pt,proc_id);
@@ -40,8 +40,10 @@
 #include "integrator_wh.h"
 #include "integrator_whfast.h"
 #include "integrator_ias15.h"
+#include "integrator_hermite.h"
 #include "boundary.h"
 #include "gravity.h"
+#include "gravity_fft.h"
 #include "collision.h"
 #include "tree.h"
 #include "output.h"
@@ -78,18 +80,31 @@ void reb_step(struct reb_simulation* const r){
 	// Prepare particles for distribution to other nodes. 
 	// This function also creates the tree if called for the first time.
 	PROFILING_START()
-	if (r->tree_needs_update || r->gravity==REB_GRAVITY_TREE || r->collision==REB_COLLISION_TREE){
+	if (r->reorder_interval>0 && ++r->reorder_steps>=r->reorder_interval){
+		// Sort particles along the Morton curve for better memory locality.
+		r->reorder_steps = 0;
+		reb_tree_reorder_particles(r);
+	}
+	if (r->tree_needs_update || r->gravity==REB_GRAVITY_TREE || r->gravity==REB_GRAVITY_FMM || (r->gravity==REB_GRAVITY_FFT && r->fft_rcut>0.) || r->collision==REB_COLLISION_TREE){
         // Update tree (this will remove particles which left the box)
 		reb_tree_update(r);          
 	}
 
 #ifdef MPI
+	if (r->tree_root==NULL){
+		// Without a tree, particles which left the local root boxes are sent to their new node here.
+		reb_communication_mpi_queue_nonlocal_particles(r);
+	}
+
+	// Redistribute root boxes between nodes if the load is imbalanced.
+	reb_communication_mpi_balance(r);
+
 	// Distribute particles and add newly received particles to tree.
 	reb_communication_mpi_distribute_particles(r);
 #endif // MPI
 
-	if (r->tree_root!=NULL && r->gravity==REB_GRAVITY_TREE){
-		// Update center of mass and quadrupole moments in tree in preparation of force calculation.
+	if (r->tree_root!=NULL && (r->gravity==REB_GRAVITY_TREE || r->gravity==REB_GRAVITY_FFT)){
+		// Update center of mass and higher order moments in tree in preparation of force calculation.
 		reb_tree_update_gravity_data(r); 
 #ifdef MPI
 		// Prepare essential tree (and particles close to the boundary needed for collisions) for distribution to other nodes.
@@ -101,12 +116,15 @@ void reb_step(struct reb_simulation* const r){
 	}
 
 	// Calculate accelerations. 
-	reb_calculate_acceleration(r);
-	if (r->N_var){
-		reb_calculate_acceleration_var(r);
+	// The Hermite integrator calculates the forces of each block itself.
+	if (r->integrator!=REB_INTEGRATOR_HERMITE){
+		reb_calculate_acceleration(r);
+		if (r->N_var){
+			reb_calculate_acceleration_var(r);
+		}
+		// Calculate non-gravity accelerations. 
+		if (r->additional_forces) r->additional_forces(r);
 	}
-	// Calculate non-gravity accelerations. 
-	if (r->additional_forces) r->additional_forces(r);
 	PROFILING_STOP(PROFILING_CAT_GRAVITY)
 
 	// A 'DKD'-like integrator will do the 'KD' part.
@@ -116,6 +134,7 @@ void reb_step(struct reb_simulation* const r){
 		reb_integrator_synchronize(r);
 		r->post_timestep_modifications(r);
 		r->ri_whfast.recalculate_jacobi_this_timestep = 1;
+		r->ri_hermite.recalculate_this_timestep = 1;
 	}
 	PROFILING_STOP(PROFILING_CAT_INTEGRATOR)
 
@@ -166,9 +185,9 @@ void reb_configure_box(struct reb_simulation* const r, const double root_size, c
 #ifdef MPI
 void reb_mpi_init(struct reb_simulation* const r){
     reb_communication_mpi_init(r,0,NULL);
-	// Make sure domain can be decomposed into equal number of root boxes per node.
-	if ((r->root_n/r->mpi_num)*r->mpi_num != r->root_n){
-		if (r->mpi_id==0) fprintf(stderr,"ERROR: Number of root boxes (%d) not a multiple of mpi nodes (%d).\n",r->root_n,r->mpi_num);
+	// Make sure every node gets at least one root box.
+	if (r->root_n<r->mpi_num){
+		if (r->mpi_id==0) fprintf(stderr,"ERROR: Number of root boxes (%d) smaller than number of mpi nodes (%d).\n",r->root_n,r->mpi_num);
 		exit(-1);
 	}
 	printf("MPI-node: %d. Process id: %d.\n",r->mpi_id, getpid());
@@ -199,10 +218,31 @@ void reb_free_simulation(struct reb_simulation* const r){
 void reb_free_pointers(struct reb_simulation* const r){
 	reb_tree_delete(r);
 	free(r->gravity_cs 	);
+	free(r->gravity_simd_buffer);
+	free(r->gravity_thread_buffer);
+	free(r->gravity_var_buffer);
+	free(r->gravity_fmm_cells);
+	free(r->gravity_fmm_expansions);
+	free(r->gravity_fmm_list);
+	free(r->gravity_fmm_particles);
+	free(r->gravity_ewald_table);
+#ifdef FFTW
+	reb_gravity_fft_free(r);
+#endif // FFTW
+	free(r->tree_multipoles);
+	free(r->tree_aold);
 	free(r->collisions	);
+#ifdef MPI
+	free(r->mpi_rootbox_owner);
+	free(r->mpi_rootbox_cost);
+	free(r->mpi_ring_buffer);
+	free(r->mpi_ring_N);
+	free(r->mpi_ring_members);
+#endif // MPI
 	reb_integrator_wh_reset(r);
 	reb_integrator_whfast_reset(r);
 	reb_integrator_ias15_reset(r);
+	reb_integrator_hermite_reset(r);
 	free(r->particles	);
 }
 
@@ -210,14 +250,45 @@ void reb_reset_temporary_pointers(struct reb_simulation* const r){
 	// Note: this will not clear the particle array.
 	r->gravity_cs_allocatedN 	= 0;
 	r->gravity_cs 			= NULL;
+	r->gravity_simd_allocatedN 	= 0;
+	r->gravity_simd_buffer		= NULL;
+	r->gravity_thread_buffer_allocatedN = 0;
+	r->gravity_thread_buffer	= NULL;
+	r->gravity_var_allocatedN	= 0;
+	r->gravity_var_buffer		= NULL;
+	r->gravity_fmm_allocatedN	= 0;
+	r->gravity_fmm_order		= 0;
+	r->gravity_fmm_cells		= NULL;
+	r->gravity_fmm_expansions	= NULL;
+	r->gravity_fmm_list_allocatedN	= 0;
+	r->gravity_fmm_list		= NULL;
+	r->gravity_fmm_particles	= NULL;
+	r->gravity_ewald_table		= NULL;
+	r->gravity_fft_data		= NULL;
+	r->tree_multipoles_N		= 0;
+	r->tree_multipoles_allocatedN	= 0;
+	r->tree_multipoles		= NULL;
+	r->tree_cell_slabs		= NULL;
+	r->tree_cell_slabs_N		= 0;
+	r->tree_cell_free		= NULL;
+	r->tree_cells_allocatedN	= 0;
+	r->tree_cells			= NULL;
+	r->tree_keys_N			= 0;
+	r->tree_keys_allocatedN		= 0;
+	r->tree_keys			= NULL;
+	r->tree_keys_tmp		= NULL;
+	r->tree_aold_allocatedN		= 0;
+	r->tree_aold			= NULL;
 	r->collisions_allocatedN	= 0;
 	r->collisions			= NULL;
 	// ********** WHFAST
 	r->ri_whfast.allocated_N	= 0;
 	r->ri_whfast.eta		= NULL;
 	r->ri_whfast.p_j		= NULL;
+	r->ri_whfast.p_tmp		= NULL;
 	// ********** IAS15
 	r->ri_ias15.allocatedN		= 0;
+	r->ri_ias15.arena		= NULL;
 	set_dp7_null(&(r->ri_ias15.g));
 	set_dp7_null(&(r->ri_ias15.b));
 	set_dp7_null(&(r->ri_ias15.csb));
@@ -231,7 +302,22 @@ void reb_reset_temporary_pointers(struct reb_simulation* const r){
 	r->ri_ias15.csx  		= NULL;
 	r->ri_ias15.csv  		= NULL;
 	r->ri_ias15.csa0  		= NULL;
+	r->ri_ias15.xs  		= NULL;
+	r->ri_ias15.vs  		= NULL;
+	r->ri_ias15.last_N  		= 0;
 	r->ri_ias15.at  		= NULL;
+	// ********** HERMITE
+	r->ri_hermite.allocatedN	= 0;
+	r->ri_hermite.initializedN	= 0;
+	r->ri_hermite.a			= NULL;
+	r->ri_hermite.jerk		= NULL;
+	r->ri_hermite.xp		= NULL;
+	r->ri_hermite.vp		= NULL;
+	r->ri_hermite.ap		= NULL;
+	r->ri_hermite.jp		= NULL;
+	r->ri_hermite.tick		= NULL;
+	r->ri_hermite.level		= NULL;
+	r->ri_hermite.active		= NULL;
 	// ********** WH
 	r->ri_wh.allocatedN 		= 0;
 	r->ri_wh.eta 			= NULL;
@@ -285,6 +371,12 @@ void reb_init_simulation(struct reb_simulation* r){
 	r->exact_finish_time 	= 1;
 	r->force_is_velocity_dependent = 0;
 	r->gravity_ignore_10	= 0;
+	r->gravity_basic_symmetric = 0;
+	r->gravity_tile_i	= 256;
+	r->gravity_tile_j	= 2048;
+	r->reorder_interval	= 0;
+	r->reorder_steps	= 0;
+	r->reorder_jump		= 0;
 	r->calculate_megno	= 0;
 	r->output_timing_last 	= -1;
 
@@ -296,6 +388,7 @@ void reb_init_simulation(struct reb_simulation* r){
 	r->integrator 	= REB_INTEGRATOR_IAS15;
 	r->boundary 	= REB_BOUNDARY_NONE;
 	r->gravity	= REB_GRAVITY_COMPENSATED;
+	r->gravity_simd	= REB_SIMD_AUTO;
 	r->collision	= REB_COLLISION_NONE;
 
 
@@ -305,6 +398,7 @@ void reb_init_simulation(struct reb_simulation* r){
 	// will be slower and less accurate
 	r->ri_whfast.corrector = 0;
 	r->ri_whfast.safe_mode = 1;
+	r->ri_whfast.simd = REB_SIMD_AUTO;
 	r->ri_whfast.recalculate_jacobi_this_timestep = 0;
 	r->ri_whfast.is_synchronized = 1;
 	r->ri_whfast.timestep_warning = 0;
@@ -315,6 +409,16 @@ void reb_init_simulation(struct reb_simulation* r){
 	r->ri_ias15.min_dt 		= 0;
 	r->ri_ias15.epsilon_global	= 1;
 	r->ri_ias15.iterations_max_exceeded = 0;	
+	r->ri_ias15.last_t		= 0;
+	r->ri_ias15.last_dt		= 0;
+
+	// ********** HERMITE
+	r->ri_hermite.eta		= 0.02;
+	r->ri_hermite.eta_start		= 0.01;
+	r->ri_hermite.max_level		= 40;
+	r->ri_hermite.recalculate_this_timestep = 0;
+	r->ri_hermite.steps_done	= 0;
+	r->ri_hermite.level_warning	= 0;
 	
 	// ********** SEI
 	r->ri_sei.OMEGA  	= 1;
@@ -328,6 +432,20 @@ void reb_init_simulation(struct reb_simulation* r){
     r->tree_needs_update= 0;
 	r->tree_root		= NULL;
 	r->opening_angle2	= 0.25;
+#ifdef QUADRUPOLE
+	r->tree_multipole	= REB_TREE_QUADRUPOLE;
+#else // QUADRUPOLE
+	r->tree_multipole	= REB_TREE_MONOPOLE;
+#endif // QUADRUPOLE
+	r->tree_type		= REB_TREE_DYNAMIC;
+	r->tree_ncrit		= 0;
+	r->tree_opening		= REB_TREE_OPENING_GEOMETRIC;
+	r->opening_tolerance	= 0.005;
+	r->fmm_order		= 4;
+	r->fmm_ncrit		= 16;
+	r->fft_nx		= 64;
+	r->fft_ny		= 64;
+	r->fft_rcut		= 0;
 
 #ifdef MPI
     r->mpi_id = 0;                            
@@ -345,6 +463,13 @@ void reb_init_simulation(struct reb_simulation* r){
     r->tree_essential_recv = NULL;
     r->tree_essential_recv_N = 0;             
     r->tree_essential_recv_Nmax = 0;          
+    r->tree_essential_send_multipoles = NULL;
+    r->tree_essential_recv_multipoles = NULL;
+    r->tree_essential_multipole = 0;
+    r->mpi_rootbox_owner = NULL;
+    r->mpi_rootbox_cost = NULL;
+    r->mpi_imbalance_max = 0;
+    r->mpi_imbalance = 0;
 
 #else // MPI
 #ifndef LIBREBOUND
@@ -52,6 +52,8 @@ enum REB_STATUS {
 };
 
 struct reb_simulation;
+struct reb_fmm_cell;
+struct reb_tree_key;
 
 /**
  * @brief Generic 3d vector, for internal use only.
@@ -192,9 +194,12 @@ struct reb_simulation_integrator_ias15 {
 	 */
 	unsigned long iterations_max_exceeded;
 
+	double last_t;				///< Time at the beginning of the last accepted step.
+	double last_dt;				///< Length of the last accepted step.
+	int last_N;				///< Number of particles during the last accepted step. 0 if there is nothing to interpolate.
 
-
-	int allocatedN; 			///< Size of allocated arrays.
+	int allocatedN; 			///< Number of coordinates the arrays below have space for.
+	double* arena;				///< 64 byte aligned memory holding all arrays below.
 
 	double* restrict at;			///< Temporary buffer for acceleration
 	double* restrict x0;			///<                      position (used for initial values at h=0) 
@@ -203,6 +208,8 @@ struct reb_simulation_integrator_ias15 {
 	double* restrict csx;			///<                      compensated summation for x
 	double* restrict csv;			///<                      compensated summation for v
 	double* restrict csa0;			///<                      compensated summation for a
+	double* restrict xs;			///< Position at the beginning of the last accepted step
+	double* restrict vs;			///< Velocity at the beginning of the last accepted step
 
 	struct reb_dp7 g;
 	struct reb_dp7 b;
@@ -218,6 +225,65 @@ struct reb_simulation_integrator_ias15 {
 
 };
 
+/**
+ * @brief This structure contains variables and pointer used by the Hermite integrator.
+ * @details Each particle has its own timestep dt/2^level, where dt is the 
+ * timestep of the simulation. All particles are synchronized after every step.
+ */
+struct reb_simulation_integrator_hermite {
+	/**
+	 * @brief Accuracy parameter of the Aarseth timestep criterion.
+	 * @details The default value is: 0.02.
+	 **/
+	double eta;
+
+	/**
+	 * @brief Accuracy parameter for the first timestep, eta_start*|a|/|jerk|.
+	 * @details The default value is: 0.01.
+	 **/
+	double eta_start;
+
+	/**
+	 * @brief Number of timestep levels.
+	 * @details The smallest timestep is dt/2^max_level. At most 62. 
+	 * The default value is: 40.
+	 **/
+	unsigned int max_level;
+
+	/** 
+	 * @brief Setting this flag to one will recalculate accelerations, jerks and timesteps of all particles in the next timestep. 
+	 * @details This is needed if particles were modified between timesteps. Adding or
+	 * removing particles sets it automatically. After the timestep, the flag gets set back to 0. 
+	 */ 
+	unsigned int recalculate_this_timestep;
+
+	/**
+	 * @brief Number of individual particle timesteps done so far.
+	 * @details Each particle timestep requires the force from all N_active massive particles.
+	 **/
+	unsigned long steps_done;
+
+	/**
+	 * @cond PRIVATE
+	 * Internal data structures below. Nothing to be changed by the user.
+	 */
+	int allocatedN; 			///< Size of allocated arrays.
+	int initializedN; 			///< Number of particles at the last initialization.
+	unsigned int level_warning; 		///< Flag that the smallest timestep has been reached.
+	double* restrict a;			///< Acceleration at the time of the last correction
+	double* restrict jerk;			///< Jerk at the time of the last correction
+	double* restrict xp;			///< Predicted position
+	double* restrict vp;			///< Predicted velocity
+	double* restrict ap;			///< Acceleration of the active particles at the predicted positions
+	double* restrict jp;			///< Jerk of the active particles at the predicted positions
+	long long* tick;			///< Time of the last correction in units of dt/2^max_level
+	int* level;				///< Timestep level of each particle
+	int* active;				///< Indices of the particles in the active block
+	/**
+	 * @endcond
+	 */
+};
+
 /**
  * @brief This structure contains variables used by the SEI integrator.
  * @details This is where the user sets the orbital frequency OMEGA for 
@@ -255,6 +321,9 @@ struct reb_simulation_integrator_wh {
 
 /**
  * @brief This structure contains variables used by the WHFast integrator.
+ * @details The Kepler solver advances several particles at once with AVX2 or
+ * AVX-512. The instruction set is chosen by simd. The results are bitwise 
+ * identical for all instruction sets.
  */
 struct reb_simulation_integrator_whfast {
 	/**
@@ -289,6 +358,14 @@ struct reb_simulation_integrator_whfast {
 	 */
 	unsigned int safe_mode;
 
+	/**
+	 * @brief Instruction set of the Kepler solver.
+	 * @details Takes the same values as gravity_simd in reb_simulation. 
+	 * REB_SIMD_AUTO (default) uses the widest instruction set supported by the
+	 * CPU, REB_SIMD_NONE turns off the batched Kepler solver.
+	 */
+	int simd;
+
 	/**
 	 * @brief Jacobi coordinates
 	 * @details This array contains the Jacobi coordinates of all particles.
@@ -302,6 +379,7 @@ struct reb_simulation_integrator_whfast {
 	 * Internal data structures below. Nothing to be changed by the user.
 	 */
 	double* restrict eta;		///< Struct containg Jacobi eta parameters 
+	struct reb_particle* restrict p_tmp;	///< Scratch space for 2N particles, used by reb_integrator_whfast_interpolate()
 	double Mtotal;			///< Total mass, used for Jacobi coordinates 
 
 	unsigned int is_synchronized;	///< Flag to determine if current particle structure is synchronized
@@ -353,14 +431,57 @@ struct reb_simulation {
 	struct reb_particle* particles;	///< Main particle array. This contains all particles on this node.  
 	struct reb_vec3d* gravity_cs;	///< Vector containing the information for compensated gravity summation 
 	int 	gravity_cs_allocatedN;	///< Current number of allocated space for cs array
+	double* gravity_simd_buffer;	///< Aligned SoA buffer (x, y, z, m) used by the SIMD gravity kernels
+	int 	gravity_simd_allocatedN;///< Current number of particles the SoA buffer has room for (stride of each array)
+	double* gravity_thread_buffer;	///< Thread private acceleration buffers used by the symmetric direct summation
+	int 	gravity_thread_buffer_allocatedN;	///< Current number of doubles allocated in gravity_thread_buffer
+	double* gravity_var_buffer;	///< Aligned buffer for the positions and thread private accelerations of the variational particles
+	int 	gravity_var_allocatedN;	///< Current number of doubles allocated in gravity_var_buffer
+	struct reb_fmm_cell* gravity_fmm_cells;	///< Cell bookkeeping used by REB_GRAVITY_FMM
+	double* gravity_fmm_expansions;	///< Multipole and local expansions of all cells used by REB_GRAVITY_FMM
+	int 	gravity_fmm_allocatedN;	///< Current number of cells allocated in gravity_fmm_cells and gravity_fmm_expansions
+	int 	gravity_fmm_order;	///< Expansion order gravity_fmm_expansions was allocated for
+	int* 	gravity_fmm_list;	///< Particle indices sorted by cell used by REB_GRAVITY_FMM
+	double* gravity_fmm_particles;	///< Positions, masses and accelerations in the order of gravity_fmm_list used by REB_GRAVITY_FMM
+	int 	gravity_fmm_list_allocatedN;	///< Current number of particles allocated in gravity_fmm_list and gravity_fmm_particles
+	double* gravity_ewald_table;	///< Tabulated Ewald correction used by REB_GRAVITY_EWALD
+	struct reb_vec3d gravity_ewald_boxsize;	///< Size of the box gravity_ewald_table was calculated for
+	struct reb_fft_data* gravity_fft_data;	///< Grid, wave vectors and FFTW plans used by REB_GRAVITY_FFT
 	struct reb_treecell** tree_root;///< Pointer to the roots of the trees. 
+	double* tree_multipoles;	///< Higher order moments of all non-leaf cells used by REB_GRAVITY_TREE
+	int 	tree_multipoles_N;	///< Number of cells with moments in tree_multipoles
+	int 	tree_multipoles_allocatedN;	///< Number of doubles allocated in tree_multipoles
+	struct reb_treecell** tree_cell_slabs;	///< Blocks of memory the cells of the dynamic tree are taken from (REB_TREE_DYNAMIC)
+	int 	tree_cell_slabs_N;	///< Number of blocks in tree_cell_slabs
+	struct reb_treecell* tree_cell_free;	///< Unused cells in tree_cell_slabs, linked by oct[0]
+	struct reb_treecell* tree_cells;	///< All cells of the linear tree in depth first order (REB_TREE_LINEAR)
+	int 	tree_cells_allocatedN;	///< Number of cells allocated in tree_cells
+	struct reb_tree_key* tree_keys;	///< Sorted keys of all particles used to build the linear tree
+	struct reb_tree_key* tree_keys_tmp;	///< Buffer used to sort tree_keys
+	int 	tree_keys_N;		///< Number of keys in tree_keys after the last build
+	int 	tree_keys_allocatedN;	///< Number of keys allocated in tree_keys and tree_keys_tmp
+	double* tree_aold;		///< Acceleration of each particle in the previous force calculation (REB_TREE_OPENING_RELATIVE)
+	int 	tree_aold_allocatedN;	///< Number of doubles allocated in tree_aold
     int     tree_needs_update;  ///< Flag to force a tree update (after boundary check)
 	double opening_angle2;	 	///< Square of the cell opening angle \f$ \theta \f$. 
+	double opening_tolerance;	///< Tolerance \f$ \alpha \f$ of the relative opening criterion (REB_TREE_OPENING_RELATIVE). Default: 0.005.
+	int 	tree_ncrit;		///< Particles in cells with at most this many particles share one tree walk in REB_GRAVITY_TREE. Typical values are 16-64. Default: 0 (one tree walk per particle).
+	int 	fmm_order;		///< Order of the multipole expansions in REB_GRAVITY_FMM (at least 1). Default: 4.
+	int 	fmm_ncrit;		///< Cells with at most this many particles are not split in REB_GRAVITY_FMM. Default: 16.
+	int 	fft_nx;			///< Number of grid points in x direction used by REB_GRAVITY_FFT. Default: 64.
+	int 	fft_ny;			///< Number of grid points in y direction used by REB_GRAVITY_FFT (even). Default: 64.
+	double 	fft_rcut;		///< Forces within this distance are calculated with the tree in REB_GRAVITY_FFT (TreePM). Set to 0 to use the grid only. Default: 0.
+	int 	reorder_interval;	///< Sort the particles along the Morton curve of the tree every reorder_interval time steps for better memory locality. Only with REB_INTEGRATOR_LEAPFROG and REB_INTEGRATOR_SEI. Requires a box. Set to 0 to turn off. Default: 0.
+	int 	reorder_steps;		///< Number of time steps since the particles were sorted the last time.
+	double 	reorder_jump;		///< Mean distance in memory between neighbours on the Morton curve before the last sort. 1 is optimal.
 	enum REB_STATUS status;		///< Set to 1 to exit the simulation at the end of the next timestep. 
 	int 	exact_finish_time; 	///< Set to 1 to finish the integration exactly at tmax. Set to 0 to finish at the next dt. Default is 1. 
 
 	unsigned int force_is_velocity_dependent;///< Set to 1 if integrator needs to consider velocity dependent forces.  
 	unsigned int gravity_ignore_10;		///< Ignore the gravity form the central object (for WH-type integrators)
+	unsigned int gravity_basic_symmetric;	///< Set to 1 to evaluate each massive pair only once in REB_GRAVITY_BASIC (Newton's third law). Not used with ghost boxes. Default: 0. 
+	int	gravity_tile_i;		///< Number of particles receiving a force per cache tile in REB_GRAVITY_BASIC. Default: 256.
+	int	gravity_tile_j;		///< Number of particles exerting a force per cache tile in REB_GRAVITY_BASIC. Tiling is used if there are more massive particles than this. Set to 0 to turn tiling off. Default: 2048.
 	double output_timing_last; 		///< Time when reb_output_timing() was called the last time. 
 	double exit_max_distance;		///< Exit simulation if distance from origin larger than this value 
 	double exit_min_distance;		///< Exit simulation if distance from another particle smaller than this value 
@@ -404,6 +525,22 @@ struct reb_simulation {
     struct reb_treecell** tree_essential_recv;  ///< Receive buffer for cells. There is one buffer per node. 
     int*   tree_essential_recv_N;               ///< Current length of cell receive buffer. 
     int*   tree_essential_recv_Nmax;            ///< Maximal length of cell receive beffer before realloc() is needed. 
+    double** tree_essential_send_multipoles;    ///< Send buffer for the higher order moments of cells. There is one buffer per node. 
+    double** tree_essential_recv_multipoles;    ///< Receive buffer for the higher order moments of cells. There is one buffer per node. 
+    int    tree_essential_multipole;            ///< Multipole order the moment buffers were allocated for.
+
+    int*   mpi_rootbox_owner;                   ///< MPI node each root box belongs to. 
+    double* mpi_rootbox_cost;                   ///< Number of interactions of the local particles in each root box since the last load balancing check.
+    double mpi_imbalance_max;                   ///< Root boxes are redistributed if the cost of the busiest node is larger than this factor times the mean cost. Set to 0 to turn load balancing off. Default: 0.
+    double mpi_imbalance;                       ///< Cost of the busiest node divided by the mean cost, measured in the last load balancing check.
+
+    double* mpi_ring_buffer;                    ///< Two aligned SoA blocks (x, y, z, m) of massive particles passed around the ring by REB_GRAVITY_BASIC.
+    int    mpi_ring_stride;                     ///< Stride of the arrays in each block of mpi_ring_buffer.
+    int    mpi_ring_allocatedN;                 ///< Current number of doubles allocated in mpi_ring_buffer.
+    int*   mpi_ring_N;                          ///< Number of massive particles on each node in the current force calculation.
+    int*   mpi_ring_members;                    ///< Indices of the local particles receiving forces from the blocks of other nodes.
+    int    mpi_ring_members_allocatedN;         ///< Current number of ints allocated in mpi_ring_members.
+    MPI_Request mpi_ring_requests[2];           ///< Pending send and receive of the ring.
 	/** @} */
 #endif // MPI
 
@@ -456,6 +593,7 @@ struct reb_simulation {
 		REB_INTEGRATOR_LEAPFROG = 4,	///< LEAPFROG integrator, simple, 2nd order, symplectic
 		REB_INTEGRATOR_HYBRID = 5,	///< HYBRID Integrator for close encounters (experimental)
 		REB_INTEGRATOR_NONE = 6,	///< Do not integrate anything
+		REB_INTEGRATOR_HERMITE = 7,	///< Hermite integrator, 4th order, individual block timesteps
 		} integrator;
 
 	/**
@@ -476,7 +614,54 @@ struct reb_simulation {
 		REB_GRAVITY_BASIC = 1,		///< Basic O(N^2) direct summation algorithm, choose this for shearing sheet and periodic boundary conditions
 		REB_GRAVITY_COMPENSATED = 2,	///< Direct summation algorithm O(N^2) but with compensated summation, slightly slower than BASIC but more accurate
 		REB_GRAVITY_TREE = 3,		///< Use the tree to calculate gravity, O(N log(N)), set opening_angle2 to adjust accuracy.
+		REB_GRAVITY_FMM = 4,		///< Fast multipole method using the tree, O(N), set opening_angle2 and fmm_order to adjust accuracy.
+		REB_GRAVITY_EWALD = 5,		///< Direct summation O(N^2) in a periodic box using the nearest image and a tabulated Ewald correction instead of ghost boxes.
+		REB_GRAVITY_FFT = 6,		///< Two dimensional particle mesh solver using FFTW, O(N), for periodic boxes and the shearing sheet. Set fft_rcut to add short range forces with the tree (TreePM). Requires FFTW=1.
 		} gravity;
+	/**
+	 * @brief Available instruction sets for the direct summation kernels
+	 * @details Used by REB_GRAVITY_BASIC. The Kepler solver of WHFast has its
+	 * own setting, simd in reb_simulation_integrator_whfast. If the requested 
+	 * instruction set is not supported by the CPU, the scalar loop is used.
+	 */
+	enum {
+		REB_SIMD_AUTO = 0,		///< Use the widest instruction set supported by the CPU, detected at runtime (default)
+		REB_SIMD_NONE = 1,		///< Scalar loop, no explicit vectorization
+		REB_SIMD_AVX2 = 2,		///< AVX2 and FMA, 4 particle pairs per instruction
+		REB_SIMD_AVX512 = 3,		///< AVX-512F, 8 particle pairs per instruction
+		} gravity_simd;
+	/**
+	 * @brief Available multipole orders for REB_GRAVITY_TREE
+	 * @details Higher orders are more accurate for the same opening angle, 
+	 * so fewer cells need to be opened. Cells store only the moments of 
+	 * the selected order and below.
+	 */
+	enum {
+		REB_TREE_MONOPOLE = 0,		///< Total mass and center of mass only (default)
+		REB_TREE_QUADRUPOLE = 2,	///< Up to quadrupole moments, 6 moments per cell
+		REB_TREE_OCTUPOLE = 3,		///< Up to octupole moments, 16 moments per cell
+		REB_TREE_HEXADECAPOLE = 4,	///< Up to hexadecapole moments, 31 moments per cell
+		} tree_multipole;
+	/**
+	 * @brief Available tree implementations
+	 * @details Both trees consist of the same cells, so gravity and collisions
+	 * give the same results. Only the way the tree is built differs.
+	 */
+	enum {
+		REB_TREE_DYNAMIC = 0,		///< Cells are allocated one by one, particles are moved to a new cell when they leave their cell (default)
+		REB_TREE_LINEAR = 1,		///< The tree is rebuilt every time step from particles sorted by Morton key, all cells are stored in one array
+		} tree_type;
+	/**
+	 * @brief Available cell opening criteria for REB_GRAVITY_TREE
+	 * @details The relative criterion compares the estimated force error of
+	 * a cell to the acceleration of the particle in the previous force 
+	 * calculation (Springel 2005). Particles without a previous acceleration
+	 * use the geometric criterion.
+	 */
+	enum {
+		REB_TREE_OPENING_GEOMETRIC = 0,	///< Open a cell if its width is larger than sqrt(opening_angle2) times its distance (default)
+		REB_TREE_OPENING_RELATIVE = 1,	///< Open a cell if G m w^2/d^4 is larger than opening_tolerance times the previous acceleration, or if the particle is close to the cell
+		} tree_opening;
 	/** @} */
 
 
@@ -489,6 +674,7 @@ struct reb_simulation {
 	struct reb_simulation_integrator_hybrid ri_hybrid;	///< The Hybrid struct 
 	struct reb_simulation_integrator_whfast ri_whfast;	///< The WHFast struct 
 	struct reb_simulation_integrator_ias15 ri_ias15;	///< The IAS15 struct 
+	struct reb_simulation_integrator_hermite ri_hermite;	///< The Hermite struct 
 	/** @} */
 
 	/**
@@ -591,6 +777,43 @@ void reb_integrator_synchronize(struct reb_simulation* r);
  **/
 void reb_integrator_reset(struct reb_simulation* r);
 
+/**
+ * @brief Evaluates positions and velocities at any time inside the last IAS15 step.
+ * @details Uses the polynomials of the last accepted IAS15 step, so outputs can 
+ * be generated at arbitrary times without shortening the timestep with 
+ * exact_finish_time. Call this function after reb_integrate() or reb_step() 
+ * with exact_finish_time=0 for all t between r->t-r->dt_last_done and r->t.
+ * The interpolation has the same order as the integrator. 
+ * Only positions and velocities are interpolated, all other fields are copied 
+ * from r->particles. The simulation itself is not changed.
+ * @param r The rebound simulation to be considered
+ * @param t Time at which the particles are evaluated.
+ * @param particles Output array of length r->N. Must not be r->particles.
+ * @return 1 on success. 0 if t is outside the last step, if IAS15 has not yet
+ * done a step, or if particles were added or removed since the last step.
+ */
+int reb_integrator_ias15_interpolate(struct reb_simulation* const r, const double t, struct reb_particle* const particles);
+
+/**
+ * @brief Evaluates synchronized positions and velocities at any time close to the current WHFast time.
+ * @details Works on a copy of the Jacobi coordinates, so the simulation stays
+ * unsynchronized and no timestep gets shortened. With safe_mode=0, outputs 
+ * do not require reb_integrator_synchronize() and exact_finish_time. 
+ * Each call costs one inverse symplectic corrector (if enabled), 
+ * instead of the corrector and inverse corrector needed to synchronize 
+ * and continue the integration. In between two kicks, particles move along 
+ * the Kepler orbits of the drift step. For t=r->t, the result is identical 
+ * to what reb_integrator_synchronize() would give. 
+ * All fields other than positions and velocities are copied from r->particles.
+ * @param r The rebound simulation to be considered
+ * @param t Time at which the particles are evaluated. Has to be within one timestep of
+ * the last kick at r->t-r->dt/2, so any time inside the last step works.
+ * @param particles Output array of length r->N. Must not be r->particles.
+ * @return 1 on success. 0 if t is too far from r->t, if WHFast has not yet 
+ * done a step, or if particles were added or removed since the last step.
+ */
+int reb_integrator_whfast_interpolate(struct reb_simulation* const r, const double t, struct reb_particle* const particles);
+
 /**
  * @brief Configure the boundary/root box
  * @details This function helps to setup the variables for the simulation box.
@@ -1028,6 +1251,33 @@ double reb_tools_calculate_megno(struct reb_simulation* r);
  */
 double reb_tools_calculate_lyapunov(struct reb_simulation* r);
 
+/** 
+ * @brief Adds k sets of variational particles, for example to calculate a Lyapunov spectrum.
+ * @details Each set contains one variational particle per real particle and is stored
+ * after the existing sets. The new sets are randomly oriented, then all sets are 
+ * orthonormalized with reb_tools_variations_orthonormalize(). The pair geometry
+ * in the variational equations is shared by all sets. MEGNO uses the first set, so 
+ * call reb_tools_megno_init() first if both are needed. Supported by IAS15 and 
+ * LEAPFROG. WHFast and HYBRID only support a single set and exit if more than one
+ * set would be present. Hermite does not support variational particles.
+ * @param r The rebound simulation to be considered
+ * @param k Number of sets to add.
+ * @param delta Length of each set in phase space (typically 1e-16).
+ */
+void reb_tools_variations_init(struct reb_simulation* const r, const int k, const double delta);
+
+/** 
+ * @brief Orthonormalizes all sets of variational particles with the Gram-Schmidt method.
+ * @details Sets are processed in order and rescaled to length delta. The logarithm
+ * of the length of set s after removing the components along sets 0..s-1 relative 
+ * to delta is added to lnstretch[s]. Dividing lnstretch by the time gives the
+ * Lyapunov spectrum, if this function is called regularly.
+ * @param r The rebound simulation to be considered
+ * @param delta Length of each set after the orthonormalization.
+ * @param lnstretch Array of length N_var/(N-N_var), or NULL.
+ */
+void reb_tools_variations_orthonormalize(struct reb_simulation* const r, const double delta, double* const lnstretch);
+
 /**
  * @brief Print out an error message, then exit in a semi-nice way.
  */
@@ -488,10 +488,11 @@ double reb_tools_calculate_lyapunov(struct reb_simulation* r){ // Returns the la
 double reb_tools_megno_deltad_delta(struct reb_simulation* const r){
 	const struct reb_particle* restrict const particles = r->particles;
 	const int N = r->N;
-	const int N_var = r->N_var;
+	const int N_real = N - r->N_var;
         double deltad = 0;
         double delta2 = 0;
-        for (int i=N-N_var;i<N;i++){
+	// MEGNO uses the first set of variational particles.
+        for (int i=N_real;i<2*N_real;i++){
                 deltad += particles[i].vx * particles[i].x; 
                 deltad += particles[i].vy * particles[i].y; 
                 deltad += particles[i].vz * particles[i].z; 
@@ -528,3 +529,73 @@ void reb_tools_megno_update(struct reb_simulation* r, double dY){
 					*(r->t-r->megno_mean_t);
 }
 #endif // LIBREBOUNDX
+
+/**************************
+ * Variational particles  */
+
+void reb_tools_variations_init(struct reb_simulation* const r, const int k, const double delta){
+	const int N_real = r->N - r->N_var;
+	if ((r->integrator==REB_INTEGRATOR_WHFAST || r->integrator==REB_INTEGRATOR_HYBRID) && r->N_var+k*N_real>N_real){
+		reb_exit("WHFast only supports one set of variational particles.");
+	}
+	for (int s=0;s<k;s++){
+		for (int i=0;i<N_real;i++){
+			struct reb_particle var = {
+				.m  = r->particles[i].m,
+				.x  = reb_random_normal(1.),
+				.y  = reb_random_normal(1.),
+				.z  = reb_random_normal(1.),
+				.vx = reb_random_normal(1.),
+				.vy = reb_random_normal(1.),
+				.vz = reb_random_normal(1.) };
+			reb_add(r, var);
+		}
+	}
+	r->N_var += k*N_real;
+	reb_tools_variations_orthonormalize(r, delta, NULL);
+}
+
+void reb_tools_variations_orthonormalize(struct reb_simulation* const r, const double delta, double* const lnstretch){
+	struct reb_particle* const particles = r->particles;
+	const int N_real = r->N - r->N_var;
+	const int k = r->N_var/N_real;
+	// Modified Gram-Schmidt, each set is one vector in the 6*N_real dimensional phase space.
+	for (int s=0;s<k;s++){
+		struct reb_particle* const ps = particles + N_real + s*N_real;
+		for (int q=0;q<s;q++){
+			const struct reb_particle* const pq = particles + N_real + q*N_real;
+			double dot = 0.;
+			for (int i=0;i<N_real;i++){
+				dot += ps[i].x*pq[i].x + ps[i].y*pq[i].y + ps[i].z*pq[i].z;
+				dot += ps[i].vx*pq[i].vx + ps[i].vy*pq[i].vy + ps[i].vz*pq[i].vz;
+			}
+			const double f = dot/(delta*delta); // Set q already has length delta.
+			for (int i=0;i<N_real;i++){
+				ps[i].x  -= f*pq[i].x;
+				ps[i].y  -= f*pq[i].y;
+				ps[i].z  -= f*pq[i].z;
+				ps[i].vx -= f*pq[i].vx;
+				ps[i].vy -= f*pq[i].vy;
+				ps[i].vz -= f*pq[i].vz;
+			}
+		}
+		double norm2 = 0.;
+		for (int i=0;i<N_real;i++){
+			norm2 += ps[i].x*ps[i].x + ps[i].y*ps[i].y + ps[i].z*ps[i].z;
+			norm2 += ps[i].vx*ps[i].vx + ps[i].vy*ps[i].vy + ps[i].vz*ps[i].vz;
+		}
+		const double norm = sqrt(norm2);
+		if (lnstretch){
+			lnstretch[s] += log(norm/delta);
+		}
+		const double f = delta/norm;
+		for (int i=0;i<N_real;i++){
+			ps[i].x  *= f;
+			ps[i].y  *= f;
+			ps[i].z  *= f;
+			ps[i].vx *= f;
+			ps[i].vy *= f;
+			ps[i].vz *= f;
+		}
+	}
+}
@@ -25,6 +25,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
@@ -33,6 +34,9 @@
 #include "boundary.h"
 #include "tree.h"
 #include "communication_mpi.h"
+#ifdef OPENMP
+#include <omp.h>
+#endif // OPENMP
 
 
 /**
@@ -61,17 +65,84 @@ static int reb_reb_tree_get_octant_for_particle_in_cell(const struct reb_particl
   */
 static struct reb_treecell *reb_tree_add_particle_to_cell(struct reb_simulation* const r, struct reb_treecell *node, int pt, struct reb_treecell *parent, int o);
 
+/*
+ * Cells of the dynamic tree are taken from slabs of REB_TREE_CELLS_PER_SLAB 
+ * cells. Unused cells are kept in a free list, linked by oct[0]. Cells are 
+ * never returned to the system individually, all slabs are released at once.
+ */
+#define REB_TREE_CELLS_PER_SLAB 1024
+
+/**
+  * @brief Returns an unused cell with all fields set to zero.
+  */
+static struct reb_treecell* reb_tree_cell_alloc(struct reb_simulation* const r){
+	if (r->tree_cell_free==NULL){
+		struct reb_treecell* const slab = malloc(sizeof(struct reb_treecell)*REB_TREE_CELLS_PER_SLAB);
+		if (slab==NULL){
+			reb_exit("Cannot allocate memory for tree.");
+		}
+		r->tree_cell_slabs = realloc(r->tree_cell_slabs, sizeof(struct reb_treecell*)*(r->tree_cell_slabs_N+1));
+		r->tree_cell_slabs[r->tree_cell_slabs_N++] = slab;
+		// Cells are handed out in the order they are stored in memory
+		for (int i=REB_TREE_CELLS_PER_SLAB-1; i>=0; i--){
+			slab[i].oct[0] = r->tree_cell_free;
+			r->tree_cell_free = &slab[i];
+		}
+	}
+	struct reb_treecell* const node = r->tree_cell_free;
+	r->tree_cell_free = node->oct[0];
+	*node = (struct reb_treecell){0};
+	return node;
+}
+
+/**
+  * @brief Returns a cell to the free list.
+  */
+static void reb_tree_cell_free(struct reb_simulation* const r, struct reb_treecell* const node){
+#pragma omp critical (reb_tree_cell_free)
+	{
+		node->oct[0] = r->tree_cell_free;
+		r->tree_cell_free = node;
+	}
+}
+
+/**
+  * @brief Releases the memory of all cells of the dynamic tree.
+  */
+static void reb_tree_cell_release_all(struct reb_simulation* const r){
+	for (int i=0; i<r->tree_cell_slabs_N; i++){
+		free(r->tree_cell_slabs[i]);
+	}
+	free(r->tree_cell_slabs);
+	r->tree_cell_slabs = NULL;
+	r->tree_cell_slabs_N = 0;
+	r->tree_cell_free = NULL;
+}
+
+/**
+  * @brief Sets the position and width of the cell in octant o of parent.
+  */
+static void reb_tree_set_daughter_geometry(struct reb_treecell* const node, const struct reb_treecell* const parent, const int o){
+	node->w 	= parent->w/2.;
+	node->x 	= parent->x + node->w/2.*((o>>0)%2==0?1.:-1);
+	node->y 	= parent->y + node->w/2.*((o>>1)%2==0?1.:-1);
+	node->z 	= parent->z + node->w/2.*((o>>2)%2==0?1.:-1);
+}
+
 void reb_tree_add_particle_to_tree(struct reb_simulation* const r, int pt){
 	if (r->tree_root==NULL){
 		r->tree_root = calloc(r->root_nx*r->root_ny*r->root_nz,sizeof(struct reb_treecell*));
 	}
+	if (r->tree_type==REB_TREE_LINEAR){
+		// The linear tree is rebuilt with all particles in the next call of reb_tree_update().
+		r->tree_needs_update = 1;
+		return;
+	}
 	struct reb_particle p = r->particles[pt];
 	int rootbox = reb_get_rootbox_for_particle(r, p);
 #ifdef MPI
 	// Do not add particles that do not belong to this tree (avoid removing active particles)
-	int root_n_per_node = r->root_n/r->mpi_num;
-	int proc_id = rootbox/root_n_per_node;
-	if (proc_id!=r->mpi_id) return;
+	if (reb_communication_mpi_rootbox_is_local(r, rootbox)==0) return;
 #endif 	// MPI
 	r->tree_root[rootbox] = reb_tree_add_particle_to_cell(r, r->tree_root[rootbox],pt,NULL,0);
 }
@@ -80,7 +151,7 @@ static struct reb_treecell *reb_tree_add_particle_to_cell(struct reb_simulation*
 	struct reb_particle* const particles = r->particles;
 	// Initialize a new node
 	if (node == NULL) {  
-		node = calloc(1, sizeof(struct reb_treecell));
+		node = reb_tree_cell_alloc(r);
 		struct reb_particle p = particles[pt];
 		if (parent == NULL){ // The new node is a root
 			node->w = r->root_size;
@@ -91,16 +162,10 @@ static struct reb_treecell *reb_tree_add_particle_to_cell(struct reb_simulation*
 			node->y = -r->boxsize.y/2.+r->root_size*(0.5+(double)j);
 			node->z = -r->boxsize.z/2.+r->root_size*(0.5+(double)k);
 		}else{ // The new node is a normal node
-			node->w 	= parent->w/2.;
-			node->x 	= parent->x + node->w/2.*((o>>0)%2==0?1.:-1);
-			node->y 	= parent->y + node->w/2.*((o>>1)%2==0?1.:-1);
-			node->z 	= parent->z + node->w/2.*((o>>2)%2==0?1.:-1);
+			reb_tree_set_daughter_geometry(node, parent, o);
 		}
 		node->pt = pt; 
 		particles[pt].c = node;
-		for (int i=0; i<8; i++){
-			node->oct[i] = NULL;
-		}
 		return node;
 	}
 	// In a existing node
@@ -143,13 +208,23 @@ static int reb_tree_particle_is_inside_cell(const struct reb_simulation* const r
 	return 1;
 }
 
+/*
+ * Subtrees are updated in parallel with OpenMP tasks. Subtrees with fewer 
+ * than REB_TREE_TASK_MIN particles are not split into tasks.
+ */
+#define REB_TREE_TASK_MIN 1024
+
 /**
   * @brief The function is called to walk through the whole tree to update its structure and node->pt at the end of each time step.
+  * @details Particles which have left their cell are removed from the tree and 
+  * their indices are added to moved. They are reinserted by reb_tree_update().
   *
   * @param r REBOUND simulation to operate on
   * @param node is the pointer to a node cell
+  * @param moved Indices of particles which have left their cell
+  * @param moved_N Number of indices in moved
   */
-static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r, struct reb_treecell *node){
+static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r, struct reb_treecell *node, int* const moved, int* const moved_N){
 	int test = -1; /**< A temporary int variable is used to store the index of an octant when it needs to be freed. */
 	if (node == NULL) {
 		return NULL;
@@ -157,8 +232,11 @@ static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r,
 	// Non-leaf nodes	
 	if (node->pt < 0) {
 		for (int o=0; o<8; o++) {
-			node->oct[o] = reb_tree_update_cell(r, node->oct[o]);
+			struct reb_treecell* const d = node->oct[o];
+#pragma omp task if(d!=NULL && -d->pt>REB_TREE_TASK_MIN)
+			node->oct[o] = reb_tree_update_cell(r, d, moved, moved_N);
 		}
+#pragma omp taskwait
 		node->pt = 0;
 		for (int o=0; o<8; o++) {
 			struct reb_treecell *d = node->oct[o];
@@ -174,12 +252,12 @@ static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r,
 		}
 		// Check if the node requires derefinement.
 		if (node->pt == 0) {	// The node is empty.
-			free(node);
+			reb_tree_cell_free(r, node);
 			return NULL;
 		} else if (node->pt == -1) { // The node becomes a leaf.
 			node->pt = node->oct[test]->pt;
 			r->particles[node->pt].c = node;
-			free(node->oct[test]);
+			reb_tree_cell_free(r, node->oct[test]);
 			node->oct[test]=NULL;
 			return node;
 		}
@@ -187,15 +265,11 @@ static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r,
 	} 
 	// Leaf nodes
 	if (reb_tree_particle_is_inside_cell(r, node) == 0) {
-		int oldpos = node->pt;
-		struct reb_particle reinsertme = r->particles[oldpos];
-		(r->N)--;
-		r->particles[oldpos] = r->particles[r->N];
-		r->particles[oldpos].c->pt = oldpos;
-        if (!isnan(reinsertme.y)){ // Do not reinsert if flagged for removal
-		    reb_add(r, reinsertme);
-        }
-		free(node);
+		int i;
+#pragma omp atomic capture
+		i = (*moved_N)++;
+		moved[i] = node->pt;
+		reb_tree_cell_free(r, node);
 		return NULL; 
 	} else {
 		r->particles[node->pt].c = node;
@@ -203,20 +277,211 @@ static struct reb_treecell *reb_tree_update_cell(struct reb_simulation* const r,
 	}
 }
 
+static int reb_tree_compare_int_descending(const void* a, const void* b){
+	return *(const int*)b - *(const int*)a;
+}
+
+/**
+  * @brief Removes particles which have left their cell from the particle array and adds them again.
+  * @param r REBOUND simulation to operate on
+  * @param moved Indices of particles which have left their cell
+  * @param moved_N Number of indices in moved
+  */
+static void reb_tree_reinsert_particles(struct reb_simulation* const r, int* const moved, const int moved_N){
+	struct reb_particle* const reinsert = malloc(sizeof(struct reb_particle)*moved_N);
+	// Removing particles from the end first ensures that the last particle is always still in the tree.
+	qsort(moved, moved_N, sizeof(int), reb_tree_compare_int_descending);
+	for (int i=0; i<moved_N; i++){
+		const int oldpos = moved[i];
+		reinsert[i] = r->particles[oldpos];
+		(r->N)--;
+		if (oldpos!=r->N){
+			r->particles[oldpos] = r->particles[r->N];
+			r->particles[oldpos].c->pt = oldpos;
+		}
+	}
+	for (int i=moved_N-1; i>=0; i--){
+		if (!isnan(reinsert[i].y)){ // Do not reinsert if flagged for removal
+			reb_add(r, reinsert[i]);
+		}
+	}
+	free(reinsert);
+}
+
+/*
+ * Higher order moments
+ *
+ * Non-leaf cells store the coefficients of the polynomials 
+ *   P_l(x) = sum_i m_i |d_i|^l |x|^l P_l(cos(gamma_i)),	l = 2..tree_multipole,
+ * where d_i is the position of particle i relative to the center of mass of 
+ * the cell, P_l is the Legendre polynomial and gamma_i the angle between d_i 
+ * and x. The potential of the cell is then -G (m/|x| + sum_l P_l(x)/|x|^(2l+1)).
+ * P_l is homogeneous of degree l and its (l+1)(l+2)/2 coefficients are stored 
+ * in the order x^l, x^(l-1)y, x^(l-1)z, x^(l-2)y^2, ... in tree_multipoles.
+ * The polynomials are calculated from the raw moments sum_i m_i d_i^n, which 
+ * are shifted from the daughter cells to the parent cell.
+ */
+
+/**
+  * @brief Index of the multi-index (nx,ny,nz) among all multi-indices with nx+ny+nz<=order.
+  */
+static inline int reb_tree_moment_index(const int nx, const int ny, const int nz){
+	const int l = nx+ny+nz;
+	return l*(l+1)*(l+2)/6 + (l-nx)*(l-nx+1)/2 + (l-nx-ny);
+}
+
+static const double reb_tree_factorial[9] = {1., 1., 2., 6., 24., 120., 720., 5040., 40320.};
+
+int reb_tree_multipoles_per_cell(const struct reb_simulation* const r){
+	const int order = r->tree_multipole;
+	if (order<2) return 0;
+	return (order+1)*(order+2)*(order+3)/6 - 4;
+}
+
+/**
+  * @brief Makes sure tree_multipoles has room for the moments of n cells.
+  */
+static void reb_tree_multipoles_reserve(struct reb_simulation* const r, const int n){
+	const int nmp = reb_tree_multipoles_per_cell(r);
+	if (n*nmp>r->tree_multipoles_allocatedN){
+		r->tree_multipoles_allocatedN = 2*r->tree_multipoles_allocatedN>n*nmp?2*r->tree_multipoles_allocatedN:n*nmp;
+		if (r->tree_multipoles_allocatedN<128*nmp) r->tree_multipoles_allocatedN = 128*nmp;
+		r->tree_multipoles = realloc(r->tree_multipoles, sizeof(double)*r->tree_multipoles_allocatedN);
+	}
+}
+
+/**
+  * @brief Adds the raw moments Md (about a point shifted by s) to the raw moments M.
+  */
+static void reb_tree_shift_moments(const int order, double* const M, const double* const Md, const double sx, const double sy, const double sz){
+	static const double binomial[5][5] = {{1,0,0,0,0},{1,1,0,0,0},{1,2,1,0,0},{1,3,3,1,0},{1,4,6,4,1}};
+	double spx[5], spy[5], spz[5];
+	spx[0] = 1.; spy[0] = 1.; spz[0] = 1.;
+	for (int i=1;i<=order;i++){
+		spx[i] = spx[i-1]*sx;
+		spy[i] = spy[i-1]*sy;
+		spz[i] = spz[i-1]*sz;
+	}
+	for (int l=0;l<=order;l++){
+	for (int nx=l;nx>=0;nx--){
+	for (int ny=l-nx;ny>=0;ny--){
+		const int nz = l-nx-ny;
+		double sum = 0.;
+		for (int jx=0;jx<=nx;jx++){
+		for (int jy=0;jy<=ny;jy++){
+		for (int jz=0;jz<=nz;jz++){
+			sum += binomial[nx][jx]*binomial[ny][jy]*binomial[nz][jz]*spx[nx-jx]*spy[ny-jy]*spz[nz-jz]*Md[reb_tree_moment_index(jx,jy,jz)];
+		}
+		}
+		}
+		M[reb_tree_moment_index(nx,ny,nz)] += sum;
+	}
+	}
+	}
+}
+
+/**
+  * @brief Calculates the coefficients of the polynomials P_l from the raw moments M about the center of mass.
+  * @details Uses |d|^l |x|^l P_l(cos(gamma)) = sum_k A_lk (d.x)^(l-2k) (d^2 x^2)^k.
+  */
+static void reb_tree_moments_to_multipoles(const int order, const double* const M, double* c){
+	const double* const f = reb_tree_factorial;
+	for (int l=2;l<=order;l++){
+		const int nl = (l+1)*(l+2)/2;
+		for (int i=0;i<nl;i++) c[i] = 0.;
+		for (int k=0;2*k<=l;k++){
+			const int a = l-2*k;
+			const double A = (k%2?-1.:1.)*f[2*l-2*k]/(f[k]*f[l-k]*f[a]*(double)(1<<l));
+			// (d.x)^a = sum_p a!/p! d^p x^p
+			for (int px=a;px>=0;px--){
+			for (int py=a-px;py>=0;py--){
+				const int pz = a-px-py;
+				const double cp = A*f[a]/(f[px]*f[py]*f[pz]);
+				// sum_i m_i d_i^p (d_i^2)^k = sum_q k!/q! M_{p+2q}
+				double mpq = 0.;
+				for (int qx=k;qx>=0;qx--){
+				for (int qy=k-qx;qy>=0;qy--){
+					const int qz = k-qx-qy;
+					mpq += f[k]/(f[qx]*f[qy]*f[qz])*M[reb_tree_moment_index(px+2*qx,py+2*qy,pz+2*qz)];
+				}
+				}
+				// (x^2)^k = sum_s k!/s! x^2s
+				for (int sx=k;sx>=0;sx--){
+				for (int sy=k-sx;sy>=0;sy--){
+					const int sz = k-sx-sy;
+					const int nx = px+2*sx;
+					const int ny = py+2*sy;
+					c[(l-nx)*(l-nx+1)/2 + (l-nx-ny)] += cp*f[k]/(f[sx]*f[sy]*f[sz])*mpq;
+				}
+				}
+			}
+			}
+		}
+		c += nl;
+	}
+}
+
+/*
+ * The moments of different subtrees are calculated in parallel with OpenMP 
+ * tasks. To avoid any synchronization, the higher order moments of the 
+ * non-leaf cells are stored in depth first order. The offset of each subtree 
+ * in tree_multipoles is known after the non-leaf cells have been counted.
+ */
+
 /**
-  * @brief The function calculates the total mass and center of mass of a node. When QUADRUPOLE is defined, it also calculates the mass quadrupole tensor for all non-leaf nodes.
+  * @brief Counts the non-leaf cells in the subtree of node and stores the number in node->mp.
+  */
+static int reb_tree_count_nonleaf_cells(struct reb_treecell* const node){
+	if (node->pt>=0){
+		return 0;
+	}
+	int n[8] = {0};
+	for (int o=0; o<8; o++) {
+		struct reb_treecell* const d = node->oct[o];
+		if (d!=NULL){
+#pragma omp task shared(n) if(-d->pt>REB_TREE_TASK_MIN)
+			n[o] = reb_tree_count_nonleaf_cells(d);
+		}
+	}
+#pragma omp taskwait
+	node->mp = 1;
+	for (int o=0; o<8; o++) {
+		node->mp += n[o];
+	}
+	return node->mp;
+}
+
+/**
+  * @brief The function calculates the total mass and center of mass of a node. If tree_multipole is not REB_TREE_MONOPOLE, it also calculates the higher order moments of all non-leaf nodes.
+  * @param r REBOUND simulation to operate on
+  * @param node is the pointer to a node cell
+  * @param M If not NULL, the raw moments of the node about its center of mass are stored in this array.
+  * @param index Position of the moments of the node in tree_multipoles. The number of non-leaf 
+  * cells in each subtree needs to be stored in mp, see reb_tree_count_nonleaf_cells().
   */
-static void reb_tree_update_gravity_data_in_cell(const struct reb_simulation* const r, struct reb_treecell *node){
-#ifdef QUADRUPOLE
-	node->mxx = 0;
-	node->mxy = 0;
-	node->mxz = 0;
-	node->myy = 0;
-	node->myz = 0;
-	node->mzz = 0;
-#endif // QUADRUPOLE
+static void reb_tree_update_gravity_data_in_cell(struct reb_simulation* const r, struct reb_treecell *node, double* const M, int index){
+	const int order = r->tree_multipole;
+	const int nm = (order+1)*(order+2)*(order+3)/6; // Number of raw moments
 	if (node->pt < 0) {
 		// Non-leaf nodes	
+		double Md[M?8:1][nm];
+		if (M){
+			node->mp = index*reb_tree_multipoles_per_cell(r);
+		}
+		index++;
+		for (int o=0; o<8; o++) {
+			struct reb_treecell* d = node->oct[o];
+			if (d!=NULL){
+				const int index_d = index;
+				if (M && d->pt<0){
+					index += d->mp;
+				}
+#pragma omp task shared(Md) if(-d->pt>REB_TREE_TASK_MIN)
+				reb_tree_update_gravity_data_in_cell(r, d, M?Md[o]:NULL, index_d);
+			}
+		}
+#pragma omp taskwait
+		// Calculate the total mass and the center of mass
 		node->m  = 0;
 		node->mx = 0;
 		node->my = 0;
@@ -224,8 +489,6 @@ static void reb_tree_update_gravity_data_in_cell(const struct reb_simulation* co
 		for (int o=0; o<8; o++) {
 			struct reb_treecell* d = node->oct[o];
 			if (d!=NULL){
-				reb_tree_update_gravity_data_in_cell(r, d);
-				// Calculate the total mass and the center of mass
 				double d_m = d->m;
 				node->mx += d->mx*d_m;
 				node->my += d->my*d_m;
@@ -239,25 +502,16 @@ static void reb_tree_update_gravity_data_in_cell(const struct reb_simulation* co
 			node->my /= m_tot;
 			node->mz /= m_tot;
 		}
-#ifdef QUADRUPOLE
-		for (int o=0; o<8; o++) {
-			struct reb_treecell* d = node->oct[o];
-			if (d!=NULL){
-				// Ref: Hernquist, L., 1987, APJS
-				double d_m = d->m;
-				double qx  = d->mx - node->mx;
-				double qy  = d->my - node->my;
-				double qz  = d->mz - node->mz;
-				double qr2 = qx*qx + qy*qy + qz*qz;
-				node->mxx += d->mxx + d_m*(3.*qx*qx - qr2);
-				node->mxy += d->mxy + d_m*3.*qx*qy;
-				node->mxz += d->mxz + d_m*3.*qx*qz;
-				node->myy += d->myy + d_m*(3.*qy*qy - qr2);
-				node->myz += d->myz + d_m*3.*qy*qz;
+		if (M){
+			for (int i=0; i<nm; i++) M[i] = 0.;
+			for (int o=0; o<8; o++) {
+				struct reb_treecell* d = node->oct[o];
+				if (d!=NULL){
+					reb_tree_shift_moments(order, M, Md[o], d->mx - node->mx, d->my - node->my, d->mz - node->mz);
+				}
 			}
+			reb_tree_moments_to_multipoles(order, M, r->tree_multipoles + node->mp);
 		}
-		node->mzz = -node->mxx -node->myy;
-#endif // QUADRUPOLE
 	}else{ 
 		// Leaf nodes
 		struct reb_particle p = r->particles[node->pt];
@@ -265,55 +519,676 @@ static void reb_tree_update_gravity_data_in_cell(const struct reb_simulation* co
 		node->mx = p.x;
 		node->my = p.y;
 		node->mz = p.z;
+		if (M){
+			M[0] = p.m;
+			for (int i=1; i<nm; i++) M[i] = 0.;
+		}
 	}
 }
 
 void reb_tree_update_gravity_data(struct reb_simulation* const r){
-	for(int i=0;i<r->root_n;i++){
+	if (r->tree_multipole>REB_TREE_HEXADECAPOLE){
+		reb_exit("Multipole order not supported by tree.");
+	}
+	if (r->tree_type==REB_TREE_LINEAR && r->tree_needs_update){
+		// Particles have been added since the linear tree was built, e.g. received from other nodes.
+		reb_tree_update(r);
+	}
+	const int multipoles = r->tree_multipole>=REB_TREE_QUADRUPOLE;
+	int index[r->root_n];	// Position of the moments of each root in tree_multipoles
+	r->tree_multipoles_N = 0;
+#pragma omp parallel
+#pragma omp single
+	{
+		if (multipoles){
+			for(int i=0;i<r->root_n;i++){
+				index[i] = 0;
 #ifdef MPI
-		if (reb_communication_mpi_rootbox_is_local(r, i)==1){
+				if (reb_communication_mpi_rootbox_is_local(r, i)==0) continue;
+#endif // MPI
+				if (r->tree_root[i]!=NULL){
+#pragma omp task shared(index)
+					index[i] = reb_tree_count_nonleaf_cells(r->tree_root[i]);
+				}
+			}
+#pragma omp taskwait
+			for(int i=0;i<r->root_n;i++){
+				const int n = index[i];
+				index[i] = r->tree_multipoles_N;
+				r->tree_multipoles_N += n;
+			}
+			reb_tree_multipoles_reserve(r, r->tree_multipoles_N);
+		}
+		for(int i=0;i<r->root_n;i++){
+#ifdef MPI
+			if (reb_communication_mpi_rootbox_is_local(r, i)==0) continue;
 #endif // MPI
 			if (r->tree_root[i]!=NULL){
-				reb_tree_update_gravity_data_in_cell(r, r->tree_root[i]);
+#pragma omp task shared(index)
+				{
+					const int nm = (r->tree_multipole+1)*(r->tree_multipole+2)*(r->tree_multipole+3)/6;
+					double M[nm];
+					reb_tree_update_gravity_data_in_cell(r, r->tree_root[i], multipoles?M:NULL, multipoles?index[i]:0);
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Linear tree
+ *
+ * With tree_type set to REB_TREE_LINEAR the tree is rebuilt from scratch in 
+ * every call of reb_tree_update(). Each particle gets a key made of its root 
+ * box and the Morton key (bit interleaved integer coordinates) of its position 
+ * within the root box. Sorting the particles by key puts the particles of every 
+ * cell next to each other. The number of leading octant digits that two 
+ * neighbouring particles have in common is the level of the smallest cell 
+ * containing both. All cells can therefore be created in one pass over the 
+ * sorted particles. The cells are the same as those of the dynamic tree. They 
+ * are stored in depth first order in one array, tree_cells. The daughters are 
+ * pointers into this array, so all tree walks work with both trees.
+ *
+ * Particles only move a little during one time step, so the keys in the order 
+ * of the previous build are almost sorted. Only the few keys which are out of 
+ * order need to be sorted and merged back. Otherwise the keys are sorted with a 
+ * radix sort.
+ */
+
+/**
+  * @brief Number of levels stored in reb_tree_key.lo.
+  */
+#define REB_TREE_LINEAR_LEVELS_LO 21
+
+/**
+  * @brief Number of levels stored in reb_tree_key.key, the remaining bits hold the root box.
+  */
+static int reb_tree_linear_levels_key(const struct reb_simulation* const r){
+	int rootbits = 0;
+	while ((1<<rootbits)<r->root_n) rootbits++;
+	const int levels = (64-rootbits)/3;
+	return levels<REB_TREE_LINEAR_LEVELS_LO?levels:REB_TREE_LINEAR_LEVELS_LO;
+}
+
+/**
+  * @brief Spreads the lowest 21 bits of v out to every third bit.
+  */
+static inline uint64_t reb_tree_spread_bits(uint64_t v){
+	v &= 0x1fffffULL;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+	v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2)  & 0x1249249249249249ULL;
+	return v;
+}
+
+/**
+  * @brief Integer coordinate of x within [xmin,xmin+w) with the given number of bits.
+  * @details The bits are inverted, such that a set bit corresponds to the lower half, 
+  * i.e. to the octants reb_reb_tree_get_octant_for_particle_in_cell() returns.
+  */
+static inline uint64_t reb_tree_linear_coordinate(const double x, const double xmax, const double scale, const int bits){
+	const double v = ceil((xmax-x)*scale)-1.;
+	const uint64_t max = (1ULL<<bits)-1;
+	if (!(v>0.)) return 0;	// Also catches NaN
+	if (v>=(double)max) return max;
+	return (uint64_t)v;
+}
+
+/**
+  * @brief Calculates the key of particle pt.
+  * @param scale Number of integer coordinates per unit length, 2^levels/root_size.
+  */
+static inline void reb_tree_linear_set_key(const struct reb_simulation* const r, struct reb_tree_key* const k, const int pt, const int levels_key, const double scale){
+	const struct reb_particle* const p = &(r->particles[pt]);
+	const int levels = levels_key + REB_TREE_LINEAR_LEVELS_LO;
+	int i = 0, j = 0, l = 0;
+	if (r->root_n>1){
+		// Particles are inside the box, see reb_get_rootbox_for_particle()
+		const double inv_root_size = 1./r->root_size;
+		i = (int)floor((p->x + r->boxsize.x/2.)*inv_root_size);
+		j = (int)floor((p->y + r->boxsize.y/2.)*inv_root_size);
+		l = (int)floor((p->z + r->boxsize.z/2.)*inv_root_size);
+		i = i<0?0:(i>=r->root_nx?r->root_nx-1:i);
+		j = j<0?0:(j>=r->root_ny?r->root_ny-1:j);
+		l = l<0?0:(l>=r->root_nz?r->root_nz-1:l);
+	}
+	const uint64_t root = (l*r->root_ny+j)*r->root_nx+i;
+	const uint64_t qx = reb_tree_linear_coordinate(p->x, -r->boxsize.x/2.+r->root_size*(1.+(double)i), scale, levels);
+	const uint64_t qy = reb_tree_linear_coordinate(p->y, -r->boxsize.y/2.+r->root_size*(1.+(double)j), scale, levels);
+	const uint64_t qz = reb_tree_linear_coordinate(p->z, -r->boxsize.z/2.+r->root_size*(1.+(double)l), scale, levels);
+	const int lo = REB_TREE_LINEAR_LEVELS_LO;
+	k->key = (root<<(3*levels_key)) 
+		| reb_tree_spread_bits(qx>>lo) | reb_tree_spread_bits(qy>>lo)<<1 | reb_tree_spread_bits(qz>>lo)<<2;
+	k->lo = reb_tree_spread_bits(qx) | reb_tree_spread_bits(qy)<<1 | reb_tree_spread_bits(qz)<<2;
+	k->pt = pt;
+}
+
+static inline int reb_tree_key_less(const struct reb_tree_key* const a, const struct reb_tree_key* const b){
+	return a->key<b->key || (a->key==b->key && a->lo<b->lo);
+}
+
+/**
+  * @brief Number of leading octant digits two keys have in common, -1 if they are in different root boxes.
+  */
+static inline int reb_tree_key_common_levels(const struct reb_tree_key* const a, const struct reb_tree_key* const b, const int levels_key){
+	uint64_t x = a->key ^ b->key;
+	if (x>>(3*levels_key)) return -1;
+	if (x) return (3*levels_key-1-(63-__builtin_clzll(x)))/3;
+	x = a->lo ^ b->lo;
+	if (x) return levels_key + (3*REB_TREE_LINEAR_LEVELS_LO-1-(63-__builtin_clzll(x)))/3;
+	return levels_key + REB_TREE_LINEAR_LEVELS_LO;
+}
+
+/**
+  * @brief Octant digit of a key at a given level (the root box is level 0).
+  */
+static inline int reb_tree_key_octant(const struct reb_tree_key* const k, const int level, const int levels_key){
+	if (level<=levels_key){
+		return (k->key>>(3*(levels_key-level)))&7;
+	}
+	return (k->lo>>(3*(levels_key+REB_TREE_LINEAR_LEVELS_LO-level)))&7;
+}
+
+/**
+  * @brief Insertion sort, used for short or almost sorted sequences of keys.
+  */
+static void reb_tree_keys_insertion_sort(struct reb_tree_key* const k, const int N){
+	for (int i=1;i<N;i++){
+		const struct reb_tree_key t = k[i];
+		int j = i;
+		while (j>0 && reb_tree_key_less(&t, &k[j-1])){
+			k[j] = k[j-1];
+			j--;
+		}
+		k[j] = t;
+	}
+}
+
+/**
+  * @brief Sorts keys by radix sort. The buffer tmp needs to have room for N keys.
+  * @details A stable LSD radix sort with 8 bit digits sorts the lowest bits of key.
+  * An insertion sort then sorts keys which only differ in lo.
+  */
+static void reb_tree_keys_sort(struct reb_tree_key* const k, struct reb_tree_key* const tmp, const int N, const int bits){
+	struct reb_tree_key* in = k;
+	struct reb_tree_key* out = tmp;
+	for (int shift=0; shift<bits; shift+=8){
+		int count[257] = {0};
+		for (int i=0;i<N;i++){
+			count[((in[i].key>>shift)&0xff)+1]++;
+		}
+		int skip = 0;
+		for (int d=1;d<257;d++){
+			if (count[d]==N) skip = 1;
+			count[d] += count[d-1];
+		}
+		if (skip) continue; // All keys have the same digit
+		for (int i=0;i<N;i++){
+			out[count[(in[i].key>>shift)&0xff]++] = in[i];
+		}
+		struct reb_tree_key* const swap = in;
+		in = out;
+		out = swap;
+	}
+	if (in!=k){
+		memcpy(k, in, sizeof(struct reb_tree_key)*N);
+	}
+	reb_tree_keys_insertion_sort(k, N);
+}
+
+/**
+  * @brief Sorts keys which are almost sorted. The buffer tmp needs to have room for N keys.
+  * @details Keys which are out of order are moved to tmp, sorted, and merged back.
+  * @return 1 if the keys are sorted, 0 if too many keys were out of order. The keys are 
+  * a permutation of the original keys in both cases.
+  */
+static int reb_tree_keys_sort_almost_sorted(struct reb_tree_key* const k, struct reb_tree_key* const tmp, const int N, const int bits){
+	int n = 0;	// Keys in order, k[0..n)
+	int n_tmp = 0;	// Keys out of order, tmp[0..n_tmp)
+	for (int i=0;i<N;i++){
+		if (n==0 || !reb_tree_key_less(&k[i], &k[n-1])){
+			k[n++] = k[i];
+		}else if (n==1 || !reb_tree_key_less(&k[i], &k[n-2])){
+			// The previous key is out of order (its particle moved forward)
+			tmp[n_tmp++] = k[n-1];
+			k[n-1] = k[i];
+		}else{
+			tmp[n_tmp++] = k[i];
+		}
+		if (n_tmp>N/2){
+			memcpy(k+n, tmp, sizeof(struct reb_tree_key)*n_tmp);
+			return 0;
+		}
+	}
+	reb_tree_keys_sort(tmp, tmp+n_tmp, n_tmp, bits);
+	// Merge from the back
+	int i = n-1;
+	int j = n_tmp-1;
+	for (int w=N-1; j>=0; w--){
+		if (i>=0 && reb_tree_key_less(&tmp[j], &k[i])){
+			k[w] = k[i--];
+		}else{
+			k[w] = tmp[j--];
+		}
+	}
+	return 1;
+}
+
+/**
+  * @brief Removes particles flagged for removal or outside of the box, and sends particles of other nodes away.
+  * @return NULL if no particles have been removed. Otherwise the previous index of each 
+  * particle, the array needs to be freed by the caller.
+  */
+static int* reb_tree_linear_remove_particles(struct reb_simulation* const r){
+	int* idx = NULL;
+	for (int i=0;i<r->N;i++){
+		struct reb_particle p = r->particles[i];
+		int remove = isnan(p.y);
+		if (!remove && reb_boundary_particle_is_in_box(r, p)==0){
+			reb_warning("Did not add particle outside of box boundaries.");
+			remove = 1;
+		}
+#ifdef MPI
+		if (!remove && reb_communication_mpi_rootbox_is_local(r, reb_get_rootbox_for_particle(r, p))==0){
+			remove = 2;
+		}
+#endif // MPI
+		if (remove){
+			if (idx==NULL){
+				idx = malloc(sizeof(int)*r->N);
+				for (int j=0;j<r->N;j++){
+					idx[j] = j;
+				}
+			}
+			(r->N)--;
+			r->particles[i] = r->particles[r->N];
+			idx[i] = idx[r->N];
+			i--;
+#ifdef MPI
+			if (remove==2){
+				reb_add(r, p); // Adds the particle to the send queue
 			}
+#endif // MPI
+		}
+	}
+	return idx;
+}
+
+/**
+  * @brief Sets the position and width of the cell on level l containing the key.
+  * @details Gives the same result as descending from the root cell with reb_tree_set_daughter_geometry().
+  */
+static void reb_tree_linear_set_geometry(const struct reb_simulation* const r, struct reb_treecell* const c, const struct reb_tree_key* const k, const int l, const int levels_key){
+	const int root = k->key>>(3*levels_key);
+	c->w = r->root_size;
+	c->x = -r->boxsize.x/2.+r->root_size*(0.5+(double)(root%r->root_nx));
+	c->y = -r->boxsize.y/2.+r->root_size*(0.5+(double)((root/r->root_nx)%r->root_ny));
+	c->z = -r->boxsize.z/2.+r->root_size*(0.5+(double)(root/(r->root_nx*r->root_ny)));
+	for (int j=1;j<=l;j++){
+		struct reb_treecell parent = *c;
+		reb_tree_set_daughter_geometry(c, &parent, reb_tree_key_octant(k, j, levels_key));
+	}
+}
+
+/**
+  * @brief Link to, or completion of, a cell opened by an earlier chunk of keys.
+  */
+struct reb_tree_linear_fix {
+	int level;			///< Level of the cell opened by an earlier chunk.
+	int o;				///< Octant of the daughter c, -1 if the cell is complete.
+	int end;			///< One past the last particle of a complete cell.
+	struct reb_treecell* c;		///< Daughter cell.
+};
+
+/**
+  * @brief Rebuilds the linear tree from scratch.
+  */
+static void reb_tree_linear_build(struct reb_simulation* const r){
+	if (r->tree_cell_slabs_N){
+		// Delete a dynamic tree created before tree_type was changed.
+		reb_tree_cell_release_all(r);
+	}
+	const int N_old = r->N;
+	int* const idx = reb_tree_linear_remove_particles(r);
+	const int N = r->N;
+	for(int i=0;i<r->root_n;i++){
+#ifdef MPI
+		if (reb_communication_mpi_rootbox_is_local(r, i)==1){
+#endif // MPI
+			r->tree_root[i] = NULL;
 #ifdef MPI
 		}
 #endif // MPI
 	}
+	if (r->tree_keys_allocatedN<N){
+		r->tree_keys_allocatedN = N;
+		r->tree_keys = realloc(r->tree_keys, sizeof(struct reb_tree_key)*N);
+		r->tree_keys_tmp = realloc(r->tree_keys_tmp, sizeof(struct reb_tree_key)*N);
+	}
+	
+	// Start with the order of the previous build, new particles at the end
+	struct reb_tree_key* const k = r->tree_keys;
+	const int N_last = r->tree_keys_N<=N_old?r->tree_keys_N:0;
+	int n = 0;
+	if (idx){
+		int* const map = malloc(sizeof(int)*N_old);
+		for (int i=0;i<N_old;i++){
+			map[i] = -1;
+		}
+		for (int i=0;i<N;i++){
+			map[idx[i]] = i;
+		}
+		for (int j=0;j<N_last;j++){
+			const int pt = map[k[j].pt];
+			if (pt>=0){
+				k[n++].pt = pt;
+			}
+		}
+		for (int i=0;i<N;i++){
+			if (idx[i]>=N_last){
+				k[n++].pt = i;
+			}
+		}
+		free(map);
+		free(idx);
+	}else{
+		n = N_last;
+		for (int i=N_last;i<N;i++){
+			k[n++].pt = i;
+		}
+	}
+
+	// Calculate and sort keys
+	const int levels_key = reb_tree_linear_levels_key(r);
+	const int levels = levels_key + REB_TREE_LINEAR_LEVELS_LO;
+	const double scale = ldexp(1.,levels)/r->root_size;
+	struct reb_tree_key* const kp = r->tree_keys_tmp;	// Keys in the order of the particles
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N;i++){
+		reb_tree_linear_set_key(r, &kp[i], i, levels_key, scale);
+	}
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N;i++){
+		k[i] = kp[k[i].pt];
+	}
+	int rootbits = 0;
+	while ((1<<rootbits)<r->root_n) rootbits++;
+	const int bits = 3*levels_key+rootbits;
+	if (N_last==0 || !reb_tree_keys_sort_almost_sorted(k, r->tree_keys_tmp, N, bits)){
+		reb_tree_keys_sort(k, r->tree_keys_tmp, N, bits);
+	}
+	r->tree_keys_N = N;
+
+	// The sorted keys are split into chunks which are converted to cells in parallel.
+	// Cells of a chunk are stored contiguously, so the cells remain in depth first order.
+	// Links to and completions of cells opened by earlier chunks are recorded and 
+	// applied serially afterwards.
+	int nchunks = 1;
+#ifdef OPENMP
+	nchunks = 4*omp_get_max_threads();
+	if (nchunks>N/REB_TREE_TASK_MIN) nchunks = N/REB_TREE_TASK_MIN;
+	if (nchunks<1) nchunks = 1;
+#endif // OPENMP
+	const int nfix = 8*(levels+1);	// Maximum number of links to earlier cells per chunk
+	int* const chunk_cells = malloc(sizeof(int)*(nchunks+1));
+	struct reb_treecell** const chunk_open = malloc(sizeof(struct reb_treecell*)*nchunks*(levels+1));
+	struct reb_tree_linear_fix* const chunk_fix = malloc(sizeof(struct reb_tree_linear_fix)*nchunks*nfix);
+	int* const chunk_fix_N = malloc(sizeof(int)*nchunks);
+
+	// Count cells. Particle i starts the cells on levels cprev+1 to cnext.
+	int too_close = 0;
+#pragma omp parallel for schedule(static) reduction(+:too_close)
+	for (int ch=0;ch<nchunks;ch++){
+		const int start = (int)((long)N*ch/nchunks);
+		const int end = (int)((long)N*(ch+1)/nchunks);
+		int cprev = start>0?reb_tree_key_common_levels(&k[start-1], &k[start], levels_key):-1;
+		int Ncells = 0;
+		for (int i=start;i<end;i++){
+			const int cnext = i+1<N?reb_tree_key_common_levels(&k[i], &k[i+1], levels_key):-1;
+			if (cnext==levels){
+				too_close++;
+			}
+			Ncells += 1 + (cnext>cprev?cnext-cprev:0);
+			cprev = cnext;
+		}
+		chunk_cells[ch+1] = Ncells;
+	}
+	if (too_close){
+		reb_exit("Particles are too close to each other to be separated by the tree.");
+	}
+	chunk_cells[0] = 0;
+	for (int ch=0;ch<nchunks;ch++){
+		chunk_cells[ch+1] += chunk_cells[ch];
+	}
+	const int Ncells = chunk_cells[nchunks];
+	if (r->tree_cells_allocatedN<Ncells){
+		r->tree_cells_allocatedN = Ncells;
+		free(r->tree_cells);
+		r->tree_cells = malloc(sizeof(struct reb_treecell)*Ncells);
+	}
+
+	// Create cells in depth first order
+#pragma omp parallel for schedule(static)
+	for (int ch=0;ch<nchunks;ch++){
+		const int start = (int)((long)N*ch/nchunks);
+		const int end = (int)((long)N*(ch+1)/nchunks);
+		struct reb_treecell* stack[levels+1];	// Open cells on each level, NULL if opened by an earlier chunk
+		for (int l=0;l<=levels;l++){
+			stack[l] = NULL;
+		}
+		struct reb_tree_linear_fix* const fix = chunk_fix + ch*nfix;
+		int fix_N = 0;
+		struct reb_treecell* c = r->tree_cells + chunk_cells[ch];
+		int cprev = start>0?reb_tree_key_common_levels(&k[start-1], &k[start], levels_key):-1;
+		for (int i=start;i<end;i++){
+			const int cnext = i+1<N?reb_tree_key_common_levels(&k[i], &k[i+1], levels_key):-1;
+			const int leaf = (cprev>cnext?cprev:cnext)+1;
+			for (int l=cprev+1; l<=leaf; l++){
+				*c = (struct reb_treecell){0};
+				if (l==0){
+					reb_tree_linear_set_geometry(r, c, &k[i], 0, levels_key);
+					r->tree_root[k[i].key>>(3*levels_key)] = c;
+				}else{
+					const int o = reb_tree_key_octant(&k[i], l, levels_key);
+					if (stack[l-1]){
+						reb_tree_set_daughter_geometry(c, stack[l-1], o);
+						stack[l-1]->oct[o] = c;
+					}else{
+						reb_tree_linear_set_geometry(r, c, &k[i], l, levels_key);
+						fix[fix_N++] = (struct reb_tree_linear_fix){.level=l-1, .o=o, .c=c};
+					}
+				}
+				if (l==leaf){
+					c->pt = k[i].pt;
+					r->particles[c->pt].c = c;
+				}else{
+					c->pt = i; // First particle, replaced by the number of particles once the cell is complete
+					stack[l] = c;
+				}
+				c++;
+			}
+			// Cells not containing the next particle are complete
+			for (int l=(cprev>cnext?cprev:cnext); l>cnext; l--){
+				if (stack[l]){
+					stack[l]->pt = -(i+1-stack[l]->pt);
+					stack[l] = NULL;
+				}else{
+					fix[fix_N++] = (struct reb_tree_linear_fix){.level=l, .o=-1, .end=i+1};
+				}
+			}
+			cprev = cnext;
+		}
+		chunk_fix_N[ch] = fix_N;
+		memcpy(chunk_open+ch*(levels+1), stack, sizeof(struct reb_treecell*)*(levels+1));
+	}
+
+	// Connect chunks
+	struct reb_treecell* open[levels+1];	// Cells opened by earlier chunks
+	for (int l=0;l<=levels;l++){
+		open[l] = NULL;
+	}
+	for (int ch=0;ch<nchunks;ch++){
+		const struct reb_tree_linear_fix* const fix = chunk_fix + ch*nfix;
+		for (int f=0;f<chunk_fix_N[ch];f++){
+			struct reb_treecell* const p = open[fix[f].level];
+			if (fix[f].o>=0){
+				p->oct[fix[f].o] = fix[f].c;
+			}else{
+				p->pt = -(fix[f].end-p->pt);
+			}
+		}
+		for (int l=0;l<=levels;l++){
+			if (chunk_open[ch*(levels+1)+l]){
+				open[l] = chunk_open[ch*(levels+1)+l];
+			}
+		}
+	}
+	free(chunk_cells);
+	free(chunk_open);
+	free(chunk_fix);
+	free(chunk_fix_N);
 }
 
 void reb_tree_update(struct reb_simulation* const r){
 	if (r->tree_root==NULL){
 		r->tree_root = calloc(r->root_nx*r->root_ny*r->root_nz,sizeof(struct reb_treecell*));
 	}
+	if (r->tree_type==REB_TREE_LINEAR){
+		reb_tree_linear_build(r);
+		r->tree_needs_update= 0;
+		return;
+	}
+	if (r->tree_cells!=NULL){
+		// tree_type was changed, replace the linear tree by a dynamic tree.
+		free(r->tree_cells);
+		r->tree_cells = NULL;
+		r->tree_cells_allocatedN = 0;
+		r->tree_keys_N = 0;
+		for(int i=0;i<r->root_n;i++){
+			r->tree_root[i] = NULL;
+		}
+		for(int i=0;i<r->N;i++){
+			reb_tree_add_particle_to_tree(r, i);
+		}
+	}
+	int* const moved = malloc(sizeof(int)*r->N);
+	int moved_N = 0;
+#pragma omp parallel
+#pragma omp single
 	for(int i=0;i<r->root_n;i++){
-
 #ifdef MPI
 		if (reb_communication_mpi_rootbox_is_local(r, i)==1){
 #endif // MPI
-			r->tree_root[i] = reb_tree_update_cell(r, r->tree_root[i]);
+#pragma omp task shared(moved_N)
+			r->tree_root[i] = reb_tree_update_cell(r, r->tree_root[i], moved, &moved_N);
 #ifdef MPI
 		}
 #endif // MPI
 	}
+	reb_tree_reinsert_particles(r, moved, moved_N);
+	free(moved);
     r->tree_needs_update= 0;
 }
-static void reb_tree_delete_cell(struct reb_treecell* node){
-	if (node==NULL){
+
+/**
+  * @brief Replaces the particle index of all leaves in the subtree by its new index.
+  */
+static void reb_tree_renumber_leaves(struct reb_treecell* const node, const int* const new_index){
+	if (node==NULL) return;
+	if (node->pt>=0){
+		node->pt = new_index[node->pt];
 		return;
 	}
-	for (int o=0; o<8; o++) {
-		reb_tree_delete_cell(node->oct[o]);
+	for (int o=0;o<8;o++){
+		reb_tree_renumber_leaves(node->oct[o], new_index);
 	}
 }
 
-void reb_tree_delete(struct reb_simulation* const r){
-	if (r->tree_root!=NULL){
-		for(int i=0;i<r->root_n;i++){
-			reb_tree_delete_cell(r->tree_root[i]);
+void reb_tree_reorder_particles(struct reb_simulation* const r){
+	if (r->integrator!=REB_INTEGRATOR_LEAPFROG && r->integrator!=REB_INTEGRATOR_SEI){
+		reb_warning("Reordering particles is only supported by the leapfrog and SEI integrators. Reordering turned off.");
+		r->reorder_interval = 0;
+		return;
+	}
+	if (r->N_var){
+		reb_warning("Reordering particles is not supported with variational particles. Reordering turned off.");
+		r->reorder_interval = 0;
+		return;
+	}
+	if (r->root_size<=0){
+		reb_warning("Reordering particles requires a box. Use reb_configure_box(). Reordering turned off.");
+		r->reorder_interval = 0;
+		return;
+	}
+	const int N = r->N;
+	if (N<2) return;
+	const int N_active = (r->N_active==-1 || r->N_active>N)?N:r->N_active;
+
+	// Keys are the same as in the linear tree, so the particles end up in the order of the leaves
+	const int levels_key = reb_tree_linear_levels_key(r);
+	const double scale = ldexp(1.,levels_key+REB_TREE_LINEAR_LEVELS_LO)/r->root_size;
+	int rootbits = 0;
+	while ((1<<rootbits)<r->root_n) rootbits++;
+	const int bits = 3*levels_key+rootbits;
+	struct reb_tree_key* const k = malloc(sizeof(struct reb_tree_key)*N);
+	struct reb_tree_key* const tmp = malloc(sizeof(struct reb_tree_key)*N);
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N;i++){
+		reb_tree_linear_set_key(r, &k[i], i, levels_key, scale);
+	}
+	// Massive and test particles are sorted separately 
+	reb_tree_keys_sort(k, tmp, N_active, bits);
+	reb_tree_keys_sort(k+N_active, tmp, N-N_active, bits);
+
+	// Mean distance in memory between neighbours on the curve before sorting
+	double jump = 0;
+	for (int j=1;j<N;j++){
+		jump += abs(k[j].pt-k[j-1].pt);
+	}
+	r->reorder_jump = jump/(double)(N-1);
+
+	int* const new_index = malloc(sizeof(int)*N);
+	struct reb_particle* const particles = malloc(sizeof(struct reb_particle)*r->allocatedN);
+#pragma omp parallel for schedule(guided)
+	for (int j=0;j<N;j++){
+		particles[j] = r->particles[k[j].pt];
+		new_index[k[j].pt] = j;
+	}
+	free(r->particles);
+	r->particles = particles;
+
+	// Update the trees
+	if (r->tree_root){
+		for (int i=0;i<r->root_n;i++){
+#ifdef MPI
+			if (reb_communication_mpi_rootbox_is_local(r, i)==1){
+#endif // MPI
+				reb_tree_renumber_leaves(r->tree_root[i], new_index);
+#ifdef MPI
+			}
+#endif // MPI
+		}
+	}
+	if (r->tree_keys_N<=N){
+		for (int j=0;j<r->tree_keys_N;j++){
+			r->tree_keys[j].pt = new_index[r->tree_keys[j].pt];
 		}
-		free(r->tree_root);
+	}else{
+		r->tree_keys_N = 0;
 	}
+	free(new_index);
+	free(tmp);
+	free(k);
+}
+
+void reb_tree_delete(struct reb_simulation* const r){
+	free(r->tree_root);
+	reb_tree_cell_release_all(r);
+	free(r->tree_cells);
+	free(r->tree_keys);
+	free(r->tree_keys_tmp);
 }
 
 
@@ -361,11 +1236,17 @@ void reb_tree_add_essential_node_to_node(struct reb_treecell* nnode, struct reb_
 	}
 }
 
-void reb_tree_add_essential_node(struct reb_simulation* const r, struct reb_treecell* node){
+void reb_tree_add_essential_node(struct reb_simulation* const r, struct reb_treecell* node, const double* const multipoles){
 	// Add essential node to appropriate parent.
 	for (int o=0;o<8;o++){
 		node->oct[o] = NULL;	
 	}
+	const int nmp = reb_tree_multipoles_per_cell(r);
+	if (multipoles!=NULL && node->pt<0 && nmp>0){
+		reb_tree_multipoles_reserve(r, r->tree_multipoles_N+1);
+		node->mp = nmp*(r->tree_multipoles_N++);
+		memcpy(r->tree_multipoles + node->mp, multipoles, sizeof(double)*nmp);
+	}
 	int index = reb_particles_get_rootbox_for_node(r, node);
 	if (r->tree_root[index]==NULL){
 		r->tree_root[index] = node;
@@ -374,6 +1255,14 @@ void reb_tree_add_essential_node(struct reb_simulation* const r, struct reb_tree
 	}
 }
 void reb_tree_prepare_essential_tree_for_gravity(struct reb_simulation* const r){
+	if (r->tree_essential_multipole!=r->tree_multipole){
+		// Send and receive buffers for the moments need to be reallocated.
+		for (int i=0;i<r->mpi_num;i++){
+			r->tree_essential_send_Nmax[i] = 0;
+			r->tree_essential_recv_Nmax[i] = 0;
+		}
+		r->tree_essential_multipole = r->tree_multipole;
+	}
 	for(int i=0;i<r->root_n;i++){
 		if (reb_communication_mpi_rootbox_is_local(r, i)==1){
 			reb_communication_mpi_prepare_essential_tree_for_gravity(r, r->tree_root[i]);
@@ -385,6 +1274,22 @@ void reb_tree_prepare_essential_tree_for_gravity(struct reb_simulation* const r)
 		}
 	}
 }
+void reb_tree_rebuild_local(struct reb_simulation* const r){
+	reb_tree_cell_release_all(r);
+	for(int i=0;i<r->root_n;i++){
+		r->tree_root[i] = NULL;
+	}
+	if (r->tree_type==REB_TREE_LINEAR){
+		// Indices of the previous build are no longer valid.
+		r->tree_keys_N = 0;
+		r->tree_needs_update = 1;
+		return;
+	}
+	for (int i=0;i<r->N;i++){
+		reb_tree_add_particle_to_tree(r, i);
+	}
+}
+
 void reb_tree_prepare_essential_tree_for_collisions(struct reb_simulation* const r){
 	for(int i=0;i<r->root_n;i++){
 		if (reb_communication_mpi_rootbox_is_local(r, i)==1){
@@ -25,6 +25,7 @@
 
 #ifndef _TREE_H
 #define _TREE_H
+#include <stdint.h>
 
 struct reb_treecell; 
 
@@ -40,27 +41,44 @@ struct reb_treecell {
 	double mx; /**< The x position of the center of mass of a cell */
 	double my; /**< The y position of the center of mass of a cell */
 	double mz; /**< The z position of the center of mass of a cell */
-#ifdef QUADRUPOLE
-	double mxx; /**< The xx component of the quadrupole tensor of mass of a cell */
-	double mxy; /**< The xy component of the quadrupole tensor of mass of a cell */
-	double mxz; /**< The xz component of the quadrupole tensor of mass of a cell */
-	double myy; /**< The yy component of the quadrupole tensor of mass of a cell */
-	double myz; /**< The yz component of the quadrupole tensor of mass of a cell */
-	double mzz; /**< The zz component of the quadrupole tensor of mass of a cell */
-#endif // QUADRUPOLE
 	struct reb_treecell *oct[8]; /**< The pointer array to the octants of a cell */
 	int pt;		/**< It has double usages: in a leaf node, it stores the index 
 			  * of a particle; in a non-leaf node, it equals to (-1)*Total 
 			  * Number of particles within that cell. */ 
+	int fmm;	/**< Index of the cell in the buffers of REB_GRAVITY_FMM. */
+	int mp;		/**< Offset of the higher order moments of a non-leaf cell in tree_multipoles. */
+};
+
+/**
+ * @brief Sort key of one particle used to build the linear tree (REB_TREE_LINEAR).
+ * @details The octant digits are stored such that sorting by key and then by lo
+ * puts the particles in the order of a depth first walk through the tree.
+ */
+struct reb_tree_key {
+	uint64_t key;	/**< Root box in the highest bits, followed by the octant digits of the first levels */
+	uint64_t lo;	/**< Octant digits of the next 21 levels */
+	int pt;		/**< Index of the particle */
 };
 
 /**
   * @brief This function updates the tree.
   * @details The tree needs to be updated when particles move, this function does that.
+  * The dynamic tree (REB_TREE_DYNAMIC) moves particles which have left their cell, 
+  * the linear tree (REB_TREE_LINEAR) is rebuilt from scratch.
   * @param r Rebound simulation to operate on
   */
 void reb_tree_update(struct reb_simulation* const r);
 
+/**
+  * @brief Sorts the particles along the Morton curve used by the linear tree.
+  * @details Massive and test particles are sorted separately. The particle
+  * indices stored in the tree are updated, so the tree stays valid. The
+  * mean distance in memory between neighbours on the curve before sorting 
+  * is stored in reorder_jump. Called every reorder_interval time steps.
+  * @param r Rebound simulation to operate on
+  */
+void reb_tree_reorder_particles(struct reb_simulation* const r);
+
 /**
   * @brief The wrap function calls reb_tree_update_gravity_data_in_cell() for each tree.
   * @param r Rebound simulation to operate on
@@ -81,12 +99,21 @@ void reb_tree_add_particle_to_tree(struct reb_simulation* const r, int pt);
  */
 void reb_tree_delete(struct reb_simulation* const r);
 
+/**
+  * @brief Returns the number of higher order moments stored per non-leaf cell.
+  * @details This is 0 for REB_TREE_MONOPOLE, 6 for REB_TREE_QUADRUPOLE, 16 for 
+  * REB_TREE_OCTUPOLE and 31 for REB_TREE_HEXADECAPOLE.
+  * @param r Rebound simulation to operate on
+  */
+int reb_tree_multipoles_per_cell(const struct reb_simulation* const r);
+
 #ifdef MPI
 /**
   * @brief MPI related function used to calculate gravity from nearby nodes
   * @param node is a pointer to a node cell.
+  * @param multipoles Higher order moments of the node, reb_tree_multipoles_per_cell() values.
   */
-void reb_tree_add_essential_node(struct reb_simulation* const r, struct reb_treecell* node);
+void reb_tree_add_essential_node(struct reb_simulation* const r, struct reb_treecell* node, const double* const multipoles);
 /**
   * @brief MPI related function used to calculate gravity from nearby nodes
   */
@@ -95,6 +122,11 @@ void reb_tree_prepare_essential_tree_for_gravity(struct reb_simulation* const r)
   * @brief MPI related function used to calculate gravity from nearby nodes
   */
 void reb_tree_prepare_essential_tree_for_collisions(struct reb_simulation* const r);
+/**
+  * @brief Deletes the local trees and adds all local particles again.
+  * @details Used after root boxes have been assigned to other nodes.
+  */
+void reb_tree_rebuild_local(struct reb_simulation* const r);
 #endif // MPI
 
 #endif // _TREE_H